@@ -128,88 +128,50 @@ public:
       return {};
     }
 
-    bool interrupt_flag = false;
     auto options = planner.get_default_options();
-    options.interrupt_flag(&interrupt_flag);
     options.ignore_schedule_ids(schedule_ids());
 
-    bool main_plan_solved = false;
+    // The first problem is the main goal, and the rest are the fallbacks
+    std::vector<rmf_traffic::agv::Planner::Problem> problems;
+    problems.push_back(
+          {plan_starts, rmf_traffic::agv::Plan::Goal(_goal_wp_index)});
+    for (const std::size_t goal_wp : _fallback_wps)
+      problems.push_back({plan_starts, rmf_traffic::agv::Plan::Goal(goal_wp)});
+
     bool main_plan_failed = false;
     bool fallback_plan_solved = false;
-    std::condition_variable plan_solved_cv;
-    rmf_utils::optional<rmf_traffic::agv::Plan> main_plan;
-    std::thread main_plan_thread = std::thread(
-          [&]()
+    const auto done_searching = [&](
+        const std::size_t i,
+        const rmf_utils::optional<rmf_traffic::agv::Plan>& plan) -> bool
     {
-      main_plan = 
-          planner.plan(
-              plan_starts, 
-              rmf_traffic::agv::Plan::Goal(_goal_wp_index), options);
-      if (main_plan)
-      {
-        main_plan_solved = true;
-        plan_solved_cv.notify_all();
-      }
-      else
+      if (i == 0)
       {
+        if (plan)
+          return true;
+
         main_plan_failed = true;
       }
-    });
-
-    std::vector<std::thread> fallback_plan_threads;
-    std::vector<rmf_utils::optional<rmf_traffic::agv::Plan>> fallback_plans;
-    std::mutex fallback_plan_mutex;
-    for (const std::size_t goal_wp : _fallback_wps)
-    {
-      fallback_plan_threads.emplace_back(std::thread([&, goal_wp]()
+      else if (plan)
       {
-        auto fallback_plan = 
-            planner.plan(
-                plan_starts, 
-                rmf_traffic::agv::Plan::Goal(goal_wp), options);
-
-        std::unique_lock<std::mutex> lock(fallback_plan_mutex);
-        if (fallback_plan)
-        {
-          fallback_plan_solved = true;
-          plan_solved_cv.notify_all();
-        }
-        fallback_plans.emplace_back(std::move(fallback_plan));
-      }));
-    }
-
-    const auto giveup_time =
-        std::chrono::steady_clock::now() + _node->get_plan_time();
+        fallback_plan_solved = true;
+      }
 
-    const auto done_searching = [&]() -> bool
-    {
-      return main_plan_solved || (main_plan_failed && fallback_plan_solved);
+      return main_plan_failed && fallback_plan_solved;
     };
 
-    // Waiting for the main planning thread is a bit complicated, because we
-    // want to avoid the possibility that the plan finishes and triggers the
-    // condition variable before we check it.
-    while (std::chrono::steady_clock::now() < giveup_time && !done_searching())
-    {
-      std::mutex placeholder;
-      std::unique_lock<std::mutex> lock(placeholder);
-      plan_solved_cv.wait_for(
-            lock, std::chrono::milliseconds(100),
-            [&](){ return done_searching(); });
-    }
-
-    interrupt_flag = true;
-    main_plan_thread.join();
-    for (auto& fallback_thread : fallback_plan_threads)
-      fallback_thread.join();
+    auto candidate_plans = planner.plan_batch(
+          problems, options,
+          rmf_traffic::agv::Planner::BatchOptions(
+            false, _node->get_plan_time(), done_searching));
 
-    if (main_plan)
+    if (candidate_plans.front())
     {
-      plans.emplace_back(std::move(*std::move(main_plan)));
+      plans.emplace_back(std::move(*candidate_plans.front()));
       return plans;
     }
 
-    return use_fallback(std::move(fallback_plans));
+    candidate_plans.erase(candidate_plans.begin());
+    return use_fallback(std::move(candidate_plans));
   }
 
   void find_and_execute_plan(const std::chrono::nanoseconds start_delay)
@@ -259,52 +221,28 @@ public:
 
     const auto& planner = _node->get_planner();
 
-    bool interrupt_flag = false;
     auto options = planner.get_default_options();
-    options.interrupt_flag(&interrupt_flag);
     options.ignore_schedule_ids(schedule_ids());
 
     const auto t_spread = std::chrono::seconds(15);
-    bool have_resume_plan = false;
-    std::vector<std::thread> resume_plan_threads;
-    std::vector<rmf_utils::optional<rmf_traffic::agv::Plan>> resume_plans;
-    std::mutex resume_plan_mutex;
-    std::condition_variable resume_plan_cv;
-
+    std::vector<rmf_traffic::agv::Planner::Problem> problems;
     for (std::size_t i=1; i < 9; ++i)
     {
-      resume_plan_threads.emplace_back(std::thread([&, i]()
-      {
-        const auto resume_time = fallback_end_time + i*t_spread;
-        auto resume_plan = planner.plan(
-              rmf_traffic::agv::Plan::Start(
-                resume_time, fallback_waypoint, fallback_orientation),
-              rmf_traffic::agv::Plan::Goal(
-                _goal_wp_index),
-              options);
-
-        std::unique_lock<std::mutex> lock(resume_plan_mutex);
-        if (resume_plan)
-          have_resume_plan = true;
-        resume_plans.emplace_back(std::move(resume_plan));
-        resume_plan_cv.notify_all();
-      }));
-    }
-
-    const auto giveup_time =
-        std::chrono::steady_clock::now() + _node->get_plan_time();
-
-    while (std::chrono::steady_clock::now() < giveup_time && !have_resume_plan)
-    {
-      std::mutex placeholder;
-      std::unique_lock<std::mutex> lock(placeholder);
-      resume_plan_cv.wait_for(lock, std::chrono::milliseconds(100),
-                              [&](){ return have_resume_plan; });
+      const auto resume_time = fallback_end_time + i*t_spread;
+      problems.push_back(
+            {{rmf_traffic::agv::Plan::Start(
+                resume_time, fallback_waypoint, fallback_orientation)},
+             rmf_traffic::agv::Plan::Goal(_goal_wp_index)});
     }
 
-    interrupt_flag = true;
-    for (auto& resume_plan_thread : resume_plan_threads)
-      resume_plan_thread.join();
+    // Stop searching as soon as any of the resume plans has been found
+    const auto resume_plans = planner.plan_batch(
+          problems, options,
+          rmf_traffic::agv::Planner::BatchOptions(
+            false, _node->get_plan_time(),
+            [](std::size_t,
+               const rmf_utils::optional<rmf_traffic::agv::Plan>& plan)
+            { return plan.has_value(); }));
 
     const auto quickest_finish_opt = get_fastest_plan_index(resume_plans);
     if (!quickest_finish_opt)
@@ -1127,47 +1065,21 @@ public:
       return {};
     }
 
-    bool interrupt_flag = false;
     auto options = planner.get_default_options();
-    options.interrupt_flag(&interrupt_flag);
     options.ignore_schedule_ids(schedule_ids());
 
-    std::vector<std::thread> plan_threads;
-    std::vector<rmf_utils::optional<rmf_traffic::agv::Plan>> candidate_plans;
-    std::mutex plans_mutex;
-    std::condition_variable plans_cv;
-    bool have_plan = false;
+    std::vector<rmf_traffic::agv::Planner::Problem> problems;
     for (const std::size_t goal_wp : _fallback_wps)
-    {
-      plan_threads.emplace_back(std::thread([&, goal_wp]()
-      {
-        auto emergency_plan = 
-            planner.plan(
-                plan_starts, 
-                rmf_traffic::agv::Plan::Goal(goal_wp), options);
-
-        std::unique_lock<std::mutex> lock(plans_mutex);
-        if (emergency_plan)
-          have_plan = true;
-
-        candidate_plans.emplace_back(std::move(emergency_plan));
-        plans_cv.notify_all();
-      }));
-    }
-
-    const auto giveup_time =
-        std::chrono::steady_clock::now() + 5*_node->get_plan_time();
-
-    while (std::chrono::steady_clock::now() < giveup_time && !have_plan)
-    {
-      std::unique_lock<std::mutex> lock(plans_mutex);
-      plans_cv.wait_for(lock, std::chrono::milliseconds(100),
-                        [&](){ return have_plan; });
-    }
-
-    interrupt_flag =  true;
-    for (auto& plan_thread : plan_threads)
-      plan_thread.join();
+      problems.push_back({plan_starts, rmf_traffic::agv::Plan::Goal(goal_wp)});
+
+    // Stop searching as soon as any of the emergency plans has been found
+    const auto candidate_plans = planner.plan_batch(
+          problems, options,
+          rmf_traffic::agv::Planner::BatchOptions(
+            false, 5*_node->get_plan_time(),
+            [](std::size_t,
+               const rmf_utils::optional<rmf_traffic::agv::Plan>& plan)
+            { return plan.has_value(); }));
 
     const auto quickest_finish_opt = get_fastest_plan_index(candidate_plans);
     if (!quickest_finish_opt)
@@ -18,8 +18,10 @@
 #ifndef RMF_TRAFFIC__CONFLICT_HPP
 #define RMF_TRAFFIC__CONFLICT_HPP
 
+#include <rmf_traffic/ThreadPool.hpp>
 #include <rmf_traffic/Trajectory.hpp>
 #include <exception>
+#include <vector>
 
 namespace rmf_traffic {
 
@@ -73,6 +75,28 @@ class DetectConflict
 {
 public:
 
+  /// Reusable state for the narrow phase of conflict detection.
+  ///
+  /// The narrow phase binds the collision geometry of each profile shape to a
+  /// motion before it can check that shape. When a Context is given to
+  /// between() or narrow_phase(), those bindings are made once for each shape
+  /// and then reused by every later check that is given the same Context, so
+  /// it is worth holding onto a Context while checking many trajectories.
+  ///
+  /// A Context keeps the collision geometry of the shapes that it has seen
+  /// alive. It may only be used by one thread at a time.
+  class Context
+  {
+  public:
+
+    /// Create an empty Context.
+    Context();
+
+    class Implementation;
+  private:
+    rmf_utils::unique_impl_ptr<Implementation> _pimpl;
+  };
+
   /// Checks if there are any conflicts between the two trajectories.
   ///
   /// First broad_phase will be run, and if there is an intersection in the
@@ -80,7 +104,8 @@ public:
   static std::vector<ConflictData> between(
       const Trajectory& trajectory_a,
       const Trajectory& trajectory_b,
-      const bool quit_after_one = false);
+      const bool quit_after_one = false,
+      Context* context = nullptr);
 
   /// Checks if there is any overlap in the map name and time of the two
   /// trajectories.
@@ -100,12 +125,100 @@ public:
   /// pair of Trajectories that would fail the broad_phase() test. Segmentation
   /// faults or false positives may occur when this function is called on
   /// Trajectories that do not pass the broad_phase test.
+  ///
+  /// If a Context is given, its collision objects will be reused.
   static std::vector<ConflictData> narrow_phase(
       const Trajectory& trajectory_a,
       const Trajectory& trajectory_b,
-      const bool quit_after_one = false);
+      const bool quit_after_one = false,
+      Context* context = nullptr);
   // TODO(MXG): Replace quit_after_one with a DetectConflict::Options class
 
+  /// How much a batch conflict check should report.
+  enum class Report
+  {
+    /// Stop after the first conflict that gets found.
+    FirstConflict,
+
+    /// Report every pair of trajectories that conflict, but only the first
+    /// conflict of each pair.
+    FirstOfEachPair,
+
+    /// Report every conflict of every pair of trajectories.
+    AllConflicts
+  };
+
+  /// Two trajectories in a set that conflict with each other.
+  struct Pair
+  {
+    /// The index of the first trajectory of the pair. This is always less than
+    /// the index of the second trajectory.
+    std::size_t first;
+
+    /// The index of the second trajectory of the pair.
+    std::size_t second;
+
+    /// The conflicts between the two trajectories. The segments of each
+    /// ConflictData are given in the order (first, second).
+    std::vector<ConflictData> conflicts;
+  };
+
+  /// A trajectory in a set that conflicts with some other trajectory.
+  struct Match
+  {
+    /// The index of the trajectory within the set.
+    std::size_t index;
+
+    /// The conflicts with the trajectory at this index. The segments of each
+    /// ConflictData are given in the order (checked trajectory, member of the
+    /// set).
+    std::vector<ConflictData> conflicts;
+  };
+
+  /// Checks every pair of trajectories in a set for conflicts.
+  ///
+  /// This is equivalent to calling between() on every pair, but it sweeps over
+  /// the bounding boxes of all the trajectory segments at once, so only the
+  /// pairs that have segments which overlap in time and space will be given
+  /// to the narrow phase.
+  ///
+  /// The ConflictData that gets returned refers to the trajectories, so they
+  /// must outlive it. Every trajectory must have at least two waypoints.
+  ///
+  /// \param[in] trajectories
+  ///   The set of trajectories to check. Trajectories on different maps never
+  ///   conflict with each other.
+  ///
+  /// \param[in] report
+  ///   How much to report. The pairs are checked in order of their indices.
+  ///
+  /// \param[in] pool
+  ///   If this is not a nullptr, the candidate pairs will be checked in
+  ///   parallel by the workers of this pool. The results will be the same as
+  ///   when no pool is used.
+  ///
+  /// \return the pairs of trajectories that conflict, sorted by their indices.
+  static std::vector<Pair> among(
+      const std::vector<const Trajectory*>& trajectories,
+      Report report = Report::FirstOfEachPair,
+      ThreadPool* pool = nullptr);
+
+  /// Checks a trajectory against every trajectory in a set.
+  ///
+  /// This is equivalent to calling between() with the trajectory and each
+  /// member of the set, but only the members of the set whose segments overlap
+  /// the segments of the trajectory will be given to the narrow phase.
+  ///
+  /// \sa among()
+  ///
+  /// \return the members of the set that conflict with the trajectory, sorted
+  /// by their indices.
+  static std::vector<Match> against(
+      const Trajectory& trajectory,
+      const std::vector<const Trajectory*>& others,
+      Report report = Report::FirstOfEachPair,
+      ThreadPool* pool = nullptr);
+
   class Implementation;
 };
 
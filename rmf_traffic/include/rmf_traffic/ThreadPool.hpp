@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef RMF_TRAFFIC__THREADPOOL_HPP
+#define RMF_TRAFFIC__THREADPOOL_HPP
+
+#include <rmf_utils/impl_ptr.hpp>
+
+#include <cstddef>
+
+namespace rmf_traffic {
+
+//==============================================================================
+/// A set of worker threads that rmf_traffic can use to spread independent
+/// collision checks across the cores of a machine.
+///
+/// Each worker keeps its own queue of jobs. Idle workers steal jobs from the
+/// queues of busy workers, and a thread that is waiting on the pool to finish
+/// a batch of jobs will help to run them.
+///
+/// Passing a ThreadPool to an rmf_traffic function never changes its results,
+/// only how quickly they are produced. A single ThreadPool may be shared by any
+/// number of threads.
+class ThreadPool
+{
+public:
+
+  /// Constructor
+  ///
+  /// \param[in] num_workers
+  ///   How many worker threads to start. If this is 0, one worker will be
+  ///   started for each hardware thread of the machine.
+  ThreadPool(std::size_t num_workers = 0);
+
+  /// Get the number of worker threads in this pool.
+  std::size_t size() const;
+
+  class Implementation;
+private:
+  rmf_utils::unique_impl_ptr<Implementation> _pimpl;
+};
+
+} // namespace rmf_traffic
+
+#endif // RMF_TRAFFIC__THREADPOOL_HPP
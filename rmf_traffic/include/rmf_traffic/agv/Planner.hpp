@@ -28,6 +28,8 @@
 
 #include <rmf_utils/optional.hpp>
 
+#include <functional>
+
 namespace rmf_traffic {
 namespace agv {
 
@@ -89,6 +91,26 @@ public:
     /// Get a const reference to the interpolation options
     const Interpolate::Options& interpolation() const;
 
+    /// Set the goal waypoints whose planning heuristics should be computed
+    /// ahead of time.
+    ///
+    /// By default, the heuristic for a goal is filled in lazily as plans are
+    /// made towards it, which can make the first few plans to each goal very
+    /// slow on large graphs. Any goals listed here will instead have a complete
+    /// heuristic table built (in parallel) when a Planner is constructed with
+    /// this configuration. The tables are shared by every copy of that Planner.
+    ///
+    /// \param[in] goals
+    ///   The indices of the waypoints that will be used as goals. Indices that
+    ///   are not in the graph will be ignored.
+    Configuration& precomputed_goals(std::vector<std::size_t> goals);
+
+    /// Get a mutable reference to the goals whose heuristics get precomputed
+    std::vector<std::size_t>& precomputed_goals();
+
+    /// Get a const reference to the goals whose heuristics get precomputed
+    const std::vector<std::size_t>& precomputed_goals() const;
+
     // TODO(MXG): Add a field to specify whether multi-start planning problems
     // should choose the plan that takes the least amount of time (according to
     // plan duration) or the plan that finishes the earliest (according to the
@@ -293,6 +315,147 @@ public:
     rmf_utils::impl_ptr<Implementation> _pimpl;
   };
 
+  using StartSet = std::vector<Start>;
+
+  /// One planning problem within a batch of problems that are solved together.
+  struct Problem
+  {
+    /// The starting conditions that the problem may use
+    StartSet starts;
+
+    /// The goal conditions of the problem
+    Goal goal;
+  };
+
+  /// The BatchOptions class contains parameters that change how a batch of
+  /// planning problems gets solved.
+  class BatchOptions
+  {
+  public:
+
+    /// A callback that gets triggered each time a problem of the batch has
+    /// finished, whether or not a plan was found for it. Return true to stop
+    /// solving the rest of the problems in the batch.
+    ///
+    /// The callback will be triggered from the planning threads, but never
+    /// from more than one thread at a time.
+    using ResultCallback = std::function<
+        bool(std::size_t problem_index, const rmf_utils::optional<Plan>& plan)>;
+
+    /// Constructor
+    ///
+    /// \param[in] cancel_dominated
+    ///   If true, each search will stop as soon as it can no longer find a plan
+    ///   that finishes sooner than a plan that was already found for another
+    ///   problem in the batch. Use this when only the plan that finishes
+    ///   soonest is wanted.
+    ///
+    /// \param[in] time_limit
+    ///   The longest amount of time to spend solving the batch. Any problems
+    ///   that have not been solved within this limit will have no plan. If
+    ///   this is a nullopt, there is no time limit.
+    ///
+    /// \param[in] on_result
+    ///   A callback that will be triggered each time a problem has finished.
+    BatchOptions(
+        bool cancel_dominated = false,
+        rmf_utils::optional<Duration> time_limit = rmf_utils::nullopt,
+        ResultCallback on_result = nullptr);
+
+    /// Set whether dominated searches should be cancelled.
+    BatchOptions& cancel_dominated(bool cancel);
+
+    /// Get whether dominated searches will be cancelled.
+    bool cancel_dominated() const;
+
+    /// Set the time limit for solving the batch.
+    BatchOptions& time_limit(rmf_utils::optional<Duration> limit);
+
+    /// Get the time limit for solving the batch.
+    rmf_utils::optional<Duration> time_limit() const;
+
+    /// Set the callback that is triggered as each problem finishes.
+    BatchOptions& on_result(ResultCallback callback);
+
+    /// Get the callback that is triggered as each problem finishes.
+    const ResultCallback& on_result() const;
+
+    class Implementation;
+  private:
+    rmf_utils::impl_ptr<Implementation> _pimpl;
+  };
+
+  /// The AnytimeOptions class contains parameters for producing a plan that
+  /// gets progressively better within a time budget.
+  ///
+  /// Anytime planning first runs a search whose heuristic is inflated by the
+  /// initial weight. This finds a feasible plan quickly, but that plan may cost
+  /// up to that many times more than the optimal plan. The search is then
+  /// repeated with a smaller weight each time, and each repetition only looks
+  /// for plans that improve on the best plan so far. Once a search with a
+  /// weight of 1 finishes, the best plan is known to be optimal.
+  class AnytimeOptions
+  {
+  public:
+
+    /// A callback that gets triggered each time a better plan is found.
+    ///
+    /// The weight that the search used is passed along with the plan. The plan
+    /// is guaranteed to be optimal if the weight is 1.
+    using ImprovementCallback =
+        std::function<void(const Plan& plan, double weight)>;
+
+    /// Constructor
+    ///
+    /// \param[in] time_budget
+    ///   The longest amount of time to spend improving the plan. The best plan
+    ///   that was found within this budget will be returned.
+    ///
+    /// \param[in] initial_weight
+    ///   The weight of the first search. Values less than 1 will be treated as
+    ///   1, which makes the first search optimal.
+    ///
+    /// \param[in] weight_step
+    ///   How much the weight is reduced by after each search. This must be
+    ///   greater than 0.
+    ///
+    /// \param[in] on_improvement
+    ///   A callback that will be triggered each time a better plan is found.
+    AnytimeOptions(
+        Duration time_budget,
+        double initial_weight = 3.0,
+        double weight_step = 0.5,
+        ImprovementCallback on_improvement = nullptr);
+
+    /// Set the time budget for improving the plan.
+    AnytimeOptions& time_budget(Duration budget);
+
+    /// Get the time budget for improving the plan.
+    Duration time_budget() const;
+
+    /// Set the weight of the first search.
+    AnytimeOptions& initial_weight(double weight);
+
+    /// Get the weight of the first search.
+    double initial_weight() const;
+
+    /// Set how much the weight is reduced by after each search.
+    AnytimeOptions& weight_step(double step);
+
+    /// Get how much the weight is reduced by after each search.
+    double weight_step() const;
+
+    /// Set the callback that is triggered each time a better plan is found.
+    AnytimeOptions& on_improvement(ImprovementCallback callback);
+
+    /// Get the callback that is triggered each time a better plan is found.
+    const ImprovementCallback& on_improvement() const;
+
+    class Implementation;
+  private:
+    rmf_utils::impl_ptr<Implementation> _pimpl;
+  };
+
   /// Constructor
   ///
   /// \param[in] config
@@ -333,8 +496,6 @@ public:
   /// Get a const reference to the default planning options.
   const Options& get_default_options() const;
 
-  using StartSet = std::vector<Start>;
-
   /// Produce a plan for the given starting conditions and goal. The default
   /// Options of this Planner instance will be used.
   ///
@@ -402,6 +563,100 @@ public:
       Goal goal,
       Options options) const;
 
+  /// Solve a batch of planning problems concurrently. The default Options of
+  /// this Planner instance will be used.
+  ///
+  /// The problems are solved on a pool of threads that is shared by every
+  /// Planner in the process, so the number of searches that run at once stays
+  /// bounded no matter how many batches are being solved. Heuristics that are
+  /// learned while solving a problem get shared with the problems that start
+  /// after it.
+  ///
+  /// \param[in] problems
+  ///   The planning problems to solve
+  ///
+  /// \param[in] batch_options
+  ///   The options for solving the batch
+  ///
+  /// \return a plan (or nullopt) for each problem, in the same order as the
+  /// problems were given.
+  std::vector<rmf_utils::optional<Plan>> plan_batch(
+      const std::vector<Problem>& problems,
+      BatchOptions batch_options = BatchOptions()) const;
+
+  /// Solve a batch of planning problems concurrently. Override the default
+  /// options.
+  ///
+  /// \param[in] problems
+  ///   The planning problems to solve
+  ///
+  /// \param[in] options
+  ///   The Options to use for every problem in the batch. This overrides the
+  ///   default Options of the Planner instance.
+  ///
+  /// \param[in] batch_options
+  ///   The options for solving the batch
+  ///
+  /// \return a plan (or nullopt) for each problem, in the same order as the
+  /// problems were given.
+  std::vector<rmf_utils::optional<Plan>> plan_batch(
+      const std::vector<Problem>& problems,
+      Options options,
+      BatchOptions batch_options = BatchOptions()) const;
+
+  /// Produce a plan that gets progressively better until it is optimal or the
+  /// time budget runs out. The default Options of this Planner instance will
+  /// be used.
+  ///
+  /// At least one start must be specified or else this is guaranteed to return
+  /// a nullopt.
+  ///
+  /// \param[in] starts
+  ///   The set of available starting conditions
+  ///
+  /// \param[in] goal
+  ///   The goal conditions
+  ///
+  /// \param[in] anytime_options
+  ///   The parameters for improving the plan
+  ///
+  /// \return the best plan that was found, or nullopt if no plan was found
+  /// within the time budget.
+  rmf_utils::optional<Plan> plan_anytime(
+      const StartSet& starts,
+      Goal goal,
+      AnytimeOptions anytime_options) const;
+
+  /// Produce a plan that gets progressively better until it is optimal or the
+  /// time budget runs out. Override the default options.
+  ///
+  /// The interrupt flag of the Options will stop the planning early, and the
+  /// best plan that was found before the interruption will be returned.
+  ///
+  /// \param[in] starts
+  ///   The set of available starting conditions
+  ///
+  /// \param[in] goal
+  ///   The goal conditions
+  ///
+  /// \param[in] options
+  ///   The Options to use for this plan. This overrides the default Options of
+  ///   the Planner instance.
+  ///
+  /// \param[in] anytime_options
+  ///   The parameters for improving the plan
+  ///
+  /// \return the best plan that was found, or nullopt if no plan was found
+  /// within the time budget.
+  rmf_utils::optional<Plan> plan_anytime(
+      const StartSet& starts,
+      Goal goal,
+      Options options,
+      AnytimeOptions anytime_options) const;
+
+  // The Debug class is for internal testing use only. Its definition is not
+  // visible to downstream users.
+  class Debug;
   class Implementation;
 private:
   rmf_utils::impl_ptr<Implementation> _pimpl;
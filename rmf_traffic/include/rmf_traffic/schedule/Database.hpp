@@ -455,6 +455,10 @@ public:
   /// this version number will remain the same.
   Version cull(Time time);
 
+private:
+  // The Journal needs to read and rebuild the full history of the Database in
+  // order to save and recover it.
+  friend class Journal;
 };
 
 } // namespace schedule
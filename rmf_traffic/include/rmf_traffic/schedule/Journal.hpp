@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef RMF_TRAFFIC__SCHEDULE__JOURNAL_HPP
+#define RMF_TRAFFIC__SCHEDULE__JOURNAL_HPP
+
+#include <rmf_traffic/schedule/Database.hpp>
+
+#include <string>
+
+namespace rmf_traffic {
+namespace schedule {
+
+//==============================================================================
+/// A class that keeps a copy of a Database on local disk so that the Database
+/// can be recovered after its process restarts.
+///
+/// The copy is made of two files inside of a directory:
+///  * snapshot - A compact binary image of the whole Database, including the
+///    history that mirrors need in order to catch up with the Database.
+///  * journal - Every change that has been made to the Database since the
+///    snapshot was written, in the order that they were made.
+///
+/// A recovered Database has the same version numbers as the original, so any
+/// mirror of the original can keep requesting patches from it.
+///
+/// The files are written in the byte order of the machine that writes them, so
+/// they should only be read on the same kind of machine. Writes are flushed to
+/// the operating system as soon as they are made, which means that a crash of
+/// the process will not lose anything, but a crash of the whole machine may.
+class Journal
+{
+public:
+
+  /// Use the given directory to keep the files of this journal. The directory
+  /// must already exist. Nothing will be read or written until one of the
+  /// other functions of this class is called.
+  ///
+  /// \param[in] directory
+  ///   The path to the directory
+  Journal(std::string directory);
+
+  /// Recover the Database that was recorded in the directory of this journal.
+  /// The snapshot is loaded first, and then every change in the journal that
+  /// came after the snapshot gets applied to it. If neither file exists, an
+  /// empty Database will be returned.
+  ///
+  /// This must be called before record() whenever the directory might hold
+  /// the files of an earlier run, so that new changes are appended after the
+  /// ones that are already there.
+  ///
+  /// A change at the very end of the journal that was only partially written
+  /// (e.g. because the process crashed while writing it) will be ignored.
+  /// Anything else that cannot be read will cause a std::runtime_error to be
+  /// thrown.
+  Database recover();
+
+  /// Append every change that has been made to the Database since the last
+  /// time it was recorded or snapshotted.
+  ///
+  /// This must be called after any change that is followed by a Database::cull
+  /// and before the cull takes place, because the changes of culled entries
+  /// can no longer be recorded. Calling it after every change is the simplest
+  /// way to ensure this.
+  void record(const Database& database);
+
+  /// Write a snapshot of the Database and start a new journal. The old
+  /// snapshot is only replaced once the new one has been completely written.
+  void snapshot(const Database& database);
+
+  /// Rename the snapshot and journal files by appending the given suffix to
+  /// their names, so that a new journal can be started in this directory
+  /// without destroying the old files. This is useful when recover() has
+  /// failed and the old files need to be kept for inspection. Files that do
+  /// not exist are skipped.
+  ///
+  /// A std::runtime_error will be thrown if a file exists but cannot be
+  /// renamed, in which case nothing should be written to this journal.
+  void move_aside(const std::string& suffix);
+
+  /// The number of changes that have been recorded since the last snapshot.
+  /// This can be used to decide when it is time for a new snapshot, since the
+  /// time that recover() takes grows with the size of the journal.
+  std::size_t changes_since_snapshot() const;
+
+  /// Get the directory that this journal uses.
+  const std::string& directory() const;
+
+  class Implementation;
+private:
+  rmf_utils::unique_impl_ptr<Implementation> _pimpl;
+};
+
+} // namespace schedule
+} // namespace rmf_traffic
+
+#endif // RMF_TRAFFIC__SCHEDULE__JOURNAL_HPP
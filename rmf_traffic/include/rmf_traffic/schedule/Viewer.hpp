@@ -22,11 +22,14 @@
 
 #include <rmf_traffic/schedule/Query.hpp>
 
+#include <rmf_traffic/ThreadPool.hpp>
 #include <rmf_traffic/Trajectory.hpp>
 
 #include <rmf_utils/impl_ptr.hpp>
 #include <rmf_utils/macros.hpp>
 
+#include <memory>
+
 namespace rmf_traffic {
 namespace schedule {
 
@@ -88,6 +91,44 @@ public:
   /// Get the latest version number of this Database.
   Version latest_version() const;
 
+  /// Statistics about what this Viewer is holding in memory. These are meant
+  /// for monitoring long-running schedules.
+  struct Statistics
+  {
+    /// The number of entries that are indexed by their version. This includes
+    /// entries that have been superseded by newer versions but have not been
+    /// culled yet.
+    std::size_t entries = 0;
+
+    /// The number of indexed entries that have been superseded by a newer
+    /// version.
+    std::size_t superseded_entries = 0;
+
+    /// The number of entries that are no longer indexed but are still being
+    /// retained as the history of an indexed entry.
+    std::size_t history_entries = 0;
+
+    /// The number of time buckets across the timelines of every map.
+    std::size_t buckets = 0;
+
+    /// The number of Trajectory segments that are being held by all of the
+    /// indexed and historical entries.
+    std::size_t segments = 0;
+  };
+
+  /// Get statistics about the contents of this Viewer. This visits every entry
+  /// that is being held, so it should not be called at a high frequency.
+  Statistics statistics() const;
+
+  /// Give this Viewer a ThreadPool to use for checking which Trajectories pass
+  /// through the regions of a Query. Copies of this Viewer will share the same
+  /// pool. By default there is no pool, and the checks are done by the thread
+  /// that makes the query.
+  void set_thread_pool(std::shared_ptr<ThreadPool> pool);
+
+  /// Get the ThreadPool that this Viewer uses, if it has one.
+  const std::shared_ptr<ThreadPool>& get_thread_pool() const;
+
 
   // The Debug class is for internal testing use only. Its definition is not
   // visible to downstream users.
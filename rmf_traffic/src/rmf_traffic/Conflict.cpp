@@ -19,13 +19,23 @@
 #include "DetectConflictInternal.hpp"
 #include "Spline.hpp"
 #include "StaticMotion.hpp"
+#include "ThreadPoolInternal.hpp"
+#include "TrajectoryInternal.hpp"
 
 #include <rmf_traffic/Conflict.hpp>
+#include <rmf_traffic/geometry/Box.hpp>
+#include <rmf_traffic/geometry/Circle.hpp>
 
 #include <fcl/continuous_collision.h>
 #include <fcl/ccd/motion.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 namespace rmf_traffic {
 
@@ -112,114 +122,554 @@ invalid_trajectory_error::invalid_trajectory_error()
 std::vector<ConflictData> DetectConflict::between(
     const Trajectory& trajectory_a,
     const Trajectory& trajectory_b,
-    const bool quit_after_one)
+    const bool quit_after_one,
+    Context* const context)
 {
   if(!broad_phase(trajectory_a, trajectory_b))
     return {};
 
-  return narrow_phase(trajectory_a, trajectory_b, quit_after_one);
+  return narrow_phase(trajectory_a, trajectory_b, quit_after_one, context);
 }
 
 //==============================================================================
 
 namespace {
 
-struct BoundingBox
+//==============================================================================
+// The number of cubic polynomials whose extrema get computed together. Each
+// spline contributes two of them (x and y). Eigen will spread the arithmetic
+// over as many SIMD registers as it needs for whichever instruction set it was
+// compiled for, or fall back to scalar arithmetic.
+const int ExtremaLanes = 8;
+using LaneArray = Eigen::Array<double, ExtremaLanes, 1>;
+
+//==============================================================================
+/// The power basis coefficients [d, c, b, a] of a block of cubic polynomials
+/// that are parameterized over [0, 1], stored as one array per coefficient.
+struct CubicLanes
 {
-  Eigen::Vector2d min;
-  Eigen::Vector2d max;
+  LaneArray d;
+  LaneArray c;
+  LaneArray b;
+  LaneArray a;
+
+  LaneArray evaluate(const LaneArray& t) const
+  {
+    return a * t * t * t + b * t * t + c * t + d;
+  }
 };
 
-double evaluate_spline(
-    const Eigen::Vector4d& coeffs,
-    const double t)
+//==============================================================================
+/// Get the lowest and highest values that each polynomial takes at its
+/// boundaries and at its stationary points. The stationary points are not
+/// clamped to [0, 1], so the range may be larger than necessary, but it is
+/// never too small.
+///
+/// Each polynomial takes one of several branches depending on its coefficients.
+/// Instead of branching, every branch is computed for every lane, and the
+/// lanes where a branch does not apply are masked out.
+void compute_extrema(
+    const CubicLanes& cubic,
+    LaneArray& lower,
+    LaneArray& upper)
 {
-  // Assume time is parameterized [0,1]
-  return (coeffs[3] * t * t * t
-      + coeffs[2] * t * t
-      + coeffs[1] * t
-      + coeffs[0]);
+  const LaneArray zero = LaneArray::Zero();
+  const LaneArray v0 = cubic.evaluate(zero);
+  const LaneArray v1 = cubic.evaluate(LaneArray::Ones());
+  lower = v0.min(v1);
+  upper = v0.max(v1);
+
+  const auto include = [&](const auto& valid, const LaneArray& t)
+  {
+    const LaneArray v = cubic.evaluate(t);
+    lower = valid.select(lower.min(v), lower);
+    upper = valid.select(upper.max(v), upper);
+  };
+
+  // When the derivative of the polynomial is not quadratic
+  const auto quadratic = cubic.a.abs() < 1e-12;
+  include(quadratic && cubic.b.abs() > 1e-12, -cubic.c / (2.0 * cubic.b));
+
+  // Calculate the discriminant otherwise
+  const LaneArray D =
+      4.0 * (cubic.b * cubic.b) - 12.0 * cubic.a * cubic.c;
+  const auto single_root = !quadratic && D.abs() < 1e-12;
+  const auto two_roots = !quadratic && !(D.abs() < 1e-12) && !(D < 0.0);
+
+  const LaneArray numerator = -2.0 * cubic.b;
+  const LaneArray denominator = 6.0 * cubic.a;
+  include(single_root, numerator / denominator);
+
+  // Lanes with a negative discriminant get a NaN here, but they are masked out
+  const LaneArray sqrt_D = two_roots.select(D, zero).sqrt();
+  include(two_roots, (numerator + sqrt_D) / denominator);
+  include(two_roots, (numerator - sqrt_D) / denominator);
 }
 
-std::array<double, 2> get_local_extrema(
-    const Eigen::Vector4d& coeffs)
+//==============================================================================
+std::shared_ptr<fcl::SplineMotion> make_uninitialized_fcl_spline_motion()
 {
-  std::vector<double> extrema_candidates;
-  // Store boundary values as potential extrema
-  extrema_candidates.emplace_back(evaluate_spline(coeffs, 0));
-  extrema_candidates.emplace_back(evaluate_spline(coeffs, 1));
+  // This function is only necessary because SplineMotion does not provide a
+  // default constructor, and we want to be able to instantiate one before
+  // we have any paramters to provide to it.
+  fcl::Matrix3f R;
+  fcl::Vec3f T;
+
+  // The constructor that we are using is a no-op (apparently it was declared,
+  // but its definition is just `// TODO`, so we don't need to worry about
+  // unintended consequences. If we update the version of FCL, this may change,
+  // so I'm going to leave a FIXME tag here to keep us aware of that.
+  return std::make_shared<fcl::SplineMotion>(R, T, R, T);
+}
 
-  // When derivate of spline motion is not quadratic
-  if (std::abs(coeffs[3]) < 1e-12)
+//==============================================================================
+fcl::ContinuousCollisionRequest make_fcl_request()
+{
+  fcl::ContinuousCollisionRequest request;
+  request.ccd_solver_type = fcl::CCDC_CONSERVATIVE_ADVANCEMENT;
+  request.gjk_solver_type = fcl::GST_LIBCCD;
+
+  return request;
+}
+
+//==============================================================================
+using BezierPoints = std::array<Eigen::Vector2d, 4>;
+
+//==============================================================================
+/// The number of times that the circle solver may halve the time range before
+/// it gives up on separating a near-contact and reports it as a collision.
+/// Halving 20 times gives a time resolution of about a millionth of the range.
+const std::size_t MaxCircleSolverDepth = 20;
+
+//==============================================================================
+double squared_distance_to_box(
+    const Eigen::Vector2d& min,
+    const Eigen::Vector2d& max,
+    const Eigen::Vector2d& half_extents)
+{
+  double squared_distance = 0.0;
+  for(int i=0; i < 2; ++i)
   {
-    if (std::abs(coeffs[2]) > 1e-12)
+    const double gap = std::max(
+          0.0, std::max(min[i] - half_extents[i], -half_extents[i] - max[i]));
+    squared_distance += gap*gap;
+  }
+
+  return squared_distance;
+}
+
+//==============================================================================
+/// Find the earliest time where a cubic Bezier curve comes within radius of an
+/// axis-aligned box centered on the origin. The curve always stays inside the
+/// convex hull of its control points, so the bounding box of the control
+/// points gives a lower bound on its distance from the box. The time range gets
+/// split in half with de Casteljau's algorithm until every part of the curve is
+/// either proven to be clear of the box or found to touch it.
+bool detect_first_contact(
+    const BezierPoints& curve,
+    const Eigen::Vector2d& half_extents,
+    const double radius,
+    double* time_of_contact)
+{
+  struct Piece
+  {
+    BezierPoints points;
+    double start;
+    std::size_t depth;
+  };
+
+  const double squared_radius = radius*radius;
+
+  // The pieces are stored in reverse time order so that the earliest contact
+  // is always found first.
+  std::vector<Piece> pieces;
+  pieces.reserve(2*MaxCircleSolverDepth + 1);
+  pieces.push_back({curve, 0.0, 0});
+
+  while(!pieces.empty())
+  {
+    const Piece piece = pieces.back();
+    pieces.pop_back();
+
+    const BezierPoints& p = piece.points;
+    const Eigen::Vector2d min =
+        p[0].cwiseMin(p[1]).cwiseMin(p[2]).cwiseMin(p[3]);
+    const Eigen::Vector2d max =
+        p[0].cwiseMax(p[1]).cwiseMax(p[2]).cwiseMax(p[3]);
+    if(squared_radius < squared_distance_to_box(min, max, half_extents))
+      continue;
+
+    if(squared_distance_to_box(p[0], p[0], half_extents) <= squared_radius
+       || piece.depth == MaxCircleSolverDepth)
     {
-      double t = -coeffs[1] / (2 * coeffs[2]);
-      extrema_candidates.emplace_back(evaluate_spline(coeffs, t));
+      if(time_of_contact)
+        *time_of_contact = piece.start;
+
+      return true;
     }
+
+    const Eigen::Vector2d p01 = 0.5*(p[0] + p[1]);
+    const Eigen::Vector2d p12 = 0.5*(p[1] + p[2]);
+    const Eigen::Vector2d p23 = 0.5*(p[2] + p[3]);
+    const Eigen::Vector2d p012 = 0.5*(p01 + p12);
+    const Eigen::Vector2d p123 = 0.5*(p12 + p23);
+    const Eigen::Vector2d mid = 0.5*(p012 + p123);
+
+    const std::size_t depth = piece.depth + 1;
+    const double half_width = std::ldexp(1.0, -static_cast<int>(depth));
+    pieces.push_back({{mid, p123, p23, p[3]}, piece.start + half_width, depth});
+    pieces.push_back({{p[0], p01, p012, mid}, piece.start, depth});
   }
-  else
+
+  return false;
+}
+
+//==============================================================================
+BezierPoints get_planar_bezier_points(
+    const Spline& spline,
+    const Time start_time,
+    const Time finish_time)
+{
+  const std::array<Eigen::Vector3d, 4> points =
+      spline.compute_bezier_points(start_time, finish_time);
+
+  BezierPoints planar_points;
+  for(std::size_t i=0; i < 4; ++i)
+    planar_points[i] = points[i].block<2,1>(0,0);
+
+  return planar_points;
+}
+
+//==============================================================================
+/// One segment of a trajectory, as seen by sweep_and_prune()
+struct SweepEntry
+{
+  double min;
+  double max;
+  std::size_t trajectory;
+  const internal::SegmentBounds* segment;
+};
+
+//==============================================================================
+using CandidatePairs = std::vector<std::pair<std::size_t, std::size_t>>;
+
+//==============================================================================
+/// Find each pair of trajectories that have segments whose bounding boxes
+/// overlap while their times also overlap. The boxes get sorted along the axis
+/// where they are most spread out, and then swept over along that axis while
+/// keeping track of the boxes that are still active.
+///
+/// \param[in] bounds
+///   The bounds of every trajectory
+///
+/// \param[in] members
+///   The indices of the trajectories to check. These should all be on the same
+///   map.
+///
+/// \param[in] required
+///   If this is a valid index, then only pairs that include it are kept.
+///
+/// \param[out] pairs
+///   The candidate pairs get added to this, with the lower index first. The
+///   same pair may be added more than once.
+void sweep_and_prune(
+    const std::vector<internal::ConstTrajectoryBoundsPtr>& bounds,
+    const std::vector<std::size_t>& members,
+    const std::size_t required,
+    CandidatePairs& pairs)
+{
+  Eigen::Vector2d lowest = Eigen::Vector2d::Constant(
+        std::numeric_limits<double>::infinity());
+  Eigen::Vector2d highest = -lowest;
+
+  std::size_t num_segments = 0;
+  for(const std::size_t i : members)
   {
-    // Calculate the discriminant otherwise
-    double D = (4 * pow(coeffs[2], 2) - 12 * coeffs[3] * coeffs[1]);
+    const internal::BoundingBox& box = bounds[i]->box;
+    const Eigen::Vector2d center = 0.5*(box.min + box.max);
+    lowest = lowest.cwiseMin(center);
+    highest = highest.cwiseMax(center);
+    num_segments += bounds[i]->segments.size();
+  }
 
+  const Eigen::Vector2d spread = highest - lowest;
+  const int axis = spread[0] >= spread[1]? 0 : 1;
+  const int other_axis = 1 - axis;
 
-    if (std::abs(D) < 1e-12)
+  std::vector<SweepEntry> entries;
+  entries.reserve(num_segments);
+  for(const std::size_t i : members)
+  {
+    for(const auto& segment : bounds[i]->segments)
     {
-      double t = (-2 * coeffs[2]) / (6 * coeffs[3]);
-      double extrema = evaluate_spline(coeffs, t);
-      extrema_candidates.emplace_back(extrema);
+      entries.push_back(
+            {segment.box.min[axis], segment.box.max[axis], i, &segment});
     }
-    else if (D < 0)
+  }
+
+  std::sort(entries.begin(), entries.end(),
+            [](const SweepEntry& a, const SweepEntry& b)
+  {
+    return a.min < b.min;
+  });
+
+  const bool has_required = required < bounds.size();
+  std::vector<const SweepEntry*> active;
+  for(const SweepEntry& entry : entries)
+  {
+    const internal::SegmentBounds& segment = *entry.segment;
+
+    std::size_t i = 0;
+    while(i < active.size())
     {
-      assert(false);
+      const SweepEntry& other = *active[i];
+      if(other.max < entry.min)
+      {
+        // The sweep has moved past this entry, so it can never overlap with
+        // anything again.
+        active[i] = active.back();
+        active.pop_back();
+        continue;
+      }
+
+      ++i;
+
+      if(other.trajectory == entry.trajectory)
+        continue;
+
+      if(has_required
+         && entry.trajectory != required && other.trajectory != required)
+        continue;
+
+      const internal::SegmentBounds& other_segment = *other.segment;
+      if(segment.finish_time < other_segment.start_time
+         || other_segment.finish_time < segment.start_time)
+        continue;
+
+      if(segment.box.max[other_axis] < other_segment.box.min[other_axis]
+         || other_segment.box.max[other_axis] < segment.box.min[other_axis])
+        continue;
+
+      pairs.emplace_back(std::minmax(entry.trajectory, other.trajectory));
     }
-    else
+
+    active.push_back(&entry);
+  }
+}
+
+//==============================================================================
+void sort_candidates(CandidatePairs& pairs)
+{
+  std::sort(pairs.begin(), pairs.end());
+  pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+}
+
+//==============================================================================
+/// Call check on the index of each candidate, spreading the calls across the
+/// workers of the pool if one is given. The conflicts that get found for each
+/// candidate are stored at its index, so the results do not depend on which
+/// thread checked which candidate.
+///
+/// If stop_at_first is true, then any candidate that comes after a candidate
+/// which is already known to conflict will be skipped, because it cannot be the
+/// first conflict.
+///
+/// Each chunk of candidates shares one Context, since a Context cannot be used
+/// by more than one thread at a time.
+std::vector<std::vector<ConflictData>> check_candidates(
+    const std::size_t num_candidates,
+    const bool stop_at_first,
+    ThreadPool* const pool,
+    const std::function<std::vector<ConflictData>(
+      std::size_t, DetectConflict::Context&)>& check)
+{
+  std::vector<std::vector<ConflictData>> results(num_candidates);
+  std::atomic<std::size_t> first_conflict(num_candidates);
+
+  ThreadPool::Implementation::for_each_range(
+        pool, num_candidates,
+        [&](const std::size_t begin, const std::size_t end)
+  {
+    DetectConflict::Context context;
+    for(std::size_t i=begin; i < end; ++i)
     {
-      double t1 = ((-2 * coeffs[2]) + std::sqrt(D)) / (6 * coeffs[3]);
-      double t2 = ((-2 * coeffs[2]) - std::sqrt(D)) / (6 * coeffs[3]);
+      if(stop_at_first && first_conflict.load() < i)
+        return;
+
+      results[i] = check(i, context);
+      if(!stop_at_first || results[i].empty())
+        continue;
 
-      extrema_candidates.emplace_back(evaluate_spline(coeffs, t1));
-      extrema_candidates.emplace_back(evaluate_spline(coeffs, t2));
+      std::size_t current = first_conflict.load();
+      while(i < current && !first_conflict.compare_exchange_weak(current, i))
+      {
+        // Keep trying until the lowest index has been stored
+      }
+
+      // Nothing after this in the chunk can be the first conflict
+      return;
     }
+  });
+
+  return results;
+}
+
+} // anonymous namespace
+
+namespace internal {
+
+//==============================================================================
+bool get_circle_radius(const geometry::FinalShape& shape, double& radius)
+{
+  const auto* circle = dynamic_cast<const geometry::Circle*>(&shape.source());
+  if(!circle)
+    return false;
+
+  radius = circle->get_radius();
+  return true;
+}
+
+//==============================================================================
+bool make_rounded_box(
+    const geometry::FinalShape& shape,
+    const Eigen::Isometry2d& pose,
+    RoundedBox& output)
+{
+  output.pose = pose;
+  if(get_circle_radius(shape, output.radius))
+  {
+    output.half_extents = Eigen::Vector2d::Zero();
+    return true;
   }
-  
-  std::array<double, 2> extrema;
-  assert(!extrema_candidates.empty());
-  extrema[0] = *std::min_element(
-      extrema_candidates.begin(),
-      extrema_candidates.end());
-  extrema[1] = *std::max_element(
-      extrema_candidates.begin(),
-      extrema_candidates.end());
-
-  return extrema;
+
+  const auto* box = dynamic_cast<const geometry::Box*>(&shape.source());
+  if(!box)
+    return false;
+
+  output.half_extents =
+      0.5*Eigen::Vector2d{box->get_x_length(), box->get_y_length()};
+  output.radius = 0.0;
+  return true;
 }
 
+//==============================================================================
+bool detect_circle_collision(
+    const rmf_traffic::Spline& spline,
+    const double radius,
+    const RoundedBox& box,
+    const Time start_time,
+    const Time finish_time,
+    double* time_of_contact)
+{
+  // Express the motion of the circle in the frame of the box
+  const Eigen::Isometry2d inverse_pose = box.pose.inverse();
+  BezierPoints curve =
+      get_planar_bezier_points(spline, start_time, finish_time);
+  for(auto& point : curve)
+    point = inverse_pose * point;
+
+  return detect_first_contact(
+        curve, box.half_extents, radius + box.radius, time_of_contact);
+}
+
+//==============================================================================
+bool detect_circle_collision(
+    const rmf_traffic::Spline& spline_a,
+    const double radius_a,
+    const rmf_traffic::Spline& spline_b,
+    const double radius_b,
+    const Time start_time,
+    const Time finish_time,
+    double* time_of_contact)
+{
+  // The circles touch when the motion of one relative to the other comes
+  // within the sum of their radii of the origin.
+  const BezierPoints curve_a =
+      get_planar_bezier_points(spline_a, start_time, finish_time);
+  const BezierPoints curve_b =
+      get_planar_bezier_points(spline_b, start_time, finish_time);
+
+  BezierPoints relative_curve;
+  for(std::size_t i=0; i < 4; ++i)
+    relative_curve[i] = curve_a[i] - curve_b[i];
+
+  return detect_first_contact(
+        relative_curve, Eigen::Vector2d::Zero(), radius_a + radius_b,
+        time_of_contact);
+}
+
+//==============================================================================
 BoundingBox get_bounding_box(const rmf_traffic::Spline& spline)
 {
-  BoundingBox bounding_box;
+  BoundingBox box;
+  get_bounding_boxes(&spline, 1, &box);
+  return box;
+}
 
-  auto params = spline.get_params();
-  std::array<double, 2> extrema_x = get_local_extrema(params.coeffs[0]);
-  std::array<double, 2> extrema_y =  get_local_extrema(params.coeffs[1]);
+//==============================================================================
+void get_bounding_boxes(
+    const rmf_traffic::Spline* const splines,
+    const std::size_t count,
+    BoundingBox* const boxes)
+{
+  constexpr std::size_t SplinesPerBlock = ExtremaLanes/2;
+  for(std::size_t first=0; first < count; first += SplinesPerBlock)
+  {
+    const std::size_t num = std::min(SplinesPerBlock, count - first);
+
+    // The x coefficients of each spline go in the even lanes and the y
+    // coefficients go in the odd lanes. Unused lanes are left as zero.
+    CubicLanes cubic;
+    cubic.d.setZero();
+    cubic.c.setZero();
+    cubic.b.setZero();
+    cubic.a.setZero();
+    for(std::size_t k=0; k < num; ++k)
+    {
+      const auto& coeffs = splines[first + k].get_params().coeffs;
+      for(std::size_t i=0; i < 2; ++i)
+      {
+        const Eigen::Index lane = static_cast<Eigen::Index>(2*k + i);
+        cubic.d[lane] = coeffs[i][0];
+        cubic.c[lane] = coeffs[i][1];
+        cubic.b[lane] = coeffs[i][2];
+        cubic.a[lane] = coeffs[i][3];
+      }
+    }
 
-  Eigen::Vector2d min_coord = Eigen::Vector2d{extrema_x[0], extrema_y[0]};
-  Eigen::Vector2d max_coord = Eigen::Vector2d{extrema_x[1], extrema_y[1]};
+    LaneArray lower;
+    LaneArray upper;
+    compute_extrema(cubic, lower, upper);
 
-  double char_length =  params.profile_ptr->get_shape()
-      ->get_characteristic_length();
+    for(std::size_t k=0; k < num; ++k)
+    {
+      const double char_length = splines[first + k].get_params().profile_ptr
+          ->get_shape()->get_characteristic_length();
+      assert(char_length >= 0.0);
+
+      const Eigen::Index lane = static_cast<Eigen::Index>(2*k);
+      const Eigen::Vector2d r{char_length, char_length};
+      BoundingBox& box = boxes[first + k];
+      box.min = Eigen::Vector2d{lower[lane], lower[lane+1]} - r;
+      box.max = Eigen::Vector2d{upper[lane], upper[lane+1]} + r;
+    }
+  }
+}
 
+//==============================================================================
+BoundingBox get_bounding_box(
+    const Eigen::Isometry2d& pose,
+    const geometry::FinalShape& shape)
+{
+  const double char_length = shape.get_characteristic_length();
   assert(char_length >= 0.0);
-  min_coord -= Eigen::Vector2d{char_length, char_length};
-  max_coord += Eigen::Vector2d{char_length, char_length};
 
-  bounding_box.min = min_coord;
-  bounding_box.max = max_coord;
-
-  return bounding_box;
+  const Eigen::Vector2d p = pose.translation();
+  const Eigen::Vector2d r{char_length, char_length};
+  return BoundingBox{p - r, p + r};
 }
 
+//==============================================================================
 bool overlap(const BoundingBox& box_a, const BoundingBox& box_b)
 {
   for (std::size_t i=0; i < 2; ++i)
@@ -235,77 +685,127 @@ bool overlap(const BoundingBox& box_a, const BoundingBox& box_b)
 }
 
 //==============================================================================
-std::shared_ptr<fcl::SplineMotion> make_uninitialized_fcl_spline_motion()
-{
-  // This function is only necessary because SplineMotion does not provide a
-  // default constructor, and we want to be able to instantiate one before
-  // we have any paramters to provide to it.
-  fcl::Matrix3f R;
-  fcl::Vec3f T;
-
-  // The constructor that we are using is a no-op (apparently it was declared,
-  // but its definition is just `// TODO`, so we don't need to worry about
-  // unintended consequences. If we update the version of FCL, this may change,
-  // so I'm going to leave a FIXME tag here to keep us aware of that.
-  return std::make_shared<fcl::SplineMotion>(R, T, R, T);
-}
-
-//==============================================================================
-std::tuple<Trajectory::const_iterator, Trajectory::const_iterator>
-get_initial_iterators(
-    const Trajectory& trajectory_a,
-    const Trajectory& trajectory_b)
+ConstTrajectoryBoundsPtr get_bounds(const Trajectory& trajectory)
 {
-  std::size_t min_size = std::min(trajectory_a.size(), trajectory_b.size());
-  if(min_size < 2)
+  if(trajectory.size() < 2)
   {
     throw invalid_trajectory_error::Implementation
-        ::make_segment_num_error(min_size);
+        ::make_segment_num_error(trajectory.size());
   }
 
-  const Time& t_a0 = *trajectory_a.start_time();
-  const Time& t_b0 = *trajectory_b.start_time();
-
-  Trajectory::const_iterator a_it;
-  Trajectory::const_iterator b_it;
-
-  if(t_a0 < t_b0)
+  const SegmentStorage& storage = get_storage(trajectory);
+  if(ConstTrajectoryBoundsPtr cached = storage.bounds_cache().get())
   {
-    // Trajectory `a` starts first, so we begin evaluating at the time
-    // that `b` begins
-    a_it = trajectory_a.find(t_b0);
-    b_it = ++trajectory_b.begin();
+    bool shapes_match = true;
+    for(std::size_t i=1; i < storage.size(); ++i)
+    {
+      if(storage.at(i).profile()->get_shape() != cached->shapes[i-1])
+      {
+        shapes_match = false;
+        break;
+      }
+    }
+
+    if(shapes_match)
+      return cached;
   }
-  else if(t_b0 < t_a0)
+
+  auto bounds = std::make_shared<TrajectoryBounds>();
+  bounds->start_time = *trajectory.start_time();
+  bounds->finish_time = *trajectory.finish_time();
+
+  std::vector<Spline> splines;
+  splines.reserve(storage.size() - 1);
+  for(std::size_t i=1; i < storage.size(); ++i)
+    splines.emplace_back(storage.at(i-1), storage.at(i));
+
+  std::vector<BoundingBox> boxes(splines.size());
+  get_bounding_boxes(splines.data(), splines.size(), boxes.data());
+
+  bounds->segments.reserve(splines.size());
+  bounds->shapes.reserve(splines.size());
+  for(std::size_t i=0; i < splines.size(); ++i)
   {
-    // Trajectory `b` starts first, so we begin evaluating at the time
-    // that `a` begins
-    a_it = ++trajectory_a.begin();
-    b_it = trajectory_b.find(t_a0);
+    bounds->shapes.push_back(splines[i].get_params().profile_ptr->get_shape());
+    bounds->segments.push_back(
+          {splines[i].start_time(), splines[i].finish_time(), boxes[i],
+           std::move(splines[i])});
   }
-  else
+
+  bounds->box = bounds->segments.front().box;
+  for(const auto& segment : bounds->segments)
   {
-    // The Trajectories begin at the exact same time, so both will begin
-    // from their start
-    a_it = ++trajectory_a.begin();
-    b_it = ++trajectory_b.begin();
+    bounds->box.min = bounds->box.min.cwiseMin(segment.box.min);
+    bounds->box.max = bounds->box.max.cwiseMax(segment.box.max);
   }
 
-  return {a_it, b_it};
+  // If another thread computed the bounds at the same time, then one of the
+  // results simply replaces the other. They are identical.
+  storage.bounds_cache().set(bounds);
+  return bounds;
 }
 
 //==============================================================================
-fcl::ContinuousCollisionRequest make_fcl_request()
+bool broad_phase(
+    const TrajectoryBounds& bounds_a,
+    const TrajectoryBounds& bounds_b)
 {
-  fcl::ContinuousCollisionRequest request;
-  request.ccd_solver_type = fcl::CCDC_CONSERVATIVE_ADVANCEMENT;
-  request.gjk_solver_type = fcl::GST_LIBCCD;
+  if(bounds_b.finish_time < bounds_a.start_time)
+    return false;
 
-  return request;
+  if(bounds_a.finish_time < bounds_b.start_time)
+    return false;
+
+  if(!overlap(bounds_a.box, bounds_b.box))
+    return false;
+
+  // Walk through the segments of both trajectories in the same order as
+  // DetectConflict::broad_phase() does
+  const auto& segments_a = bounds_a.segments;
+  const auto& segments_b = bounds_b.segments;
+  std::size_t a = 0;
+  std::size_t b = 0;
+  while(a < segments_a.size() && b < segments_b.size())
+  {
+    const SegmentBounds& segment_a = segments_a[a];
+    const SegmentBounds& segment_b = segments_b[b];
+
+    if(segment_a.finish_time < segment_b.start_time)
+    {
+      ++a;
+      continue;
+    }
+
+    if(segment_b.finish_time < segment_a.start_time)
+    {
+      ++b;
+      continue;
+    }
+
+    if(overlap(segment_a.box, segment_b.box))
+      return true;
+
+    if(segment_a.finish_time < segment_b.finish_time)
+    {
+      ++a;
+    }
+    else if(segment_b.finish_time < segment_a.finish_time)
+    {
+      ++b;
+    }
+    else
+    {
+      ++a;
+      ++b;
+    }
+  }
+
+  return false;
 }
 
-} // anonymous namespace
+} // namespace internal
 
+//==============================================================================
 bool DetectConflict::broad_phase(
     const Trajectory& trajectory_a,
     const Trajectory& trajectory_b)
@@ -350,57 +850,12 @@ bool DetectConflict::broad_phase(
     return false;
   }
 
-  // Iterate through the segments of both trajectories to check for overlapping
-  // bounding boxes
-  Trajectory::const_iterator a_it;
-  Trajectory::const_iterator b_it;
-  std::tie(a_it, b_it) = get_initial_iterators(trajectory_a, trajectory_b);
-  assert(a_it != trajectory_a.end());
-  assert(b_it != trajectory_b.end());
-
-  Spline spline_a(a_it);
-  Spline spline_b(b_it);
-
-  while(a_it != trajectory_a.end() && b_it != trajectory_b.end())
-  {
-    // Increment a_it until spline_a will overlap with spline_b
-    if(a_it->get_finish_time() < spline_b.start_time())
-    {
-      ++a_it;
-      continue;
-    }
-
-    // Increment b_it until spline_b will overlap with spline_a
-    if(b_it->get_finish_time() < spline_a.start_time())
-    {
-      ++b_it;
-      continue;
-    }
-
-    spline_a = Spline(a_it);
-    spline_b = Spline(b_it);
-
-    auto box_a = get_bounding_box(spline_a);
-    auto box_b = get_bounding_box(spline_b);
-
-    if (overlap(box_a, box_b))
-      return true;
-
-    if(spline_a.finish_time() < spline_b.finish_time())
-    {
-      ++a_it;
-    }
-    else if(spline_b.finish_time() < spline_a.finish_time())
-    {
-      ++b_it;
-    }
-    else
-    {
-      ++a_it;
-      ++b_it;
-    }
-  }
-  return false;
+  // Compare the bounding boxes of the segments of both trajectories. These
+  // get cached in the trajectories, so checking the same trajectories again
+  // will be cheap.
+  return internal::broad_phase(
+        *internal::get_bounds(trajectory_a),
+        *internal::get_bounds(trajectory_b));
 }
 
 class DetectConflict::Implementation
@@ -416,79 +871,209 @@ public:
   }
 };
 
+//==============================================================================
+class DetectConflict::Context::Implementation
+{
+public:
+
+  Implementation()
+    : _request(make_fcl_request()),
+      _static_motion(std::make_shared<internal::StaticMotion>())
+  {
+    for(auto& motion : _spline_motions)
+      motion = make_uninitialized_fcl_spline_motion();
+  }
+
+  /// Get the state of a Context that was given by a user. If the user did not
+  /// give one, then a temporary one will be created in local the first time
+  /// this is called.
+  static Implementation& get(
+      Context* context,
+      std::unique_ptr<Implementation>& local)
+  {
+    if(context)
+      return *context->_pimpl;
+
+    if(!local)
+      local = std::make_unique<Implementation>();
+
+    return *local;
+  }
+
+  const fcl::ContinuousCollisionRequest& request() const
+  {
+    return _request;
+  }
+
+  /// Move one of the spline motion slots onto a new motion, and get an object
+  /// that binds the geometry to that slot. There is one slot for each of the
+  /// two trajectories in a narrow phase check.
+  const fcl::ContinuousCollisionObject& spline_object(
+      const std::size_t slot,
+      const geometry::CollisionGeometryPtr& geometry,
+      const fcl::SplineMotion& motion)
+  {
+    *_spline_motions[slot] = motion;
+    return _get_object(_spline_objects[slot], _spline_motions[slot], geometry);
+  }
+
+  /// Move the static motion slot to a new pose. This is used for regions.
+  void set_static_pose(const Eigen::Isometry2d& pose)
+  {
+    *_static_motion = internal::StaticMotion(pose);
+  }
+
+  /// Get an object that binds the geometry to the static motion slot.
+  const fcl::ContinuousCollisionObject& static_object(
+      const geometry::CollisionGeometryPtr& geometry)
+  {
+    return _get_object(_static_objects, _static_motion, geometry);
+  }
+
+private:
+
+  // A Context is usually only used with a handful of shapes, but if it sees
+  // many more than that, it starts over so its memory stays bounded.
+  static constexpr std::size_t MaxObjectsPerSlot = 64;
+
+  using ObjectMap = std::unordered_map<
+      const fcl::CollisionGeometry*, fcl::ContinuousCollisionObject>;
+
+  template<typename MotionPtr>
+  static const fcl::ContinuousCollisionObject& _get_object(
+      ObjectMap& objects,
+      const MotionPtr& motion,
+      const geometry::CollisionGeometryPtr& geometry)
+  {
+    const auto it = objects.find(geometry.get());
+    if(it != objects.end())
+      return it->second;
+
+    if(objects.size() >= MaxObjectsPerSlot)
+      objects.clear();
+
+    return objects.emplace(
+          geometry.get(),
+          fcl::ContinuousCollisionObject(geometry, motion)).first->second;
+  }
+
+  fcl::ContinuousCollisionRequest _request;
+  std::array<std::shared_ptr<fcl::SplineMotion>, 2> _spline_motions;
+  std::array<ObjectMap, 2> _spline_objects;
+  std::shared_ptr<internal::StaticMotion> _static_motion;
+  ObjectMap _static_objects;
+};
+
+//==============================================================================
+constexpr std::size_t DetectConflict::Context::Implementation::MaxObjectsPerSlot;
+
+//==============================================================================
+DetectConflict::Context::Context()
+  : _pimpl(rmf_utils::make_unique_impl<Implementation>())
+{
+  // Do nothing
+}
+
 //==============================================================================
 std::vector<ConflictData> DetectConflict::narrow_phase(
     const Trajectory& trajectory_a,
     const Trajectory& trajectory_b,
-    const bool quit_after_one)
-{
-  Trajectory::const_iterator a_it;
-  Trajectory::const_iterator b_it;
-  std::tie(a_it, b_it) = get_initial_iterators(trajectory_a, trajectory_b);
-
-  // Verify that neither trajectory has run into a bug. These conditions should
-  // be guaranteed by
-  // 1. The assumption that the trajectories overlap (this is an assumption that
-  //    is made explicit to the user)
-  // 2. The min_size check up above
-  assert(a_it != trajectory_a.end());
-  assert(b_it != trajectory_b.end());
-
-  // Initialize the objects that will be used inside the loop
-  Spline spline_a(a_it);
-  Spline spline_b(b_it);
-  std::shared_ptr<fcl::SplineMotion> motion_a =
-      make_uninitialized_fcl_spline_motion();
-  std::shared_ptr<fcl::SplineMotion> motion_b =
-      make_uninitialized_fcl_spline_motion();
-
-  const fcl::ContinuousCollisionRequest request = make_fcl_request();
+    const bool quit_after_one,
+    Context* const context)
+{
+  // These will throw an invalid_trajectory_error if either trajectory has
+  // fewer than two waypoints.
+  const internal::ConstTrajectoryBoundsPtr bounds_a =
+      internal::get_bounds(trajectory_a);
+  const internal::ConstTrajectoryBoundsPtr bounds_b =
+      internal::get_bounds(trajectory_b);
+
+  const auto& segments_a = bounds_a->segments;
+  const auto& segments_b = bounds_b->segments;
+
+  // The iterators are kept in step with the segment indices so that we can
+  // report which segments are in conflict.
+  Trajectory::const_iterator a_it = ++trajectory_a.begin();
+  Trajectory::const_iterator b_it = ++trajectory_b.begin();
+  std::size_t a = 0;
+  std::size_t b = 0;
+
+  // The FCL objects are only created if some pair of segments needs them
+  std::unique_ptr<Context::Implementation> local_context;
+
   fcl::ContinuousCollisionResult result;
   std::vector<ConflictData> conflicts;
 
-  while(a_it != trajectory_a.end() && b_it != trajectory_b.end())
+  while(a < segments_a.size() && b < segments_b.size())
   {
-    // Increment a_it until spline_a will overlap with spline_b
-    if(a_it->get_finish_time() < spline_b.start_time())
+    const internal::SegmentBounds& segment_a = segments_a[a];
+    const internal::SegmentBounds& segment_b = segments_b[b];
+
+    // Increment a until segment_a will overlap with segment_b
+    if(segment_a.finish_time < segment_b.start_time)
     {
+      ++a;
       ++a_it;
       continue;
     }
 
-    // Increment b_it until spline_b will overlap with spline_a
-    if(b_it->get_finish_time() < spline_a.start_time())
+    // Increment b until segment_b will overlap with segment_a
+    if(segment_b.finish_time < segment_a.start_time)
     {
+      ++b;
       ++b_it;
       continue;
     }
 
-    const Trajectory::ConstProfilePtr profile_a = a_it->get_profile();
-    const Trajectory::ConstProfilePtr profile_b = b_it->get_profile();
-
-    // TODO(MXG): Consider using optional<Spline> so that we can easily keep
-    // track of which needs to be updated. There's some wasted computational
-    // cycles here whenever we are using the same spline as a previous iteration
-    spline_a = Spline(a_it);
-    spline_b = Spline(b_it);
+    const Spline& spline_a = segment_a.spline;
+    const Spline& spline_b = segment_b.spline;
 
     const Time start_time =
         std::max(spline_a.start_time(), spline_b.start_time());
     const Time finish_time =
         std::min(spline_a.finish_time(), spline_b.finish_time());
 
-    *motion_a = spline_a.to_fcl(start_time, finish_time);
-    *motion_b = spline_b.to_fcl(start_time, finish_time);
+    const Trajectory::ConstProfilePtr& profile_a =
+        spline_a.get_params().profile_ptr;
+    const Trajectory::ConstProfilePtr& profile_b =
+        spline_b.get_params().profile_ptr;
 
     assert(profile_a->get_shape());
     assert(profile_b->get_shape());
-    const auto obj_a = fcl::ContinuousCollisionObject(
-          geometry::FinalConvexShape::Implementation::get_collision(
-            *profile_a->get_shape()), motion_a);
-    const auto obj_b = fcl::ContinuousCollisionObject(
-          geometry::FinalConvexShape::Implementation::get_collision(
-            *profile_b->get_shape()), motion_b);
-
-    fcl::collide(&obj_a, &obj_b, request, result);
+
+    result.is_collide = false;
+    double radius_a;
+    double radius_b;
+    if(!internal::overlap(segment_a.box, segment_b.box))
+    {
+      // The segments cannot collide if their bounding boxes do not overlap
+    }
+    else if(internal::get_circle_radius(*profile_a->get_shape(), radius_a)
+            && internal::get_circle_radius(*profile_b->get_shape(), radius_b))
+    {
+      // Circles can be checked analytically, so we only need FCL for the
+      // other footprint shapes.
+      result.is_collide = internal::detect_circle_collision(
+            spline_a, radius_a, spline_b, radius_b, start_time, finish_time,
+            &result.time_of_contact);
+    }
+    else
+    {
+      Context::Implementation& fcl_context =
+          Context::Implementation::get(context, local_context);
+
+      const auto& obj_a = fcl_context.spline_object(
+            0, geometry::FinalConvexShape::Implementation::get_collision(
+              *profile_a->get_shape()),
+            spline_a.to_fcl(start_time, finish_time));
+      const auto& obj_b = fcl_context.spline_object(
+            1, geometry::FinalConvexShape::Implementation::get_collision(
+              *profile_b->get_shape()),
+            spline_b.to_fcl(start_time, finish_time));
+
+      fcl::collide(&obj_a, &obj_b, fcl_context.request(), result);
+    }
+
     if(result.is_collide)
     {
       const double scaled_time = result.time_of_contact;
@@ -502,15 +1087,19 @@ std::vector<ConflictData> DetectConflict::narrow_phase(
 
     if(spline_a.finish_time() < spline_b.finish_time())
     {
+      ++a;
       ++a_it;
     }
     else if(spline_b.finish_time() < spline_a.finish_time())
     {
+      ++b;
       ++b_it;
     }
     else
     {
+      ++a;
       ++a_it;
+      ++b;
       ++b_it;
     }
   }
@@ -518,12 +1107,128 @@ std::vector<ConflictData> DetectConflict::narrow_phase(
   return conflicts;
 }
 
+//==============================================================================
+auto DetectConflict::among(
+    const std::vector<const Trajectory*>& trajectories,
+    const Report report,
+    ThreadPool* const pool) -> std::vector<Pair>
+{
+  std::vector<internal::ConstTrajectoryBoundsPtr> bounds;
+  bounds.reserve(trajectories.size());
+
+  std::unordered_map<std::string, std::vector<std::size_t>> maps;
+  for(std::size_t i=0; i < trajectories.size(); ++i)
+  {
+    bounds.push_back(internal::get_bounds(*trajectories[i]));
+    maps[trajectories[i]->get_map_name()].push_back(i);
+  }
+
+  CandidatePairs candidates;
+  for(const auto& map : maps)
+    sweep_and_prune(bounds, map.second, bounds.size(), candidates);
+
+  sort_candidates(candidates);
+
+  std::vector<std::vector<ConflictData>> results = check_candidates(
+        candidates.size(), report == Report::FirstConflict, pool,
+        [&](const std::size_t i, Context& context)
+  {
+    return narrow_phase(
+          *trajectories[candidates[i].first],
+          *trajectories[candidates[i].second],
+          report != Report::AllConflicts, &context);
+  });
+
+  std::vector<Pair> pairs;
+  for(std::size_t i=0; i < candidates.size(); ++i)
+  {
+    if(results[i].empty())
+      continue;
+
+    const auto& candidate = candidates[i];
+    pairs.push_back({candidate.first, candidate.second, std::move(results[i])});
+    if(report == Report::FirstConflict)
+      break;
+  }
+
+  return pairs;
+}
+
+//==============================================================================
+auto DetectConflict::against(
+    const Trajectory& trajectory,
+    const std::vector<const Trajectory*>& others,
+    const Report report,
+    ThreadPool* const pool) -> std::vector<Match>
+{
+  const internal::ConstTrajectoryBoundsPtr trajectory_bounds =
+      internal::get_bounds(trajectory);
+
+  // The trajectory that is being checked goes at the end of the bounds, after
+  // the members of the set.
+  std::vector<internal::ConstTrajectoryBoundsPtr> bounds;
+  bounds.reserve(others.size() + 1);
+  std::vector<std::size_t> members;
+  for(std::size_t i=0; i < others.size(); ++i)
+  {
+    bounds.push_back(internal::get_bounds(*others[i]));
+    const internal::TrajectoryBounds& other_bounds = *bounds.back();
+
+    if(others[i]->get_map_name() != trajectory.get_map_name())
+      continue;
+
+    if(other_bounds.finish_time < trajectory_bounds->start_time
+       || trajectory_bounds->finish_time < other_bounds.start_time)
+      continue;
+
+    if(!internal::overlap(other_bounds.box, trajectory_bounds->box))
+      continue;
+
+    members.push_back(i);
+  }
+
+  std::vector<Match> matches;
+  if(members.empty())
+    return matches;
+
+  const std::size_t required = bounds.size();
+  bounds.push_back(trajectory_bounds);
+  members.push_back(required);
+
+  CandidatePairs candidates;
+  sweep_and_prune(bounds, members, required, candidates);
+  sort_candidates(candidates);
+
+  // The required index is the highest, so it is always the second of a pair
+  std::vector<std::vector<ConflictData>> results = check_candidates(
+        candidates.size(), report == Report::FirstConflict, pool,
+        [&](const std::size_t i, Context& context)
+  {
+    return narrow_phase(
+          trajectory, *others[candidates[i].first],
+          report != Report::AllConflicts, &context);
+  });
+
+  for(std::size_t i=0; i < candidates.size(); ++i)
+  {
+    if(results[i].empty())
+      continue;
+
+    matches.push_back({candidates[i].first, std::move(results[i])});
+    if(report == Report::FirstConflict)
+      break;
+  }
+
+  return matches;
+}
+
 namespace internal {
 //==============================================================================
 bool detect_conflicts(
     const Trajectory& trajectory,
     const Spacetime& region,
-    std::vector<Trajectory::const_iterator>* output_iterators)
+    std::vector<Trajectory::const_iterator>* output_iterators,
+    DetectConflict::Context* const context)
 {
 #ifndef NDEBUG
   // This should never actually happen because this function only gets used
@@ -559,6 +1264,14 @@ bool detect_conflicts(
     return false;
   }
 
+  const ConstTrajectoryBoundsPtr bounds = get_bounds(trajectory);
+
+  assert(region.shape);
+  const BoundingBox region_bounding_box =
+      get_bounding_box(region.pose, *region.shape);
+  if(!overlap(bounds->box, region_bounding_box))
+    return false;
+
   const Trajectory::const_iterator begin_it =
       trajectory_start_time < start_time?
         trajectory.find(start_time) : ++trajectory.begin();
@@ -567,44 +1280,82 @@ bool detect_conflicts(
       finish_time < trajectory_finish_time?
         ++trajectory.find(finish_time) : trajectory.end();
 
-  std::shared_ptr<fcl::SplineMotion> motion_trajectory =
-      make_uninitialized_fcl_spline_motion();
-  std::shared_ptr<internal::StaticMotion> motion_region =
-      std::make_shared<internal::StaticMotion>(region.pose);
+  // This is the index of the segment bounds that belong to begin_it
+  const auto& segments = bounds->segments;
+  std::size_t index = static_cast<std::size_t>(std::partition_point(
+        segments.begin(), segments.end(),
+        [&](const SegmentBounds& segment)
+  {
+    return segment.finish_time < start_time;
+  }) - segments.begin());
+
+  // The FCL objects are only created if some segment needs them
+  using ContextImpl = DetectConflict::Context::Implementation;
+  std::unique_ptr<ContextImpl> local_context;
+  ContextImpl* fcl_context = nullptr;
 
-  const fcl::ContinuousCollisionRequest request = make_fcl_request();
+  // Circle and Box regions can be checked analytically against circles
+  RoundedBox region_box;
+  const bool region_is_rounded_box =
+      make_rounded_box(*region.shape, region.pose, region_box);
 
   bool collision_detected = false;
 
-  for(auto it = begin_it; it != end_it; ++it)
+  for(auto it = begin_it; it != end_it; ++it, ++index)
   {
-    const Trajectory::ConstProfilePtr profile = it->get_profile();
+    assert(index < segments.size());
+    const SegmentBounds& segment = segments[index];
+    if(!overlap(segment.box, region_bounding_box))
+      continue;
 
-    Spline spline_trajectory{it};
+    const Spline& spline_trajectory = segment.spline;
+    const Trajectory::ConstProfilePtr& profile =
+        spline_trajectory.get_params().profile_ptr;
 
     const Time spline_start_time =
         std::max(spline_trajectory.start_time(), start_time);
     const Time spline_finish_time =
         std::min(spline_trajectory.finish_time(), finish_time);
 
-    *motion_trajectory = spline_trajectory.to_fcl(
-          spline_start_time, spline_finish_time);
-
     assert(profile->get_shape());
-    const auto obj_trajectory = fcl::ContinuousCollisionObject(
-          geometry::FinalConvexShape::Implementation::get_collision(
-            *profile->get_shape()), motion_trajectory);
+    double radius;
+    if(region_is_rounded_box
+       && get_circle_radius(*profile->get_shape(), radius))
+    {
+      if(detect_circle_collision(
+           spline_trajectory, radius, region_box,
+           spline_start_time, spline_finish_time, nullptr))
+      {
+        if(!output_iterators)
+          return true;
+
+        output_iterators->push_back(it);
+        collision_detected = true;
+      }
+
+      continue;
+    }
+
+    if(!fcl_context)
+    {
+      fcl_context = &ContextImpl::get(context, local_context);
+      fcl_context->set_static_pose(region.pose);
+    }
+
+    const auto& obj_trajectory = fcl_context->spline_object(
+          0, geometry::FinalConvexShape::Implementation::get_collision(
+            *profile->get_shape()),
+          spline_trajectory.to_fcl(spline_start_time, spline_finish_time));
 
-    assert(region.shape);
     const auto& region_shapes = geometry::FinalShape::Implementation
         ::get_collisions(*region.shape);
     for(const auto& region_shape : region_shapes)
     {
-      const auto obj_region = fcl::ContinuousCollisionObject(
-            region_shape, motion_region);
+      const auto& obj_region = fcl_context->static_object(region_shape);
 
       fcl::ContinuousCollisionResult result;
-      fcl::collide(&obj_trajectory, &obj_region, request, result);
+      fcl::collide(
+            &obj_trajectory, &obj_region, fcl_context->request(), result);
       if(result.is_collide)
       {
         if(output_iterators)
@@ -19,10 +19,13 @@
 #define SRC__RMF_UTILS__DETECTCONFLICTINTERNAL_HPP
 
 #include "geometry/ShapeInternal.hpp"
+#include "Spline.hpp"
 
+#include <rmf_traffic/Conflict.hpp>
 #include <rmf_traffic/Trajectory.hpp>
 
 #include <unordered_map>
+#include <vector>
 
 namespace rmf_traffic {
 namespace internal {
@@ -38,11 +41,155 @@ struct Spacetime
 };
 
 //==============================================================================
+/// Check whether a trajectory passes through a spacetime region. If a Context
+/// is given, its collision objects will be reused.
 bool detect_conflicts(
     const Trajectory& trajectory,
     const Spacetime& region,
-    std::vector<Trajectory::const_iterator>* output_iterators);
+    std::vector<Trajectory::const_iterator>* output_iterators,
+    DetectConflict::Context* context = nullptr);
 
+//==============================================================================
+/// Get the radius of a shape if it is a Circle.
+///
+/// \return true if the shape is a Circle, otherwise false.
+bool get_circle_radius(const geometry::FinalShape& shape, double& radius);
+
+//==============================================================================
+/// A box that is aligned with the frame of its pose and then inflated by a
+/// radius. A static Circle is a RoundedBox with no half extents.
+struct RoundedBox
+{
+  Eigen::Isometry2d pose;
+  Eigen::Vector2d half_extents;
+  double radius;
+};
+
+//==============================================================================
+/// Make a RoundedBox out of a shape that sits at the given pose.
+///
+/// \return true if the shape is a Circle or a Box, otherwise false.
+bool make_rounded_box(
+    const geometry::FinalShape& shape,
+    const Eigen::Isometry2d& pose,
+    RoundedBox& output);
+
+//==============================================================================
+/// Find the first contact between a circle that follows a spline and a static
+/// RoundedBox. This gives the same conservative answer as FCL conservative
+/// advancement without building any FCL objects.
+///
+/// \param[out] time_of_contact
+///   If a contact is found, this will be set to the time of the contact,
+///   scaled to the range [0, 1] of [start_time, finish_time].
+///
+/// \return true if there is a contact.
+bool detect_circle_collision(
+    const rmf_traffic::Spline& spline,
+    double radius,
+    const RoundedBox& box,
+    Time start_time,
+    Time finish_time,
+    double* time_of_contact);
+
+//==============================================================================
+/// Find the first contact between two circles that each follow a spline.
+/// \sa detect_circle_collision()
+bool detect_circle_collision(
+    const rmf_traffic::Spline& spline_a,
+    double radius_a,
+    const rmf_traffic::Spline& spline_b,
+    double radius_b,
+    Time start_time,
+    Time finish_time,
+    double* time_of_contact);
+
+//==============================================================================
+struct BoundingBox
+{
+  Eigen::Vector2d min;
+  Eigen::Vector2d max;
+};
+
+//==============================================================================
+/// Get an axis-aligned box that contains everything that the spline's profile
+/// shape sweeps through while following the spline.
+BoundingBox get_bounding_box(const rmf_traffic::Spline& spline);
+
+//==============================================================================
+/// Get the bounding boxes of many splines at once. Each box is identical to
+/// what get_bounding_box() gives for the same spline, but the coefficients of
+/// the splines are gathered into blocks so that their extrema can be computed
+/// with vectorized arithmetic and without any allocations.
+///
+/// \param[in] splines
+///   An array of splines
+///
+/// \param[in] count
+///   The number of splines in the array
+///
+/// \param[out] boxes
+///   An array with room for count boxes
+void get_bounding_boxes(
+    const rmf_traffic::Spline* splines,
+    std::size_t count,
+    BoundingBox* boxes);
+
+//==============================================================================
+/// Get an axis-aligned box that contains a shape placed at the given pose.
+BoundingBox get_bounding_box(
+    const Eigen::Isometry2d& pose,
+    const geometry::FinalShape& shape);
+
+//==============================================================================
+bool overlap(const BoundingBox& box_a, const BoundingBox& box_b);
+
+//==============================================================================
+/// The time range, spline, and bounding box of one segment of a Trajectory.
+struct SegmentBounds
+{
+  Time start_time;
+  Time finish_time;
+  BoundingBox box;
+  rmf_traffic::Spline spline;
+};
+
+//==============================================================================
+/// The bounds of every segment of a Trajectory, along with the bounds of the
+/// whole Trajectory. segments[i] belongs to the spline that finishes at the
+/// waypoint with index i+1.
+struct TrajectoryBounds
+{
+  Time start_time;
+  Time finish_time;
+  BoundingBox box;
+  std::vector<SegmentBounds> segments;
+
+  /// The shapes that the boxes of the segments were inflated by, in the same
+  /// order as the segments. A profile can be given a new shape without
+  /// modifying any Trajectory that uses it, so these are compared against the
+  /// current shapes before cached bounds get reused.
+  std::vector<geometry::ConstFinalConvexShapePtr> shapes;
+};
+
+using ConstTrajectoryBoundsPtr = std::shared_ptr<const TrajectoryBounds>;
+
+//==============================================================================
+/// Get the bounds of a Trajectory. The Trajectory must have at least two
+/// waypoints.
+///
+/// The bounds are only computed the first time they are needed. After that
+/// they are cached in the Trajectory and shared with its copies until the
+/// Trajectory gets modified or one of its profiles is given a new shape.
+ConstTrajectoryBoundsPtr get_bounds(const Trajectory& trajectory);
+
+//==============================================================================
+/// Equivalent to DetectConflict::broad_phase(), except it uses bounds that
+/// were computed ahead of time. It is assumed that both trajectories are on the
+/// same map.
+bool broad_phase(
+    const TrajectoryBounds& bounds_a,
+    const TrajectoryBounds& bounds_b);
 
 } // namespace internal
 } // namespace rmf_traffic
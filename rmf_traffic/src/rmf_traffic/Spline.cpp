@@ -93,26 +93,21 @@ Spline::Parameters compute_parameters(
 
 //==============================================================================
 Spline::Parameters compute_parameters(
-    const internal::SegmentList::const_iterator& finish_it)
+    const internal::SegmentView& start,
+    const internal::SegmentView& finish)
 {
-  const internal::SegmentList::const_iterator start_it =
-      --internal::SegmentList::const_iterator(finish_it);
-
-  const internal::SegmentElement::Data& start = start_it->data;
-  const internal::SegmentElement::Data& finish = finish_it->data;
-
-  const Time start_time = start.finish_time;
-  const Time finish_time = finish.finish_time;
+  const Time start_time = start.finish_time();
+  const Time finish_time = finish.finish_time();
 
   const double delta_t = compute_delta_t(finish_time, start_time);
 
-  const Eigen::Vector3d x0 = start.position;
-  const Eigen::Vector3d x1 = finish.position;
-  const Eigen::Vector3d v0 = delta_t * start.velocity;
-  const Eigen::Vector3d v1 = delta_t * finish.velocity;
+  const Eigen::Vector3d x0 = start.position();
+  const Eigen::Vector3d x1 = finish.position();
+  const Eigen::Vector3d v0 = delta_t * start.velocity();
+  const Eigen::Vector3d v1 = delta_t * finish.velocity();
 
   const rmf_traffic::Trajectory::ConstProfilePtr profile_ptr =
-      finish_it->data.profile;
+      finish.profile();
 
   return {
     profile_ptr,
@@ -199,14 +194,16 @@ Spline::Spline(const Trajectory::const_iterator& it)
 }
 
 //==============================================================================
-Spline::Spline(const internal::SegmentList::const_iterator& it)
-  : params(compute_parameters(it))
+Spline::Spline(
+    const internal::SegmentView& start,
+    const internal::SegmentView& finish)
+  : params(compute_parameters(start, finish))
 {
   // Do nothing
 }
 
 //==============================================================================
-std::array<Eigen::Vector3d, 4> Spline::compute_knots(
+std::array<Eigen::Vector4d, 3> Spline::compute_subspline_coefficients(
     const Time start_time, const Time finish_time) const
 {
   assert(params.time_range[0] <= start_time);
@@ -227,8 +224,15 @@ std::array<Eigen::Vector3d, 4> Spline::compute_knots(
   const Eigen::Vector3d v1 =
     scaled_delta_t * rmf_traffic::compute_velocity(params, scaled_finish_time);
 
+  return compute_coefficients(x0, x1, v0, v1);
+}
+
+//==============================================================================
+std::array<Eigen::Vector3d, 4> Spline::compute_knots(
+    const Time start_time, const Time finish_time) const
+{
   const std::array<Eigen::Vector4d, 3> subspline_coeffs =
-      compute_coefficients(x0, x1, v0, v1);
+      compute_subspline_coefficients(start_time, finish_time);
 
   std::array<Eigen::Vector3d, 4> result;
   for(std::size_t i=0; i < 3; ++i)
@@ -241,6 +245,28 @@ std::array<Eigen::Vector3d, 4> Spline::compute_knots(
   return result;
 }
 
+//==============================================================================
+std::array<Eigen::Vector3d, 4> Spline::compute_bezier_points(
+    const Time start_time, const Time finish_time) const
+{
+  const std::array<Eigen::Vector4d, 3> subspline_coeffs =
+      compute_subspline_coefficients(start_time, finish_time);
+
+  std::array<Eigen::Vector3d, 4> result;
+  for(std::size_t i=0; i < 3; ++i)
+  {
+    // Convert the power basis coefficients [d, c, b, a] into the Bernstein
+    // basis of a cubic Bezier curve
+    const Eigen::Vector4d& p = subspline_coeffs[i];
+    result[0][i] = p[0];
+    result[1][i] = p[0] + p[1]/3.0;
+    result[2][i] = p[0] + 2.0*p[1]/3.0 + p[2]/3.0;
+    result[3][i] = p[0] + p[1] + p[2] + p[3];
+  }
+
+  return result;
+}
+
 //==============================================================================
 fcl::SplineMotion Spline::to_fcl(
     const Time start_time, const Time finish_time) const
@@ -41,15 +41,23 @@ public:
   /// `it`.
   Spline(const Trajectory::const_iterator& it);
 
-  /// Create a spline that goes from the end of the preceding to the Segment of
-  /// `it`.
-  Spline(const internal::SegmentList::const_iterator& it);
+  /// Create a spline that goes from the end of the start segment to the end of
+  /// the finish segment.
+  Spline(
+      const internal::SegmentView& start,
+      const internal::SegmentView& finish);
 
   /// Compute the knots for the motion of this spline from start_time to
   /// finish_time, scaled to a "time" range of [0, 1].
   std::array<Eigen::Vector3d, 4> compute_knots(
       const Time start_time, const Time finish_time) const;
 
+  /// Compute the control points of the cubic Bezier curve that follows this
+  /// spline from start_time to finish_time, scaled to a "time" range of [0, 1].
+  /// The curve stays inside the convex hull of these points.
+  std::array<Eigen::Vector3d, 4> compute_bezier_points(
+      const Time start_time, const Time finish_time) const;
+
   fcl::SplineMotion to_fcl(const Time start_time, const Time finish_time) const;
 
   Time start_time() const;
@@ -77,6 +85,9 @@ public:
 
 private:
 
+  std::array<Eigen::Vector4d, 3> compute_subspline_coefficients(
+      const Time start_time, const Time finish_time) const;
+
   Parameters params;
 
 };
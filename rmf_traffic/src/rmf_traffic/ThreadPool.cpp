@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "ThreadPoolInternal.hpp"
+
+#include <algorithm>
+#include <exception>
+
+namespace rmf_traffic {
+
+namespace {
+
+//==============================================================================
+// Each worker gets this many chunks of a for_each_range() range, so that the
+// workers that finish early have something left to steal.
+const std::size_t ChunksPerWorker = 4;
+
+//==============================================================================
+/// The progress of one call to ThreadPool::Implementation::for_each_range()
+struct Batch
+{
+  std::mutex mutex;
+  std::condition_variable finished_cv;
+  std::size_t remaining;
+  std::exception_ptr error;
+};
+
+} // anonymous namespace
+
+//==============================================================================
+void ThreadPool::Implementation::for_each(
+    ThreadPool* const pool,
+    const std::size_t count,
+    const std::function<void(std::size_t)>& job)
+{
+  for_each_range(
+        pool, count, [&job](const std::size_t begin, const std::size_t end)
+  {
+    for(std::size_t i=begin; i < end; ++i)
+      job(i);
+  });
+}
+
+//==============================================================================
+void ThreadPool::Implementation::for_each_range(
+    ThreadPool* const pool,
+    const std::size_t count,
+    const std::function<void(std::size_t, std::size_t)>& job)
+{
+  if(count == 0)
+    return;
+
+  if(!pool || count < 2)
+  {
+    job(0, count);
+    return;
+  }
+
+  Implementation& impl = *pool->_pimpl;
+  const std::size_t num_workers = impl.size();
+  const std::size_t num_chunks =
+      std::min(count, ChunksPerWorker*(num_workers + 1));
+
+  Batch batch;
+  batch.remaining = num_chunks;
+
+  const std::size_t first_worker = impl._next_worker++;
+  for(std::size_t c=0; c < num_chunks; ++c)
+  {
+    const std::size_t begin = c*count/num_chunks;
+    const std::size_t end = (c+1)*count/num_chunks;
+
+    impl._push((first_worker + c) % num_workers, [&job, &batch, begin, end]()
+    {
+      std::exception_ptr error;
+      try
+      {
+        job(begin, end);
+      }
+      catch(...)
+      {
+        error = std::current_exception();
+      }
+
+      std::lock_guard<std::mutex> lock(batch.mutex);
+      if(error && !batch.error)
+        batch.error = error;
+
+      --batch.remaining;
+      batch.finished_cv.notify_all();
+    });
+  }
+
+  // Help the workers until every chunk of the batch has been claimed by some
+  // thread. Any jobs that get run here might belong to other batches. Those
+  // jobs may call for_each() on this pool themselves, which is safe: a thread
+  // only waits below once every chunk of its batch has been claimed, so it only
+  // ever waits on chunks that some thread is already running, and the nested
+  // batches of those chunks get claimed in the same way before they are waited
+  // on.
+  Job stolen;
+  while(impl._steal(num_workers, stolen))
+    stolen();
+
+  // The jobs refer to variables on this stack frame, so we must wait for every
+  // one of them to finish.
+  std::unique_lock<std::mutex> lock(batch.mutex);
+  batch.finished_cv.wait(lock, [&batch]() { return batch.remaining == 0; });
+
+  if(batch.error)
+    std::rethrow_exception(batch.error);
+}
+
+//==============================================================================
+ThreadPool::Implementation::Implementation(std::size_t num_workers)
+  : _queued(0),
+    _next_worker(0)
+{
+  if(num_workers == 0)
+    num_workers = std::max(1u, std::thread::hardware_concurrency());
+
+  _workers.reserve(num_workers);
+  for(std::size_t i=0; i < num_workers; ++i)
+    _workers.emplace_back(std::make_unique<Worker>());
+
+  _threads.reserve(num_workers);
+  for(std::size_t i=0; i < num_workers; ++i)
+    _threads.emplace_back([this, i]() { _run(i); });
+}
+
+//==============================================================================
+ThreadPool::Implementation::~Implementation()
+{
+  {
+    std::lock_guard<std::mutex> lock(_sleep_mutex);
+    _shutdown = true;
+  }
+
+  _sleep_cv.notify_all();
+  for(auto& thread : _threads)
+    thread.join();
+}
+
+//==============================================================================
+std::size_t ThreadPool::Implementation::size() const
+{
+  return _workers.size();
+}
+
+//==============================================================================
+void ThreadPool::Implementation::_push(const std::size_t worker, Job job)
+{
+  {
+    std::lock_guard<std::mutex> lock(_workers[worker]->mutex);
+    _workers[worker]->jobs.emplace_back(std::move(job));
+  }
+
+  {
+    // The count is changed while the sleep mutex is locked so that a worker
+    // cannot miss this notification between checking the count and going to
+    // sleep.
+    std::lock_guard<std::mutex> lock(_sleep_mutex);
+    ++_queued;
+  }
+
+  _sleep_cv.notify_one();
+}
+
+//==============================================================================
+bool ThreadPool::Implementation::_pop(const std::size_t worker, Job& job)
+{
+  Worker& w = *_workers[worker];
+  std::lock_guard<std::mutex> lock(w.mutex);
+  if(w.jobs.empty())
+    return false;
+
+  job = std::move(w.jobs.back());
+  w.jobs.pop_back();
+  --_queued;
+  return true;
+}
+
+//==============================================================================
+bool ThreadPool::Implementation::_steal(const std::size_t thief, Job& job)
+{
+  const std::size_t N = _workers.size();
+  for(std::size_t k=1; k <= N; ++k)
+  {
+    const std::size_t victim = (thief + k) % N;
+    if(victim == thief)
+      continue;
+
+    Worker& w = *_workers[victim];
+    std::lock_guard<std::mutex> lock(w.mutex);
+    if(w.jobs.empty())
+      continue;
+
+    job = std::move(w.jobs.front());
+    w.jobs.pop_front();
+    --_queued;
+    return true;
+  }
+
+  return false;
+}
+
+//==============================================================================
+void ThreadPool::Implementation::_run(const std::size_t worker)
+{
+  while(true)
+  {
+    Job job;
+    if(_pop(worker, job) || _steal(worker, job))
+    {
+      job();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(_sleep_mutex);
+    _sleep_cv.wait(lock, [this]() { return _shutdown || _queued > 0; });
+    if(_shutdown && _queued == 0)
+      return;
+  }
+}
+
+//==============================================================================
+ThreadPool::ThreadPool(const std::size_t num_workers)
+  : _pimpl(rmf_utils::make_unique_impl<Implementation>(num_workers))
+{
+  // Do nothing
+}
+
+//==============================================================================
+std::size_t ThreadPool::size() const
+{
+  return _pimpl->size();
+}
+
+} // namespace rmf_traffic
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SRC__RMF_TRAFFIC__THREADPOOLINTERNAL_HPP
+#define SRC__RMF_TRAFFIC__THREADPOOLINTERNAL_HPP
+
+#include <rmf_traffic/ThreadPool.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rmf_traffic {
+
+//==============================================================================
+class ThreadPool::Implementation
+{
+public:
+
+  using Job = std::function<void()>;
+
+  /// Call job(i) for every i in the range [0, count) and return once every
+  /// call has finished.
+  ///
+  /// If pool is a nullptr, the calls are made in order on the current thread.
+  /// Otherwise the range is split into chunks that get spread across the
+  /// workers of the pool, and the current thread helps to run them while it
+  /// waits. The calls within a chunk are made in order, but there is no
+  /// ordering between chunks, so job must be safe to call concurrently for
+  /// different values of i. Callers that need deterministic results should
+  /// store the result of each call at its index.
+  ///
+  /// If any call throws an exception, the first exception that gets caught
+  /// will be rethrown after every chunk has finished.
+  ///
+  /// job may call for_each() on the same pool again. The nested call will not
+  /// deadlock, even when every worker of the pool is busy.
+  static void for_each(
+      ThreadPool* pool,
+      std::size_t count,
+      const std::function<void(std::size_t)>& job);
+
+  /// Same as for_each(), except job gets called once for each chunk of the
+  /// range with the bounds [begin, end) of the chunk. This is useful when each
+  /// chunk needs some state that is too expensive to create for every index.
+  static void for_each_range(
+      ThreadPool* pool,
+      std::size_t count,
+      const std::function<void(std::size_t begin, std::size_t end)>& job);
+
+  Implementation(std::size_t num_workers);
+
+  ~Implementation();
+
+  std::size_t size() const;
+
+private:
+
+  struct Worker
+  {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+
+  /// Give a job to a worker and wake up a thread to run it.
+  void _push(std::size_t worker, Job job);
+
+  /// Take the newest job off of the queue of a worker.
+  bool _pop(std::size_t worker, Job& job);
+
+  /// Take the oldest job off of the queue of any worker except the thief. Pass
+  /// in size() for the thief when the current thread is not a worker.
+  bool _steal(std::size_t thief, Job& job);
+
+  void _run(std::size_t worker);
+
+  std::vector<std::unique_ptr<Worker>> _workers;
+  std::vector<std::thread> _threads;
+
+  std::mutex _sleep_mutex;
+  std::condition_variable _sleep_cv;
+  std::atomic<std::size_t> _queued;
+  bool _shutdown = false;
+
+  std::atomic<std::size_t> _next_worker;
+};
+
+} // namespace rmf_traffic
+
+#endif // SRC__RMF_TRAFFIC__THREADPOOLINTERNAL_HPP
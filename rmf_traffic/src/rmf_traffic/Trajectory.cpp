@@ -21,38 +21,296 @@
 #include "MotionInternal.hpp"
 #include "TrajectoryInternal.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <mutex>
 #include <string>
 
 namespace rmf_traffic {
 
+//==============================================================================
+namespace internal {
+
+//==============================================================================
+SegmentView SegmentStorage::at(const std::size_t index) const
+{
+  assert(index < _size);
+  const Slice& slice = _slices[_find_slice(index)];
+  return SegmentView(slice.at(index), slice.offset);
+}
+
+//==============================================================================
+std::size_t SegmentStorage::lower_bound(const Time time) const
+{
+  // Find the first slice whose last segment does not finish before the time
+  const auto slice_it = std::partition_point(
+        _slices.begin(), _slices.end(),
+        [&](const Slice& slice)
+  {
+    return (*slice.run)[slice.end-1].finish_time + slice.offset < time;
+  });
+
+  if(slice_it == _slices.end())
+    return _size;
+
+  const Time relative_time = time - slice_it->offset;
+  const auto run_begin = slice_it->run->cbegin() + slice_it->begin;
+  const auto run_end = slice_it->run->cbegin() + slice_it->end;
+  const auto it = std::partition_point(
+        run_begin, run_end,
+        [&](const SegmentData& data)
+  {
+    return data.finish_time < relative_time;
+  });
+
+  return slice_it->start + static_cast<std::size_t>(it - run_begin);
+}
+
+//==============================================================================
+void SegmentStorage::insert(const std::size_t index, SegmentData data)
+{
+  assert(index <= _size);
+  _bounds_cache.clear();
+  if(!_slices.empty())
+  {
+    // If the segment lands in (or at the end of) a slice that has its run all
+    // to itself, then we can put it directly into that run.
+    const std::size_t s = index == _size? _slices.size()-1 : _find_slice(index);
+    Slice& slice = _slices[s];
+    if(slice.run.use_count() == 1
+       && slice.begin == 0 && slice.end == slice.run->size())
+    {
+      data.finish_time -= slice.offset;
+      slice.run->emplace(
+            slice.run->begin() + static_cast<std::ptrdiff_t>(index - slice.start),
+            std::move(data));
+      ++slice.end;
+      ++_size;
+      _restart(s+1);
+      return;
+    }
+  }
+
+  const std::size_t s = _split(index);
+  if(s > 0)
+  {
+    // If nothing else is using the run of the preceding slice, and the slice
+    // reaches the end of that run, then we can simply append to it.
+    Slice& preceding = _slices[s-1];
+    if(preceding.run.use_count() == 1 && preceding.end == preceding.run->size())
+    {
+      data.finish_time -= preceding.offset;
+      preceding.run->emplace_back(std::move(data));
+      ++preceding.end;
+      ++_size;
+      _restart(s);
+      return;
+    }
+  }
+
+  auto run = std::make_shared<Run>();
+  run->emplace_back(std::move(data));
+  _slices.insert(
+        _slices.begin() + static_cast<std::ptrdiff_t>(s),
+        Slice{std::move(run), 0, 1, Duration(0), index});
+  ++_size;
+  _restart(s+1);
+  _compact();
+}
+
+//==============================================================================
+void SegmentStorage::erase(const std::size_t first, const std::size_t last)
+{
+  if(last <= first)
+    return;
+
+  _bounds_cache.clear();
+  assert(last <= _size);
+  const std::size_t s_first = _split(first);
+  const std::size_t s_last = _split(last);
+  _slices.erase(
+        _slices.begin() + static_cast<std::ptrdiff_t>(s_first),
+        _slices.begin() + static_cast<std::ptrdiff_t>(s_last));
+
+  _size -= last - first;
+  _restart(s_first);
+}
+
+//==============================================================================
+void SegmentStorage::shift(const std::size_t from, const Duration delta_t)
+{
+  _bounds_cache.clear();
+  for(std::size_t s = _split(from); s < _slices.size(); ++s)
+    _slices[s].offset += delta_t;
+}
+
+//==============================================================================
+void SegmentStorage::set_profile(
+    const std::size_t index, Trajectory::ConstProfilePtr profile)
+{
+  _modify(index).profile = std::move(profile);
+  _compact();
+}
+
+//==============================================================================
+void SegmentStorage::set_position(
+    const std::size_t index, Eigen::Vector3d position)
+{
+  _modify(index).position = std::move(position);
+  _compact();
+}
+
+//==============================================================================
+void SegmentStorage::set_velocity(
+    const std::size_t index, Eigen::Vector3d velocity)
+{
+  _modify(index).velocity = std::move(velocity);
+  _compact();
+}
+
+//==============================================================================
+std::size_t SegmentStorage::_find_slice(const std::size_t index) const
+{
+  const auto it = std::upper_bound(
+        _slices.begin(), _slices.end(), index,
+        [](const std::size_t i, const Slice& slice)
+  {
+    return i < slice.start;
+  });
+
+  assert(it != _slices.begin());
+  return static_cast<std::size_t>(it - _slices.begin()) - 1;
+}
+
+//==============================================================================
+std::size_t SegmentStorage::_split(const std::size_t index)
+{
+  if(index == _size)
+    return _slices.size();
+
+  const std::size_t s = _find_slice(index);
+  Slice& slice = _slices[s];
+  if(slice.start == index)
+    return s;
+
+  Slice tail = slice;
+  tail.begin = slice.begin + (index - slice.start);
+  tail.start = index;
+  slice.end = tail.begin;
+
+  _slices.insert(
+        _slices.begin() + static_cast<std::ptrdiff_t>(s+1), std::move(tail));
+
+  return s+1;
+}
+
+//==============================================================================
+SegmentData& SegmentStorage::_modify(const std::size_t index)
+{
+  _bounds_cache.clear();
+  std::size_t s = _find_slice(index);
+  if(_slices[s].run.use_count() > 1)
+  {
+    // Some other slice is using this run, so we will give this segment a run
+    // of its own before modifying it. That way only this one segment gets
+    // copied.
+    s = _split(index);
+    _split(index+1);
+
+    Slice& slice = _slices[s];
+    slice.run = std::make_shared<Run>(1, (*slice.run)[slice.begin]);
+    slice.begin = 0;
+    slice.end = 1;
+  }
+
+  return _slices[s].at(index);
+}
+
+//==============================================================================
+void SegmentStorage::_restart(const std::size_t from_slice)
+{
+  std::size_t start = 0;
+  if(from_slice > 0)
+  {
+    const Slice& preceding = _slices[from_slice-1];
+    start = preceding.start + preceding.size();
+  }
+
+  for(std::size_t s = from_slice; s < _slices.size(); ++s)
+  {
+    _slices[s].start = start;
+    start += _slices[s].size();
+  }
+}
+
+//==============================================================================
+void SegmentStorage::_compact()
+{
+  // Each modification adds at most a couple of slices, so we only merge them
+  // back together once they have become numerous relative to the segments.
+  if(_slices.size() <= 8 || _slices.size() <= _size/8)
+    return;
+
+  auto run = std::make_shared<Run>();
+  run->reserve(_size);
+  for(const Slice& slice : _slices)
+  {
+    for(std::size_t i = slice.begin; i < slice.end; ++i)
+    {
+      run->push_back((*slice.run)[i]);
+      run->back().finish_time += slice.offset;
+    }
+  }
+
+  _slices.clear();
+  _slices.push_back(Slice{std::move(run), 0, _size, Duration(0), 0});
+}
+
+} // namespace internal
+
 //==============================================================================
 namespace detail {
 class TrajectoryIteratorImplementation
 {
 public:
 
-  internal::SegmentList::iterator raw_iterator;
+  // The Segment handle that this iterator refers to. A nullptr indicates the
+  // end() iterator. Segment handles keep a stable address for as long as their
+  // Segment exists, so an iterator remains valid while other Segments get
+  // inserted or erased, just like it would for a node-based container.
+  Trajectory::Segment* segment;
   const Trajectory::Implementation* parent;
 
   template<typename SegT>
   Trajectory::base_iterator<SegT> make_iterator(
-      internal::SegmentList::iterator it) const
+      Trajectory::Segment* seg) const
   {
     Trajectory::base_iterator<SegT> result;
-    result._pimpl->raw_iterator = it;
+    result._pimpl->segment = seg;
     result._pimpl->parent = parent;
 
     return result;
   }
 
+  /// Get the index of this iterator within the segment storage. The end()
+  /// iterator has an index equal to the size of the Trajectory.
+  std::size_t index() const;
+
+  /// Get the segment storage of a Trajectory
+  static const internal::SegmentStorage& storage(const Trajectory& trajectory);
+
+  void increment();
+
+  void decrement();
+
   template<typename SegT>
   Trajectory::base_iterator<SegT> post_increment()
   {
     const Trajectory::base_iterator<SegT> old_it =
-        make_iterator<SegT>(raw_iterator);
+        make_iterator<SegT>(segment);
 
-    ++raw_iterator;
+    increment();
 
     return old_it;
   }
@@ -61,9 +319,9 @@ public:
   Trajectory::base_iterator<SegT> post_decrement()
   {
     const Trajectory::base_iterator<SegT> old_it =
-        make_iterator<SegT>(raw_iterator);
+        make_iterator<SegT>(segment);
 
-    --raw_iterator;
+    decrement();
 
     return old_it;
   }
@@ -76,25 +334,14 @@ class Trajectory::Segment::Implementation
 {
 public:
 
-  // Note: these fields will be filled in by the
-  // Trajectory::Implementation::insert() function.
-  internal::SegmentList::iterator myself;
+  // Note: these fields will be filled in by the Trajectory::Implementation
+  // whenever the Segment handle gets created or moved within the Trajectory.
+  std::size_t index;
   Trajectory::Implementation* parent;
 
-  internal::SegmentElement::Data& data()
-  {
-    return myself->data;
-  }
+  internal::SegmentView view() const;
 
-  const internal::SegmentElement::Data& data() const
-  {
-    return myself->data;
-  }
-
-  Time time() const
-  {
-    return data().finish_time;
-  }
+  internal::SegmentStorage& storage();
 
 };
 
@@ -104,27 +351,118 @@ class Trajectory::Implementation
 public:
 
   std::string map_name;
-  internal::OrderMap ordering;
-  internal::SegmentList segments;
+
+  internal::SegmentStorage segments;
+
+  // These are kept up to date so that start_time() and finish_time() can
+  // return pointers to them.
+  Time cached_start_time;
+  Time cached_finish_time;
+
+  /// A Segment handle that gets created the first time someone asks for it.
+  /// The pointer is atomic so that handles can be created while several
+  /// threads are reading the same Trajectory. The Implementation owns the
+  /// Segment that it points to.
+  struct HandleSlot
+  {
+    std::atomic<Segment*> segment;
+
+    HandleSlot(Segment* s = nullptr)
+      : segment(s)
+    {
+      // Do nothing
+    }
+
+    // Slots are only copied or moved while the Trajectory is being modified,
+    // which cannot happen concurrently with anything else.
+    HandleSlot(const HandleSlot& other)
+      : segment(other.get())
+    {
+      // Do nothing
+    }
+
+    HandleSlot& operator=(const HandleSlot& other)
+    {
+      segment.store(other.get(), std::memory_order_relaxed);
+      return *this;
+    }
+
+    Segment* get() const
+    {
+      return segment.load(std::memory_order_acquire);
+    }
+  };
+
+  // The handles that we give out for each Segment. handles[i] refers to the
+  // segment at index i. Handles are only created once someone asks for them,
+  // so that copying a Trajectory does not need to allocate anything per
+  // segment. They are allocated individually so that references to them
+  // remain valid when the segments get rearranged.
+  mutable std::vector<HandleSlot> handles;
+  mutable std::mutex handle_mutex;
 
   template<typename SegT>
-  base_iterator<SegT> make_iterator(
-      internal::SegmentList::iterator iterator) const
+  base_iterator<SegT> make_iterator(const std::size_t index) const
   {
     base_iterator<SegT> it;
-    it._pimpl->raw_iterator = std::move(iterator);
+    it._pimpl->segment = index < segments.size()? handle(index) : nullptr;
     it._pimpl->parent = this;
 
     return it;
   }
 
-  std::unique_ptr<Segment> make_segment(internal::SegmentList::iterator iterator)
+  Segment* handle(const std::size_t index) const
+  {
+    HandleSlot& slot = handles[index];
+    if(Segment* const existing = slot.get())
+      return existing;
+
+    std::lock_guard<std::mutex> lock(handle_mutex);
+    if(Segment* const existing = slot.get())
+      return existing;
+
+    Segment* const segment = new Segment;
+    segment->_pimpl->index = index;
+    segment->_pimpl->parent = const_cast<Implementation*>(this);
+    slot.segment.store(segment, std::memory_order_release);
+
+    return segment;
+  }
+
+  /// Delete the handles in the range [begin, end)
+  void release_handles(const std::size_t begin, const std::size_t end)
+  {
+    for(std::size_t i=begin; i < end; ++i)
+      delete handles[i].get();
+  }
+
+  static std::size_t index_of(const Segment& segment)
+  {
+    return segment._pimpl->index;
+  }
+
+  /// Update the indices of the handles in the range [begin, end)
+  void reindex(const std::size_t begin, const std::size_t end)
+  {
+    for(std::size_t i=begin; i < end; ++i)
+    {
+      if(Segment* const segment = handles[i].get())
+        segment->_pimpl->index = i;
+    }
+  }
+
+  void reindex(const std::size_t begin)
   {
-    std::unique_ptr<Segment> seg(new Segment);
-    seg->_pimpl->myself = std::move(iterator);
-    seg->_pimpl->parent = this;
+    reindex(begin, handles.size());
+  }
+
+  void update_time_range()
+  {
+    if(segments.empty())
+      return;
 
-    return seg;
+    cached_start_time = segments.front().finish_time();
+    cached_finish_time = segments.back().finish_time();
   }
 
   Implementation(std::string map_name)
@@ -138,97 +476,153 @@ public:
     *this = other;
   }
 
+  ~Implementation()
+  {
+    release_handles(0, handles.size());
+  }
+
   Implementation& operator=(const Implementation& other)
   {
-    // Start by making a normal copy
     map_name = other.map_name;
-    ordering = other.ordering;
     segments = other.segments;
+    cached_start_time = other.cached_start_time;
+    cached_finish_time = other.cached_finish_time;
 
-    // Now correct all the iterators to point to the freshly copied container
-    internal::SegmentList::iterator sit = segments.begin();
-    internal::OrderMap::iterator oit = ordering.begin();
-    for( ; sit != segments.end(); ++sit, ++oit)
-    {
-      sit->myself = make_segment(sit);
-      oit->second = sit;
-    }
+    // Keep whatever handles we already have, since they will still be valid
+    // handles for this Trajectory.
+    if(segments.size() < handles.size())
+      release_handles(segments.size(), handles.size());
+
+    handles.resize(segments.size());
+    reindex(0);
 
     return *this;
   }
 
-  InsertionResult insert(internal::SegmentElement::Data data)
+  InsertionResult insert(internal::SegmentData data)
   {
-    const internal::OrderMap::iterator hint = ordering.lower_bound(data.finish_time);
-    if(hint != ordering.end() && hint->first == data.finish_time)
+    const std::size_t index =
+        (segments.empty() || segments.back().finish_time() < data.finish_time)?
+          segments.size() : segments.lower_bound(data.finish_time);
+
+    if(index < segments.size()
+       && segments.at(index).finish_time() == data.finish_time)
     {
       // We already have a Segment in the Trajectory that ends at this same
       // exact moment in time, so we will return the existing iterator along
       // with inserted==false.
-      assert(segments.size() > 0);
-      return InsertionResult{make_iterator<Segment>(hint->second), false};
+      return InsertionResult{make_iterator<Segment>(index), false};
     }
 
-    const internal::SegmentList::const_iterator list_destination =
-        (hint == ordering.end()) ? segments.end() : hint->second;
-
-    const internal::SegmentList::iterator result =
-        segments.emplace(list_destination, std::move(data));
-    result->myself = make_segment(result);
-    assert(segments.size() > 0);
+    segments.insert(index, std::move(data));
+    handles.emplace(
+          handles.begin() + static_cast<std::ptrdiff_t>(index), nullptr);
+    reindex(index+1);
+    update_time_range();
+    assert(segments.size() == handles.size());
 
-    ordering.emplace_hint(hint, data.finish_time, result);
-    assert(ordering.size() > 0);
-
-    return InsertionResult{make_iterator<Segment>(result), true};
+    return InsertionResult{make_iterator<Segment>(index), true};
   }
 
-  iterator find(Time time)
+  iterator find(Time time) const
   {
-    const auto it = ordering.lower_bound(time);
-    if(it == ordering.end())
-      return make_iterator<Segment>(segments.end());
-
     // If the time comes before the start of the Trajectory, then we return
     // the end() iterator
-    if(time < segments.begin()->data.finish_time)
-      return make_iterator<Segment>(segments.end());
+    if(segments.empty() || time < cached_start_time)
+      return end();
 
-    return make_iterator<Segment>(it->second);
+    return make_iterator<Segment>(segments.lower_bound(time));
   }
 
   iterator erase(iterator segment)
   {
-    ordering.erase(segment->_pimpl->myself->data.finish_time);
-    return make_iterator<Segment>(segments.erase(segment->_pimpl->myself));
+    iterator next = segment;
+    return erase(segment, ++next);
   }
 
   iterator erase(iterator first, iterator last)
   {
-    const auto seg_begin = first->_pimpl->myself;
-    const auto seg_end = last._pimpl->raw_iterator == segments.end()?
-          segments.end() : last->_pimpl->myself;
-
-    const auto order_start = ordering.find(seg_begin->data.finish_time);
-    const auto order_end = seg_end == segments.end()?
-          ordering.end() : ordering.find(seg_end->data.finish_time);
-
-    ordering.erase(order_start, order_end);
-    return make_iterator<Segment>(segments.erase(seg_begin, seg_end));
+    const std::size_t begin_index = first._pimpl->index();
+    const std::size_t end_index = last._pimpl->index();
+    if(end_index <= begin_index)
+      return make_iterator<Segment>(end_index);
+
+    segments.erase(begin_index, end_index);
+    release_handles(begin_index, end_index);
+    handles.erase(
+          handles.begin() + static_cast<std::ptrdiff_t>(begin_index),
+          handles.begin() + static_cast<std::ptrdiff_t>(end_index));
+    reindex(begin_index);
+    update_time_range();
+
+    return make_iterator<Segment>(begin_index);
   }
 
-  iterator begin()
+  iterator begin() const
   {
-    return make_iterator<Segment>(segments.begin());
+    return make_iterator<Segment>(0);
   }
 
-  iterator end()
+  iterator end() const
   {
-    return make_iterator<Segment>(segments.end());
+    return make_iterator<Segment>(segments.size());
   }
 
 };
 
+//==============================================================================
+internal::SegmentView Trajectory::Segment::Implementation::view() const
+{
+  return parent->segments.at(index);
+}
+
+//==============================================================================
+internal::SegmentStorage& Trajectory::Segment::Implementation::storage()
+{
+  return parent->segments;
+}
+
+//==============================================================================
+namespace detail {
+
+//==============================================================================
+std::size_t TrajectoryIteratorImplementation::index() const
+{
+  if(!segment)
+    return parent->segments.size();
+
+  return Trajectory::Implementation::index_of(*segment);
+}
+
+//==============================================================================
+const internal::SegmentStorage& TrajectoryIteratorImplementation::storage(
+    const Trajectory& trajectory)
+{
+  return trajectory._pimpl->segments;
+}
+
+//==============================================================================
+void TrajectoryIteratorImplementation::increment()
+{
+  const std::size_t next = index() + 1;
+  segment = next < parent->segments.size()? parent->handle(next) : nullptr;
+}
+
+//==============================================================================
+void TrajectoryIteratorImplementation::decrement()
+{
+  segment = parent->handle(index() - 1);
+}
+
+} // namespace detail
+
+//==============================================================================
+const internal::SegmentStorage& internal::get_storage(
+    const Trajectory& trajectory)
+{
+  return detail::TrajectoryIteratorImplementation::storage(trajectory);
+}
+
 //==============================================================================
 class Trajectory::Profile::Implementation
 {
@@ -377,116 +771,107 @@ Trajectory::Profile::Profile(geometry::ConstFinalConvexShapePtr shape)
 //==============================================================================
 auto Trajectory::Segment::get_profile() const -> ConstProfilePtr
 {
-  return _pimpl->data().profile;
+  return _pimpl->view().profile();
 }
 
 //==============================================================================
 Trajectory::Segment& Trajectory::Segment::set_profile(
     ConstProfilePtr new_profile)
 {
-  _pimpl->data().profile = std::move(new_profile);
+  _pimpl->storage().set_profile(_pimpl->index, std::move(new_profile));
   return *this;
 }
 
 //==============================================================================
 Eigen::Vector3d Trajectory::Segment::get_finish_position() const
 {
-  return _pimpl->data().position;
+  return _pimpl->view().position();
 }
 
 //==============================================================================
 Trajectory::Segment& Trajectory::Segment::set_finish_position(
     Eigen::Vector3d new_position)
 {
-  _pimpl->data().position = std::move(new_position);
+  _pimpl->storage().set_position(_pimpl->index, std::move(new_position));
   return *this;
 }
 
 //==============================================================================
 Eigen::Vector3d Trajectory::Segment::get_finish_velocity() const
 {
-  return _pimpl->data().velocity;
+  return _pimpl->view().velocity();
 }
 
 //==============================================================================
 Trajectory::Segment& Trajectory::Segment::set_finish_velocity(
     Eigen::Vector3d new_velocity)
 {
-  _pimpl->data().velocity = std::move(new_velocity);
+  _pimpl->storage().set_velocity(_pimpl->index, std::move(new_velocity));
   return *this;
 }
 
 //==============================================================================
 Time Trajectory::Segment::get_finish_time() const
 {
-  return _pimpl->time();
+  return _pimpl->view().finish_time();
 }
 
 //==============================================================================
 Trajectory::Segment& Trajectory::Segment::set_finish_time(const Time new_time)
 {
-  internal::SegmentList::iterator data_it = _pimpl->myself;
-  internal::SegmentElement::Data& current_data = data_it->data;
-  const Time current_time = current_data.finish_time;
+  const Time current_time = get_finish_time();
 
   if(current_time == new_time)
   {
-    // Short-circuit, since nothing is changing. The erase and re-insertion
-    // would be a waste of time in this case.
+    // Short-circuit, since nothing is changing. The rearrangement would be a
+    // waste of time in this case.
     return *this;
   }
 
-  internal::OrderMap& ordering = _pimpl->parent->ordering;
-  internal::SegmentList& segments = _pimpl->parent->segments;
-  const internal::OrderMap::const_iterator current_order_it =
-      ordering.find(current_time);
-  assert(current_order_it != ordering.end());
+  Trajectory::Implementation& parent = *_pimpl->parent;
+  internal::SegmentStorage& segments = parent.segments;
+  auto& handles = parent.handles;
+  const std::size_t current = _pimpl->index;
+  const std::size_t hint = segments.lower_bound(new_time);
+
+  if(hint < segments.size() && segments.at(hint).finish_time() == new_time)
+  {
+    // The new time conflicts with an existing time, so we will throw an
+    // exception.
+    throw std::invalid_argument(
+          "[Trajectory::Segment::set_finish_time] Attempted to set time to "
+          + std::to_string(new_time.time_since_epoch().count())
+          + "ns, but a waypoint already exists at that timestamp.");
+  }
+
+  internal::SegmentData data = segments.at(current).copy();
+  data.finish_time = new_time;
 
-  const internal::OrderMap::const_iterator hint =
-      ordering.lower_bound(new_time);
+  // Once this Segment is removed, everything at or after hint moves down by
+  // one, so that is where this Segment should go back in.
+  const std::size_t destination = current < hint? hint - 1 : hint;
+  segments.erase(current, current+1);
+  segments.insert(destination, std::move(data));
 
-  if(current_order_it == hint)
+  const auto handle_it = [&](const std::size_t i)
   {
-    // The Segment is already in the correct location within the list, so it
-    // does not need to be moved. We can just update its entry in the OrderMap.
+    return handles.begin() + static_cast<std::ptrdiff_t>(i);
+  };
 
-    // We need to create a new_hint iterator which points to the iterator after
-    // hint because the hint iterator will be invalidated when we erase
-    // current_order_it (because they are iterators to the same element).
-    const internal::OrderMap::const_iterator new_hint =
-        ++internal::OrderMap::const_iterator(hint);
-    ordering.erase(current_order_it);
-    ordering.emplace_hint(new_hint, new_time, std::move(data_it));
-  }
-  else if(hint == ordering.end())
+  if(current < destination)
   {
-    // This Segment must be moved to the end of the list.
-    segments.splice(segments.end(), segments, data_it);
-    ordering.erase(current_order_it);
-    ordering.emplace_hint(hint, new_time, std::move(data_it));
+    std::rotate(
+          handle_it(current), handle_it(current+1), handle_it(destination+1));
+    parent.reindex(current, destination+1);
   }
-  else
+  else if(destination < current)
   {
-    const internal::SegmentList::const_iterator destination = hint->second;
-    assert(destination != segments.end());
-
-    if(destination->data.finish_time == new_time)
-    {
-      // The new time conflicts with an existing time, so we will throw an
-      // exception.
-      throw std::invalid_argument(
-            "[Trajectory::Segment::set_finish_time] Attempted to set time to "
-            + std::to_string(new_time.time_since_epoch().count())
-            + "ns, but a waypoint already exists at that timestamp.");
-    }
-
-    segments.splice(destination, segments, data_it);
-    ordering.erase(current_order_it);
-    ordering.emplace_hint(hint, new_time, std::move(data_it));
+    std::rotate(
+          handle_it(destination), handle_it(current), handle_it(current+1));
+    parent.reindex(destination, current+1);
   }
 
-  // Update the finish_time value in the data field.
-  current_data.finish_time = new_time;
+  parent.update_time_range();
 
   return *this;
 }
@@ -494,22 +879,20 @@ Trajectory::Segment& Trajectory::Segment::set_finish_time(const Time new_time)
 //==============================================================================
 void Trajectory::Segment::adjust_finish_times(Duration delta_t)
 {
-  internal::SegmentList& segments = _pimpl->parent->segments;
-  const internal::SegmentList::iterator begin_it = _pimpl->myself;
-  const Time original_begin_time = begin_it->data.finish_time;
+  Trajectory::Implementation& parent = *_pimpl->parent;
+  internal::SegmentStorage& segments = parent.segments;
+  const std::size_t begin_index = _pimpl->index;
 
-  if(delta_t.count() < 0 && begin_it != segments.begin())
+  if(delta_t.count() < 0 && begin_index > 0)
   {
     // If delta_t is negative and this is not the first Segment in the
     // Trajectory, make sure the change in time does not make it dip beneath its
     // predecessor Segment.
-    const internal::SegmentList::const_iterator predecessor_it =
-        --internal::SegmentList::iterator(begin_it);
-    const auto new_time = begin_it->data.finish_time + delta_t;
-    if(new_time <= predecessor_it->data.finish_time)
+    const Time predecessor_time = segments.at(begin_index - 1).finish_time();
+    const auto new_time = segments.at(begin_index).finish_time() + delta_t;
+    if(new_time <= predecessor_time)
     {
-      const auto tp = predecessor_it->data.finish_time
-          .time_since_epoch().count();
+      const auto tp = predecessor_time.time_since_epoch().count();
       const auto tc = (new_time).time_since_epoch().count();
 
       const std::string error =
@@ -524,49 +907,30 @@ void Trajectory::Segment::adjust_finish_times(Duration delta_t)
     }
   }
 
-  // Adjust the times for the segments and collect their iterators
-  std::vector<internal::SegmentList::iterator> list_iterators;
-  list_iterators.reserve(segments.size());
-  for(internal::SegmentList::iterator it = begin_it; it != segments.end(); ++it)
-  {
-    it->data.finish_time += delta_t;
-    list_iterators.push_back(it);
-  }
-
-  internal::OrderMap& ordering = _pimpl->parent->ordering;
-  const internal::OrderMap::iterator order_it =
-      ordering.find(original_begin_time);
-  assert(order_it != ordering.end());
-
-  // Erase the existing ordering entries for all the modified Trajectory
-  // Segments.
-  ordering.erase(order_it, ordering.end());
-
-  // Add new entries one at a time, supplying the emplacement operator with the
-  // hint that it can always append the entry to the end of the map.
-  for(internal::SegmentList::iterator& it : list_iterators)
-  {
-    const Time new_time = it->data.finish_time;
-    ordering.emplace_hint(ordering.end(), new_time, std::move(it));
-  }
+  // Shifting every Segment from here onwards by the same amount preserves
+  // their order, so the storage only needs to record a new time offset for
+  // them.
+  segments.shift(begin_index, delta_t);
+  parent.update_time_range();
 }
 
 //==============================================================================
 std::unique_ptr<Motion> Trajectory::Segment::compute_motion() const
 {
-  const internal::SegmentList& segments = _pimpl->parent->segments;
-  const internal::SegmentList::const_iterator& it = _pimpl->myself;
-  const internal::SegmentElement::Data& finish_data = it->data;
+  const internal::SegmentStorage& segments = _pimpl->parent->segments;
+  const std::size_t index = _pimpl->index;
+  const internal::SegmentView finish = segments.at(index);
 
-  if(it == segments.begin())
+  if(index == 0)
   {
     return std::make_unique<SinglePointMotion>(
-          finish_data.finish_time,
-          finish_data.position,
-          finish_data.velocity);
+          finish.finish_time(),
+          finish.position(),
+          finish.velocity());
   }
 
-  return std::make_unique<SplineMotion>(Spline(it));
+  return std::make_unique<SplineMotion>(
+        Spline(segments.at(index-1), finish));
 }
 
 //==============================================================================
@@ -618,7 +982,7 @@ Trajectory::InsertionResult Trajectory::insert(
     Eigen::Vector3d velocity)
 {
   return _pimpl->insert(
-        internal::SegmentElement::Data{
+        internal::SegmentData{
           std::move(finish_time),
           std::move(profile),
           std::move(position),
@@ -628,7 +992,7 @@ Trajectory::InsertionResult Trajectory::insert(
 //==============================================================================
 Trajectory::InsertionResult Trajectory::insert(const Segment& other)
 {
-  return _pimpl->insert(internal::SegmentElement::Data{other._pimpl->data()});
+  return _pimpl->insert(other._pimpl->view().copy());
 }
 
 //==============================================================================
@@ -694,48 +1058,45 @@ Trajectory::const_iterator Trajectory::cend() const
 //==============================================================================
 auto Trajectory::front() -> Segment&
 {
-  return *_pimpl->segments.front().myself;
+  return *_pimpl->handle(0);
 }
 
 //==============================================================================
 auto Trajectory::front() const -> const Segment&
 {
-  return *_pimpl->segments.front().myself;
+  return *_pimpl->handle(0);
 }
 
 //==============================================================================
 auto Trajectory::back() -> Segment&
 {
-  return *_pimpl->segments.back().myself;
+  return *_pimpl->handle(_pimpl->segments.size()-1);
 }
 
 //==============================================================================
 auto Trajectory::back() const -> const Segment&
 {
-  return *_pimpl->segments.back().myself;
+  return *_pimpl->handle(_pimpl->segments.size()-1);
 }
 
 //==============================================================================
 const Time* Trajectory::start_time() const
 {
-  const auto& segments = _pimpl->segments;
-  return segments.size() == 0? nullptr : &segments.front().data.finish_time;
+  return _pimpl->segments.empty()? nullptr : &_pimpl->cached_start_time;
 }
 
 //==============================================================================
 const Time* Trajectory::finish_time() const
 {
-  const auto& segments = _pimpl->segments;
-  return segments.size() == 0? nullptr : &segments.back().data.finish_time;
+  return _pimpl->segments.empty()? nullptr : &_pimpl->cached_finish_time;
 }
 
 //==============================================================================
 Duration Trajectory::duration() const
 {
-  const auto& segments = _pimpl->segments;
-  return segments.size() < 2?
+  return _pimpl->segments.size() < 2?
         Duration(0) :
-        segments.back().data.finish_time - segments.front().data.finish_time;
+        _pimpl->cached_finish_time - _pimpl->cached_start_time;
 }
 
 //==============================================================================
@@ -748,21 +1109,21 @@ std::size_t Trajectory::size() const
 template<typename SegT>
 SegT& Trajectory::base_iterator<SegT>::operator*() const
 {
-  return *_pimpl->raw_iterator->myself;
+  return *_pimpl->segment;
 }
 
 //==============================================================================
 template<typename SegT>
 SegT* Trajectory::base_iterator<SegT>::operator->() const
 {
-  return _pimpl->raw_iterator->myself.get();
+  return _pimpl->segment;
 }
 
 //==============================================================================
 template<typename SegT>
 auto Trajectory::base_iterator<SegT>::operator++() -> base_iterator&
 {
-  ++_pimpl->raw_iterator;
+  _pimpl->increment();
   return *this;
 }
 
@@ -770,7 +1131,7 @@ auto Trajectory::base_iterator<SegT>::operator++() -> base_iterator&
 template<typename SegT>
 auto Trajectory::base_iterator<SegT>::operator--() -> base_iterator&
 {
-  --_pimpl->raw_iterator;
+  _pimpl->decrement();
   return *this;
 }
 
@@ -794,7 +1155,7 @@ auto Trajectory::base_iterator<SegT>::operator--(int) -> base_iterator
   bool Trajectory::base_iterator<SegT>::operator op ( \
       const base_iterator& other) const \
   { \
-    return _pimpl->raw_iterator op other._pimpl->raw_iterator; \
+    return _pimpl->segment op other._pimpl->segment; \
   }
 
 DEFINE_BASIC_ITERATOR_OP(==)
@@ -804,24 +1165,9 @@ template<typename SegT>
 bool Trajectory::base_iterator<SegT>::operator<(
     const base_iterator& other) const
 {
-  const bool this_is_end =
-      this->_pimpl->raw_iterator == _pimpl->parent->segments.end();
-  const bool other_is_end =
-      other._pimpl->raw_iterator == _pimpl->parent->segments.end();
-
-  if(this_is_end || other_is_end)
-  {
-    // If the other is the end iterator but this iterator is not, then we return
-    // true, because the end iterator is "larger" than any valid iterator.
-    // If the other is not the end iterator but this iterator is, then we return
-    // false, because this iterator is definitely larger than anything the other
-    // can be.
-    return other_is_end && !this_is_end;
-  }
-
-  // If they are both valid iterators, then we can compare their times.
-  return this->_pimpl->raw_iterator->data.finish_time
-      < other._pimpl->raw_iterator->data.finish_time;
+  // The end iterator has an index equal to the size of the Trajectory, so it
+  // is "larger" than any valid iterator.
+  return _pimpl->index() < other._pimpl->index();
 }
 
 //==============================================================================
@@ -829,21 +1175,7 @@ template<typename SegT>
 bool Trajectory::base_iterator<SegT>::operator>(
     const base_iterator& other) const
 {
-  const bool this_is_end =
-      this->_pimpl->raw_iterator == _pimpl->parent->segments.end();
-  const bool other_is_end =
-      other._pimpl->raw_iterator == _pimpl->parent->segments.end();
-
-  if(this_is_end || other_is_end)
-  {
-    // See the logic above for operator<, but in this case we want the opposite
-    // conclusion.
-    return this_is_end && !other_is_end;
-  }
-
-  // If they are both valid iterators, then we can compare their times.
-  return this->_pimpl->raw_iterator->data.finish_time
-      > other._pimpl->raw_iterator->data.finish_time;
+  return _pimpl->index() > other._pimpl->index();
 }
 
 //==============================================================================
@@ -866,7 +1198,7 @@ bool Trajectory::base_iterator<SegT>::operator>=(
 template<typename SegT>
 Trajectory::base_iterator<SegT>::operator const_iterator() const
 {
-  return _pimpl->make_iterator<const SegT>(_pimpl->raw_iterator);
+  return _pimpl->make_iterator<const SegT>(_pimpl->segment);
 }
 
 //==============================================================================
@@ -887,56 +1219,54 @@ bool Trajectory::Debug::check_iterator_time_consistency(
 {
   assert(trajectory._pimpl);
 
-  const internal::SegmentList& segments = trajectory._pimpl->segments;
-  const internal::OrderMap& ordering = trajectory._pimpl->ordering;
+  const internal::SegmentStorage& segments = trajectory._pimpl->segments;
+  const auto& handles = trajectory._pimpl->handles;
 
-  bool consistent = true;
+  bool consistent = segments.size() == handles.size();
 
-  internal::SegmentList::const_iterator s_it = segments.begin();
-  internal::OrderMap::const_iterator o_it = ordering.begin();
-  for( ; s_it != segments.end() && o_it != ordering.end(); ++s_it, ++o_it)
+  std::size_t expected_start = 0;
+  for(const auto& slice : segments.slices())
   {
-    consistent &= s_it->data.finish_time == o_it->first;
+    consistent &= slice.start == expected_start;
+    consistent &= slice.begin < slice.end;
+    expected_start += slice.size();
   }
+  consistent &= expected_start == segments.size();
 
-  consistent &= s_it == segments.end();
-  consistent &= o_it == ordering.end();
+  for(std::size_t i=0; consistent && i < segments.size(); ++i)
+  {
+    if(const Segment* const segment = handles[i].get())
+      consistent &= Implementation::index_of(*segment) == i;
+
+    if(i > 0)
+    {
+      consistent &=
+          segments.at(i-1).finish_time() < segments.at(i).finish_time();
+    }
+  }
 
   if(print_inconsistency && !consistent)
   {
-    std::size_t index = 0;
-    s_it = segments.begin();
-    o_it = ordering.begin();
     std::cout << "Trajectory time inconsistency detected: "
-              << "( ordering | segments | difference )\n";
-    for( ; s_it != segments.end() && o_it != ordering.end();
-         ++s_it, ++o_it, ++index)
+              << "( slice start | size | offset )\n";
+    for(const auto& slice : segments.slices())
     {
-      const auto difference = o_it->first - s_it->data.finish_time;
-      std::cout << " -- [" << index << "] "
-                << o_it->first.time_since_epoch().count()/1e9 << " | "
-                << s_it->data.finish_time.time_since_epoch().count()/1e9
-                << " | Difference: " << difference.count()/1e9 << "\n";
+      std::cout << " -- [" << slice.start << "] " << slice.size() << " | "
+                << slice.offset.count()/1e9 << "\n";
     }
 
-    if(s_it != segments.end())
-    {
-      std::cout << " -- more elements in segments\n";
-      for( ; s_it != segments.end(); ++s_it, ++index)
-      {
-        std::cout << "      -- [" << index << "] "
-                  << s_it->data.finish_time.time_since_epoch().count()/1e9
-                  << "\n";
-      }
-    }
-    if(o_it != ordering.end())
+    std::cout << "( handle index | finish time )\n";
+    for(std::size_t i=0; i < std::min(segments.size(), handles.size()); ++i)
     {
-      std::cout << " -- more elements in ordering:\n";
-      for( ; o_it != ordering.end(); ++o_it, ++index)
-      {
-        std::cout << "     -- [" << index << "] "
-                  << o_it->first.time_since_epoch().count()/1e9 << "\n";
-      }
+      std::cout << " -- [" << i << "] ";
+      if(const Segment* const segment = handles[i].get())
+        std::cout << Implementation::index_of(*segment);
+      else
+        std::cout << "(none)";
+
+      std::cout << " | "
+                << segments.at(i).finish_time().time_since_epoch().count()/1e9
+                << "\n";
     }
     std::cout << std::endl;
   }
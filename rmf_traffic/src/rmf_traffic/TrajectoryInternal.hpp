@@ -20,57 +20,236 @@
 
 #include <rmf_traffic/Trajectory.hpp>
 
-#include <list>
-#include <map>
+#include <memory>
+#include <vector>
 
 namespace rmf_traffic {
 namespace internal {
 
+struct TrajectoryBounds;
+
 //==============================================================================
-struct SegmentElement;
-using SegmentList = std::list<SegmentElement>;
-using OrderMap = std::map<Time, SegmentList::iterator>;
+/// Holds the TrajectoryBounds of a Trajectory once they have been computed.
+/// Copies of a cache share the same bounds, and the bounds can be filled in
+/// while several threads are reading the same Trajectory.
+class BoundsCache
+{
+public:
+
+  using ConstBoundsPtr = std::shared_ptr<const TrajectoryBounds>;
+
+  BoundsCache() = default;
+
+  BoundsCache(const BoundsCache& other)
+    : _bounds(other.get())
+  {
+    // Do nothing
+  }
+
+  BoundsCache& operator=(const BoundsCache& other)
+  {
+    std::atomic_store(&_bounds, other.get());
+    return *this;
+  }
+
+  ConstBoundsPtr get() const
+  {
+    return std::atomic_load(&_bounds);
+  }
 
-struct SegmentElement
+  void set(ConstBoundsPtr bounds) const
+  {
+    std::atomic_store(&_bounds, std::move(bounds));
+  }
+
+  void clear()
+  {
+    std::atomic_store(&_bounds, ConstBoundsPtr());
+  }
+
+private:
+  mutable ConstBoundsPtr _bounds;
+};
+
+//==============================================================================
+struct SegmentData
+{
+  Time finish_time;
+  Trajectory::ConstProfilePtr profile;
+  Eigen::Vector3d position;
+  Eigen::Vector3d velocity;
+};
+
+//==============================================================================
+/// Read-only access to a segment inside of a SegmentStorage.
+class SegmentView
 {
-  struct Data
+public:
+
+  SegmentView(const SegmentData& data, const Duration offset)
+    : _data(&data),
+      _offset(offset)
+  {
+    // Do nothing
+  }
+
+  Time finish_time() const
   {
-    Time finish_time;
-    Trajectory::ConstProfilePtr profile;
-    Eigen::Vector3d position;
-    Eigen::Vector3d velocity;
+    return _data->finish_time + _offset;
+  }
+
+  const Trajectory::ConstProfilePtr& profile() const
+  {
+    return _data->profile;
+  }
+
+  const Eigen::Vector3d& position() const
+  {
+    return _data->position;
+  }
+
+  const Eigen::Vector3d& velocity() const
+  {
+    return _data->velocity;
+  }
+
+  /// Make an independent copy of this segment's data
+  SegmentData copy() const
+  {
+    return SegmentData{finish_time(), profile(), position(), velocity()};
+  }
+
+private:
+  const SegmentData* _data;
+  Duration _offset;
+};
+
+//==============================================================================
+/// Time-sorted storage for the segments of a Trajectory.
+///
+/// The segments live in contiguous runs which are shared between copies of a
+/// Trajectory. A storage refers to its runs through a sequence of slices, and
+/// each slice applies a time offset to the segments that it covers. This lets
+/// a copy of a Trajectory be made without copying any segments, and it lets
+/// the finish times of any suffix of the Trajectory be shifted without
+/// touching the segments themselves. A run is only modified in place while a
+/// single slice refers to it; otherwise the affected segments are copied into
+/// a fresh run first.
+class SegmentStorage
+{
+public:
+
+  using Run = std::vector<SegmentData>;
+
+  struct Slice
+  {
+    std::shared_ptr<Run> run;
+
+    /// The range of the run that is covered by this slice
+    std::size_t begin;
+    std::size_t end;
+
+    /// Added to the finish time of every segment in this slice
+    Duration offset;
+
+    /// The index of this slice's first segment within the whole storage
+    std::size_t start;
+
+    std::size_t size() const
+    {
+      return end - begin;
+    }
+
+    SegmentData& at(std::size_t index) const
+    {
+      return (*run)[begin + index - start];
+    }
   };
 
-  Data data;
+  std::size_t size() const
+  {
+    return _size;
+  }
+
+  bool empty() const
+  {
+    return _size == 0;
+  }
+
+  SegmentView at(std::size_t index) const;
 
-  // We store a Trajectory::Segment in this struct so that we can always safely
-  // return a reference to a Trajectory::Segment object. As long as this
-  // SegmentData is alive, any Trajectory::Segment reference that refers to it
-  // will remain valid.
-  std::unique_ptr<Trajectory::Segment> myself;
+  SegmentView front() const
+  {
+    return at(0);
+  }
 
-  SegmentElement(Data input_data)
-    : data(std::move(input_data))
+  SegmentView back() const
   {
-    // Do nothing
+    return at(_size - 1);
   }
 
-  SegmentElement(const SegmentElement& other)
-    : data(other.data)
+  /// Get the index of the first segment whose finish time is not earlier than
+  /// the given time.
+  std::size_t lower_bound(Time time) const;
+
+  /// Insert a segment at the given index. The caller is responsible for
+  /// keeping the segments sorted by time.
+  void insert(std::size_t index, SegmentData data);
+
+  /// Erase the segments in the range [first, last)
+  void erase(std::size_t first, std::size_t last);
+
+  /// Add delta_t to the finish time of every segment from the given index
+  /// onwards.
+  void shift(std::size_t from, Duration delta_t);
+
+  void set_profile(std::size_t index, Trajectory::ConstProfilePtr profile);
+
+  void set_position(std::size_t index, Eigen::Vector3d position);
+
+  void set_velocity(std::size_t index, Eigen::Vector3d velocity);
+
+  const std::vector<Slice>& slices() const
   {
-    // Do nothing
+    return _slices;
   }
 
-  SegmentElement& operator=(const SegmentElement& other)
+  /// The bounds of these segments, if they have been computed since the last
+  /// time the segments were modified
+  const BoundsCache& bounds_cache() const
   {
-    data = other.data;
-    return *this;
+    return _bounds_cache;
   }
 
-  SegmentElement(SegmentElement&&) = default;
-  SegmentElement& operator=(SegmentElement&&) = default;
+private:
+
+  /// Get the index of the slice that contains the segment at the given index
+  std::size_t _find_slice(std::size_t index) const;
+
+  /// Make sure that a slice begins at the given index, and return the index of
+  /// that slice. If index is equal to size(), this returns the number of
+  /// slices.
+  std::size_t _split(std::size_t index);
+
+  /// Get a reference to the segment at the given index that can be safely
+  /// modified without affecting any other storage.
+  SegmentData& _modify(std::size_t index);
+
+  /// Recompute the start field of every slice from the given slice onwards
+  void _restart(std::size_t from_slice);
+
+  /// Merge all the slices into one run if they have become too fragmented
+  void _compact();
+
+  std::vector<Slice> _slices;
+  std::size_t _size = 0;
+  BoundsCache _bounds_cache;
 };
 
+//==============================================================================
+/// Get the segment storage of a Trajectory
+const SegmentStorage& get_storage(const Trajectory& trajectory);
+
 } // namespace internal
 } // namespace rmf_traffic
 
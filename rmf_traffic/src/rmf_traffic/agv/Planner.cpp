@@ -17,8 +17,10 @@
 
 #include <rmf_traffic/agv/Planner.hpp>
 
+#include "debug_Planner.hpp"
 #include "internal_Planner.hpp"
 #include "internal_planning.hpp"
+#include "../ThreadPoolInternal.hpp"
 
 namespace rmf_traffic {
 namespace agv {
@@ -31,6 +33,7 @@ public:
   Graph graph;
   VehicleTraits traits;
   Interpolate::Options interpolation;
+  std::vector<std::size_t> precomputed_goals = {};
 
 };
 
@@ -108,6 +111,27 @@ const Interpolate::Options& Planner::Configuration::interpolation() const
   return _pimpl->interpolation;
 }
 
+//==============================================================================
+auto Planner::Configuration::precomputed_goals(std::vector<std::size_t> goals)
+-> Configuration&
+{
+  _pimpl->precomputed_goals = std::move(goals);
+  return *this;
+}
+
+//==============================================================================
+std::vector<std::size_t>& Planner::Configuration::precomputed_goals()
+{
+  return _pimpl->precomputed_goals;
+}
+
+//==============================================================================
+const std::vector<std::size_t>&
+Planner::Configuration::precomputed_goals() const
+{
+  return _pimpl->precomputed_goals;
+}
+
 //==============================================================================
 class Planner::Options::Implementation
 {
@@ -363,6 +387,160 @@ const double* Planner::Goal::orientation() const
   return nullptr;
 }
 
+//==============================================================================
+class Planner::BatchOptions::Implementation
+{
+public:
+
+  bool cancel_dominated;
+  rmf_utils::optional<Duration> time_limit;
+  ResultCallback on_result;
+
+};
+
+//==============================================================================
+Planner::BatchOptions::BatchOptions(
+    const bool cancel_dominated,
+    rmf_utils::optional<Duration> time_limit,
+    ResultCallback on_result)
+  : _pimpl(rmf_utils::make_impl<Implementation>(
+             Implementation{
+               cancel_dominated,
+               time_limit,
+               std::move(on_result)
+             }))
+{
+  // Do nothing
+}
+
+//==============================================================================
+auto Planner::BatchOptions::cancel_dominated(const bool cancel)
+-> BatchOptions&
+{
+  _pimpl->cancel_dominated = cancel;
+  return *this;
+}
+
+//==============================================================================
+bool Planner::BatchOptions::cancel_dominated() const
+{
+  return _pimpl->cancel_dominated;
+}
+
+//==============================================================================
+auto Planner::BatchOptions::time_limit(rmf_utils::optional<Duration> limit)
+-> BatchOptions&
+{
+  _pimpl->time_limit = limit;
+  return *this;
+}
+
+//==============================================================================
+rmf_utils::optional<Duration> Planner::BatchOptions::time_limit() const
+{
+  return _pimpl->time_limit;
+}
+
+//==============================================================================
+auto Planner::BatchOptions::on_result(ResultCallback callback)
+-> BatchOptions&
+{
+  _pimpl->on_result = std::move(callback);
+  return *this;
+}
+
+//==============================================================================
+auto Planner::BatchOptions::on_result() const -> const ResultCallback&
+{
+  return _pimpl->on_result;
+}
+
+//==============================================================================
+class Planner::AnytimeOptions::Implementation
+{
+public:
+
+  Duration time_budget;
+  double initial_weight;
+  double weight_step;
+  ImprovementCallback on_improvement;
+
+};
+
+//==============================================================================
+Planner::AnytimeOptions::AnytimeOptions(
+    const Duration time_budget,
+    const double initial_weight,
+    const double weight_step,
+    ImprovementCallback on_improvement)
+  : _pimpl(rmf_utils::make_impl<Implementation>(
+             Implementation{
+               time_budget,
+               initial_weight,
+               weight_step,
+               std::move(on_improvement)
+             }))
+{
+  // Do nothing
+}
+
+//==============================================================================
+auto Planner::AnytimeOptions::time_budget(const Duration budget)
+-> AnytimeOptions&
+{
+  _pimpl->time_budget = budget;
+  return *this;
+}
+
+//==============================================================================
+Duration Planner::AnytimeOptions::time_budget() const
+{
+  return _pimpl->time_budget;
+}
+
+//==============================================================================
+auto Planner::AnytimeOptions::initial_weight(const double weight)
+-> AnytimeOptions&
+{
+  _pimpl->initial_weight = weight;
+  return *this;
+}
+
+//==============================================================================
+double Planner::AnytimeOptions::initial_weight() const
+{
+  return _pimpl->initial_weight;
+}
+
+//==============================================================================
+auto Planner::AnytimeOptions::weight_step(const double step)
+-> AnytimeOptions&
+{
+  _pimpl->weight_step = step;
+  return *this;
+}
+
+//==============================================================================
+double Planner::AnytimeOptions::weight_step() const
+{
+  return _pimpl->weight_step;
+}
+
+//==============================================================================
+auto Planner::AnytimeOptions::on_improvement(ImprovementCallback callback)
+-> AnytimeOptions&
+{
+  _pimpl->on_improvement = std::move(callback);
+  return *this;
+}
+
+//==============================================================================
+auto Planner::AnytimeOptions::on_improvement() const
+-> const ImprovementCallback&
+{
+  return _pimpl->on_improvement;
+}
+
 //==============================================================================
 class Planner::Implementation
 {
@@ -390,10 +568,12 @@ public:
       internal::planning::CacheManager cache_mgr,
       const std::vector<Planner::Start>& starts,
       Planner::Goal goal,
-      Planner::Options options)
+      Planner::Options options,
+      const internal::planning::SearchParams& params =
+          internal::planning::SearchParams())
   {
     auto result = cache_mgr.get().plan(
-        {starts}, std::move(goal), std::move(options));
+        {starts}, std::move(goal), std::move(options), params);
 
     if (!result)
       return rmf_utils::nullopt;
@@ -492,6 +672,159 @@ rmf_utils::optional<Plan> Planner::plan(
         std::move(options));
 }
 
+//==============================================================================
+auto Planner::plan_batch(
+    const std::vector<Problem>& problems,
+    BatchOptions batch_options) const
+-> std::vector<rmf_utils::optional<Plan>>
+{
+  return plan_batch(
+        problems, _pimpl->default_options, std::move(batch_options));
+}
+
+//==============================================================================
+auto Planner::plan_batch(
+    const std::vector<Problem>& problems,
+    Options options,
+    BatchOptions batch_options) const
+-> std::vector<rmf_utils::optional<Plan>>
+{
+  std::vector<rmf_utils::optional<Plan>> plans(problems.size());
+  if(problems.empty())
+    return plans;
+
+  internal::planning::SearchCutoff cutoff(batch_options.cancel_dominated());
+  const BatchOptions::ResultCallback& on_result = batch_options.on_result();
+  const bool* const interrupt_flag = options.interrupt_flag();
+
+  if(const auto time_limit = batch_options.time_limit())
+    cutoff.set_deadline(std::chrono::steady_clock::now() + *time_limit);
+
+  // The problems are spread across the planning pool, and this thread helps to
+  // solve them while it waits. Each problem gets its own handle on the cache
+  // when it begins, so it will benefit from any heuristics that were learned by
+  // the problems that finished before it.
+  std::mutex mutex;
+  ThreadPool::Implementation::for_each(
+        &internal::planning::planning_pool(), problems.size(),
+        [&](const std::size_t i)
+  {
+    rmf_utils::optional<Plan> plan;
+    if(!cutoff.cancelled() && !(interrupt_flag && *interrupt_flag))
+    {
+      const Problem& problem = problems[i];
+      plan = Plan::Implementation::generate(
+            _pimpl->cache_mgr,
+            problem.starts,
+            problem.goal,
+            options,
+            internal::planning::SearchParams{nullptr, &cutoff});
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    plans[i] = std::move(plan);
+    if(on_result && on_result(i, plans[i]))
+      cutoff.cancel();
+  });
+
+  return plans;
+}
+
+//==============================================================================
+rmf_utils::optional<Plan> Planner::plan_anytime(
+    const StartSet& starts,
+    Goal goal,
+    AnytimeOptions anytime_options) const
+{
+  return plan_anytime(
+        starts,
+        std::move(goal),
+        _pimpl->default_options,
+        std::move(anytime_options));
+}
+
+//==============================================================================
+rmf_utils::optional<Plan> Planner::plan_anytime(
+    const StartSet& starts,
+    Goal goal,
+    Options options,
+    AnytimeOptions anytime_options) const
+{
+  if(anytime_options.weight_step() <= 0.0)
+  {
+    throw std::invalid_argument(
+          "[rmf_traffic::agv::Planner::plan_anytime] The weight step must be "
+          "greater than 0, but it was given as "
+          + std::to_string(anytime_options.weight_step()));
+  }
+
+  // Each search only looks for plans that finish sooner than the best plan so
+  // far, and every search gets cancelled once the time budget runs out.
+  internal::planning::SearchCutoff cutoff(true);
+  cutoff.set_deadline(
+        std::chrono::steady_clock::now() + anytime_options.time_budget());
+
+  const auto& on_improvement = anytime_options.on_improvement();
+  const bool* const interrupt_flag = options.interrupt_flag();
+
+  const auto finish_time = [](const Plan& plan) -> Time
+  {
+    return *plan.get_trajectories().back().finish_time();
+  };
+
+  rmf_utils::optional<Plan> best_plan;
+  double weight = std::max(1.0, anytime_options.initial_weight());
+  while(true)
+  {
+    auto plan = Plan::Implementation::generate(
+          _pimpl->cache_mgr,
+          starts,
+          goal,
+          options,
+          internal::planning::SearchParams{nullptr, &cutoff, weight});
+
+    // The cutoff prunes the branches that cannot beat the best plan, but that
+    // does not promise that a plan which comes back is strictly better, so the
+    // best plan only gets replaced by one that finishes sooner.
+    if(plan && (!best_plan || finish_time(*plan) < finish_time(*best_plan)))
+    {
+      best_plan = std::move(plan);
+      if(on_improvement)
+        on_improvement(*best_plan, weight);
+    }
+    else if(!best_plan && !cutoff.cancelled()
+            && !(interrupt_flag && *interrupt_flag))
+    {
+      // The search was not stopped early, so there is no plan to be found
+      return rmf_utils::nullopt;
+    }
+
+    if(weight <= 1.0 || cutoff.cancelled()
+       || (interrupt_flag && *interrupt_flag))
+      break;
+
+    weight = std::max(1.0, weight - anytime_options.weight_step());
+  }
+
+  return best_plan;
+}
+
+//==============================================================================
+rmf_utils::optional<Plan> Planner::Debug::plan(
+    const Planner& planner,
+    const StartSet& starts,
+    Goal goal,
+    Options options,
+    SearchDebug& debug)
+{
+  return Plan::Implementation::generate(
+        planner._pimpl->cache_mgr,
+        starts,
+        std::move(goal),
+        std::move(options),
+        internal::planning::SearchParams{&debug});
+}
+
 //==============================================================================
 const Eigen::Vector3d& Plan::Waypoint::position() const
 {
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SRC__RMF_TRAFFIC__AGV__DEBUG_PLANNER_HPP
+#define SRC__RMF_TRAFFIC__AGV__DEBUG_PLANNER_HPP
+
+#include "internal_planning.hpp"
+
+namespace rmf_traffic {
+namespace agv {
+
+class Planner::Debug
+{
+public:
+
+  using SearchDebug = internal::planning::SearchDebug;
+
+  /// Produce a plan while collecting information about the search that was
+  /// performed to find it.
+  static rmf_utils::optional<Plan> plan(
+      const Planner& planner,
+      const StartSet& starts,
+      Goal goal,
+      Options options,
+      SearchDebug& debug);
+
+};
+
+} // namespace agv
+} // namespace rmf_traffic
+
+#endif // SRC__RMF_TRAFFIC__AGV__DEBUG_PLANNER_HPP
@@ -20,14 +20,22 @@
 #include "internal_planning.hpp"
 #include "GraphInternal.hpp"
 
+#include "../DetectConflictInternal.hpp"
+#include "../ThreadPoolInternal.hpp"
+
 #include <rmf_utils/math.hpp>
 
 #include <rmf_traffic/Conflict.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 #include <queue>
+#include <type_traits>
 
 namespace rmf_traffic {
 namespace internal {
@@ -48,6 +56,310 @@ struct Compare
   }
 };
 
+//==============================================================================
+/// A monotonic arena that provides the memory for the nodes of a single search.
+/// Individual allocations are never freed. Instead the whole arena is released
+/// once the last node that was allocated from it has been destroyed.
+class SearchArena
+{
+public:
+
+  void* allocate(const std::size_t bytes, const std::size_t alignment)
+  {
+    void* ptr = _next;
+    std::size_t space = _remaining;
+    if(!std::align(alignment, bytes, ptr, space))
+    {
+      const std::size_t size = std::max(BlockSize, bytes + alignment);
+      _blocks.emplace_back(new char[size]);
+      ptr = _blocks.back().get();
+      space = size;
+      std::align(alignment, bytes, ptr, space);
+    }
+
+    _next = static_cast<char*>(ptr) + bytes;
+    _remaining = space - bytes;
+    return ptr;
+  }
+
+  /// Get a reference to a copy of the map name that will remain valid for as
+  /// long as this arena exists.
+  const std::string& map_name(const std::string& name)
+  {
+    if(_last_map_name && *_last_map_name == name)
+      return *_last_map_name;
+
+    _last_map_name = &*_map_names.insert(name).first;
+    return *_last_map_name;
+  }
+
+private:
+  static constexpr std::size_t BlockSize = 64*1024;
+  std::vector<std::unique_ptr<char[]>> _blocks;
+  void* _next = nullptr;
+  std::size_t _remaining = 0;
+
+  std::unordered_set<std::string> _map_names;
+  const std::string* _last_map_name = nullptr;
+};
+
+//==============================================================================
+constexpr std::size_t SearchArena::BlockSize;
+
+//==============================================================================
+template<typename T>
+class ArenaAllocator
+{
+public:
+
+  using value_type = T;
+
+  ArenaAllocator(std::shared_ptr<SearchArena> arena)
+  : _arena(std::move(arena))
+  {
+    // Do nothing
+  }
+
+  template<typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other)
+  : _arena(other.arena())
+  {
+    // Do nothing
+  }
+
+  T* allocate(const std::size_t n)
+  {
+    return static_cast<T*>(_arena->allocate(n*sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T*, std::size_t)
+  {
+    // Do nothing. The memory will be released along with the arena.
+  }
+
+  const std::shared_ptr<SearchArena>& arena() const
+  {
+    return _arena;
+  }
+
+  template<typename U>
+  bool operator==(const ArenaAllocator<U>& other) const
+  {
+    return _arena == other.arena();
+  }
+
+  template<typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const
+  {
+    return _arena != other.arena();
+  }
+
+private:
+  std::shared_ptr<SearchArena> _arena;
+};
+
+//==============================================================================
+template<typename Node, typename... Args>
+std::shared_ptr<Node> make_node(
+    const std::shared_ptr<SearchArena>& arena,
+    Args&&... args)
+{
+  return std::allocate_shared<Node>(
+        ArenaAllocator<Node>(arena), Node{std::forward<Args>(args)...});
+}
+
+//==============================================================================
+struct Knot
+{
+  Time time;
+  Eigen::Vector3d position;
+  Eigen::Vector3d velocity;
+};
+
+static_assert(std::is_trivially_destructible<Knot>::value,
+              "Knots are placed in a SearchArena, which never destroys them");
+
+//==============================================================================
+/// The motion that leads from the parent of a search node to the node. Search
+/// nodes only need the final knot of their motion in order to be expanded, so
+/// the knots are kept compactly in the search arena, and Trajectory objects are
+/// only rebuilt for the solution that the search finds.
+class Route
+{
+public:
+
+  static Route make(SearchArena& arena, const Trajectory& trajectory)
+  {
+    assert(trajectory.size() > 0);
+
+    Route route;
+    route._map_name = &arena.map_name(trajectory.get_map_name());
+    route._size = trajectory.size();
+
+    Knot* const knots = static_cast<Knot*>(
+          arena.allocate(sizeof(Knot)*route._size, alignof(Knot)));
+
+    Knot* knot = knots;
+    for(const auto& segment : trajectory)
+    {
+      new (knot++) Knot{
+        segment.get_finish_time(),
+        segment.get_finish_position(),
+        segment.get_finish_velocity()
+      };
+    }
+
+    route._knots = knots;
+    return route;
+  }
+
+  const std::string& get_map_name() const
+  {
+    return *_map_name;
+  }
+
+  const Knot* begin() const
+  {
+    return _knots;
+  }
+
+  const Knot* end() const
+  {
+    return _knots + _size;
+  }
+
+  const Knot& back() const
+  {
+    return _knots[_size-1];
+  }
+
+  Time finish_time() const
+  {
+    return back().time;
+  }
+
+private:
+  const std::string* _map_name = nullptr;
+  const Knot* _knots = nullptr;
+  std::size_t _size = 0;
+};
+
+//==============================================================================
+/// The schedule entries that a single plan needs to avoid. The schedule is
+/// queried once when the plan begins, and the bounds of every relevant
+/// trajectory are computed up front, so that each candidate motion of the
+/// search only needs to be compared against cached bounding boxes.
+///
+/// The snapshot refers to trajectories that are owned by the schedule, so the
+/// schedule must not be modified while the snapshot is in use. The snapshot
+/// also holds the collision checking context of its search, so it must only be
+/// used by one thread at a time.
+class ScheduleSnapshot
+{
+public:
+
+  ScheduleSnapshot(
+      const schedule::Viewer& viewer,
+      const std::vector<agv::Planner::Start>& starts,
+      const agv::Graph::Implementation& graph,
+      const std::unordered_set<schedule::Version>& ignore_schedule_ids)
+  {
+    assert(!starts.empty());
+
+    // TODO(MXG): When we start generating plans across multiple maps, we should
+    // include every map that the plan might pass through.
+    std::vector<std::string> maps;
+    Time earliest_time = starts.front().time();
+    for(const auto& start : starts)
+    {
+      const std::string& map_name =
+          graph.waypoints[start.waypoint()].get_map_name();
+      if(std::find(maps.begin(), maps.end(), map_name) == maps.end())
+        maps.push_back(map_name);
+
+      earliest_time = std::min(earliest_time, start.time());
+    }
+
+    // Nothing in the plan can happen before its earliest start time, so there
+    // is no need to look at any trajectories that finish before then.
+    const auto view = viewer.query(
+          schedule::make_query(std::move(maps), &earliest_time, nullptr));
+
+    for(const auto& element : view)
+    {
+      if(ignore_schedule_ids.count(element.id) > 0)
+        continue;
+
+      assert(element.trajectory.size() > 1);
+      _entries[element.trajectory.get_map_name()].push_back(
+            Entry{&element.trajectory, get_bounds(element.trajectory)});
+    }
+
+    for(auto& map_entries : _entries)
+    {
+      std::sort(map_entries.second.begin(), map_entries.second.end(),
+                [](const Entry& a, const Entry& b)
+      {
+        return a.bounds->start_time < b.bounds->start_time;
+      });
+    }
+  }
+
+  /// Returns true if the trajectory does not conflict with anything in the
+  /// snapshot.
+  bool is_valid(const Trajectory& trajectory) const
+  {
+    assert(trajectory.size() > 1);
+    const auto map_it = _entries.find(trajectory.get_map_name());
+    if(map_it == _entries.end())
+      return true;
+
+    const std::vector<Entry>& entries = map_it->second;
+    const Time finish_time = *trajectory.finish_time();
+
+    // Only the entries that start before the trajectory finishes can conflict
+    // with it.
+    const auto end = std::upper_bound(
+          entries.begin(), entries.end(), finish_time,
+          [](const Time t, const Entry& entry)
+    {
+      return t < entry.bounds->start_time;
+    });
+
+    if(entries.begin() == end)
+      return true;
+
+    // The bounds get cached in the trajectory, so narrow_phase() will reuse
+    // them along with the bounds of the entries.
+    const ConstTrajectoryBoundsPtr bounds = get_bounds(trajectory);
+    for(auto it = entries.begin(); it != end; ++it)
+    {
+      if(!broad_phase(*bounds, *it->bounds))
+        continue;
+
+      if(!DetectConflict::narrow_phase(
+           trajectory, *it->trajectory, true, &_context).empty())
+        return false;
+    }
+
+    return true;
+  }
+
+private:
+
+  struct Entry
+  {
+    const Trajectory* trajectory;
+    ConstTrajectoryBoundsPtr bounds;
+  };
+
+  // Entries for each map, sorted by their start times
+  std::unordered_map<std::string, std::vector<Entry>> _entries;
+
+  // Reused by every collision check of the search
+  mutable DetectConflict::Context _context;
+};
+
 //==============================================================================
 Cache::Cache(const Cache&)
 {
@@ -74,6 +386,69 @@ Cache& Cache::operator=(Cache&&)
   return *this;
 }
 
+//==============================================================================
+SearchCutoff::SearchCutoff(const bool prune_dominated)
+  : _prune_dominated(prune_dominated),
+    _cancelled(false),
+    _finish_time(Time::max().time_since_epoch().count()),
+    _deadline(Time::max().time_since_epoch().count())
+{
+  // Do nothing
+}
+
+//==============================================================================
+void SearchCutoff::cancel()
+{
+  _cancelled = true;
+}
+
+//==============================================================================
+bool SearchCutoff::cancelled() const
+{
+  if(_cancelled)
+    return true;
+
+  const Duration::rep deadline = _deadline;
+  if(deadline == Time::max().time_since_epoch().count())
+    return false;
+
+  return deadline <= std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+//==============================================================================
+void SearchCutoff::offer(const Time finish_time)
+{
+  if(!_prune_dominated)
+    return;
+
+  const Duration::rep t = finish_time.time_since_epoch().count();
+  Duration::rep current = _finish_time;
+  while(t < current && !_finish_time.compare_exchange_weak(current, t))
+  {
+    // Keep trying until either we have lowered the finish time or another
+    // search has offered an even lower one.
+  }
+}
+
+//==============================================================================
+bool SearchCutoff::dominates(const Time finish_time) const
+{
+  return _finish_time <= finish_time.time_since_epoch().count();
+}
+
+//==============================================================================
+void SearchCutoff::set_deadline(const Time deadline)
+{
+  _deadline = deadline.time_since_epoch().count();
+}
+
+//==============================================================================
+ThreadPool& planning_pool()
+{
+  static ThreadPool pool;
+  return pool;
+}
+
 //==============================================================================
 CacheHandle::CacheHandle(CachePtr original)
   : _original(std::move(original))
@@ -86,9 +461,10 @@ CacheHandle::CacheHandle(CachePtr original)
 rmf_utils::optional<Result> CacheHandle::plan(
     const std::vector<agv::Planner::Start>& starts,
     agv::Planner::Goal goal,
-    agv::Planner::Options options)
+    agv::Planner::Options options,
+    const SearchParams& params)
 {
-  return _copy->plan(starts, std::move(goal), std::move(options));
+  return _copy->plan(starts, std::move(goal), std::move(options), params);
 }
 
 //==============================================================================
@@ -128,7 +504,8 @@ template<
 NodePtr search(
     Context&& context,
     InitialNodeArgs&& initial_node_args,
-    const bool* interrupt_flag)
+    const bool* interrupt_flag,
+    SearchDebug* debug = nullptr)
 {
   using SearchQueue = typename Expander::SearchQueue;
 
@@ -137,14 +514,41 @@ NodePtr search(
   SearchQueue queue;
   expander.make_initial_nodes(initial_node_args, queue);
 
-  while(!queue.empty() && !(interrupt_flag && *interrupt_flag))
+  while(!queue.empty() && !(interrupt_flag && *interrupt_flag)
+        && !expander.is_cancelled())
   {
     NodePtr top = queue.top();
     queue.pop();
 
+    // There is no point in expanding or returning a node that cannot beat a
+    // plan which was already found by another search.
+    if(expander.is_dominated(top))
+    {
+      // When the queue is sorted by an admissible estimate, the top of the
+      // queue has the lowest bound, so nothing else in the queue can beat that
+      // plan either.
+      if(expander.is_admissible())
+        return nullptr;
+
+      continue;
+    }
+
     if(expander.is_finished(top))
       return top;
 
+    // If an equivalent search state has already been expanded with an equal or
+    // lower cost, then expanding this node cannot produce anything better.
+    if((!debug || debug->prune_duplicates) && !expander.add_to_closed_set(top))
+    {
+      if(debug)
+        ++debug->pruned_nodes;
+
+      continue;
+    }
+
+    if(debug)
+      ++debug->expanded_nodes;
+
     expander.expand(top, queue);
   }
 
@@ -153,7 +557,9 @@ NodePtr search(
 
 //==============================================================================
 template<typename NodePtr>
-std::vector<Trajectory> reconstruct_trajectories(const NodePtr& finish_node)
+std::vector<Trajectory> reconstruct_trajectories(
+    const NodePtr& finish_node,
+    const Trajectory::ConstProfilePtr& profile)
 {
   NodePtr node = finish_node;
   std::vector<NodePtr> node_sequence;
@@ -164,27 +570,24 @@ std::vector<Trajectory> reconstruct_trajectories(const NodePtr& finish_node)
   }
 
   std::vector<Trajectory> trajectories;
-  trajectories.push_back(
-        Trajectory{
-          node_sequence.back()->trajectory_from_parent.get_map_name()
-        });
+  std::string map_name = node_sequence.back()->route_from_parent.get_map_name();
+  trajectories.push_back(Trajectory{map_name});
 
   // We exclude the first node in the sequence, because it contains a dummy
   // trajectory which is not helpful.
   const auto stop_it = node_sequence.rend();
   for (auto it = ++node_sequence.rbegin(); it != stop_it; ++it)
   {
-    Trajectory& last_trajectory = trajectories.back();
-    const Trajectory& next_trajectory = (*it)->trajectory_from_parent;
-    if(next_trajectory.get_map_name() == last_trajectory.get_map_name())
-    {
-      for(const auto& segment : next_trajectory)
-        last_trajectory.insert(segment);
-    }
-    else
+    const Route& next_route = (*it)->route_from_parent;
+    if(next_route.get_map_name() != map_name)
     {
-      trajectories.push_back(next_trajectory);
+      map_name = next_route.get_map_name();
+      trajectories.push_back(Trajectory{map_name});
     }
+
+    Trajectory& trajectory = trajectories.back();
+    for(const Knot& knot : next_route)
+      trajectory.insert(knot.time, profile, knot.position, knot.velocity);
   }
 
   return trajectories;
@@ -210,9 +613,8 @@ std::vector<agv::Plan::Waypoint> reconstruct_waypoints(
     const auto& n = *it;
     const Eigen::Vector2d p = n->waypoint?
           graph.waypoints[*n->waypoint].get_location() :
-          n->trajectory_from_parent.back().get_finish_position()
-            .template block<2,1>(0,0);
-    const Time time{*n->trajectory_from_parent.finish_time()};
+          n->route_from_parent.back().position.template block<2,1>(0,0);
+    const Time time{n->route_from_parent.finish_time()};
     waypoints.emplace_back(
           agv::Plan::Waypoint::Implementation::make(
             Eigen::Vector3d{p[0], p[1], n->orientation}, time,
@@ -286,14 +688,13 @@ struct EuclideanExpander
     const Eigen::Vector2d location =
         context.graph.waypoints[args.waypoint].get_location();
 
-    queue.emplace(std::make_shared<Node>(
-          Node{
-            args.waypoint,
-            estimate_remaining_cost(location),
-            0.0,
-            location,
-            nullptr
-          }));
+    queue.push(make_node<Node>(
+                 arena,
+                 args.waypoint,
+                 estimate_remaining_cost(location),
+                 0.0,
+                 location,
+                 nullptr));
   }
 
   bool is_finished(const NodePtr& node)
@@ -301,6 +702,29 @@ struct EuclideanExpander
     return node->waypoint == context.final_waypoint;
   }
 
+  bool is_cancelled() const
+  {
+    // This search is only used for heuristics, so it never gets cut off
+    return false;
+  }
+
+  bool is_dominated(const NodePtr&) const
+  {
+    return false;
+  }
+
+  bool is_admissible() const
+  {
+    return true;
+  }
+
+  bool add_to_closed_set(const NodePtr& node)
+  {
+    // The cost of this search does not depend on time, so the first visit to
+    // each waypoint is always the cheapest.
+    return expanded.insert(node->waypoint).second;
+  }
+
   static double lane_event_cost(const agv::Graph::Lane& lane)
   {
     double cost = 0.0;
@@ -337,21 +761,18 @@ struct EuclideanExpander
         + lane_event_cost(lane)
         + (p_exit - p_start).norm();
 
-    queue.push(std::make_shared<Node>(
-                 Node{
-                   exit_waypoint_index,
-                   estimate_remaining_cost(p_exit),
-                   cost,
-                   p_exit,
-                   parent_node
-                 }));
+    queue.push(make_node<Node>(
+                 arena,
+                 exit_waypoint_index,
+                 estimate_remaining_cost(p_exit),
+                 cost,
+                 p_exit,
+                 parent_node));
   }
 
   void expand(const NodePtr& parent_node, SearchQueue& queue)
   {
     const std::size_t parent_waypoint = parent_node->waypoint;
-    expanded.insert(parent_waypoint);
-
     const std::vector<std::size_t>& lanes =
         context.graph.lanes_from[parent_waypoint];
 
@@ -363,6 +784,7 @@ private:
   const Context& context;
   Eigen::Vector2d p_final;
   std::unordered_set<std::size_t> expanded;
+  std::shared_ptr<SearchArena> arena = std::make_shared<SearchArena>();
 };
 
 //==============================================================================
@@ -371,6 +793,15 @@ Eigen::Vector3d to_3d(const Eigen::Vector2d& p, const double w)
   return Eigen::Vector3d(p[0], p[1], w);
 }
 
+//==============================================================================
+void insert_knot(
+    Trajectory& trajectory,
+    const Trajectory::ConstProfilePtr& profile,
+    const Knot& knot)
+{
+  trajectory.insert(knot.time, profile, knot.position, knot.velocity);
+}
+
 //==============================================================================
 template<typename NodePtrT>
 double compute_current_cost(
@@ -442,7 +873,7 @@ struct DifferentialDriveExpander
     double current_cost;
     rmf_utils::optional<std::size_t> waypoint;
     double orientation;
-    Trajectory trajectory_from_parent;
+    Route route_from_parent;
     agv::Graph::Lane::EventPtr event;
     NodePtr parent;
     rmf_utils::optional<std::size_t> start_set_index = rmf_utils::nullopt;
@@ -537,14 +968,30 @@ struct DifferentialDriveExpander
     const agv::Planner::StartSet& starts;
   };
 
+  // A complete table of the cost estimates from every waypoint in the graph
+  // to one goal. Waypoints that cannot reach the goal have an infinite cost.
+  using HeuristicTable = std::vector<double>;
+  using ConstHeuristicTablePtr = std::shared_ptr<const HeuristicTable>;
+
   class Heuristic
   {
   public:
 
+    Heuristic() = default;
+
+    Heuristic(ConstHeuristicTablePtr table)
+    : precomputed(std::move(table))
+    {
+      // Do nothing
+    }
+
     double estimate_remaining_cost(
         const Context& context,
         const std::size_t waypoint)
     {
+      if(precomputed)
+        return (*precomputed)[waypoint];
+
       auto estimate_it = known_costs.insert(
           {waypoint, std::numeric_limits<double>::infinity()});
 
@@ -594,12 +1041,19 @@ struct DifferentialDriveExpander
 
     void update(const Heuristic& other)
     {
+      if(!precomputed)
+        precomputed = other.precomputed;
+
       for(const auto& wp_costs : other.known_costs)
         known_costs.insert(wp_costs);
     }
 
   private:
     std::unordered_map<std::size_t, double> known_costs;
+
+    // The tables are immutable once they are built, so every copy of a
+    // Heuristic can share them without any synchronization.
+    ConstHeuristicTablePtr precomputed;
   };
 
   struct Context
@@ -609,18 +1063,19 @@ struct DifferentialDriveExpander
     const Trajectory::ConstProfilePtr& profile;
     const Duration holding_time;
     const agv::Interpolate::Options::Implementation& interpolate;
-    const schedule::Viewer& viewer;
+    const ScheduleSnapshot& schedule;
     const std::size_t final_waypoint;
     const double* const final_orientation;
     const rmf_traffic::Time initial_time;
+    const rmf_traffic::Time earliest_start_time;
     const bool* const interrupt_flag;
-    const std::unordered_set<schedule::Version> ignore_schedule_ids;
+    SearchCutoff* const cutoff;
+    const double heuristic_weight;
     Heuristic& heuristic;
   };
 
   DifferentialDriveExpander(Context& context)
   : _context(context),
-    _query(schedule::make_query({}, nullptr, nullptr)),
     _differential_constraint(
       _context.traits.get_differential()->get_forward(),
       _context.traits.get_differential()->is_reversible())
@@ -638,15 +1093,12 @@ struct DifferentialDriveExpander
       const std::size_t initial_waypoint = start.waypoint();
 
       const double cost_estimate =
-          _context.heuristic.estimate_remaining_cost(
-            _context, initial_waypoint);
+          estimate_remaining_cost(initial_waypoint);
 
       const double initial_orientation = start.orientation();
       const std::string& map_name =
           _context.graph.waypoints[initial_waypoint].get_map_name();
 
-      _query.spacetime().timespan()->add_map(map_name);
-
       const auto initial_time = start.time();
 
       const Eigen::Vector2d wp_location =
@@ -665,17 +1117,16 @@ struct DifferentialDriveExpander
               initial_position,
               Eigen::Vector3d::Zero());
 
-        const auto initial_node = std::make_shared<Node>(
-              Node{
-                std::numeric_limits<double>::infinity(),
-                0.0,
-                rmf_utils::nullopt,
-                initial_orientation,
-                initial_trajectory,
-                nullptr,
-                nullptr,
-                start_index
-              });
+        const auto initial_node = make_node<Node>(
+              _arena,
+              std::numeric_limits<double>::infinity(),
+              0.0,
+              rmf_utils::nullopt,
+              initial_orientation,
+              make_route(initial_trajectory),
+              nullptr,
+              nullptr,
+              start_index);
 
         const Eigen::Vector2d course =
             (wp_location - *initial_location).normalized();
@@ -743,21 +1194,22 @@ struct DifferentialDriveExpander
             const double rotation_cost =
                 rmf_traffic::time::to_seconds(rotation_trajectory.duration());
 
-            rotated_initial_node = std::make_shared<Node>(
-                  Node{
-                    std::numeric_limits<double>::infinity(),
-                    rotation_cost,
-                    rmf_utils::nullopt,
-                    orientation,
-                    std::move(rotation_trajectory),
-                    nullptr,
-                    initial_node
-                  });
+            rotated_initial_node = make_node<Node>(
+                  _arena,
+                  std::numeric_limits<double>::infinity(),
+                  rotation_cost,
+                  rmf_utils::nullopt,
+                  orientation,
+                  make_route(rotation_trajectory),
+                  nullptr,
+                  initial_node);
           }
 
           Trajectory approach_trajectory{map_name};
-          approach_trajectory.insert(
-                rotated_initial_node->trajectory_from_parent.back());
+          insert_knot(
+                approach_trajectory,
+                _context.profile,
+                rotated_initial_node->route_from_parent.back());
 
           agv::internal::interpolate_translation(
                 approach_trajectory,
@@ -780,16 +1232,15 @@ struct DifferentialDriveExpander
               rmf_traffic::time::to_seconds(approach_trajectory.duration())
               + rotated_initial_node->current_cost;
 
-          queue.push(std::make_shared<Node>(
-                       Node{
-                         cost_estimate,
-                         current_cost,
-                         initial_waypoint,
-                         orientation,
-                         std::move(approach_trajectory),
-                         nullptr,
-                         rotated_initial_node
-                       }));
+          queue.push(make_node<Node>(
+                       _arena,
+                       cost_estimate,
+                       current_cost,
+                       initial_waypoint,
+                       orientation,
+                       make_route(approach_trajectory),
+                       nullptr,
+                       rotated_initial_node));
         }
       }
       else
@@ -801,17 +1252,16 @@ struct DifferentialDriveExpander
               to_3d(wp_location, initial_orientation),
               Eigen::Vector3d::Zero());
 
-        queue.push(std::make_shared<Node>(
-                     Node{
-                       cost_estimate,
-                       0.0,
-                       initial_waypoint,
-                       initial_orientation,
-                       std::move(initial_trajectory),
-                       nullptr,
-                       nullptr,
-                       start_index
-                     }));
+        queue.push(make_node<Node>(
+                     _arena,
+                     cost_estimate,
+                     0.0,
+                     initial_waypoint,
+                     initial_orientation,
+                     make_route(initial_trajectory),
+                     nullptr,
+                     nullptr,
+                     start_index));
       }
     }
   }
@@ -831,57 +1281,80 @@ struct DifferentialDriveExpander
     return true;
   }
 
-  bool is_valid(const Trajectory& trajectory)
+  bool is_cancelled() const
   {
-    assert(trajectory.size() > 1);
-    _query.spacetime().timespan()->set_lower_time_bound(
-          *trajectory.start_time());
-    _query.spacetime().timespan()->set_upper_time_bound(
-          *trajectory.finish_time());
+    return _context.cutoff && _context.cutoff->cancelled();
+  }
 
-    // TODO(MXG): When we start generating plans across multiple maps, we should
-    // account for the trajectory's map name(s) here.
-    const auto view = _context.viewer.query(_query);
+  bool is_dominated(const NodePtr& node) const
+  {
+    if(!_context.cutoff)
+      return false;
 
-    const auto& ignore_schedule_ids = _context.ignore_schedule_ids;
-    if (ignore_schedule_ids.empty())
-    {
-      for (const auto& check : view)
-      {
-        assert(trajectory.size() > 1);
-        assert(check.trajectory.size() > 1);
-        if(!DetectConflict::between(trajectory, check.trajectory, true).empty())
-          return false;
-      }
-    }
-    else
-    {
-      for (const auto& check : view)
-      {
-        assert(trajectory.size() > 1);
-        assert(check.trajectory.size() > 1);
-        if (ignore_schedule_ids.count(check.id) > 0)
-          continue;
+    // The cost of a node is measured from the time of the start that it came
+    // from, so the earliest start time gives a bound that is valid for every
+    // node in the search. The weight needs to be removed from the estimate to
+    // make the bound admissible.
+    const double cost_bound = node->current_cost
+        + node->remaining_cost_estimate/_context.heuristic_weight;
+    if(!std::isfinite(cost_bound))
+      return false;
 
-        if(!DetectConflict::between(trajectory, check.trajectory, true).empty())
-          return false;
-      }
-    }
+    return _context.cutoff->dominates(
+          time::apply_offset(_context.earliest_start_time, cost_bound));
+  }
+
+  bool is_admissible() const
+  {
+    return _context.heuristic_weight <= 1.0;
+  }
+
+  double estimate_remaining_cost(const std::size_t waypoint)
+  {
+    return _context.heuristic_weight
+        * _context.heuristic.estimate_remaining_cost(_context, waypoint);
+  }
+
+  bool add_to_closed_set(const NodePtr& node)
+  {
+    const double orientation = rmf_utils::wrap_to_pi(node->orientation);
+    const Time arrival_time = node->route_from_parent.finish_time();
 
+    const ClosedKey key{
+      *node->waypoint,
+      std::lround(orientation/OrientationResolution),
+      (arrival_time.time_since_epoch() + TimeResolution/2)/TimeResolution
+    };
+
+    const auto insertion = _closed_set.insert({key, node->current_cost});
+    if(insertion.second)
+      return true;
+
+    // Two nodes with the same key have the same heuristic estimate and the same
+    // opportunities for expansion, so the cheaper one dominates.
+    double& best_cost = insertion.first->second;
+    if(best_cost <= node->current_cost)
+      return false;
+
+    best_cost = node->current_cost;
     return true;
   }
 
+  bool is_valid(const Trajectory& trajectory) const
+  {
+    return _context.schedule.is_valid(trajectory);
+  }
+
   NodePtr expand_rotation(
       const NodePtr& parent_node,
       const double target_orientation)
   {
     const std::size_t waypoint = *parent_node->waypoint;
     Trajectory trajectory{_context.graph.waypoints[waypoint].get_map_name()};
-    const Trajectory::Segment& last =
-        parent_node->trajectory_from_parent.back();
+    const Knot& last = parent_node->route_from_parent.back();
 
-    const Eigen::Vector3d& p = last.get_finish_position();
-    trajectory.insert(last);
+    const Eigen::Vector3d& p = last.position;
+    insert_knot(trajectory, _context.profile, last);
 
     // TODO(MXG): Consider storing these traits as POD member fields of the
     // context to reduce the dereferencing cost here.
@@ -890,7 +1363,7 @@ struct DifferentialDriveExpander
           trajectory,
           rotational.get_nominal_velocity(),
           rotational.get_nominal_acceleration(),
-          last.get_finish_time(),
+          last.time,
           p,
           Eigen::Vector3d(p[0], p[1], target_orientation),
           _context.profile,
@@ -898,16 +1371,15 @@ struct DifferentialDriveExpander
 
     if(is_valid(trajectory))
     {
-      return std::make_shared<Node>(
-            Node{
-              _context.heuristic.estimate_remaining_cost(_context, waypoint),
-              compute_current_cost(parent_node, trajectory),
-              waypoint,
-              target_orientation,
-              std::move(trajectory),
-              nullptr,
-              parent_node
-            });
+      return make_node<Node>(
+            _arena,
+            estimate_remaining_cost(waypoint),
+            compute_current_cost(parent_node, trajectory),
+            waypoint,
+            target_orientation,
+            make_route(trajectory),
+            nullptr,
+            parent_node);
     }
 
     return nullptr;
@@ -991,16 +1463,15 @@ struct DifferentialDriveExpander
     assert(trajectory.size() > 1);
     if(is_valid(trajectory))
     {
-      return std::make_shared<Node>(
-            Node{
-              _context.heuristic.estimate_remaining_cost(_context, waypoint),
-              compute_current_cost(parent_node, trajectory),
-              waypoint,
-              orientation,
-              std::move(trajectory),
-              std::move(event),
-              parent_node
-            });
+      return make_node<Node>(
+            _arena,
+            estimate_remaining_cost(waypoint),
+            compute_current_cost(parent_node, trajectory),
+            waypoint,
+            orientation,
+            make_route(trajectory),
+            std::move(event),
+            parent_node);
     }
 
     return nullptr;
@@ -1066,11 +1537,10 @@ struct DifferentialDriveExpander
     const std::string map_name =
         _context.graph.waypoints[initial_waypoint].get_map_name();
 
-    const Trajectory::Segment& initial_seg =
-        initial_parent->trajectory_from_parent.back();
+    const Knot& initial_knot = initial_parent->route_from_parent.back();
 
-    const Time initial_time = initial_seg.get_finish_time();
-    const Eigen::Vector3d initial_position = initial_seg.get_finish_position();
+    const Time initial_time = initial_knot.time;
+    const Eigen::Vector3d initial_position = initial_knot.position;
 
     std::vector<LaneExpansionNode> lane_expansion_queue;
     lane_expansion_queue.push_back({initial_lane_index});
@@ -1091,7 +1561,7 @@ struct DifferentialDriveExpander
       // TODO(MXG): Figure out what to do if the trajectory spans across
       // multiple maps.
       Trajectory trajectory{map_name};
-      trajectory.insert(initial_seg);
+      insert_knot(trajectory, _context.profile, initial_knot);
       agv::internal::interpolate_translation(
             trajectory,
             _context.traits.linear().get_nominal_velocity(),
@@ -1107,17 +1577,15 @@ struct DifferentialDriveExpander
         if(!is_valid(trajectory))
           continue;
 
-        auto parent_to_event = std::make_shared<Node>(
-              Node{
-                _context.heuristic.estimate_remaining_cost(
-                    _context, exit_waypoint_index),
-                compute_current_cost(initial_parent, trajectory),
-                exit_waypoint_index,
-                orientation,
-                std::move(trajectory),
-                nullptr,
-                initial_parent
-              });
+        auto parent_to_event = make_node<Node>(
+              _arena,
+              estimate_remaining_cost(exit_waypoint_index),
+              compute_current_cost(initial_parent, trajectory),
+              exit_waypoint_index,
+              orientation,
+              make_route(trajectory),
+              nullptr,
+              initial_parent);
 
         event->execute(_executor.update(parent_to_event))
             .add_if_valid(this, queue);
@@ -1199,14 +1667,13 @@ struct DifferentialDriveExpander
       const Duration delay,
       agv::Graph::Lane::EventPtr event = nullptr)
   {
-    const Trajectory& parent_trajectory = parent_node->trajectory_from_parent;
-    const auto& initial_segment = parent_trajectory.back();
+    const Knot& initial_knot = parent_node->route_from_parent.back();
 
     Trajectory trajectory{_context.graph.waypoints[waypoint].get_map_name()};
 
-    const Time initial_time = initial_segment.get_finish_time();
-    const Eigen::Vector3d& initial_pos = initial_segment.get_finish_position();
-    trajectory.insert(initial_segment);
+    const Time initial_time = initial_knot.time;
+    const Eigen::Vector3d& initial_pos = initial_knot.position;
+    insert_knot(trajectory, _context.profile, initial_knot);
 
     trajectory.insert(
           initial_time + delay,
@@ -1291,14 +1758,208 @@ struct DifferentialDriveExpander
 
 private:
 
+  // Nodes that arrive at the same waypoint with the same orientation at the
+  // same time are equivalent search states. Arrival times and orientations are
+  // discretized so that different sequences of the same motions (e.g. holding
+  // before or after moving down a lane) are recognized as equivalent in spite
+  // of floating point error.
+  static constexpr double OrientationResolution = 1e-3;
+  static constexpr Duration TimeResolution = std::chrono::milliseconds(1);
+
+  struct ClosedKey
+  {
+    std::size_t waypoint;
+    long orientation;
+    Duration::rep time;
+
+    bool operator==(const ClosedKey& other) const
+    {
+      return waypoint == other.waypoint
+          && orientation == other.orientation
+          && time == other.time;
+    }
+  };
+
+  struct ClosedKeyHash
+  {
+    std::size_t operator()(const ClosedKey& key) const
+    {
+      std::size_t seed = std::hash<std::size_t>()(key.waypoint);
+      for(const std::size_t v : {
+          std::hash<long>()(key.orientation),
+          std::hash<Duration::rep>()(key.time)})
+      {
+        seed ^= v + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+      }
+
+      return seed;
+    }
+  };
+
+  Route make_route(const Trajectory& trajectory)
+  {
+    return Route::make(*_arena, trajectory);
+  }
+
   Context& _context;
-  schedule::Query _query;
   DifferentialDriveConstraint _differential_constraint;
   LaneEventExecutor _executor;
+  std::unordered_map<ClosedKey, double, ClosedKeyHash> _closed_set;
+  std::shared_ptr<SearchArena> _arena = std::make_shared<SearchArena>();
 };
 
+//==============================================================================
+constexpr double DifferentialDriveExpander::OrientationResolution;
+constexpr Duration DifferentialDriveExpander::TimeResolution;
+
 //==============================================================================
 namespace {
+
+using HeuristicTable = DifferentialDriveExpander::HeuristicTable;
+using ConstHeuristicTablePtr = std::shared_ptr<const HeuristicTable>;
+using HeuristicTables = std::unordered_map<std::size_t, ConstHeuristicTablePtr>;
+
+//==============================================================================
+/// Run the function on every index from 0 to N-1, spread across the planning
+/// pool. Each index is visited exactly once.
+template<typename F>
+void parallel_for(const std::size_t N, const F& function)
+{
+  ThreadPool::Implementation::for_each(&planning_pool(), N, function);
+}
+
+//==============================================================================
+/// Build a complete heuristic table for each of the goals. Each table holds the
+/// same estimates that DifferentialDriveExpander::Heuristic would lazily find
+/// for its goal: the duration of an interpolated trajectory along the shortest
+/// path through the graph, ignoring rotations and the schedule.
+HeuristicTables compute_heuristic_tables(
+    const agv::Graph::Implementation& graph,
+    const agv::VehicleTraits& traits,
+    const std::vector<std::size_t>& requested_goals)
+{
+  const std::size_t N = graph.waypoints.size();
+
+  std::vector<std::size_t> goals;
+  for(const std::size_t goal : requested_goals)
+  {
+    if(goal < N && std::find(goals.begin(), goals.end(), goal) == goals.end())
+      goals.push_back(goal);
+  }
+
+  if(goals.empty())
+    return {};
+
+  // A map from a waypoint index to the set of lanes that can enter it, so that
+  // we can search backwards from each goal
+  std::vector<std::vector<std::size_t>> lanes_into(N);
+  for(std::size_t l=0; l < graph.lanes.size(); ++l)
+    lanes_into[graph.lanes[l].exit().waypoint_index()].push_back(l);
+
+  // For each goal, run a reverse Dijkstra search that finds the next waypoint
+  // along the shortest path from every other waypoint towards the goal.
+  const std::size_t NoWaypoint = std::numeric_limits<std::size_t>::max();
+  std::vector<std::vector<std::size_t>> next_waypoints(goals.size());
+  parallel_for(goals.size(), [&](const std::size_t g)
+  {
+    using Entry = std::pair<double, std::size_t>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+    std::vector<double> costs(N, std::numeric_limits<double>::infinity());
+    std::vector<std::size_t>& next = next_waypoints[g];
+    next.resize(N, NoWaypoint);
+
+    const std::size_t goal = goals[g];
+    costs[goal] = 0.0;
+    next[goal] = goal;
+    queue.push({0.0, goal});
+    while(!queue.empty())
+    {
+      const Entry top = queue.top();
+      queue.pop();
+
+      const std::size_t exit_wp = top.second;
+      if(costs[exit_wp] < top.first)
+        continue;
+
+      const Eigen::Vector2d p_exit = graph.waypoints[exit_wp].get_location();
+      for(const std::size_t l : lanes_into[exit_wp])
+      {
+        const agv::Graph::Lane& lane = graph.lanes[l];
+        const std::size_t entry_wp = lane.entry().waypoint_index();
+        const Eigen::Vector2d p_entry =
+            graph.waypoints[entry_wp].get_location();
+
+        const double cost = top.first
+            + EuclideanExpander::lane_event_cost(lane)
+            + (p_exit - p_entry).norm();
+
+        if(cost < costs[entry_wp])
+        {
+          costs[entry_wp] = cost;
+          next[entry_wp] = exit_wp;
+          queue.push({cost, entry_wp});
+        }
+      }
+    }
+  });
+
+  // Interpolating the path from each waypoint is where most of the time goes,
+  // so we spread the waypoints of every goal across the threads in chunks.
+  const std::size_t ChunkSize = 64;
+  const std::size_t chunks_per_goal = (N + ChunkSize - 1)/ChunkSize;
+  std::vector<HeuristicTable> tables(goals.size(), HeuristicTable(N));
+  parallel_for(goals.size()*chunks_per_goal, [&](const std::size_t c)
+  {
+    const std::size_t g = c / chunks_per_goal;
+    const std::vector<std::size_t>& next = next_waypoints[g];
+    HeuristicTable& table = tables[g];
+
+    const std::size_t begin = (c % chunks_per_goal)*ChunkSize;
+    const std::size_t end = std::min(begin + ChunkSize, N);
+    std::vector<Eigen::Vector3d> positions;
+    for(std::size_t wp = begin; wp < end; ++wp)
+    {
+      if(next[wp] == NoWaypoint)
+      {
+        table[wp] = std::numeric_limits<double>::infinity();
+        continue;
+      }
+
+      positions.clear();
+      std::size_t current = wp;
+      while(true)
+      {
+        const Eigen::Vector2d p = graph.waypoints[current].get_location();
+        positions.push_back({p[0], p[1], 0.0});
+        if(next[current] == current)
+          break;
+
+        current = next[current];
+      }
+
+      // Interpolate from the goal back to the waypoint, exactly like the lazy
+      // heuristic does, so that both give identical estimates.
+      std::reverse(positions.begin(), positions.end());
+
+      // The start time is arbitrary because we only care about the duration
+      const rmf_traffic::Trajectory estimate = agv::Interpolate::positions(
+            "", traits, rmf_traffic::Time(), positions);
+
+      table[wp] = time::to_seconds(estimate.duration());
+    }
+  });
+
+  HeuristicTables result;
+  for(std::size_t g=0; g < goals.size(); ++g)
+  {
+    result[goals[g]] =
+        std::make_shared<const HeuristicTable>(std::move(tables[g]));
+  }
+
+  return result;
+}
+
+//==============================================================================
 class DifferentialDriveCache : public Cache
 {
 public:
@@ -1314,7 +1975,11 @@ public:
     _interpolate(agv::Interpolate::Options::Implementation::get(
                    _config.interpolation()))
   {
-    // Do nothing
+    const auto tables = compute_heuristic_tables(
+          _graph, _traits, _config.precomputed_goals());
+
+    for(const auto& table : tables)
+      _heuristics.insert(std::make_pair(table.first, Heuristic(table.second)));
   }
 
   CachePtr clone() const final
@@ -1339,16 +2004,27 @@ public:
   rmf_utils::optional<Result> plan(
       const std::vector<agv::Planner::Start>& starts,
       agv::Planner::Goal goal,
-      agv::Planner::Options options) final
+      agv::Planner::Options options,
+      const SearchParams& params) final
   {
     if (starts.empty())
       return rmf_utils::nullopt;
 
+    Time earliest_start_time = starts.front().time();
+    for(const auto& start : starts)
+      earliest_start_time = std::min(earliest_start_time, start.time());
+
     const std::size_t goal_waypoint = goal.waypoint();
     Heuristic& h = _heuristics.insert(
           std::make_pair(goal_waypoint, Heuristic{})).first->second;
     const bool* const interrupt_flag = options.interrupt_flag();
 
+    const ScheduleSnapshot snapshot(
+          options.schedule_viewer(),
+          starts,
+          _graph,
+          options.ignore_schedule_ids());
+
     const NodePtr solution = search<DifferentialDriveExpander>(
           DifferentialDriveExpander::Context{
             _graph,
@@ -1356,21 +2032,27 @@ public:
             _profile,
             options.minimum_holding_time(),
             _interpolate,
-            options.schedule_viewer(),
+            snapshot,
             goal_waypoint,
             goal.orientation(),
             starts.front().time(),
+            earliest_start_time,
             interrupt_flag,
-            options.ignore_schedule_ids(),
+            params.cutoff,
+            params.heuristic_weight,
             h
           },
           DifferentialDriveExpander::InitialNodeArgs{starts},
-          interrupt_flag);
+          interrupt_flag,
+          params.debug);
 
     if (!solution)
       return rmf_utils::nullopt;
 
-    auto trajectories = reconstruct_trajectories(solution);
+    if (params.cutoff)
+      params.cutoff->offer(solution->route_from_parent.finish_time());
+
+    auto trajectories = reconstruct_trajectories(solution, _profile);
     auto waypoints = reconstruct_waypoints(solution, _graph);
     auto start_index = find_start_index(solution);
 
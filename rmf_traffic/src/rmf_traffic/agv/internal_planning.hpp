@@ -19,7 +19,10 @@
 #define SRC__RMF_TRAFFIC__AGV__PLANNINGINTERNAL_HPP
 
 #include <rmf_traffic/agv/Planner.hpp>
+#include <rmf_traffic/ThreadPool.hpp>
 
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <mutex>
 
@@ -41,6 +44,89 @@ struct Result
   agv::Planner::Options options;
 };
 
+//==============================================================================
+/// Instrumentation for the search of a planner. This is only meant to be used
+/// for testing and benchmarking.
+struct SearchDebug
+{
+  /// Set this to false to expand every node that reaches the top of the search
+  /// queue, even if an equivalent search state has already been expanded.
+  bool prune_duplicates = true;
+
+  /// The number of nodes that were expanded by the search
+  std::size_t expanded_nodes = 0;
+
+  /// The number of nodes that were skipped because an equivalent search state
+  /// had already been expanded with an equal or lower cost
+  std::size_t pruned_nodes = 0;
+};
+
+//==============================================================================
+/// Lets the searches in a batch of planning problems stop each other. A search
+/// stops when the batch is cancelled. It can also stop once it can no longer
+/// find a plan that finishes before one that another search has already found.
+class SearchCutoff
+{
+public:
+
+  /// Constructor
+  ///
+  /// \param[in] prune_dominated
+  ///   If false, offer() has no effect, and searches only stop when the batch
+  ///   is cancelled.
+  SearchCutoff(bool prune_dominated);
+
+  /// Stop every search that is using this cutoff.
+  void cancel();
+
+  /// True if cancel() has been called.
+  bool cancelled() const;
+
+  /// Tell the other searches that a plan was found which finishes at the given
+  /// time.
+  void offer(Time finish_time);
+
+  /// True if a plan that cannot finish any sooner than the given time is no
+  /// longer worth searching for.
+  bool dominates(Time finish_time) const;
+
+  /// Cancel every search that is using this cutoff once the steady clock
+  /// reaches the deadline.
+  void set_deadline(Time deadline);
+
+private:
+  const bool _prune_dominated;
+  std::atomic_bool _cancelled;
+  std::atomic<Duration::rep> _finish_time;
+  std::atomic<Duration::rep> _deadline;
+};
+
+//==============================================================================
+/// Parameters for a single search which are not part of the Planner::Options.
+struct SearchParams
+{
+  /// Instrumentation for testing, or a nullptr
+  SearchDebug* debug = nullptr;
+
+  /// The cutoff that can stop the search early, or a nullptr
+  SearchCutoff* cutoff = nullptr;
+
+  /// The factor that the heuristic gets inflated by. Values greater than 1
+  /// find plans more quickly, but the plans may cost up to this many times
+  /// more than the optimal plan.
+  double heuristic_weight = 1.0;
+};
+
+//==============================================================================
+/// Get the ThreadPool that is shared by every Planner in the process, so that
+/// solving many planning problems at once does not oversubscribe the CPU. Its
+/// workers are started the first time this is called.
+///
+/// Work gets spread across the pool with ThreadPool::Implementation::for_each,
+/// which lets a job of the pool use the pool again. For example, each problem
+/// of a batch may build its heuristic tables in parallel.
+ThreadPool& planning_pool();
+
 //==============================================================================
 class Cache
 {
@@ -64,7 +150,8 @@ public:
   virtual rmf_utils::optional<Result> plan(
       const std::vector<agv::Planner::Start>& starts,
       agv::Planner::Goal goal,
-      agv::Planner::Options options) = 0;
+      agv::Planner::Options options,
+      const SearchParams& params) = 0;
 
   virtual const agv::Planner::Configuration& get_configuration() const =0;
 
@@ -87,7 +174,8 @@ public:
   rmf_utils::optional<Result> plan(
       const std::vector<agv::Planner::Start>& starts,
       agv::Planner::Goal goal,
-      agv::Planner::Options options);
+      agv::Planner::Options options,
+      const SearchParams& params = SearchParams());
 
   ~CacheHandle();
 
@@ -26,51 +26,6 @@
 namespace rmf_traffic {
 namespace schedule {
 
-//==============================================================================
-class Database::Change::Implementation
-{
-public:
-
-  Mode mode;
-  Insert insert;
-  Interrupt interrupt;
-  Delay delay;
-  Replace replace;
-  Erase erase;
-  Cull cull;
-
-  Version id;
-
-  static Change make(const Mode mode, const Version id)
-  {
-    Change change;
-    change._pimpl->mode = mode;
-    change._pimpl->id = id;
-
-    return change;
-  }
-
-  static Change make_insert_ref(
-      const Trajectory* trajectory,
-      Version id);
-
-  // Note(MXG): We're not using make_interrupt_ref yet, and perhaps we never
-  // will. In theory this function could be used to save time and memory when a
-  // Database generates a Patch that includes an interrupt, but it would add
-  // complexity to the implementation of Patch generation, so I'm deferring that
-  // feature for later.
-  static Change make_interrupt_ref(
-      Version original_id,
-      const Trajectory* interruption_trajectory,
-      Duration delay,
-      Version id);
-
-  static Change make_replace_ref(
-      Version original_id,
-      const Trajectory* trajectory,
-      Version id);
-};
-
 namespace {
 //==============================================================================
 // TODO(MXG): Consider generalizing this class using templates if it ends up
@@ -658,6 +613,63 @@ ConstEntryPtr get_last_known_ancestor(
   return from;
 }
 
+//==============================================================================
+// Rough sizes, in bytes, of the parts of a change when it gets sent to a
+// mirror. These only need to be accurate enough to compare chains of changes
+// against each other.
+const std::size_t ChangeHeaderSize = 24;
+const std::size_t SegmentSize = 64;
+
+//==============================================================================
+std::size_t estimate_size(const Trajectory& trajectory)
+{
+  return trajectory.size()*SegmentSize;
+}
+
+//==============================================================================
+std::size_t estimate_size(const Database::Change& change)
+{
+  using Mode = Database::Change::Mode;
+  switch(change.get_mode())
+  {
+    case Mode::Insert:
+      return ChangeHeaderSize + estimate_size(*change.insert()->trajectory());
+    case Mode::Interrupt:
+      return ChangeHeaderSize
+          + estimate_size(*change.interrupt()->interruption());
+    case Mode::Replace:
+      return ChangeHeaderSize + estimate_size(*change.replace()->trajectory());
+    case Mode::Invalid:
+    case Mode::Delay:
+    case Mode::Erase:
+    case Mode::Cull:
+    case Mode::NUM:
+      return ChangeHeaderSize;
+  }
+
+  return ChangeHeaderSize;
+}
+
+//==============================================================================
+/// Returns true if a single replacement of the ancestor by the latest entry of
+/// its lineage would be no larger than the chain of changes between them.
+bool should_compress(const ConstEntryPtr& ancestor, const ConstEntryPtr& latest)
+{
+  const std::size_t replace_size =
+      ChangeHeaderSize + estimate_size(latest->trajectory);
+
+  std::size_t chain_size = 0;
+  for(auto record = ancestor->succeeded_by; record;
+      record = record->succeeded_by)
+  {
+    chain_size += estimate_size(*record->change);
+    if(replace_size <= chain_size)
+      return true;
+  }
+
+  return false;
+}
+
 } // anonymous namespace
 
 //==============================================================================
@@ -707,13 +719,19 @@ void ChangeRelevanceInspector::inspect(
       }
     }
 
-    if(record_changes_from)
+    if(record_changes_from && should_compress(record_changes_from, entry))
+    {
+      // A mirror that has fallen behind could be sent a long chain of changes
+      // for this lineage, e.g. one delay for every update that a robot sent
+      // while the mirror was away. When a single replacement of the version
+      // that the mirror knows about would be no larger, we send that instead.
+      relevant_changes.emplace_back(
+            Database::Change::Implementation::make_replace_ref(
+              record_changes_from->version, &entry->trajectory,
+              entry->version));
+    }
+    else if(record_changes_from)
     {
-      // TODO(MXG): We can improve bandwidth usage a bit if we check whether a
-      // Replace operation has taken place since the last known ancestor. If
-      // that is the case, then we can skip recording all of the changes and
-      // just use a single replace from the old version number to the current
-      // version of the trajectory.
       ConstEntryPtr record = record_changes_from->succeeded_by;
       while(record)
       {
@@ -756,23 +774,31 @@ void ChangeRelevanceInspector::inspect(
   }
 }
 
+//==============================================================================
+bool ChangeRelevanceInspector::needs_inspection(
+    const ConstEntryPtr& entry) const
+{
+  if(entry->succeeded_by)
+    return false;
+
+  if(after_version && versions.less_or_equal(entry->version, *after_version))
+    return false;
+
+  return true;
+}
+
 //==============================================================================
 void ChangeRelevanceInspector::inspect(
     const ConstEntryPtr& entry,
-    const rmf_traffic::internal::Spacetime& spacetime)
+    const rmf_traffic::internal::Spacetime& spacetime,
+    const bool entry_in_region)
 {
   inspect(entry, [&](const ConstEntryPtr& e) -> bool {
-    const Trajectory& trajectory = e->trajectory;
-    if(trajectory.start_time())
-    {
-      return rmf_traffic::internal::detect_conflicts(
-            e->trajectory, spacetime, nullptr);
-    }
-    else
-    {
-      assert(e->change->get_mode() == Database::Change::Mode::Erase);
-      return false;
-    }
+    // The entry itself has already been tested, but its ancestors have not
+    if(e == entry)
+      return entry_in_region;
+
+    return in_region(e, spacetime);
   });
 }
 
@@ -804,6 +830,136 @@ void ChangeRelevanceInspector::inspect(
 
 } // namespace internal
 
+namespace {
+//==============================================================================
+/// Tests whether an entry is relevant to the spacetime of a query. Unlike the
+/// timeline inspection of the Viewer, this looks at each entry on its own, so
+/// it can be used on the entries that come out of the change journal.
+class SpacetimeFilter
+{
+public:
+
+  SpacetimeFilter(const Query::Spacetime& spacetime)
+    : _mode(spacetime.get_mode())
+  {
+    switch(_mode)
+    {
+      case Query::Spacetime::Mode::Invalid:
+      {
+        throw std::runtime_error(
+            "[rmf_traffic::schedule::Database] Invalid Query::Spacetime::Mode "
+            "used. Please report this as a bug.");
+      }
+
+      case Query::Spacetime::Mode::All:
+      {
+        // Do nothing
+        break;
+      }
+
+      case Query::Spacetime::Mode::Regions:
+      {
+        assert(spacetime.regions() != nullptr);
+        for(const Region& region : *spacetime.regions())
+        {
+          rmf_traffic::internal::Spacetime data;
+          data.lower_time_bound = region.get_lower_time_bound();
+          data.upper_time_bound = region.get_upper_time_bound();
+
+          auto& spacetimes = _regions[region.get_map()];
+          for(auto space_it = region.begin(); space_it != region.end();
+              ++space_it)
+          {
+            data.pose = space_it->get_pose();
+            data.shape = space_it->get_shape();
+            spacetimes.push_back(data);
+          }
+        }
+        break;
+      }
+
+      case Query::Spacetime::Mode::Timespan:
+      {
+        assert(spacetime.timespan() != nullptr);
+        const Query::Spacetime::Timespan& timespan = *spacetime.timespan();
+        _maps = &timespan.get_maps();
+        _lower_time_bound = timespan.get_lower_time_bound();
+        _upper_time_bound = timespan.get_upper_time_bound();
+        break;
+      }
+    }
+  }
+
+  bool operator()(const internal::ConstEntryPtr& entry) const
+  {
+    const Trajectory& trajectory = entry->trajectory;
+
+    // Erasure entries do not have any trajectory that could be relevant
+    if(!trajectory.start_time())
+      return false;
+
+    switch(_mode)
+    {
+      case Query::Spacetime::Mode::Invalid:
+      {
+        return false;
+      }
+
+      case Query::Spacetime::Mode::All:
+      {
+        return true;
+      }
+
+      case Query::Spacetime::Mode::Regions:
+      {
+        const auto it = _regions.find(trajectory.get_map_name());
+        if(it == _regions.end())
+          return false;
+
+        for(const auto& spacetime : it->second)
+        {
+          if(internal::in_region(entry, spacetime, &_context))
+            return true;
+        }
+
+        return false;
+      }
+
+      case Query::Spacetime::Mode::Timespan:
+      {
+        if(_maps->count(trajectory.get_map_name()) == 0)
+          return false;
+
+        if(_lower_time_bound
+           && *trajectory.finish_time() < *_lower_time_bound)
+          return false;
+
+        if(_upper_time_bound
+           && *_upper_time_bound < *trajectory.start_time())
+          return false;
+
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+private:
+
+  Query::Spacetime::Mode _mode;
+
+  std::unordered_map<
+      std::string, std::vector<rmf_traffic::internal::Spacetime>> _regions;
+
+  const std::unordered_set<std::string>* _maps = nullptr;
+  const Time* _lower_time_bound = nullptr;
+  const Time* _upper_time_bound = nullptr;
+
+  mutable DetectConflict::Context _context;
+};
+} // anonymous namespace
+
 //==============================================================================
 Database::Database()
 {
@@ -813,12 +969,41 @@ Database::Database()
 //==============================================================================
 auto Database::changes(const Query& parameters) const -> Patch
 {
-  auto relevant_changes = _pimpl->inspect<internal::ChangeRelevanceInspector>(
-        parameters).relevant_changes;
+  const auto* after = parameters.versions().after();
+
+  std::vector<Change> relevant_changes;
+  if(after)
+  {
+    // Every entry of the schedule is indexed by the version of the change that
+    // created it, so all_entries doubles as a version-ordered journal of the
+    // changes. Only the changes that are newer than the last version that the
+    // mirror knows about need to be looked at, no matter how large the rest of
+    // the schedule is.
+    const Version after_version = after->get_version();
+    const SpacetimeFilter filter(parameters.spacetime());
+    const auto relevant = [&](const internal::ConstEntryPtr& entry) -> bool
+    {
+      return filter(entry);
+    };
+
+    internal::ChangeRelevanceInspector inspector;
+    inspector.after(&after_version);
+    _pimpl->all_entries.for_each_after(
+          after_version, [&](const internal::ConstEntryPtr& entry)
+    {
+      inspector.inspect(entry, relevant);
+    });
+
+    relevant_changes = std::move(inspector.relevant_changes);
+  }
+  else
+  {
+    relevant_changes = _pimpl->inspect<internal::ChangeRelevanceInspector>(
+          parameters).relevant_changes;
+  }
 
   if(_pimpl->cull_has_occurred)
   {
-    const auto* after = parameters.versions().after();
     const auto& last_cull = _pimpl->last_cull;
     if(after)
     {
@@ -862,22 +1047,24 @@ Version Database::interrupt(
     Trajectory interruption_trajectory,
     Duration delay)
 {
-  const internal::EntryPtr old_entry =
-      _pimpl->get_entry_iterator(id, "interruption")->second;
+  const internal::EntryPtr old_entry = _pimpl->get_entry(id, "interruption");
 
+  Time changed_from;
   Trajectory new_trajectory = add_interruption(
-        old_entry->trajectory, interruption_trajectory, delay);
+        old_entry->trajectory, interruption_trajectory, delay, &changed_from);
 
   const Version new_version = ++_pimpl->latest_version;
   Change change = Database::Change::make_interrupt(
         id, std::move(interruption_trajectory), delay, new_version);
 
-  old_entry->succeeded_by = _pimpl->add_entry(
+  old_entry->succeeded_by = _pimpl->add_successor(
+      old_entry,
       std::make_shared<internal::Entry>(
         std::move(new_trajectory),
         new_version,
         old_entry,
-        std::make_unique<Change>(std::move(change))));
+        std::make_unique<Change>(std::move(change))),
+      changed_from);
 
   return new_version;
 }
@@ -888,21 +1075,23 @@ Version Database::delay(
     const Time from,
     const Duration delay)
 {
-  const internal::EntryPtr old_entry =
-      _pimpl->get_entry_iterator(id, "delay")->second;
+  const internal::EntryPtr old_entry = _pimpl->get_entry(id, "delay");
 
+  Time changed_from;
   Trajectory new_trajectory = add_delay(
-        old_entry->trajectory, from, delay);
+        old_entry->trajectory, from, delay, &changed_from);
 
   const Version new_version = ++_pimpl->latest_version;
   Change change = Database::Change::make_delay(id, from, delay, new_version);
 
-  old_entry->succeeded_by = _pimpl->add_entry(
+  old_entry->succeeded_by = _pimpl->add_successor(
+        old_entry,
         std::make_shared<internal::Entry>(
           std::move(new_trajectory),
           new_version,
           old_entry,
-          std::make_unique<Change>(std::move(change))));
+          std::make_unique<Change>(std::move(change))),
+        changed_from);
 
   return new_version;
 }
@@ -913,7 +1102,7 @@ Version Database::replace(
     Trajectory trajectory)
 {
   const internal::EntryPtr old_entry =
-      _pimpl->get_entry_iterator(previous_id, "replacement")->second;
+      _pimpl->get_entry(previous_id, "replacement");
 
   const Version new_version = ++_pimpl->latest_version;
   internal::EntryPtr new_entry =
@@ -926,7 +1115,8 @@ Version Database::replace(
         Change::Implementation::make_replace_ref(
           previous_id, &new_entry->trajectory, new_version));
 
-  old_entry->succeeded_by = _pimpl->add_entry(new_entry);
+  old_entry->succeeded_by =
+      _pimpl->add_successor(old_entry, new_entry, Time::min());
 
   return new_version;
 }
@@ -934,8 +1124,7 @@ Version Database::replace(
 //==============================================================================
 Version Database::erase(Version id)
 {
-  const internal::EntryPtr old_entry =
-      _pimpl->get_entry_iterator(id, "erasure")->second;
+  const internal::EntryPtr old_entry = _pimpl->get_entry(id, "erasure");
 
   const Version new_version = ++_pimpl->latest_version;
 
@@ -946,13 +1135,17 @@ Version Database::erase(Version id)
           old_entry,
           std::make_unique<Change>(Change::make_erase(id, new_version))), true);
 
+  _pimpl->retire_from_timeline(old_entry);
+
   return new_version;
 }
 
 //==============================================================================
 Version Database::cull(Time time)
 {
-  _pimpl->cull(++_pimpl->latest_version, time);
+  // The version only advances if something actually got culled
+  if(_pimpl->cull(_pimpl->latest_version + 1, time))
+    ++_pimpl->latest_version;
 
   return _pimpl->latest_version;
 }
@@ -0,0 +1,987 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "ViewerInternal.hpp"
+
+#include <rmf_traffic/schedule/Journal.hpp>
+
+#include <rmf_traffic/geometry/Box.hpp>
+#include <rmf_traffic/geometry/Circle.hpp>
+
+#include <rmf_utils/optional.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <typeinfo>
+#include <unordered_map>
+
+namespace rmf_traffic {
+namespace schedule {
+
+namespace {
+//==============================================================================
+const char SnapshotMagic[8] = {'R', 'M', 'F', 'S', 'N', 'A', 'P', '1'};
+
+const std::string SnapshotFile = "snapshot";
+const std::string JournalFile = "journal";
+
+//==============================================================================
+enum class ShapeType : uint8_t
+{
+  None = 0,
+  Box,
+  Circle
+};
+
+//==============================================================================
+// Flags for each entry of a snapshot
+const uint8_t EntryIndexed = 0x01;
+const uint8_t EntrySucceeds = 0x02;
+const uint8_t EntrySucceededBy = 0x04;
+
+//==============================================================================
+[[noreturn]] void throw_error(const std::string& message)
+{
+  throw std::runtime_error("[rmf_traffic::schedule::Journal] " + message);
+}
+
+//==============================================================================
+/// Returns true if version comes after reference, accounting for versions that
+/// may have wrapped around.
+bool is_after(const Version version, const Version reference)
+{
+  return version != reference
+      && version - reference <= std::numeric_limits<Version>::max()/2;
+}
+
+//==============================================================================
+class Writer
+{
+public:
+
+  template<typename T>
+  void write(const T& value)
+  {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  void write(const std::string& value)
+  {
+    write(static_cast<uint32_t>(value.size()));
+    buffer.append(value);
+  }
+
+  void write(const Time time)
+  {
+    write(static_cast<int64_t>(time.time_since_epoch().count()));
+  }
+
+  void write(const Duration duration)
+  {
+    write(static_cast<int64_t>(duration.count()));
+  }
+
+  void write(const Eigen::Vector3d& v)
+  {
+    for(int i=0; i < 3; ++i)
+      write(v[i]);
+  }
+
+  std::string buffer;
+};
+
+//==============================================================================
+class Reader
+{
+public:
+
+  Reader(const char* begin, const char* end)
+    : _it(begin),
+      _end(end)
+  {
+    // Do nothing
+  }
+
+  template<typename T>
+  T read()
+  {
+    T value;
+    std::memcpy(&value, take(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  std::string read_string()
+  {
+    const auto size = read<uint32_t>();
+    const char* const data = take(size);
+    return std::string(data, size);
+  }
+
+  Time read_time()
+  {
+    return Time(Duration(read<int64_t>()));
+  }
+
+  Duration read_duration()
+  {
+    return Duration(read<int64_t>());
+  }
+
+  Eigen::Vector3d read_vector()
+  {
+    Eigen::Vector3d v;
+    for(int i=0; i < 3; ++i)
+      v[i] = read<double>();
+
+    return v;
+  }
+
+  const char* take(const std::size_t size)
+  {
+    if(remaining() < size)
+      throw_error("Unexpected end of data");
+
+    const char* const data = _it;
+    _it += size;
+    return data;
+  }
+
+  std::size_t remaining() const
+  {
+    return static_cast<std::size_t>(_end - _it);
+  }
+
+private:
+  const char* _it;
+  const char* _end;
+};
+
+//==============================================================================
+void write_shape(Writer& w, const geometry::ConstFinalConvexShapePtr& shape)
+{
+  if(!shape)
+  {
+    w.write(ShapeType::None);
+    return;
+  }
+
+  const geometry::Shape& source = shape->source();
+  if(const auto* box = dynamic_cast<const geometry::Box*>(&source))
+  {
+    w.write(ShapeType::Box);
+    w.write(box->get_x_length());
+    w.write(box->get_y_length());
+    return;
+  }
+
+  if(const auto* circle = dynamic_cast<const geometry::Circle*>(&source))
+  {
+    w.write(ShapeType::Circle);
+    w.write(circle->get_radius());
+    return;
+  }
+
+  throw_error(std::string("Unsupported shape type: ") + typeid(source).name());
+}
+
+//==============================================================================
+void write_profile(Writer& w, const Trajectory::Profile& profile)
+{
+  const auto autonomy = profile.get_autonomy();
+  w.write(autonomy);
+  if(const auto* queue = profile.get_queue_info())
+    w.write(queue->get_queue_id());
+
+  write_shape(w, profile.get_shape());
+}
+
+//==============================================================================
+void write_trajectory(Writer& w, const Trajectory& trajectory)
+{
+  w.write(trajectory.get_map_name());
+
+  // Segments usually share a handful of profiles, so each distinct profile is
+  // only written once per trajectory.
+  std::vector<const Trajectory::Profile*> profiles;
+  std::vector<uint32_t> profile_of_segment;
+  profile_of_segment.reserve(trajectory.size());
+  for(const auto& segment : trajectory)
+  {
+    const Trajectory::Profile* profile = segment.get_profile().get();
+    const auto it = std::find(profiles.begin(), profiles.end(), profile);
+    profile_of_segment.push_back(static_cast<uint32_t>(it - profiles.begin()));
+    if(it == profiles.end())
+      profiles.push_back(profile);
+  }
+
+  w.write(static_cast<uint32_t>(profiles.size()));
+  for(const auto* profile : profiles)
+  {
+    Writer p;
+    write_profile(p, *profile);
+    w.write(p.buffer);
+  }
+
+  w.write(static_cast<uint32_t>(trajectory.size()));
+  std::size_t i = 0;
+  for(const auto& segment : trajectory)
+  {
+    w.write(profile_of_segment[i++]);
+    w.write(segment.get_finish_time());
+    w.write(segment.get_finish_position());
+    w.write(segment.get_finish_velocity());
+  }
+}
+
+//==============================================================================
+/// Write a change. The trajectory of an insertion or replacement is left out
+/// when with_trajectory is false, because a snapshot stores it in the entry.
+void write_change(
+    Writer& w,
+    const Database::Change& change,
+    const bool with_trajectory)
+{
+  using Mode = Database::Change::Mode;
+  const Mode mode = change.get_mode();
+  w.write(mode);
+  w.write(change.id());
+
+  switch(mode)
+  {
+    case Mode::Insert:
+    {
+      if(with_trajectory)
+        write_trajectory(w, *change.insert()->trajectory());
+      return;
+    }
+    case Mode::Interrupt:
+    {
+      const auto& interrupt = *change.interrupt();
+      w.write(interrupt.original_id());
+      write_trajectory(w, *interrupt.interruption());
+      w.write(interrupt.delay());
+      return;
+    }
+    case Mode::Delay:
+    {
+      const auto& delay = *change.delay();
+      w.write(delay.original_id());
+      w.write(delay.from());
+      w.write(delay.duration());
+      return;
+    }
+    case Mode::Replace:
+    {
+      const auto& replace = *change.replace();
+      w.write(replace.original_id());
+      if(with_trajectory)
+        write_trajectory(w, *replace.trajectory());
+      return;
+    }
+    case Mode::Erase:
+    {
+      w.write(change.erase()->original_id());
+      return;
+    }
+    case Mode::Cull:
+    {
+      w.write(change.cull()->time());
+      return;
+    }
+    case Mode::Invalid:
+    case Mode::NUM:
+      break;
+  }
+
+  throw_error("Cannot write a change with an invalid mode ["
+              + std::to_string(static_cast<uint16_t>(mode)) + "]");
+}
+
+//==============================================================================
+/// The fields of a change that has been read, before it gets applied
+struct ChangeRecord
+{
+  Database::Change::Mode mode;
+  Version id;
+  Version original_id = 0;
+  rmf_utils::optional<Trajectory> trajectory;
+  Duration duration = Duration(0);
+  Time time;
+};
+
+//==============================================================================
+class Decoder
+{
+public:
+
+  Trajectory read_trajectory(Reader& r)
+  {
+    Trajectory trajectory(r.read_string());
+
+    const auto num_profiles = r.read<uint32_t>();
+    std::vector<Trajectory::ConstProfilePtr> profiles;
+    profiles.reserve(num_profiles);
+    for(uint32_t i=0; i < num_profiles; ++i)
+      profiles.push_back(read_profile(r));
+
+    const auto num_segments = r.read<uint32_t>();
+    for(uint32_t i=0; i < num_segments; ++i)
+    {
+      const auto profile = r.read<uint32_t>();
+      if(profile >= profiles.size())
+        throw_error("Segment refers to a profile that does not exist");
+
+      const Time finish_time = r.read_time();
+      const Eigen::Vector3d position = r.read_vector();
+      const Eigen::Vector3d velocity = r.read_vector();
+      trajectory.insert(finish_time, profiles[profile], position, velocity);
+    }
+
+    return trajectory;
+  }
+
+  ChangeRecord read_change(Reader& r, const bool with_trajectory)
+  {
+    using Mode = Database::Change::Mode;
+
+    ChangeRecord record;
+    record.mode = r.read<Mode>();
+    record.id = r.read<Version>();
+
+    switch(record.mode)
+    {
+      case Mode::Insert:
+      {
+        if(with_trajectory)
+          record.trajectory = read_trajectory(r);
+        return record;
+      }
+      case Mode::Interrupt:
+      {
+        record.original_id = r.read<Version>();
+        record.trajectory = read_trajectory(r);
+        record.duration = r.read_duration();
+        return record;
+      }
+      case Mode::Delay:
+      {
+        record.original_id = r.read<Version>();
+        record.time = r.read_time();
+        record.duration = r.read_duration();
+        return record;
+      }
+      case Mode::Replace:
+      {
+        record.original_id = r.read<Version>();
+        if(with_trajectory)
+          record.trajectory = read_trajectory(r);
+        return record;
+      }
+      case Mode::Erase:
+      {
+        record.original_id = r.read<Version>();
+        return record;
+      }
+      case Mode::Cull:
+      {
+        record.time = r.read_time();
+        return record;
+      }
+      case Mode::Invalid:
+      case Mode::NUM:
+        break;
+    }
+
+    throw_error("Invalid change mode ["
+                + std::to_string(static_cast<uint16_t>(record.mode)) + "]");
+  }
+
+private:
+
+  Trajectory::ConstProfilePtr read_profile(Reader& r)
+  {
+    // Many trajectories of a schedule use the same few profiles, so profiles
+    // with identical data get shared, just like they usually were before they
+    // were written.
+    std::string data = r.read_string();
+    const auto it = _profiles.find(data);
+    if(it != _profiles.end())
+      return it->second;
+
+    Reader p(data.data(), data.data() + data.size());
+    using Autonomy = Trajectory::Profile::Autonomy;
+    const auto autonomy = p.read<Autonomy>();
+    std::string queue_id;
+    if(autonomy == Autonomy::Queued)
+      queue_id = p.read_string();
+
+    geometry::ConstFinalConvexShapePtr shape = read_shape(p);
+
+    Trajectory::ProfilePtr profile;
+    switch(autonomy)
+    {
+      case Autonomy::Guided:
+        profile = Trajectory::Profile::make_guided(std::move(shape));
+        break;
+      case Autonomy::Autonomous:
+        profile = Trajectory::Profile::make_autonomous(std::move(shape));
+        break;
+      case Autonomy::Queued:
+        profile = Trajectory::Profile::make_queued(std::move(shape), queue_id);
+        break;
+      case Autonomy::Unspecified:
+        break;
+    }
+
+    if(!profile)
+    {
+      throw_error("Invalid profile autonomy ["
+                  + std::to_string(static_cast<uint16_t>(autonomy)) + "]");
+    }
+
+    _profiles.insert(std::make_pair(std::move(data), profile));
+    return profile;
+  }
+
+  static geometry::ConstFinalConvexShapePtr read_shape(Reader& r)
+  {
+    const auto type = r.read<ShapeType>();
+    switch(type)
+    {
+      case ShapeType::None:
+        return nullptr;
+      case ShapeType::Box:
+      {
+        const double x = r.read<double>();
+        const double y = r.read<double>();
+        return geometry::make_final_convex<geometry::Box>(x, y);
+      }
+      case ShapeType::Circle:
+        return geometry::make_final_convex<geometry::Circle>(r.read<double>());
+    }
+
+    throw_error("Invalid shape type ["
+                + std::to_string(static_cast<int>(type)) + "]");
+  }
+
+  std::unordered_map<std::string, Trajectory::ConstProfilePtr> _profiles;
+};
+
+//==============================================================================
+/// Rebuild the change that led to a snapshot entry. Insertions and replacements
+/// refer to the trajectory of the entry, like they do when the Database makes
+/// them.
+internal::ChangePtr make_entry_change(
+    ChangeRecord record,
+    const internal::Entry& entry)
+{
+  using Mode = Database::Change::Mode;
+  using Change = Database::Change;
+  switch(record.mode)
+  {
+    case Mode::Insert:
+      return std::make_unique<Change>(
+            Change::Implementation::make_insert_ref(
+              &entry.trajectory, record.id));
+    case Mode::Interrupt:
+      return std::make_unique<Change>(
+            Change::make_interrupt(
+              record.original_id, std::move(*record.trajectory),
+              record.duration, record.id));
+    case Mode::Delay:
+      return std::make_unique<Change>(
+            Change::make_delay(
+              record.original_id, record.time, record.duration, record.id));
+    case Mode::Replace:
+      return std::make_unique<Change>(
+            Change::Implementation::make_replace_ref(
+              record.original_id, &entry.trajectory, record.id));
+    case Mode::Erase:
+      return std::make_unique<Change>(
+            Change::make_erase(record.original_id, record.id));
+    case Mode::Cull:
+    case Mode::Invalid:
+    case Mode::NUM:
+      break;
+  }
+
+  throw_error("Snapshot entry [" + std::to_string(entry.version)
+              + "] has a change that cannot lead to an entry");
+}
+
+//==============================================================================
+/// Apply a change from the journal to a Database. Returns the version of the
+/// Database after the change.
+Version apply(Database& database, ChangeRecord record)
+{
+  using Mode = Database::Change::Mode;
+  switch(record.mode)
+  {
+    case Mode::Insert:
+      return database.insert(std::move(*record.trajectory));
+    case Mode::Interrupt:
+      return database.interrupt(
+            record.original_id, std::move(*record.trajectory),
+            record.duration);
+    case Mode::Delay:
+      return database.delay(record.original_id, record.time, record.duration);
+    case Mode::Replace:
+      return database.replace(
+            record.original_id, std::move(*record.trajectory));
+    case Mode::Erase:
+      return database.erase(record.original_id);
+    case Mode::Cull:
+      return database.cull(record.time);
+    case Mode::Invalid:
+    case Mode::NUM:
+      break;
+  }
+
+  throw_error("Journal has a change with an invalid mode");
+}
+
+//==============================================================================
+/// Read a whole file into memory. Returns false if the file does not exist.
+bool read_file(const std::string& path, std::string& data)
+{
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if(!file)
+    return false;
+
+  const std::streamsize size = file.tellg();
+  data.resize(static_cast<std::size_t>(size));
+  file.seekg(0);
+  if(!file.read(&data[0], size))
+    throw_error("Failed to read [" + path + "]");
+
+  return true;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+class Journal::Implementation
+{
+public:
+
+  std::string directory;
+
+  std::ofstream journal;
+
+  Version last_recorded = 0;
+
+  std::size_t changes_since_snapshot = 0;
+
+  std::string path(const std::string& file) const
+  {
+    return directory + "/" + file;
+  }
+
+  std::ofstream& open_journal(const std::ios::openmode mode)
+  {
+    if(!journal.is_open())
+    {
+      journal.open(path(JournalFile), std::ios::binary | mode);
+      if(!journal)
+        throw_error("Failed to open [" + path(JournalFile) + "]");
+    }
+
+    return journal;
+  }
+
+  void load_snapshot(Database& database, const std::string& data) const
+  {
+    auto& impl = *database._pimpl;
+
+    Reader r(data.data(), data.data() + data.size());
+    if(std::memcmp(r.take(sizeof(SnapshotMagic)), SnapshotMagic,
+                   sizeof(SnapshotMagic)) != 0)
+    {
+      throw_error("[" + path(SnapshotFile) + "] is not a schedule snapshot");
+    }
+
+    impl.latest_version = r.read<Version>();
+    impl.oldest_version = r.read<Version>();
+    impl.cull_has_occurred = r.read<uint8_t>() != 0;
+    impl.last_cull.first = r.read<Version>();
+    impl.last_cull.second = r.read_time();
+
+    struct Link
+    {
+      internal::EntryPtr entry;
+      uint8_t flags;
+      Version succeeds;
+      Version succeeded_by;
+    };
+
+    const auto num_entries = r.read<uint64_t>();
+    std::vector<Link> links;
+    links.reserve(num_entries);
+    std::unordered_map<Version, internal::EntryPtr> entries;
+    entries.reserve(num_entries);
+
+    Decoder decoder;
+    for(uint64_t i=0; i < num_entries; ++i)
+    {
+      Link link;
+      const auto version = r.read<Version>();
+      link.flags = r.read<uint8_t>();
+      link.succeeds = r.read<Version>();
+      link.succeeded_by = r.read<Version>();
+      link.entry = std::make_shared<internal::Entry>(
+            decoder.read_trajectory(r), version);
+      link.entry->change = make_entry_change(
+            decoder.read_change(r, false), *link.entry);
+
+      if(!entries.insert(std::make_pair(version, link.entry)).second)
+        throw_error("Snapshot has two entries for [" + std::to_string(version)
+                    + "]");
+
+      links.emplace_back(std::move(link));
+    }
+
+    const auto get = [&](const Version version) -> internal::EntryPtr
+    {
+      const auto it = entries.find(version);
+      if(it == entries.end())
+        throw_error("Snapshot refers to a missing entry ["
+                    + std::to_string(version) + "]");
+
+      return it->second;
+    };
+
+    for(const Link& link : links)
+    {
+      if(link.flags & EntrySucceeds)
+        link.entry->succeeds = get(link.succeeds);
+
+      if(link.flags & EntrySucceededBy)
+        link.entry->succeeded_by = get(link.succeeded_by);
+    }
+
+    // The indexed entries were written first, from the oldest version to the
+    // newest, so they get added to the store in that same order. Entries that
+    // have been superseded stay in the timeline as retired entries so that
+    // they can still be culled.
+    for(const Link& link : links)
+    {
+      if(!(link.flags & EntryIndexed))
+        continue;
+
+      impl.all_entries.insert(link.entry);
+      if(!link.entry->trajectory.start_time())
+        continue;
+
+      impl.add_to_timeline(link.entry);
+      if(link.entry->succeeded_by)
+        impl.retire_from_timeline(link.entry);
+    }
+  }
+
+  /// Apply the changes of the journal that came after the snapshot. Returns
+  /// the number of bytes at the start of the journal that hold complete
+  /// changes.
+  std::size_t replay_journal(Database& database, const std::string& data) const
+  {
+    Reader r(data.data(), data.data() + data.size());
+    Decoder decoder;
+    std::size_t complete = 0;
+    while(r.remaining() >= sizeof(uint32_t))
+    {
+      const auto size = r.read<uint32_t>();
+      if(r.remaining() < size)
+      {
+        // This change was cut off while it was being written, so it never
+        // finished being recorded.
+        break;
+      }
+
+      const char* const begin = r.take(size);
+      complete = data.size() - r.remaining();
+      Reader record_reader(begin, begin + size);
+      ChangeRecord record = decoder.read_change(record_reader, true);
+
+      const Version latest = database.latest_version();
+      if(!is_after(record.id, latest))
+      {
+        // This change was already included in the snapshot. This happens if
+        // a crash interrupted the snapshot after it was written but before the
+        // journal was started over.
+        continue;
+      }
+
+      const Version id = record.id;
+      const Version result = apply(database, std::move(record));
+      if(result != id)
+      {
+        throw_error("Replaying the journal gave version ["
+                    + std::to_string(result) + "] instead of ["
+                    + std::to_string(id) + "]");
+      }
+    }
+
+    return complete;
+  }
+
+  void write_snapshot(const Database& database, std::ofstream& out) const
+  {
+    const auto& impl = *database._pimpl;
+
+    // Every indexed entry is written, along with the history that is still
+    // linked to it, since mirrors may need that history to catch up.
+    std::vector<internal::ConstEntryPtr> indexed;
+    indexed.reserve(impl.all_entries.size());
+    impl.all_entries.for_each([&](const internal::EntryPtr& entry)
+    {
+      indexed.push_back(entry);
+    });
+
+    std::vector<internal::ConstEntryPtr> history;
+    std::unordered_set<const internal::Entry*> visited;
+    for(const auto& entry : indexed)
+      visited.insert(entry.get());
+
+    const auto visit = [&](internal::ConstEntryPtr e)
+    {
+      if(e && visited.insert(e.get()).second)
+        history.push_back(std::move(e));
+    };
+
+    for(const auto& entry : indexed)
+    {
+      for(auto e = entry->succeeds; e; e = e->succeeds)
+        visit(e);
+
+      for(auto e = entry->succeeded_by; e; e = e->succeeded_by)
+        visit(e);
+    }
+
+    // The history entries may themselves link to entries that have not been
+    // visited yet.
+    for(std::size_t i=0; i < history.size(); ++i)
+    {
+      visit(history[i]->succeeds);
+      visit(history[i]->succeeded_by);
+    }
+
+    Writer w;
+    w.buffer.append(SnapshotMagic, sizeof(SnapshotMagic));
+    w.write(impl.latest_version);
+    w.write(impl.oldest_version);
+    w.write(static_cast<uint8_t>(impl.cull_has_occurred? 1 : 0));
+    w.write(impl.last_cull.first);
+    w.write(impl.last_cull.second);
+    w.write(static_cast<uint64_t>(indexed.size() + history.size()));
+
+    const auto write_entry = [&](const internal::Entry& entry, uint8_t flags)
+    {
+      if(!entry.change)
+      {
+        throw_error("Entry [" + std::to_string(entry.version)
+                    + "] does not have a change");
+      }
+
+      if(entry.succeeds)
+        flags |= EntrySucceeds;
+
+      if(entry.succeeded_by)
+        flags |= EntrySucceededBy;
+
+      w.write(entry.version);
+      w.write(flags);
+      w.write(entry.succeeds? entry.succeeds->version : Version(0));
+      w.write(entry.succeeded_by? entry.succeeded_by->version : Version(0));
+      write_trajectory(w, entry.trajectory);
+      write_change(w, *entry.change, false);
+    };
+
+    for(const auto& entry : indexed)
+      write_entry(*entry, EntryIndexed);
+
+    for(const auto& entry : history)
+      write_entry(*entry, 0);
+
+    out.write(w.buffer.data(), static_cast<std::streamsize>(w.buffer.size()));
+  }
+};
+
+//==============================================================================
+Journal::Journal(std::string directory)
+  : _pimpl(rmf_utils::make_unique_impl<Implementation>())
+{
+  _pimpl->directory = std::move(directory);
+}
+
+//==============================================================================
+Database Journal::recover()
+{
+  Database database;
+
+  std::string data;
+  if(read_file(_pimpl->path(SnapshotFile), data))
+    _pimpl->load_snapshot(database, data);
+
+  const Version snapshot_version = database.latest_version();
+
+  _pimpl->changes_since_snapshot = 0;
+  if(read_file(_pimpl->path(JournalFile), data))
+  {
+    const std::size_t complete = _pimpl->replay_journal(database, data);
+    _pimpl->changes_since_snapshot =
+        database.latest_version() - snapshot_version;
+
+    if(complete < data.size())
+    {
+      // The last change was only partially written, so the journal gets
+      // rewritten without it. Otherwise new changes would be appended after
+      // the fragment and could never be read.
+      _pimpl->journal.close();
+      std::ofstream& journal = _pimpl->open_journal(std::ios::trunc);
+      journal.write(data.data(), static_cast<std::streamsize>(complete));
+      journal.flush();
+      if(!journal)
+        throw_error("Failed to write to [" + _pimpl->path(JournalFile) + "]");
+    }
+  }
+
+  _pimpl->last_recorded = database.latest_version();
+  return database;
+}
+
+//==============================================================================
+void Journal::record(const Database& database)
+{
+  const auto& impl = *database._pimpl;
+  const Version last_recorded = _pimpl->last_recorded;
+  if(impl.latest_version == last_recorded)
+    return;
+
+  Writer w;
+  std::size_t count = 0;
+  const auto add = [&](const Database::Change& change)
+  {
+    Writer record;
+    write_change(record, change, true);
+    w.write(static_cast<uint32_t>(record.buffer.size()));
+    w.buffer.append(record.buffer);
+    ++count;
+  };
+
+  // A cull does not leave behind an entry, so it needs to be put in order
+  // among the changes of the entries.
+  rmf_utils::optional<Database::Change> cull;
+  if(impl.cull_has_occurred && is_after(impl.last_cull.first, last_recorded))
+  {
+    cull = Database::Change::make_cull(
+          impl.last_cull.second, impl.last_cull.first);
+  }
+
+  impl.all_entries.for_each_after(
+        last_recorded, [&](const internal::ConstEntryPtr& entry)
+  {
+    if(cull && is_after(entry->version, cull->id()))
+    {
+      add(*cull);
+      cull = rmf_utils::nullopt;
+    }
+
+    if(!entry->change)
+    {
+      throw_error("Entry [" + std::to_string(entry->version)
+                  + "] does not have a change");
+    }
+
+    add(*entry->change);
+  });
+
+  if(cull)
+    add(*cull);
+
+  std::ofstream& journal = _pimpl->open_journal(std::ios::app);
+  journal.write(w.buffer.data(), static_cast<std::streamsize>(w.buffer.size()));
+  journal.flush();
+  if(!journal)
+    throw_error("Failed to write to [" + _pimpl->path(JournalFile) + "]");
+
+  _pimpl->last_recorded = impl.latest_version;
+  _pimpl->changes_since_snapshot += count;
+}
+
+//==============================================================================
+void Journal::snapshot(const Database& database)
+{
+  const std::string snapshot_path = _pimpl->path(SnapshotFile);
+  const std::string temporary_path = snapshot_path + ".tmp";
+  {
+    std::ofstream out(temporary_path, std::ios::binary | std::ios::trunc);
+    if(!out)
+      throw_error("Failed to open [" + temporary_path + "]");
+
+    _pimpl->write_snapshot(database, out);
+    out.flush();
+    if(!out)
+      throw_error("Failed to write [" + temporary_path + "]");
+  }
+
+  // Renaming the finished snapshot replaces the old one in a single step, so a
+  // crash can never leave an incomplete snapshot behind.
+  if(std::rename(temporary_path.c_str(), snapshot_path.c_str()) != 0)
+    throw_error("Failed to replace [" + snapshot_path + "]");
+
+  _pimpl->journal.close();
+  _pimpl->open_journal(std::ios::trunc);
+
+  _pimpl->last_recorded = database.latest_version();
+  _pimpl->changes_since_snapshot = 0;
+}
+
+//==============================================================================
+void Journal::move_aside(const std::string& suffix)
+{
+  _pimpl->journal.close();
+
+  for(const std::string& file : {SnapshotFile, JournalFile})
+  {
+    const std::string path = _pimpl->path(file);
+    if(!std::ifstream(path))
+      continue;
+
+    const std::string new_path = path + suffix;
+    if(std::rename(path.c_str(), new_path.c_str()) != 0)
+      throw_error("Failed to move [" + path + "] to [" + new_path + "]");
+  }
+
+  _pimpl->last_recorded = 0;
+  _pimpl->changes_since_snapshot = 0;
+}
+
+//==============================================================================
+std::size_t Journal::changes_since_snapshot() const
+{
+  return _pimpl->changes_since_snapshot;
+}
+
+//==============================================================================
+const std::string& Journal::directory() const
+{
+  return _pimpl->directory;
+}
+
+} // namespace schedule
+} // namespace rmf_traffic
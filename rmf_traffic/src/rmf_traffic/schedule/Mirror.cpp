@@ -49,15 +49,17 @@ Mirror::Mirror()
 //              << "]" << std::endl;
 
     const internal::EntryPtr& entry =
-        _pimpl->get_entry_iterator(
-          interruption.original_id(), "interruption")->second;
+        _pimpl->get_entry(interruption.original_id(), "interruption");
 
+    Time changed_from;
     Trajectory new_trajectory = add_interruption(
           entry->trajectory,
           *interruption.interruption(),
-          interruption.delay());
+          interruption.delay(),
+          &changed_from);
 
-    _pimpl->modify_entry(entry, std::move(new_trajectory), change.id());
+    _pimpl->modify_entry(
+          entry, std::move(new_trajectory), change.id(), changed_from);
   };
 
   _pimpl->changers[static_cast<std::size_t>(Database::Change::Mode::Delay)]
@@ -69,14 +71,17 @@ Mirror::Mirror()
 //              << "] --> [" << change.id() << "]" << std::endl;
 
     const internal::EntryPtr& entry =
-        _pimpl->get_entry_iterator(delay.original_id(), "delay")->second;
+        _pimpl->get_entry(delay.original_id(), "delay");
 
+    Time changed_from;
     Trajectory new_trajectory = add_delay(
           entry->trajectory,
           delay.from(),
-          delay.duration());
+          delay.duration(),
+          &changed_from);
 
-    _pimpl->modify_entry(entry, std::move(new_trajectory), change.id());
+    _pimpl->modify_entry(
+          entry, std::move(new_trajectory), change.id(), changed_from);
   };
 
   _pimpl->changers[static_cast<std::size_t>(Database::Change::Mode::Replace)]
@@ -90,8 +95,7 @@ Mirror::Mirror()
     try
     {
       const internal::EntryPtr& entry =
-          _pimpl->get_entry_iterator(
-            replace.original_id(), "replacement")->second;
+          _pimpl->get_entry(replace.original_id(), "replacement");
 
       _pimpl->modify_entry(entry, *replace.trajectory(), change.id());
     }
@@ -19,11 +19,15 @@
 
 #include "../detail/internal_bidirectional_iterator.hpp"
 #include "../DetectConflictInternal.hpp"
+#include "../Spline.hpp"
 
 #include <rmf_traffic/schedule/Viewer.hpp>
 #include <rmf_traffic/schedule/Database.hpp>
 #include "debug_Viewer.hpp"
 
+#include <cmath>
+#include <limits>
+
 namespace rmf_traffic {
 namespace schedule {
 
@@ -44,7 +48,7 @@ namespace internal {
 //==============================================================================
 Entry::Entry(Trajectory _trajectory,
     Version _version,
-    ConstEntryPtr _succeeds,
+    EntryPtr _succeeds,
     ChangePtr _change)
   : trajectory(std::move(_trajectory)),
     version(_version),
@@ -98,18 +102,24 @@ void ViewRelevanceInspector::reserve(const std::size_t size)
 }
 
 //==============================================================================
-void ViewRelevanceInspector::inspect(
-    const ConstEntryPtr& entry,
-    const rmf_traffic::internal::Spacetime& spacetime_region)
+bool ViewRelevanceInspector::needs_inspection(const ConstEntryPtr& entry) const
 {
   if(entry->succeeded_by)
-    return;
+    return false;
 
   if(after_version && versions.less_or_equal(entry->version, *after_version))
-    return;
+    return false;
 
-  if(rmf_traffic::internal::detect_conflicts(
-       entry->trajectory, spacetime_region, nullptr))
+  return true;
+}
+
+//==============================================================================
+void ViewRelevanceInspector::inspect(
+    const ConstEntryPtr& entry,
+    const rmf_traffic::internal::Spacetime&,
+    const bool in_region)
+{
+  if(in_region)
     elements.emplace_back(Viewer::View::Element{
                             entry->version, entry->trajectory});
 }
@@ -127,7 +137,10 @@ void ViewRelevanceInspector::inspect(
     return;
 
   const Trajectory& trajectory = entry->trajectory;
-  assert(trajectory.start_time() != nullptr);
+
+  // Erasure entries do not have any trajectory to view
+  if(!trajectory.start_time())
+    return;
 
   if(lower_time_bound && *trajectory.finish_time() < *lower_time_bound)
     return;
@@ -139,158 +152,687 @@ void ViewRelevanceInspector::inspect(
                           entry->version, entry->trajectory});
 }
 
-} // namespace internal
+//==============================================================================
+bool in_region(
+    const ConstEntryPtr& entry,
+    const rmf_traffic::internal::Spacetime& spacetime,
+    DetectConflict::Context* const context)
+{
+  // Erasure entries do not have any trajectory to test
+  if(!entry->trajectory.start_time())
+    return false;
+
+  return rmf_traffic::internal::detect_conflicts(
+        entry->trajectory, spacetime, nullptr, context);
+}
 
 //==============================================================================
-internal::EntryPtr Viewer::Implementation::add_entry(
-    internal::EntryPtr entry,
-    const bool erasure)
+constexpr double Bucket::CellSize;
+constexpr std::size_t Bucket::MaxCellsPerEntry;
+
+//==============================================================================
+auto Bucket::make_cell(const int64_t x, const int64_t y) -> Cell
 {
-  all_entries.insert(std::make_pair(entry->version, entry));
+  return (static_cast<Cell>(static_cast<uint32_t>(x)) << 32)
+      | static_cast<Cell>(static_cast<uint32_t>(y));
+}
 
-  if(!erasure)
+//==============================================================================
+bool Bucket::get_cell_range(
+    const rmf_traffic::internal::BoundingBox& box,
+    CellRange& range)
+{
+  const double limit =
+      static_cast<double>(std::numeric_limits<int32_t>::max());
+
+  double cells[4];
+  const double values[4] = {box.min[0], box.max[0], box.min[1], box.max[1]};
+  for(std::size_t i=0; i < 4; ++i)
   {
-    const Trajectory& trajectory = entry->trajectory;
-    assert(trajectory.start_time());
-    const Time start_time = *trajectory.start_time();
-    const Time finish_time = *trajectory.finish_time();
+    cells[i] = std::floor(values[i]/CellSize);
+
+    // This also catches NaN values
+    if(!(std::abs(cells[i]) < limit))
+      return false;
+  }
+
+  range.x_min = static_cast<int64_t>(cells[0]);
+  range.x_max = static_cast<int64_t>(cells[1]);
+  range.y_min = static_cast<int64_t>(cells[2]);
+  range.y_max = static_cast<int64_t>(cells[3]);
+
+  return range.x_min <= range.x_max && range.y_min <= range.y_max;
+}
 
-    const MapToTimeline::iterator map_it = timelines.insert(
-          std::make_pair(entry->trajectory.get_map_name(), Timeline())).first;
+//==============================================================================
+void Bucket::insert(ConstEntryPtr entry, Cells cells)
+{
+  _positions[entry.get()] = _items.size();
+  _items.emplace_back(Item{std::move(entry), std::move(cells)});
+  _index(_items.back());
+}
 
-    Timeline& timeline = map_it->second;
+//==============================================================================
+bool Bucket::erase(const ConstEntryPtr& entry)
+{
+  const std::size_t position = _find(entry);
+  if(position == _items.size())
+    return _retired.erase(entry) > 0;
 
-    const Timeline::iterator start_it =
-        get_timeline_iterator(timeline, start_time);
-    const Timeline::iterator finish_it =
-        get_timeline_iterator(timeline, finish_time);
+  _unindex(_items[position]);
+  _remove_item(position);
+  return true;
+}
 
-    const Timeline::const_iterator end_it = ++Timeline::iterator(finish_it);
+//==============================================================================
+bool Bucket::replace(const ConstEntryPtr& original, ConstEntryPtr successor)
+{
+  const std::size_t position = _find(original);
+  if(position == _items.size())
+    return false;
 
-    for(auto it = start_it; it != end_it; ++it)
-    {
-      it->second.push_back(entry);
-    }
+  if(original == successor)
+    return true;
+
+  // The cells stay the same, so we only need to swap out the pointers that
+  // refer to the original entry.
+  const auto swap_in = [&](std::vector<ConstEntryPtr>& entries)
+  {
+    std::replace(entries.begin(), entries.end(), original, successor);
+  };
+
+  Item& item = _items[position];
+  if(item.cells.empty())
+  {
+    swap_in(_unbounded);
+  }
+  else
+  {
+    for(const Cell cell : item.cells)
+      swap_in(_grid.at(cell));
   }
 
-  return entry;
+  _positions.erase(original.get());
+  _positions[successor.get()] = position;
+  _retired.insert(std::move(item.entry));
+  item.entry = std::move(successor);
+  return true;
 }
 
 //==============================================================================
-void Viewer::Implementation::modify_entry(
-    const internal::EntryPtr& entry,
-    Trajectory new_trajectory,
-    const Version new_id)
+bool Bucket::replace(
+    const ConstEntryPtr& original,
+    ConstEntryPtr successor,
+    Cells cells)
 {
-  const Version old_version = entry->version;
-  all_entries.erase(old_version);
-  entry->version = new_id;
-  all_entries.insert(std::make_pair(new_id, entry));
+  const std::size_t position = _find(original);
+  if(position == _items.size())
+    return false;
 
-  // TODO(MXG): Handle the case where a replacement changes the map name
+  Item& item = _items[position];
+  _unindex(item);
+  if(original != successor)
+  {
+    _positions.erase(original.get());
+    _positions[successor.get()] = position;
+    _retired.insert(std::move(item.entry));
+  }
 
-  // TODO(MXG): It should be posssible to improve performance for entry
-  // modifications by applying the change directly to the original Trajectory
-  // object instead of making a copy.
-  Timeline& timeline = timelines.at(entry->trajectory.get_map_name());
+  item.entry = std::move(successor);
+  item.cells = std::move(cells);
+  _index(item);
+  return true;
+}
 
-  const Time old_start = *entry->trajectory.start_time();
-  const Time old_end = *entry->trajectory.finish_time();
-  // TODO(MXG): A micro-optimization might be to store these iterators in the
-  // entry data so we don't need to look them up again.
-  const Timeline::iterator old_start_it = timeline.lower_bound(old_start);
-  const Timeline::iterator old_end_it = timeline.lower_bound(old_end);
+//==============================================================================
+bool Bucket::retire(const ConstEntryPtr& entry)
+{
+  const std::size_t position = _find(entry);
+  if(position == _items.size())
+    return false;
+
+  _unindex(_items[position]);
+  _retired.insert(_items[position].entry);
+  _remove_item(position);
+  return true;
+}
+
+//==============================================================================
+bool Bucket::empty() const
+{
+  return _items.empty() && _retired.empty();
+}
 
-  const Time new_start = *new_trajectory.start_time();
-  const Time new_end = *new_trajectory.finish_time();
-  const Timeline::iterator new_start_it =
-      get_timeline_iterator(timeline, new_start);
-  const Timeline::iterator new_end_it =
-      get_timeline_iterator(timeline, new_end);
+//==============================================================================
+std::size_t Bucket::size() const
+{
+  return _items.size();
+}
 
-  entry->trajectory = std::move(new_trajectory);
+//==============================================================================
+std::size_t Bucket::_find(const ConstEntryPtr& entry) const
+{
+  const auto it = _positions.find(entry.get());
+  if(it == _positions.end())
+    return _items.size();
+
+  return it->second;
+}
 
-  // Fix the bucketing for this entry
-  if(old_end_it->first < new_start_it->first
-     || new_end_it->first < old_start_it->first)
+//==============================================================================
+void Bucket::_remove_item(const std::size_t position)
+{
+  _positions.erase(_items[position].entry.get());
+  if(position + 1 < _items.size())
   {
-    for(auto it = new_start_it; it != ++Timeline::iterator(new_end_it); ++it)
-    {
-      Bucket& bucket = it->second;
-      bucket.push_back(entry);
-    }
+    _items[position] = std::move(_items.back());
+    _positions[_items[position].entry.get()] = position;
+  }
 
-    for(auto it = old_start_it; it != ++Timeline::iterator(old_end_it); ++it)
-    {
-      Bucket& bucket = it->second;
-      bucket.erase(std::remove(bucket.begin(), bucket.end(), entry),
-                   bucket.end());
-    }
+  _items.pop_back();
+}
+
+//==============================================================================
+void Bucket::_index(const Item& item)
+{
+  if(item.cells.empty())
+  {
+    _unbounded.push_back(item.entry);
+    return;
+  }
+
+  for(const Cell cell : item.cells)
+    _grid[cell].push_back(item.entry);
+}
+
+//==============================================================================
+void Bucket::_unindex(const Item& item)
+{
+  const auto remove_from = [&](std::vector<ConstEntryPtr>& entries)
+  {
+    entries.erase(std::remove(entries.begin(), entries.end(), item.entry),
+                  entries.end());
+  };
+
+  if(item.cells.empty())
+  {
+    remove_from(_unbounded);
+    return;
+  }
+
+  for(const Cell cell : item.cells)
+  {
+    const auto cell_it = _grid.find(cell);
+    assert(cell_it != _grid.end());
+    remove_from(cell_it->second);
+    if(cell_it->second.empty())
+      _grid.erase(cell_it);
+  }
+}
+
+//==============================================================================
+constexpr std::size_t EntryStore::BlockBits;
+constexpr std::size_t EntryStore::BlockSize;
+constexpr Version EntryStore::SlotMask;
+
+//==============================================================================
+bool EntryStore::insert(EntryPtr entry)
+{
+  const Version version = entry->version;
+  Block& block = _blocks[version >> BlockBits];
+  EntryPtr& slot = block.slots[version & SlotMask];
+  if(slot)
+    return false;
+
+  slot = std::move(entry);
+  ++block.count;
+
+  if(_size == 0)
+  {
+    _first = version;
+    _last = version;
   }
   else
   {
-    if(old_start_it->first < new_start_it->first)
+    const Version ahead = version - _first;
+    const Version span = _last - _first;
+    if(ahead > span)
     {
-      for(auto it = old_start_it; it != new_start_it; ++it)
-      {
-        Bucket& bucket = it->second;
-        bucket.erase(std::remove(bucket.begin(), bucket.end(), entry),
-                     bucket.end());
-      }
+      // The version is outside of the range that we have. Extend the range
+      // towards whichever end is closer to it.
+      const Version behind = _first - version;
+      if(behind < ahead - span)
+        _first = version;
+      else
+        _last = version;
     }
-    else
+  }
+
+  ++_size;
+  return true;
+}
+
+//==============================================================================
+const EntryPtr* EntryStore::find(const Version version) const
+{
+  const auto it = _blocks.find(version >> BlockBits);
+  if(it == _blocks.end())
+    return nullptr;
+
+  const EntryPtr& slot = it->second.slots[version & SlotMask];
+  if(!slot)
+    return nullptr;
+
+  return &slot;
+}
+
+//==============================================================================
+bool EntryStore::erase(const Version version)
+{
+  const auto it = _blocks.find(version >> BlockBits);
+  if(it == _blocks.end())
+    return false;
+
+  EntryPtr& slot = it->second.slots[version & SlotMask];
+  if(!slot)
+    return false;
+
+  slot = nullptr;
+  --_size;
+  if(--it->second.count == 0)
+    _blocks.erase(it);
+
+  if(_size > 0)
+  {
+    if(version == _first)
+      _first = _oldest_from(version);
+
+    if(version == _last)
+      _last = _newest_from(version);
+  }
+
+  return true;
+}
+
+//==============================================================================
+Version EntryStore::oldest() const
+{
+  assert(_size > 0);
+  return _first;
+}
+
+//==============================================================================
+std::size_t EntryStore::size() const
+{
+  return _size;
+}
+
+//==============================================================================
+bool EntryStore::empty() const
+{
+  return _size == 0;
+}
+
+//==============================================================================
+std::size_t EntryStore::capacity() const
+{
+  return _blocks.size() * BlockSize;
+}
+
+//==============================================================================
+Version EntryStore::_oldest_from(const Version version) const
+{
+  assert(_size > 0);
+  const Version key = version >> BlockBits;
+  auto it = _blocks.lower_bound(key);
+  while(true)
+  {
+    if(it == _blocks.end())
+      it = _blocks.begin();
+
+    const std::size_t begin = it->first == key ? (version & SlotMask) : 0;
+    for(std::size_t i = begin; i < BlockSize; ++i)
     {
-      for(auto it = new_start_it; it != old_start_it; ++it)
-      {
-        Bucket& bucket = it->second;
-        bucket.push_back(entry);
-      }
+      if(it->second.slots[i])
+        return (it->first << BlockBits) | i;
     }
 
-    if(new_end_it->first < old_end_it->first)
+    ++it;
+  }
+}
+
+//==============================================================================
+Version EntryStore::_newest_from(const Version version) const
+{
+  assert(_size > 0);
+  const Version key = version >> BlockBits;
+  auto it = _blocks.upper_bound(key);
+  while(true)
+  {
+    if(it == _blocks.begin())
+      it = _blocks.end();
+
+    --it;
+    const std::size_t end =
+        it->first == key ? (version & SlotMask) + 1 : BlockSize;
+    for(std::size_t i = end; i > 0; --i)
     {
-      const auto begin_erase = ++Timeline::iterator(new_end_it);
-      const auto end_erase = ++Timeline::iterator(old_end_it);
-      for(auto it = begin_erase; it != end_erase; ++it)
-      {
-        Bucket& bucket = it->second;
-        bucket.erase(std::remove(bucket.begin(), bucket.end(), entry),
-                     bucket.end());
-      }
+      if(it->second.slots[i-1])
+        return (it->first << BlockBits) | (i-1);
     }
-    else
+  }
+}
+
+} // namespace internal
+
+namespace {
+
+//==============================================================================
+/// Find the grid cells that a trajectory passes through between the lower and
+/// upper time bounds. If the trajectory cannot be bounded, this returns an
+/// empty set of cells.
+internal::Bucket::Cells compute_cells(
+    const Trajectory& trajectory,
+    const Time lower_time_bound,
+    const Time upper_time_bound)
+{
+  using Bucket = internal::Bucket;
+  Bucket::Cells cells;
+
+  if(trajectory.size() < 2)
+    return cells;
+
+  Trajectory::const_iterator it = lower_time_bound <= *trajectory.start_time()?
+        ++trajectory.begin() : trajectory.find(lower_time_bound);
+
+  for(; it != trajectory.end(); ++it)
+  {
+    const auto& shape = it->get_profile()->get_shape();
+    if(!shape)
+      return {};
+
+    Bucket::CellRange range;
+    if(!Bucket::get_cell_range(
+         rmf_traffic::internal::get_bounding_box(Spline(it)), range))
+      return {};
+
+    for(int64_t x = range.x_min; x <= range.x_max; ++x)
     {
-      const auto begin_insert = ++Timeline::iterator(old_end_it);
-      const auto end_insert = ++Timeline::iterator(new_end_it);
-      for(auto it = begin_insert; it != end_insert; ++it)
+      for(int64_t y = range.y_min; y <= range.y_max; ++y)
       {
-        Bucket& bucket = it->second;
-        bucket.push_back(entry);
+        cells.push_back(Bucket::make_cell(x, y));
+        if(cells.size() > Bucket::MaxCellsPerEntry)
+          return {};
       }
     }
+
+    if(upper_time_bound <= it->get_finish_time())
+      break;
   }
+
+  std::sort(cells.begin(), cells.end());
+  cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+  return cells;
 }
 
 //==============================================================================
-void Viewer::Implementation::erase_entry(Version id)
+/// Check whether compute_cells() would only look at segments of the trajectory
+/// that finish before changed_from for the bucket that ends at bucket_time.
+bool cells_unchanged(
+    const Trajectory& trajectory,
+    const Time bucket_time,
+    const Time changed_from)
+{
+  if(trajectory.size() < 2)
+    return false;
+
+  // compute_cells() looks at every spline up to and including the first one
+  // that finishes at or after the end of the bucket.
+  Trajectory::const_iterator last = bucket_time <= *trajectory.start_time()?
+        ++trajectory.begin() : trajectory.find(bucket_time);
+
+  if(last == trajectory.end())
+    --last;
+
+  return last->get_finish_time() < changed_from;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+internal::EntryPtr Viewer::Implementation::add_entry(
+    internal::EntryPtr entry,
+    const bool erasure)
+{
+  all_entries.insert(entry);
+
+  if(!erasure)
+    add_to_timeline(entry);
+
+  return entry;
+}
+
+//==============================================================================
+internal::EntryPtr Viewer::Implementation::add_successor(
+    const internal::EntryPtr& original,
+    internal::EntryPtr successor,
+    const Time changed_from)
+{
+  all_entries.insert(successor);
+  update_timeline(original, original->trajectory, successor, changed_from);
+  return successor;
+}
+
+//==============================================================================
+void Viewer::Implementation::add_to_timeline(
+    const internal::ConstEntryPtr& entry)
+{
+  const Trajectory& trajectory = entry->trajectory;
+  assert(trajectory.start_time());
+  const Time start_time = *trajectory.start_time();
+  const Time finish_time = *trajectory.finish_time();
+
+  const MapToTimeline::iterator map_it = timelines.insert(
+        std::make_pair(trajectory.get_map_name(), Timeline())).first;
+
+  Timeline& timeline = map_it->second;
+
+  const Timeline::iterator start_it =
+      get_timeline_iterator(timeline, start_time);
+  const Timeline::iterator finish_it =
+      get_timeline_iterator(timeline, finish_time);
+
+  const Timeline::const_iterator end_it = ++Timeline::iterator(finish_it);
+
+  for(auto it = start_it; it != end_it; ++it)
+  {
+    // The first bucket of a timeline may span less than a full BucketDuration,
+    // so this window is sometimes a little wider than needed. That only makes
+    // the cells more conservative.
+    it->second.insert(
+          entry, compute_cells(trajectory, it->first - BucketDuration,
+                               it->first));
+  }
+}
+
+//==============================================================================
+void Viewer::Implementation::remove_from_timeline(
+    const internal::ConstEntryPtr& entry)
 {
-  const internal::EntryPtr& entry = get_entry_iterator(id, "erasure")->second;
+  const auto map_it = timelines.find(entry->trajectory.get_map_name());
+  if(map_it == timelines.end())
+    return;
 
-  Timeline& timeline = timelines.at(entry->trajectory.get_map_name());
+  Timeline& timeline = map_it->second;
 
-  const Time old_start = *entry->trajectory.start_time();
-  const Time old_end = *entry->trajectory.finish_time();
+  const Time start = *entry->trajectory.start_time();
+  const Time finish = *entry->trajectory.finish_time();
   // TODO(MXG): A micro-optimization might be to store these iterators in the
   // entry data so we don't need to look them up again.
-  const Timeline::iterator begin_it = timeline.lower_bound(old_start);
-  const Timeline::iterator end_it = ++timeline.lower_bound(old_end);
+  const Timeline::iterator begin_it = timeline.lower_bound(start);
+  const Timeline::iterator last_it = timeline.lower_bound(finish);
+  const Timeline::iterator end_it = last_it == timeline.end()?
+        timeline.end() : ++Timeline::iterator(last_it);
+
+  for(auto it = begin_it; it != end_it; ++it)
+    it->second.erase(entry);
+}
+
+//==============================================================================
+void Viewer::Implementation::retire_from_timeline(
+    const internal::ConstEntryPtr& entry)
+{
+  // Erasure entries never get put into the timeline
+  if(!entry->trajectory.start_time())
+    return;
+
+  const auto map_it = timelines.find(entry->trajectory.get_map_name());
+  if(map_it == timelines.end())
+    return;
+
+  Timeline& timeline = map_it->second;
+
+  const Timeline::iterator begin_it =
+      timeline.lower_bound(*entry->trajectory.start_time());
+  const Timeline::iterator last_it =
+      timeline.lower_bound(*entry->trajectory.finish_time());
+  const Timeline::iterator end_it = last_it == timeline.end()?
+        timeline.end() : ++Timeline::iterator(last_it);
+
   for(auto it = begin_it; it != end_it; ++it)
+    it->second.retire(entry);
+}
+
+//==============================================================================
+void Viewer::Implementation::update_timeline(
+    const internal::ConstEntryPtr& original,
+    const Trajectory& original_trajectory,
+    const internal::ConstEntryPtr& successor,
+    const Time changed_from)
+{
+  const Trajectory& trajectory = successor->trajectory;
+  const bool same_entry = original == successor;
+
+  if(original_trajectory.get_map_name() != trajectory.get_map_name())
+  {
+    const auto map_it = timelines.find(original_trajectory.get_map_name());
+    if(map_it != timelines.end())
+    {
+      Timeline& timeline = map_it->second;
+      const Timeline::iterator begin_it =
+          timeline.lower_bound(*original_trajectory.start_time());
+      const Timeline::iterator last_it =
+          timeline.lower_bound(*original_trajectory.finish_time());
+      const Timeline::iterator end_it = last_it == timeline.end()?
+            timeline.end() : ++Timeline::iterator(last_it);
+
+      for(auto it = begin_it; it != end_it; ++it)
+      {
+        if(same_entry)
+          it->second.erase(original);
+        else
+          it->second.retire(original);
+      }
+    }
+
+    add_to_timeline(successor);
+    return;
+  }
+
+  Timeline& timeline = timelines.insert(
+        std::make_pair(trajectory.get_map_name(), Timeline())).first->second;
+
+  // These are the bounds of the buckets that the original entry was put into
+  const Time original_start = *original_trajectory.start_time();
+  const Time original_finish = *original_trajectory.finish_time();
+  const Timeline::iterator original_begin = timeline.lower_bound(original_start);
+  const Timeline::iterator original_last = timeline.lower_bound(original_finish);
+
+  // Make sure there are buckets for the whole span of the successor. This will
+  // not move any of the buckets of the original entry.
+  const Timeline::iterator start_it =
+      get_timeline_iterator(timeline, *trajectory.start_time());
+  const Timeline::iterator finish_it =
+      get_timeline_iterator(timeline, *trajectory.finish_time());
+
+  const bool original_has_buckets = original_begin != timeline.end();
+  const Time first_bucket = original_has_buckets?
+        std::min(original_begin->first, start_it->first) : start_it->first;
+  const Time last_bucket = std::max(
+        finish_it->first, original_last == timeline.end()?
+          (--timeline.end())->first : original_last->first);
+
+  const auto in_original = [&](const Time bucket_time)
+  {
+    if(!original_has_buckets || bucket_time < original_begin->first)
+      return false;
+
+    return original_last == timeline.end() || bucket_time <= original_last->first;
+  };
+
+  const auto in_successor = [&](const Time bucket_time)
+  {
+    return start_it->first <= bucket_time && bucket_time <= finish_it->first;
+  };
+
+  const Timeline::iterator end_it = ++timeline.find(last_bucket);
+  for(auto it = timeline.find(first_bucket); it != end_it; ++it)
   {
+    const Time bucket_time = it->first;
     Bucket& bucket = it->second;
-    bucket.erase(std::remove(bucket.begin(), bucket.end(), entry),
-                 bucket.end());
+    const bool was_in = in_original(bucket_time);
+
+    if(!in_successor(bucket_time))
+    {
+      if(was_in)
+      {
+        if(same_entry)
+          bucket.erase(original);
+        else
+          bucket.retire(original);
+      }
+
+      continue;
+    }
+
+    if(was_in && cells_unchanged(trajectory, bucket_time, changed_from)
+       && bucket.replace(original, successor))
+      continue;
+
+    Bucket::Cells cells = compute_cells(
+          trajectory, bucket_time - BucketDuration, bucket_time);
+
+    if(!was_in || !bucket.replace(original, successor, cells))
+      bucket.insert(successor, std::move(cells));
   }
+}
+
+//==============================================================================
+void Viewer::Implementation::modify_entry(
+    internal::EntryPtr entry,
+    Trajectory new_trajectory,
+    const Version new_id,
+    const Time changed_from)
+{
+  // Note: The entry is taken by value because erasing it from all_entries
+  // would leave a reference into all_entries empty.
+  all_entries.erase(entry->version);
+  entry->version = new_id;
+  all_entries.insert(entry);
 
+  // Note: The new trajectory was derived from a copy of the entry's old
+  // trajectory, but Trajectory copies share their segment storage, so only the
+  // segments that were actually changed have been duplicated.
+  const Trajectory old_trajectory = std::move(entry->trajectory);
+  entry->trajectory = std::move(new_trajectory);
+  update_timeline(entry, old_trajectory, entry, changed_from);
+}
+
+//==============================================================================
+void Viewer::Implementation::erase_entry(Version id)
+{
+  const internal::EntryPtr entry = get_entry(id, "erasure");
+  remove_from_timeline(entry);
   all_entries.erase(id);
 }
 
@@ -351,26 +893,23 @@ std::string throw_missing_id_error(
 } // anonymous namespace
 
 //==============================================================================
-auto Viewer::Implementation::get_entry_iterator(
+const internal::EntryPtr& Viewer::Implementation::get_entry(
     const Version id,
-    const std::string& operation) -> EntryMap::iterator
+    const std::string& operation) const
 {
-  const auto old_entry_it = all_entries.find(id);
-  if(old_entry_it == all_entries.end())
+  const internal::EntryPtr* const entry = all_entries.find(id);
+  if(!entry)
   {
     throw_missing_id_error(
           operation, id, oldest_version, latest_version);
   }
 
-  return old_entry_it;
+  return *entry;
 }
 
 //==============================================================================
-void Viewer::Implementation::cull(Version id, Time time)
+bool Viewer::Implementation::cull(Version id, Time time)
 {
-  cull_has_occurred = true;
-  last_cull = std::make_pair(id, time);
-
   std::unordered_set<Version> culled;
   for(auto& pair : timelines)
   {
@@ -382,17 +921,10 @@ void Viewer::Implementation::cull(Version id, Time time)
     for(Timeline::iterator it = timeline.begin(); it != end_it; ++it)
     {
       Bucket& bucket = it->second;
-      const Bucket::iterator removed =
-          std::remove_if(bucket.begin(), bucket.end(),
-                     [&](const internal::ConstEntryPtr& entry) -> bool
+      bucket.erase_if([&](const internal::ConstEntryPtr& entry) -> bool
       {
         return *entry->trajectory.finish_time() < time;
-      });
-
-      for(Bucket::iterator bit = removed; bit != bucket.end(); ++bit)
-        culled.insert((*bit)->version);
-
-      bucket.erase(removed, bucket.end());
+      }, culled);
     }
 
     Timeline::iterator stop_erasing = timeline.begin();
@@ -412,11 +944,115 @@ void Viewer::Implementation::cull(Version id, Time time)
     timeline.erase(timeline.begin(), stop_erasing);
   }
 
+  std::vector<internal::EntryPtr> culled_entries;
+  culled_entries.reserve(culled.size());
   for(const Version v : culled)
+  {
+    const internal::EntryPtr* const entry = all_entries.find(v);
+    if(!entry)
+      continue;
+
+    culled_entries.push_back(*entry);
     all_entries.erase(v);
+  }
+
+  if(culled_entries.empty())
+    return false;
+
+  cull_has_occurred = true;
+  last_cull = std::make_pair(id, time);
+
+  // An erasure only needs to be remembered while some mirror might still have
+  // a copy of the erased lineage. Once every entry of that lineage has been
+  // culled, any mirror will drop its copy when it receives the cull.
+  all_entries.erase_if([&](const internal::EntryPtr& entry) -> bool
+  {
+    if(entry->trajectory.start_time())
+      return false;
+
+    for(auto e = entry->succeeds; e; e = e->succeeds)
+    {
+      if(is_indexed(*e))
+        return false;
+    }
+
+    culled_entries.push_back(entry);
+    return true;
+  });
+
+  all_entries.for_each([&](const internal::EntryPtr& entry)
+  {
+    compact_history(entry);
+  });
+
+  for(const auto& entry : culled_entries)
+    compact_history(entry);
 
   if(!all_entries.empty())
-    oldest_version = all_entries.begin()->first;
+    oldest_version = all_entries.oldest();
+
+  return true;
+}
+
+//==============================================================================
+void Viewer::Implementation::compact_history(
+    const internal::EntryPtr& head) const
+{
+  // Only begin from the newest entry of a lineage, or from an entry whose
+  // successor has already been detached from it.
+  if(head->succeeded_by && head->succeeded_by->succeeds == head)
+    return;
+
+  std::vector<internal::EntryPtr> lineage;
+  for(auto e = head; e; e = e->succeeds)
+    lineage.push_back(e);
+
+  // The lineage is ordered from newest to oldest. Find the span of entries
+  // that are still indexed.
+  std::size_t newest_indexed = lineage.size();
+  std::size_t oldest_indexed = lineage.size();
+  for(std::size_t i=0; i < lineage.size(); ++i)
+  {
+    if(!is_indexed(*lineage[i]))
+      continue;
+
+    if(newest_indexed == lineage.size())
+      newest_indexed = i;
+
+    oldest_indexed = i;
+  }
+
+  // Every entry that is older than the oldest indexed entry has been culled,
+  // and so has every copy of it in the mirrors, so that history can be
+  // released completely.
+  const std::size_t release_from =
+      oldest_indexed == lineage.size()? 0 : oldest_indexed + 1;
+
+  if(release_from > 0)
+    lineage[release_from-1]->succeeds = nullptr;
+
+  for(std::size_t i = release_from; i < lineage.size(); ++i)
+  {
+    lineage[i]->succeeds = nullptr;
+    lineage[i]->succeeded_by = nullptr;
+  }
+
+  // If the newest entries of the lineage have been culled while some older
+  // entry is still indexed, then that older entry must still be known to be
+  // superseded. Keep the forward links so that it stays that way, but drop the
+  // backward links so that no reference cycles are left behind.
+  if(newest_indexed < lineage.size())
+  {
+    for(std::size_t i=0; i < newest_indexed; ++i)
+      lineage[i]->succeeds = nullptr;
+  }
+}
+
+//==============================================================================
+bool Viewer::Implementation::is_indexed(const internal::Entry& entry) const
+{
+  const internal::EntryPtr* const indexed = all_entries.find(entry.version);
+  return indexed && indexed->get() == &entry;
 }
 
 //==============================================================================
@@ -426,7 +1062,8 @@ Trajectory add_interruption(
     // old trajectory, but we will now be turning it into the new trajectory.
     Trajectory new_trajectory,
     const Trajectory& interruption_trajectory,
-    const Duration delay)
+    const Duration delay,
+    Time* const changed_from)
 {
   assert(interruption_trajectory.start_time());
   const Time interrupt_start_time = *interruption_trajectory.start_time();
@@ -437,8 +1074,20 @@ Trajectory add_interruption(
   Trajectory::iterator delayed_segment =
       new_trajectory.find(*interruption_trajectory.start_time());
 
+  // The interruption segments all finish at or after the start of the
+  // interruption, and so do the segments that will get delayed.
+  Time first_change = interrupt_start_time;
   if(delayed_segment != new_trajectory.end())
+  {
+    const Time delayed_time = delayed_segment->get_finish_time();
+    first_change = std::min(
+          first_change, std::min(delayed_time, delayed_time + total_delay));
+
     delayed_segment->adjust_finish_times(total_delay);
+  }
+
+  if(changed_from)
+    *changed_from = first_change;
 
   for(const Trajectory::Segment& interrupt_segment : interruption_trajectory)
   {
@@ -456,17 +1105,34 @@ Trajectory add_interruption(
 Trajectory add_delay(
     Trajectory new_trajectory,
     const Time time,
-    const Duration delay)
+    const Duration delay,
+    Time* const changed_from)
 {
   assert(new_trajectory.start_time());
+
+  // Every segment that finishes before the first delayed segment is left
+  // untouched, and so is every segment that finishes before the delayed time
+  // of the first delayed segment.
+  const auto delay_from = [&](Trajectory::Segment& segment)
+  {
+    const Time t = segment.get_finish_time();
+    if(changed_from)
+      *changed_from = std::min(t, t + delay);
+
+    segment.adjust_finish_times(delay);
+  };
+
   if (time <= *new_trajectory.start_time())
   {
-    new_trajectory.begin()->adjust_finish_times(delay);
+    delay_from(*new_trajectory.begin());
     return new_trajectory;
   }
   else if(*new_trajectory.finish_time() < time)
   {
     // No need for an adjustment
+    if(changed_from)
+      *changed_from = Time::max();
+
     return new_trajectory;
   }
 
@@ -476,7 +1142,7 @@ Trajectory add_delay(
     // but we apply it to the entire trajectory without being concerned about
     // the from_time parameter.
     // TODO(MXG): Consider if there is a more "correct" way to support this.
-    new_trajectory.begin()->adjust_finish_times(delay);
+    delay_from(*new_trajectory.begin());
     return new_trajectory;
   }
 
@@ -494,7 +1160,7 @@ Trajectory add_delay(
   // TODO(MXG): Consider inserting a new segment(s) in the trajectory when
   // adding the delay. That may help to smooth things out further.
 
-  delayed_segment->adjust_finish_times(delay);
+  delay_from(*delayed_segment);
 
   return new_trajectory;
 }
@@ -562,6 +1228,50 @@ Version Viewer::latest_version() const
   return _pimpl->latest_version;
 }
 
+//==============================================================================
+Viewer::Statistics Viewer::statistics() const
+{
+  Statistics stats;
+  stats.entries = _pimpl->all_entries.size();
+
+  for(const auto& pair : _pimpl->timelines)
+    stats.buckets += pair.second.size();
+
+  std::unordered_set<const internal::Entry*> history;
+  _pimpl->all_entries.for_each([&](const internal::EntryPtr& entry)
+  {
+    stats.segments += entry->trajectory.size();
+    if(entry->succeeded_by)
+      ++stats.superseded_entries;
+
+    // Indexed entries get visited by the outer loop, and history that was
+    // already visited does not need to be walked again.
+    for(auto e = entry->succeeds; e && !_pimpl->is_indexed(*e); e = e->succeeds)
+    {
+      if(!history.insert(e.get()).second)
+        break;
+
+      stats.segments += e->trajectory.size();
+    }
+  });
+
+  stats.history_entries = history.size();
+
+  return stats;
+}
+
+//==============================================================================
+void Viewer::set_thread_pool(std::shared_ptr<ThreadPool> pool)
+{
+  _pimpl->thread_pool = std::move(pool);
+}
+
+//==============================================================================
+const std::shared_ptr<ThreadPool>& Viewer::get_thread_pool() const
+{
+  return _pimpl->thread_pool;
+}
+
 //==============================================================================
 Viewer::Viewer()
   : _pimpl(rmf_utils::make_impl<Implementation>())
@@ -19,10 +19,14 @@
 #define SRC__RMF_TRAFFIC__SCHEDULE__VIEWERINTERNAL_HPP
 
 #include "../DetectConflictInternal.hpp"
+#include "../ThreadPoolInternal.hpp"
 
 #include <rmf_traffic/schedule/Viewer.hpp>
 #include <rmf_traffic/schedule/Database.hpp>
 
+#include <algorithm>
+#include <array>
+#include <limits>
 #include <map>
 #include <unordered_map>
 #include <unordered_set>
@@ -47,11 +51,12 @@ struct Entry
   // The version number of this entry
   Version version;
 
-  // Succeeds
-  ConstEntryPtr succeeds;
+  // The entry that this entry succeeds. Culling will cut this link once every
+  // older entry in the history has been culled.
+  EntryPtr succeeds;
 
   // A version that succeeded this entry, if such a version exists
-  ConstEntryPtr succeeded_by;
+  EntryPtr succeeded_by;
 
   // The change that led to this entry
   ConstChangePtr change;
@@ -60,7 +65,7 @@ struct Entry
   Entry(
       Trajectory _trajectory,
       Version _version,
-      ConstEntryPtr _succeeds = nullptr,
+      EntryPtr _succeeds = nullptr,
       ChangePtr _change = nullptr);
 };
 
@@ -162,9 +167,16 @@ public:
   virtual void after(const Version* after) = 0;
   virtual void reserve(Version size) = 0;
 
+  /// Returns false if the entry can be skipped without testing it against any
+  /// spacetime region.
+  virtual bool needs_inspection(const ConstEntryPtr& entry) const = 0;
+
+  /// Inspect an entry whose trajectory has already been tested against the
+  /// spacetime region. The result of that test is given by in_region.
   virtual void inspect(
       const ConstEntryPtr& entry,
-      const rmf_traffic::internal::Spacetime& spacetime) = 0;
+      const rmf_traffic::internal::Spacetime& spacetime,
+      bool in_region) = 0;
 
   virtual void inspect(
       const ConstEntryPtr& entry,
@@ -186,9 +198,12 @@ public:
 
   void reserve(std::size_t size) final;
 
+  bool needs_inspection(const ConstEntryPtr& entry) const final;
+
   void inspect(
       const ConstEntryPtr& entry,
-      const rmf_traffic::internal::Spacetime& spacetime_region) final;
+      const rmf_traffic::internal::Spacetime& spacetime_region,
+      bool in_region) final;
 
   void inspect(
       const ConstEntryPtr& entry,
@@ -220,9 +235,12 @@ public:
       const ConstEntryPtr& entry,
       const std::function<bool(const ConstEntryPtr&)>& relevant);
 
+  bool needs_inspection(const ConstEntryPtr& entry) const final;
+
   void inspect(
       const ConstEntryPtr& entry,
-      const rmf_traffic::internal::Spacetime& spacetime) final;
+      const rmf_traffic::internal::Spacetime& spacetime,
+      bool in_region) final;
 
   void inspect(
       const ConstEntryPtr& entry,
@@ -236,18 +254,440 @@ public:
   std::vector<Database::Change> relevant_changes;
 };
 
+//==============================================================================
+/// Test whether the trajectory of an entry passes through a spacetime region.
+/// The trajectories of erasure entries never do. A context may be given to
+/// reuse collision objects across many calls on the same thread.
+bool in_region(
+    const ConstEntryPtr& entry,
+    const rmf_traffic::internal::Spacetime& spacetime,
+    DetectConflict::Context* context = nullptr);
+
+//==============================================================================
+/// A time bucket of a schedule timeline.
+///
+/// Besides listing every entry that is active during the bucket's time window,
+/// the bucket keeps a uniform grid of the space that each entry's trajectory
+/// sweeps through during that window. Spatial queries can then skip over any
+/// entries that are nowhere near the region of interest.
+///
+/// Entries that have been superseded by a newer version are moved out of the
+/// grid and into a separate set. They are only kept there so that culling can
+/// find them, since no query will ever report them.
+class Bucket
+{
+public:
+
+  /// The key of a grid cell
+  using Cell = uint64_t;
+  using Cells = std::vector<Cell>;
+
+  /// The range of grid cells that overlap with a bounding box
+  struct CellRange
+  {
+    int64_t x_min;
+    int64_t x_max;
+    int64_t y_min;
+    int64_t y_max;
+  };
+
+  struct Item
+  {
+    ConstEntryPtr entry;
+
+    // The cells that this entry's trajectory passes through. If this is empty
+    // then the trajectory could not be bounded, so it will be visited by every
+    // spatial query.
+    Cells cells;
+  };
+
+  /// Side length of a grid cell, in meters
+  static constexpr double CellSize = 5.0;
+
+  /// Entries that would occupy more cells than this are treated as unbounded
+  static constexpr std::size_t MaxCellsPerEntry = 256;
+
+  static Cell make_cell(int64_t x, int64_t y);
+
+  /// Get the range of cells that overlap with the given box. Returns false if
+  /// the box is too large or malformed to be expressed as a range of cells.
+  static bool get_cell_range(
+      const rmf_traffic::internal::BoundingBox& box,
+      CellRange& range);
+
+  /// Add an entry to this bucket. The cells should be sorted and unique.
+  void insert(ConstEntryPtr entry, Cells cells);
+
+  /// Remove an entry from this bucket. Returns false if the entry was not in
+  /// this bucket.
+  bool erase(const ConstEntryPtr& entry);
+
+  /// Put a successor in the place of an entry, keeping the cells that were
+  /// computed for the original entry. If the successor is a different entry,
+  /// the original entry gets retired. Returns false if the original entry was
+  /// not in this bucket.
+  bool replace(const ConstEntryPtr& original, ConstEntryPtr successor);
+
+  /// Put a successor in the place of an entry, using a new set of cells for
+  /// it. If the successor is a different entry, the original entry gets
+  /// retired. Returns false if the original entry was not in this bucket, in
+  /// which case nothing is changed.
+  bool replace(
+      const ConstEntryPtr& original,
+      ConstEntryPtr successor,
+      Cells cells);
+
+  /// Take an entry out of the grid because it has been superseded. It will no
+  /// longer be visited by for_each() or for_each_nearby(), but it can still be
+  /// culled. Returns false if the entry was not in the grid of this bucket.
+  bool retire(const ConstEntryPtr& entry);
+
+  /// Remove every entry that satisfies the predicate, and report the versions
+  /// of the entries that were removed.
+  template<typename Predicate>
+  void erase_if(Predicate pred, std::unordered_set<Version>& removed)
+  {
+    const auto erased = std::stable_partition(
+          _items.begin(), _items.end(),
+          [&](const Item& item) { return !pred(item.entry); });
+
+    if(erased != _items.end())
+    {
+      for(auto it = erased; it != _items.end(); ++it)
+      {
+        removed.insert(it->entry->version);
+        _unindex(*it);
+      }
+
+      _items.erase(erased, _items.end());
+
+      // The items that remain may have moved, so their positions are indexed
+      // again from scratch.
+      _positions.clear();
+      for(std::size_t i=0; i < _items.size(); ++i)
+        _positions[_items[i].entry.get()] = i;
+    }
+
+    for(auto it = _retired.begin(); it != _retired.end();)
+    {
+      if(pred(*it))
+      {
+        removed.insert((*it)->version);
+        it = _retired.erase(it);
+      }
+      else
+        ++it;
+    }
+  }
+
+  /// Visit every entry in this bucket
+  template<typename F>
+  void for_each(F&& f) const
+  {
+    for(const Item& item : _items)
+      f(item.entry);
+  }
+
+  /// Visit the entries whose trajectories might pass through the given box.
+  /// An entry may be visited more than once if it occupies several cells.
+  template<typename F>
+  void for_each_nearby(
+      const rmf_traffic::internal::BoundingBox& box,
+      F&& f) const
+  {
+    CellRange range;
+    if(!get_cell_range(box, range))
+      return for_each(std::forward<F>(f));
+
+    for(const ConstEntryPtr& entry : _unbounded)
+      f(entry);
+
+    const std::size_t num_range_cells =
+        static_cast<std::size_t>(range.x_max - range.x_min + 1)
+        * static_cast<std::size_t>(range.y_max - range.y_min + 1);
+
+    if(_grid.size() < num_range_cells)
+    {
+      // The grid is sparser than the range that we're looking at, so it's
+      // cheaper to check every occupied cell against the range.
+      for(const auto& cell : _grid)
+      {
+        const int64_t x = static_cast<int32_t>(cell.first >> 32);
+        const int64_t y = static_cast<int32_t>(cell.first & 0xFFFFFFFF);
+        if(x < range.x_min || range.x_max < x
+           || y < range.y_min || range.y_max < y)
+          continue;
+
+        for(const ConstEntryPtr& entry : cell.second)
+          f(entry);
+      }
+
+      return;
+    }
+
+    for(int64_t x = range.x_min; x <= range.x_max; ++x)
+    {
+      for(int64_t y = range.y_min; y <= range.y_max; ++y)
+      {
+        const auto cell_it = _grid.find(make_cell(x, y));
+        if(cell_it == _grid.end())
+          continue;
+
+        for(const ConstEntryPtr& entry : cell_it->second)
+          f(entry);
+      }
+    }
+  }
+
+  /// True if this bucket has neither current nor retired entries
+  bool empty() const;
+
+  /// The number of current entries in this bucket
+  std::size_t size() const;
+
+private:
+
+  /// Get the position of an entry in _items, or _items.size() if the entry is
+  /// not one of them
+  std::size_t _find(const ConstEntryPtr& entry) const;
+
+  /// Remove the item at the given position by moving the last item into its
+  /// place
+  void _remove_item(std::size_t position);
+
+  void _index(const Item& item);
+
+  void _unindex(const Item& item);
+
+  std::vector<Item> _items;
+  std::unordered_map<const Entry*, std::size_t> _positions;
+  std::unordered_set<ConstEntryPtr> _retired;
+  std::unordered_map<Cell, std::vector<ConstEntryPtr>> _grid;
+  std::vector<ConstEntryPtr> _unbounded;
+};
+
+//==============================================================================
+/// A store of schedule entries, indexed by their versions.
+///
+/// The database hands out versions in increasing order, so the entries are kept
+/// in fixed-size blocks of slots, where each block covers a contiguous range of
+/// versions and the slot of a version is its offset inside of its block. The
+/// blocks are kept in a map that is keyed by the versions that they cover, and
+/// a block gets removed as soon as it has no entries left, so the memory used
+/// by the store is proportional to the number of its entries rather than to
+/// the span between its oldest and newest versions.
+///
+/// The oldest and newest versions are compared with the same modular arithmetic
+/// as VersionRange, and the blocks are visited in a circle starting from the
+/// block of the oldest version, so the store keeps working after the version
+/// numbers overflow.
+class EntryStore
+{
+public:
+
+  /// Add an entry under its current version. Returns false, without changing
+  /// anything, if the store already has an entry with that version.
+  bool insert(EntryPtr entry);
+
+  /// Get the entry with the given version, or a nullptr if there is none.
+  const EntryPtr* find(Version version) const;
+
+  /// Remove the entry with the given version. Returns false if there was no
+  /// such entry.
+  bool erase(Version version);
+
+  /// Remove every entry that satisfies the predicate. The predicate may look
+  /// up other entries of the store while this is running.
+  template<typename F>
+  void erase_if(F&& predicate)
+  {
+    for(auto& block : _blocks)
+    {
+      for(EntryPtr& slot : block.second.slots)
+      {
+        if(slot && predicate(slot))
+        {
+          slot = nullptr;
+          --block.second.count;
+          --_size;
+        }
+      }
+    }
+
+    // Blocks are only removed after the predicate is done, so that it never
+    // looks into a block that is gone.
+    for(auto it = _blocks.begin(); it != _blocks.end();)
+    {
+      if(it->second.count == 0)
+        it = _blocks.erase(it);
+      else
+        ++it;
+    }
+
+    if(_size > 0)
+    {
+      _first = _oldest_from(_first);
+      _last = _newest_from(_last);
+    }
+  }
+
+  /// Visit every entry, from the oldest version to the newest
+  template<typename F>
+  void for_each(F&& f) const
+  {
+    if(_size == 0)
+      return;
+
+    _visit_from(_first, std::forward<F>(f));
+  }
+
+  /// Visit every entry whose version is newer than the given version, from
+  /// the oldest version to the newest. Only the blocks after that version get
+  /// touched, so this costs nothing for the entries that are older.
+  template<typename F>
+  void for_each_after(const Version version, F&& f) const
+  {
+    if(_size == 0)
+      return;
+
+    Version first = version + 1;
+    const Version ahead = first - _first;
+    const Version span = _last - _first;
+    if(ahead > span)
+    {
+      // The version is outside of the range that we have. If it is closer to
+      // the front of the store, then every entry is newer than it. Otherwise
+      // no entry is.
+      if(_first - first < ahead - span)
+        first = _first;
+      else
+        return;
+    }
+
+    _visit_from(first, std::forward<F>(f));
+  }
+
+  /// The version of the oldest entry. This must not be called while the store
+  /// is empty.
+  Version oldest() const;
+
+  /// The number of entries in the store
+  std::size_t size() const;
+
+  bool empty() const;
+
+  /// The number of slots that the store currently has allocated, including
+  /// the empty ones
+  std::size_t capacity() const;
+
+private:
+
+  static constexpr std::size_t BlockBits = 5;
+  static constexpr std::size_t BlockSize = std::size_t(1) << BlockBits;
+  static constexpr Version SlotMask = BlockSize - 1;
+
+  struct Block
+  {
+    std::array<EntryPtr, BlockSize> slots;
+    std::size_t count = 0;
+  };
+
+  using Blocks = std::map<Version, Block>;
+
+  /// Visit every entry from the given version up to the newest one. The
+  /// version must be within the range of the store.
+  template<typename F>
+  void _visit_from(const Version first, F&& f) const
+  {
+    const Version last_key = _last >> BlockBits;
+    auto it = _blocks.lower_bound(first >> BlockBits);
+    while(true)
+    {
+      if(it == _blocks.end())
+        it = _blocks.begin();
+
+      const std::size_t begin =
+          it->first == (first >> BlockBits) ? (first & SlotMask) : 0;
+
+      for(std::size_t i = begin; i < BlockSize; ++i)
+      {
+        const EntryPtr& slot = it->second.slots[i];
+        if(slot)
+          f(slot);
+      }
+
+      if(it->first == last_key)
+        return;
+
+      ++it;
+    }
+  }
+
+  /// Get the oldest version in the store that is not older than the given one
+  Version _oldest_from(Version version) const;
+
+  /// Get the newest version in the store that is not newer than the given one
+  Version _newest_from(Version version) const;
+
+  Blocks _blocks;
+  Version _first = 0;
+  Version _last = 0;
+  std::size_t _size = 0;
+};
+
 } // namespace internal
 
 //==============================================================================
-class Viewer::Implementation
+class Database::Change::Implementation
 {
 public:
 
-  using Bucket = std::vector<internal::ConstEntryPtr>;
+  Mode mode;
+  Insert insert;
+  Interrupt interrupt;
+  Delay delay;
+  Replace replace;
+  Erase erase;
+  Cull cull;
+
+  Version id;
 
-  // TODO(MXG): A possible performance improvement could be to introduce spatial
-  // buckets that are orthogonal to the time buckets. This could be added later
-  // without negatively impacting the API or ABI.
+  static Change make(const Mode mode, const Version id)
+  {
+    Change change;
+    change._pimpl->mode = mode;
+    change._pimpl->id = id;
+
+    return change;
+  }
+
+  static Change make_insert_ref(
+      const Trajectory* trajectory,
+      Version id);
+
+  // Note(MXG): We're not using make_interrupt_ref yet, and perhaps we never
+  // will. In theory this function could be used to save time and memory when a
+  // Database generates a Patch that includes an interrupt, but it would add
+  // complexity to the implementation of Patch generation, so I'm deferring that
+  // feature for later.
+  static Change make_interrupt_ref(
+      Version original_id,
+      const Trajectory* interruption_trajectory,
+      Duration delay,
+      Version id);
+
+  static Change make_replace_ref(
+      Version original_id,
+      const Trajectory* trajectory,
+      Version id);
+};
+
+//==============================================================================
+class Viewer::Implementation
+{
+public:
+
+  using Bucket = internal::Bucket;
 
   // Each bucket stores trajectories whose time span intersects with the range
   // ( key(timeline_it - 1), key(timeline_it) ].
@@ -257,9 +697,7 @@ public:
 
   MapToTimeline timelines;
 
-  // TODO(MXG): Consider using a sorted vector here instead of a std::map.
-  using EntryMap = std::map<Version, internal::EntryPtr>;
-  EntryMap all_entries;
+  internal::EntryStore all_entries;
 
   Version oldest_version = 0;
   Version latest_version = 0;
@@ -269,6 +707,10 @@ public:
   bool cull_has_occurred = false;
   std::pair<Version, Time> last_cull;
 
+  /// The pool that spreads out the region tests of a query, or a nullptr to
+  /// run them on the thread that makes the query.
+  std::shared_ptr<ThreadPool> thread_pool;
+
   static constexpr std::size_t ChangeModeNum =
       static_cast<std::size_t>(Database::Change::Mode::NUM);
   using Changers =
@@ -280,9 +722,46 @@ public:
 
   internal::EntryPtr add_entry(internal::EntryPtr entry, bool erasure = false);
 
-  /// Used by the Mirror class to make efficient changes to entries
-  void modify_entry(const internal::EntryPtr& entry,
-      Trajectory new_trajectory, const Version new_id);
+  /// Add an entry that supersedes an existing entry. The successor takes over
+  /// the place of the original entry in the timeline.
+  ///
+  /// \param[in] changed_from
+  ///   Every segment of the successor's trajectory that finishes before this
+  ///   time is identical to the original's. Timeline buckets that only cover
+  ///   those segments can keep using the cells of the original entry.
+  internal::EntryPtr add_successor(
+      const internal::EntryPtr& original,
+      internal::EntryPtr successor,
+      Time changed_from);
+
+  /// Put the entry into each timeline bucket that its trajectory passes through
+  void add_to_timeline(const internal::ConstEntryPtr& entry);
+
+  /// Take the entry out of each timeline bucket that its trajectory passes
+  /// through
+  void remove_from_timeline(const internal::ConstEntryPtr& entry);
+
+  /// Retire the entry in each timeline bucket that its trajectory passes
+  /// through, so that queries no longer visit it but culling can still find it.
+  void retire_from_timeline(const internal::ConstEntryPtr& entry);
+
+  /// Move the place of an entry in the timeline over to its successor. Only
+  /// the buckets whose contents have changed get their cells recomputed.
+  ///
+  /// If the successor is the same entry as the original, then the entry has
+  /// been modified in place, and original_trajectory must be the trajectory
+  /// that it had before the modification.
+  void update_timeline(
+      const internal::ConstEntryPtr& original,
+      const Trajectory& original_trajectory,
+      const internal::ConstEntryPtr& successor,
+      Time changed_from);
+
+  /// Used by the Mirror class to make efficient changes to entries. See
+  /// add_successor() for the meaning of changed_from.
+  void modify_entry(internal::EntryPtr entry,
+      Trajectory new_trajectory, const Version new_id,
+      Time changed_from = Time::min());
 
   /// Used by the Mirror class to erase entries that are no longer needed
   void erase_entry(Version id);
@@ -290,11 +769,25 @@ public:
   Timeline::iterator get_timeline_iterator(
       Timeline& timeline, Time time);
 
-  EntryMap::iterator get_entry_iterator(
+  /// Get the entry with the given version, or throw an exception that names
+  /// the operation if there is no such entry.
+  const internal::EntryPtr& get_entry(
       Version id,
-      const std::string& operation);
+      const std::string& operation) const;
+
+  /// Cull every entry whose trajectory finishes before the given time, and
+  /// compact the history of the entries that remain.
+  ///
+  /// \return true if any entries were culled.
+  bool cull(Version id, Time time);
+
+  /// Release the history of this entry that can no longer be relevant to any
+  /// mirror, and break the reference cycles that culled history would
+  /// otherwise leave behind.
+  void compact_history(const internal::EntryPtr& head) const;
 
-  void cull(Version id, Time time);
+  /// Check whether this exact entry is still indexed by all_entries
+  bool is_indexed(const internal::Entry& entry) const;
 
   static Timeline::const_iterator get_timeline_end(
       const Timeline& timeline, const Time* upper_time_bound)
@@ -314,8 +807,20 @@ public:
       const Query::Spacetime::Regions& regions,
       RelevanceInspectorT& inspector) const
   {
-    std::unordered_set<Version> checked;
-    checked.reserve(all_entries.size());
+    // Each space of each region gets its own spacetime, and each entry gets
+    // tested against every spacetime that it is found near until one of them
+    // contains it.
+    struct Test
+    {
+      internal::ConstEntryPtr entry;
+      std::vector<std::size_t> spacetimes;
+    };
+
+    std::unordered_map<Version, std::size_t> test_of_entry;
+    test_of_entry.reserve(all_entries.size());
+
+    std::vector<rmf_traffic::internal::Spacetime> spacetimes;
+    std::vector<Test> tests;
 
     for(const Region& region : regions)
     {
@@ -342,24 +847,84 @@ public:
         spacetime_data.pose = space_it->get_pose();
         spacetime_data.shape = space_it->get_shape();
 
+        const std::size_t spacetime_index = spacetimes.size();
+        spacetimes.push_back(spacetime_data);
+
+        const auto inspect_entry = [&](const internal::ConstEntryPtr& entry_ptr)
+        {
+          const auto inserted = test_of_entry.insert(
+                std::make_pair(entry_ptr->version, tests.size()));
+
+          if(!inserted.second)
+          {
+            // This entry has already been found, so it only needs to be tested
+            // against one more spacetime. Entries that do not need inspection
+            // are marked with an index that is past the end of tests.
+            const std::size_t t = inserted.first->second;
+            if(t < tests.size()
+               && tests[t].spacetimes.back() != spacetime_index)
+              tests[t].spacetimes.push_back(spacetime_index);
+
+            return;
+          }
+
+          if(!inspector.needs_inspection(entry_ptr))
+          {
+            inserted.first->second = std::numeric_limits<std::size_t>::max();
+            return;
+          }
+
+          tests.push_back(Test{entry_ptr, {spacetime_index}});
+        };
+
+        const bool bounded = static_cast<bool>(spacetime_data.shape);
+        const rmf_traffic::internal::BoundingBox region_box = bounded?
+              rmf_traffic::internal::get_bounding_box(
+                spacetime_data.pose, *spacetime_data.shape)
+            : rmf_traffic::internal::BoundingBox();
+
         auto timeline_it = timeline_begin;
         for(; timeline_it != timeline_end; ++timeline_it)
         {
           const Bucket& bucket = timeline_it->second;
+          if(bounded)
+            bucket.for_each_nearby(region_box, inspect_entry);
+          else
+            bucket.for_each(inspect_entry);
+        }
+      }
+    }
 
-          auto entry_it = bucket.begin();
-          for(; entry_it != bucket.end(); ++entry_it)
+    // The region tests are independent of each other, so they can be spread
+    // across the thread pool. Their results are stored by index so that the
+    // inspector sees the entries in the same order no matter how the tests
+    // were run. Each result is the spacetime that contains the entry, or the
+    // first spacetime that it was found near if none of them contain it.
+    std::vector<std::size_t> found_in(tests.size());
+    std::vector<char> results(tests.size(), false);
+    ThreadPool::Implementation::for_each_range(
+          thread_pool.get(), tests.size(),
+          [&](const std::size_t begin, const std::size_t end)
+    {
+      DetectConflict::Context context;
+      for(std::size_t i=begin; i < end; ++i)
+      {
+        const Test& test = tests[i];
+        found_in[i] = test.spacetimes.front();
+        for(const std::size_t s : test.spacetimes)
+        {
+          if(internal::in_region(test.entry, spacetimes[s], &context))
           {
-            const internal::ConstEntryPtr& entry_ptr = *entry_it;
-            // Test if we have already checked this entry
-            if(!checked.insert(entry_ptr->version).second)
-              continue;
-
-            inspector.inspect(entry_ptr, spacetime_data);
+            found_in[i] = s;
+            results[i] = true;
+            break;
           }
         }
       }
-    }
+    });
+
+    for(std::size_t i=0; i < tests.size(); ++i)
+      inspector.inspect(tests[i].entry, spacetimes[found_in[i]], results[i]);
   }
 
   template<typename RelevanceInspectorT>
@@ -390,16 +955,13 @@ public:
       for(; timeline_it != timeline_end; ++timeline_it)
       {
         const Bucket& bucket = timeline_it->second;
-
-        auto entry_it = bucket.begin();
-        for(; entry_it != bucket.end(); ++entry_it)
+        bucket.for_each([&](const internal::ConstEntryPtr& entry_ptr)
         {
-          const internal::ConstEntryPtr& entry_ptr = *entry_it;
           if(!checked.insert(entry_ptr->version).second)
-            continue;
+            return;
 
           inspector.inspect(entry_ptr, lower_time_bound, upper_time_bound);
-        }
+        });
       }
     }
   }
@@ -407,11 +969,10 @@ public:
   template<typename RelevanceInspectorT>
   void inspect_all(RelevanceInspectorT& inspector) const
   {
-    for(const auto pair : all_entries)
+    all_entries.for_each([&](const internal::ConstEntryPtr& entry_ptr)
     {
-      const internal::ConstEntryPtr& entry_ptr = pair.second;
       inspector.inspect(entry_ptr, nullptr, nullptr);
-    }
+    });
   }
 
   template<typename RelevanceInspectorT>
@@ -496,16 +1057,30 @@ public:
 };
 
 //==============================================================================
+/// Apply an interruption to a copy of an old trajectory. Copies of a Trajectory
+/// share their segments, so this only duplicates the segments of old_trajectory
+/// that the interruption actually changes.
+///
+/// If changed_from is not a nullptr, it will be set to a time such that every
+/// segment of the new trajectory which finishes before it is identical to the
+/// corresponding segment of old_trajectory.
 Trajectory add_interruption(
     Trajectory old_trajectory,
     const Trajectory& interruption_trajectory,
-    const Duration delay);
+    const Duration delay,
+    Time* changed_from = nullptr);
 
 //==============================================================================
+/// Apply a delay to a copy of an old trajectory. The delayed segments keep
+/// sharing their storage with old_trajectory, and the delay itself is only
+/// recorded as a time offset on them.
+///
+/// changed_from has the same meaning as it does for add_interruption().
 Trajectory add_delay(
     Trajectory old_trajectory,
     const Time time,
-    const Duration delay);
+    const Duration delay,
+    Time* changed_from = nullptr);
 
 } // namespace schedule
 } // namespace rmf_traffic
@@ -25,6 +25,8 @@
 
 #include "../utils_Trajectory.hpp"
 
+#include "src/rmf_traffic/agv/debug_Planner.hpp"
+
 #include <iostream>
 #include <iomanip>
 #include <thread>
@@ -383,6 +385,14 @@ SCENARIO("Test Configuration", "[config]")
         true, 1e-2, 5.0 * M_PI/180.0, 5.0 * M_PI/180.0);
     CHECK_INTERPOLATION(config.interpolation(), options_);
   }
+
+  WHEN("Set the precomputed goals")
+  {
+    CHECK(config.precomputed_goals().empty());
+    config.precomputed_goals({0});
+    REQUIRE(config.precomputed_goals().size() == 1);
+    CHECK(config.precomputed_goals().front() == 0);
+  }
 }
 
 SCENARIO("Test Options", "[options]")
@@ -3425,3 +3435,465 @@ SCENARIO("Test computing Starts from coordinates")
     CHECK(start_set.empty());
   }
 }
+
+//==============================================================================
+SCENARIO("Duplicate search states are pruned")
+{
+  using namespace std::chrono_literals;
+  using SearchDebug = rmf_traffic::agv::Planner::Debug::SearchDebug;
+
+  // A grid of holding points gives the planner many different ways to
+  // interleave the same waits and motions, which all lead to equivalent search
+  // states.
+  const std::string test_map_name = "test_map";
+  const std::size_t GridSize = test_performance? 4 : 3;
+  const double spacing = 5.0;
+
+  rmf_traffic::agv::Graph graph;
+  for(std::size_t i=0; i < GridSize; ++i)
+  {
+    for(std::size_t j=0; j < GridSize; ++j)
+      graph.add_waypoint(test_map_name, {spacing*i, spacing*j}, true);
+  }
+
+  const auto index = [&](const std::size_t i, const std::size_t j)
+  {
+    return i*GridSize + j;
+  };
+
+  for(std::size_t i=0; i < GridSize; ++i)
+  {
+    for(std::size_t j=0; j < GridSize; ++j)
+    {
+      if(i+1 < GridSize)
+      {
+        graph.add_lane(index(i, j), index(i+1, j));
+        graph.add_lane(index(i+1, j), index(i, j));
+      }
+
+      if(j+1 < GridSize)
+      {
+        graph.add_lane(index(i, j), index(i, j+1));
+        graph.add_lane(index(i, j+1), index(i, j));
+      }
+    }
+  }
+
+  const rmf_traffic::agv::VehicleTraits traits(
+      {0.7, 0.3}, {1.0, 0.45}, make_test_profile(UnitCircle));
+
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+  const std::size_t goal_index = index(GridSize-1, GridSize-1);
+
+  // Park an obstacle on the goal for a while, so the planner needs to wait
+  // somewhere along the way.
+  rmf_traffic::schedule::Database database;
+  const Eigen::Vector3d goal_position{
+    spacing*(GridSize-1), spacing*(GridSize-1), 0.0};
+  rmf_traffic::Trajectory obstacle{test_map_name};
+  obstacle.insert(
+        start_time, make_test_profile(UnitCircle),
+        goal_position, Eigen::Vector3d::Zero());
+  obstacle.insert(
+        start_time + 60s, make_test_profile(UnitCircle),
+        goal_position, Eigen::Vector3d::Zero());
+  database.insert(obstacle);
+
+  rmf_traffic::agv::Planner::Options options{database};
+  options.minimum_holding_time(5s);
+
+  const rmf_traffic::agv::Planner planner{
+    rmf_traffic::agv::Planner::Configuration{graph, traits},
+    options
+  };
+
+  const rmf_traffic::agv::Planner::StartSet starts = {
+    rmf_traffic::agv::Planner::Start{start_time, index(0, 0), 0.0}
+  };
+
+  const auto benchmark = [&](SearchDebug& debug)
+  {
+    rmf_utils::optional<rmf_traffic::agv::Plan> plan;
+    const auto begin = std::chrono::steady_clock::now();
+    for(std::size_t i=0; i < N; ++i)
+    {
+      debug.expanded_nodes = 0;
+      debug.pruned_nodes = 0;
+      plan = rmf_traffic::agv::Planner::Debug::plan(
+            planner, starts, rmf_traffic::agv::Planner::Goal{goal_index},
+            options, debug);
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    if(test_performance)
+    {
+      const double sec = rmf_traffic::time::to_seconds(end - begin);
+      std::cout << (debug.prune_duplicates? "\nWith" : "\nWithout")
+                << " pruning on a " << GridSize << "x" << GridSize << " grid"
+                << std::endl;
+      std::cout << "Expanded: " << debug.expanded_nodes
+                << " | Pruned: " << debug.pruned_nodes << std::endl;
+      std::cout << "Total: " << sec << std::endl;
+      std::cout << "Per run: " << sec/N << std::endl;
+    }
+
+    return plan;
+  };
+
+  SearchDebug unpruned;
+  unpruned.prune_duplicates = false;
+  const auto unpruned_plan = benchmark(unpruned);
+
+  SearchDebug pruned;
+  const auto pruned_plan = benchmark(pruned);
+
+  REQUIRE(unpruned_plan);
+  REQUIRE(pruned_plan);
+
+  // Pruning must not make the plan any worse
+  const auto unpruned_finish =
+      *unpruned_plan->get_trajectories().back().finish_time();
+  const auto pruned_finish =
+      *pruned_plan->get_trajectories().back().finish_time();
+  CHECK(rmf_traffic::time::to_seconds(pruned_finish - unpruned_finish)
+        == Approx(0.0).margin(1e-3));
+
+  // The obstacle should make the robot wait
+  CHECK(pruned_finish > start_time + 60s);
+
+  CHECK(unpruned.pruned_nodes == 0);
+  CHECK(pruned.pruned_nodes > 0);
+  CHECK(pruned.expanded_nodes < unpruned.expanded_nodes);
+}
+
+//==============================================================================
+SCENARIO("Precomputed heuristics")
+{
+  using namespace std::chrono_literals;
+  using Planner = rmf_traffic::agv::Planner;
+
+  // The waypoints are nudged off of a perfect grid so that every pair of
+  // waypoints has a unique shortest path between them.
+  const std::string test_map_name = "test_map";
+  const std::size_t GridSize = test_performance? 30 : 8;
+  const double spacing = 5.0;
+
+  rmf_traffic::agv::Graph graph;
+  for(std::size_t i=0; i < GridSize; ++i)
+  {
+    for(std::size_t j=0; j < GridSize; ++j)
+    {
+      const double nudge = 0.5*std::sin(7.0*i + 13.0*j);
+      graph.add_waypoint(test_map_name, {spacing*i + nudge, spacing*j - nudge});
+    }
+  }
+
+  const auto index = [&](const std::size_t i, const std::size_t j)
+  {
+    return i*GridSize + j;
+  };
+
+  for(std::size_t i=0; i < GridSize; ++i)
+  {
+    for(std::size_t j=0; j < GridSize; ++j)
+    {
+      if(i+1 < GridSize)
+      {
+        graph.add_lane(index(i, j), index(i+1, j));
+        graph.add_lane(index(i+1, j), index(i, j));
+      }
+
+      if(j+1 < GridSize)
+      {
+        graph.add_lane(index(i, j), index(i, j+1));
+        graph.add_lane(index(i, j+1), index(i, j));
+      }
+    }
+  }
+
+  const rmf_traffic::agv::VehicleTraits traits(
+      {0.7, 0.3}, {1.0, 0.45}, make_test_profile(UnitCircle));
+
+  const std::vector<std::size_t> goals = {
+    index(0, GridSize-1),
+    index(GridSize-1, 0),
+    index(GridSize-1, GridSize-1),
+    index(GridSize/2, GridSize/2)
+  };
+
+  const std::vector<std::size_t> starts = {
+    index(0, 0),
+    index(GridSize/3, 2*GridSize/3),
+    index(2*GridSize/3, GridSize/4)
+  };
+
+  rmf_traffic::schedule::Database database;
+  const Planner::Options options{database};
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+
+  const auto benchmark = [&](const Planner::Configuration& config)
+  {
+    const auto begin = std::chrono::steady_clock::now();
+    const Planner planner{config, options};
+    const auto constructed = std::chrono::steady_clock::now();
+
+    // Planning from a copy of the planner shows that the tables are shared
+    const Planner copy = planner;
+    std::vector<rmf_traffic::Time> finish_times;
+    for(const std::size_t goal : goals)
+    {
+      for(const std::size_t start : starts)
+      {
+        const auto plan = copy.plan(
+              Planner::Start{start_time, start, 0.0}, Planner::Goal{goal});
+        REQUIRE(plan);
+        finish_times.push_back(
+              *plan->get_trajectories().back().finish_time());
+      }
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    if(test_performance)
+    {
+      const double startup = rmf_traffic::time::to_seconds(constructed - begin);
+      const double sec = rmf_traffic::time::to_seconds(end - constructed);
+      const std::size_t runs = goals.size()*starts.size();
+      const bool lazy = config.precomputed_goals().empty();
+      std::cout << (lazy? "\nLazy" : "\nPrecomputed") << " heuristics on a "
+                << GridSize << "x" << GridSize << " grid"
+                << std::endl;
+      std::cout << "Startup: " << startup << std::endl;
+      std::cout << "Total: " << sec << std::endl;
+      std::cout << "Per run: " << sec/runs << std::endl;
+    }
+
+    return finish_times;
+  };
+
+  const Planner::Configuration lazy_config{graph, traits};
+  const auto lazy_finish_times = benchmark(lazy_config);
+
+  Planner::Configuration precomputed_config{graph, traits};
+  precomputed_config.precomputed_goals(goals);
+  const auto precomputed_finish_times = benchmark(precomputed_config);
+
+  // The precomputed tables must lead to the same plans as the lazy heuristic
+  REQUIRE(lazy_finish_times.size() == precomputed_finish_times.size());
+  for(std::size_t i=0; i < lazy_finish_times.size(); ++i)
+  {
+    CHECK(rmf_traffic::time::to_seconds(
+            precomputed_finish_times[i] - lazy_finish_times[i])
+          == Approx(0.0).margin(1e-3));
+  }
+}
+
+//==============================================================================
+SCENARIO("Batch planning")
+{
+  using Planner = rmf_traffic::agv::Planner;
+
+  // A straight corridor of waypoints
+  const std::string test_map_name = "test_map";
+  const std::size_t NumWaypoints = 8;
+  rmf_traffic::agv::Graph graph;
+  for(std::size_t i=0; i < NumWaypoints; ++i)
+    graph.add_waypoint(test_map_name, {5.0*i, 0.0});
+
+  for(std::size_t i=0; i+1 < NumWaypoints; ++i)
+  {
+    graph.add_lane(i, i+1);
+    graph.add_lane(i+1, i);
+  }
+
+  const rmf_traffic::agv::VehicleTraits traits(
+      {0.7, 0.3}, {1.0, 0.45}, make_test_profile(UnitCircle));
+
+  rmf_traffic::schedule::Database database;
+  const Planner planner{
+    Planner::Configuration{graph, traits},
+    Planner::Options{database}
+  };
+
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+  const Planner::StartSet starts = {Planner::Start{start_time, 0, 0.0}};
+  const std::vector<std::size_t> goals = {7, 2, 5, 1, 6};
+
+  std::vector<Planner::Problem> problems;
+  for(const std::size_t goal : goals)
+    problems.push_back(Planner::Problem{starts, Planner::Goal{goal}});
+
+  WHEN("Every problem is solved")
+  {
+    const auto plans = planner.plan_batch(problems);
+    REQUIRE(plans.size() == problems.size());
+
+    for(std::size_t i=0; i < goals.size(); ++i)
+    {
+      REQUIRE(plans[i]);
+      CHECK(*plans[i]->get_waypoints().back().graph_index() == goals[i]);
+
+      const auto expected = planner.plan(starts, Planner::Goal{goals[i]});
+      REQUIRE(expected);
+      CHECK(*plans[i]->get_trajectories().back().finish_time()
+            == *expected->get_trajectories().back().finish_time());
+    }
+  }
+
+  WHEN("Dominated searches are cancelled")
+  {
+    const auto plans = planner.plan_batch(
+          problems, Planner::BatchOptions(true));
+    REQUIRE(plans.size() == problems.size());
+
+    // The goal that is nearest to the start must always be solved, and no
+    // other plan can finish after it.
+    REQUIRE(plans[3]);
+    const auto nearest_finish =
+        *plans[3]->get_trajectories().back().finish_time();
+    for(const auto& plan : plans)
+    {
+      if(plan)
+        CHECK(*plan->get_trajectories().back().finish_time() <= nearest_finish);
+    }
+  }
+
+  WHEN("The result callback stops the batch")
+  {
+    std::size_t callbacks = 0;
+    std::size_t solved = 0;
+    Planner::BatchOptions batch_options;
+    batch_options.on_result(
+          [&](std::size_t, const rmf_utils::optional<rmf_traffic::agv::Plan>& p)
+    {
+      ++callbacks;
+      if(p)
+        ++solved;
+
+      return true;
+    });
+
+    const auto plans = planner.plan_batch(problems, batch_options);
+    CHECK(callbacks == problems.size());
+    CHECK(solved >= 1);
+  }
+
+  WHEN("The interrupt flag is already set")
+  {
+    const bool interrupt_flag = true;
+    Planner::Options options = planner.get_default_options();
+    options.interrupt_flag(&interrupt_flag);
+
+    const auto plans = planner.plan_batch(problems, options);
+    REQUIRE(plans.size() == problems.size());
+    for(const auto& plan : plans)
+      CHECK_FALSE(plan);
+  }
+}
+
+//==============================================================================
+SCENARIO("Anytime planning")
+{
+  using namespace std::chrono_literals;
+  using Planner = rmf_traffic::agv::Planner;
+
+  // A grid with some missing lanes, so that a greedy search can be lured down
+  // paths that are not optimal.
+  const std::string test_map_name = "test_map";
+  const std::size_t GridSize = 6;
+  rmf_traffic::agv::Graph graph;
+  for(std::size_t i=0; i < GridSize; ++i)
+  {
+    for(std::size_t j=0; j < GridSize; ++j)
+      graph.add_waypoint(test_map_name, {5.0*i, 5.0*j});
+  }
+
+  const auto index = [&](const std::size_t i, const std::size_t j)
+  {
+    return i*GridSize + j;
+  };
+
+  for(std::size_t i=0; i < GridSize; ++i)
+  {
+    for(std::size_t j=0; j < GridSize; ++j)
+    {
+      if(i+1 < GridSize && !(j > 0 && i == GridSize/2))
+      {
+        graph.add_lane(index(i, j), index(i+1, j));
+        graph.add_lane(index(i+1, j), index(i, j));
+      }
+
+      if(j+1 < GridSize)
+      {
+        graph.add_lane(index(i, j), index(i, j+1));
+        graph.add_lane(index(i, j+1), index(i, j));
+      }
+    }
+  }
+
+  const rmf_traffic::agv::VehicleTraits traits(
+      {0.7, 0.3}, {1.0, 0.45}, make_test_profile(UnitCircle));
+
+  rmf_traffic::schedule::Database database;
+  const Planner planner{
+    Planner::Configuration{graph, traits},
+    Planner::Options{database}
+  };
+
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+  const Planner::StartSet starts = {
+    Planner::Start{start_time, index(0, 3), 0.0}
+  };
+  const Planner::Goal goal{index(GridSize-1, 3)};
+
+  const auto optimal = planner.plan(starts, goal);
+  REQUIRE(optimal);
+  const auto optimal_finish = *optimal->get_trajectories().back().finish_time();
+
+  WHEN("The time budget is large enough to finish")
+  {
+    std::vector<double> weights;
+    std::vector<rmf_traffic::Time> finish_times;
+    const Planner::AnytimeOptions anytime_options(
+          30s, 3.0, 1.0,
+          [&](const rmf_traffic::agv::Plan& plan, const double weight)
+    {
+      weights.push_back(weight);
+      finish_times.push_back(*plan.get_trajectories().back().finish_time());
+    });
+
+    const auto plan = planner.plan_anytime(starts, goal, anytime_options);
+    REQUIRE(plan);
+
+    // The final plan must be optimal
+    CHECK(*plan->get_trajectories().back().finish_time() == optimal_finish);
+
+    // Every plan that gets reported must be an improvement on the last one
+    REQUIRE(!weights.empty());
+    CHECK(weights.front() == Approx(3.0));
+    for(std::size_t i=1; i < weights.size(); ++i)
+    {
+      CHECK(weights[i] < weights[i-1]);
+      CHECK(finish_times[i] < finish_times[i-1]);
+    }
+
+    CHECK(finish_times.back() == optimal_finish);
+  }
+
+  WHEN("The interrupt flag is already set")
+  {
+    const bool interrupt_flag = true;
+    Planner::Options options = planner.get_default_options();
+    options.interrupt_flag(&interrupt_flag);
+
+    CHECK_FALSE(planner.plan_anytime(
+                  starts, goal, options, Planner::AnytimeOptions(30s)));
+  }
+
+  WHEN("The weight step is not positive")
+  {
+    CHECK_THROWS_AS(
+          planner.plan_anytime(
+            starts, goal, Planner::AnytimeOptions(30s, 3.0, 0.0)),
+          std::invalid_argument);
+  }
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <rmf_traffic/geometry/Circle.hpp>
+#include <rmf_traffic/schedule/Database.hpp>
+#include <rmf_traffic/schedule/Mirror.hpp>
+
+#include <rmf_utils/catch.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <unistd.h>
+
+namespace {
+
+//==============================================================================
+rmf_traffic::Trajectory make_trajectory(
+    const rmf_traffic::Time start_time,
+    const rmf_traffic::Trajectory::ProfilePtr& profile,
+    const double y)
+{
+  using namespace std::chrono_literals;
+  rmf_traffic::Trajectory trajectory{"test_map"};
+  trajectory.insert(
+        start_time, profile,
+        Eigen::Vector3d{0.0, y, 0.0}, Eigen::Vector3d::Zero());
+  trajectory.insert(
+        start_time + 30s, profile,
+        Eigen::Vector3d{30.0, y, 0.0}, Eigen::Vector3d::Zero());
+  return trajectory;
+}
+
+//==============================================================================
+std::size_t resident_set_size()
+{
+  std::size_t pages = 0;
+  std::size_t resident = 0;
+  std::ifstream statm("/proc/self/statm");
+  statm >> pages >> resident;
+  return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+//==============================================================================
+std::map<rmf_traffic::schedule::Version, rmf_traffic::Time> get_contents(
+    const rmf_traffic::schedule::Viewer& viewer)
+{
+  std::map<rmf_traffic::schedule::Version, rmf_traffic::Time> contents;
+  for(const auto& element
+      : viewer.query(rmf_traffic::schedule::query_everything()))
+    contents[element.id] = *element.trajectory.finish_time();
+
+  return contents;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+SCENARIO("Periodic culling keeps the schedule bounded")
+{
+  using namespace std::chrono_literals;
+  using Version = rmf_traffic::schedule::Version;
+
+  const bool test_performance = false;
+  const std::size_t N = test_performance? 1000000 : 1000;
+
+  const auto profile = rmf_traffic::Trajectory::Profile::make_guided(
+        rmf_traffic::geometry::make_final_convex<
+          rmf_traffic::geometry::Circle>(0.5));
+
+  const std::size_t NumRobots = 5;
+  const rmf_traffic::Duration retention = 60s;
+  const auto begin_time = std::chrono::steady_clock::now();
+
+  rmf_traffic::schedule::Database db;
+  rmf_traffic::schedule::Mirror mirror;
+
+  std::vector<Version> ids;
+  for(std::size_t r=0; r < NumRobots; ++r)
+    ids.push_back(db.insert(make_trajectory(begin_time, profile, 5.0*r)));
+
+  rmf_traffic::schedule::Viewer::Statistics halfway_stats;
+  std::size_t halfway_rss = 0;
+  std::size_t max_total = 0;
+
+  const auto start_time = std::chrono::steady_clock::now();
+  for(std::size_t step=1; step <= N; ++step)
+  {
+    const rmf_traffic::Time now = begin_time + step*1s;
+    for(std::size_t r=0; r < NumRobots; ++r)
+    {
+      const double y = 5.0*r;
+      if(step % 50 == 25)
+      {
+        db.erase(ids[r]);
+        ids[r] = db.insert(make_trajectory(now, profile, y));
+      }
+      else if(step % 10 == 0)
+      {
+        ids[r] = db.replace(ids[r], make_trajectory(now, profile, y));
+      }
+      else
+      {
+        ids[r] = db.delay(ids[r], now, 100ms);
+      }
+    }
+
+    if(step % 20 == 0)
+      db.cull(now - retention);
+
+    if(step % 7 == 0)
+    {
+      mirror.update(db.changes(
+            rmf_traffic::schedule::make_query(mirror.latest_version())));
+    }
+
+    const auto stats = db.statistics();
+    const std::size_t total = stats.entries + stats.history_entries;
+
+    if(step == N/2)
+    {
+      halfway_stats = stats;
+      halfway_rss = resident_set_size();
+    }
+    else if(step > N/2)
+    {
+      max_total = std::max(max_total, total);
+    }
+
+    // Nothing may outlive the retention horizon by more than a culling period
+    // and the length of a trajectory, no matter how long the schedule runs.
+    CHECK(total < NumRobots*200);
+  }
+
+  const auto end_time = std::chrono::steady_clock::now();
+
+  const auto final_stats = db.statistics();
+  CHECK(max_total <= 2*(halfway_stats.entries + halfway_stats.history_entries));
+  CHECK(final_stats.buckets <= halfway_stats.buckets + 2);
+
+  mirror.update(db.changes(
+        rmf_traffic::schedule::make_query(mirror.latest_version())));
+  CHECK(get_contents(mirror) == get_contents(db));
+
+  if(test_performance)
+  {
+    const double sec = rmf_traffic::time::to_seconds(end_time - start_time);
+    std::cout << "Schedule soak with " << N*NumRobots << " changes\n";
+    std::cout << "Total: " << sec << std::endl;
+    std::cout << "Per run: " << sec/(N*NumRobots) << std::endl;
+    std::cout << "Entries: " << final_stats.entries
+              << " | History: " << final_stats.history_entries
+              << " | Buckets: " << final_stats.buckets
+              << " | Segments: " << final_stats.segments << std::endl;
+    std::cout << "RSS at halfway: " << halfway_rss
+              << " | RSS at finish: " << resident_set_size() << std::endl;
+  }
+}
@@ -21,8 +21,11 @@
 
 #include "src/rmf_traffic/schedule/debug_Viewer.hpp"
 
+#include <rmf_traffic/schedule/Mirror.hpp>
+
 #include <rmf_utils/catch.hpp>
 #include<iostream>
+#include <set>
 using namespace std::chrono_literals;
 
 
@@ -199,3 +202,261 @@ SCENARIO("Test Database Conflicts")
 
 }
 
+//==============================================================================
+SCENARIO("Mirrors catch up with only the newest changes")
+{
+  using Version = rmf_traffic::schedule::Version;
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+  const auto profile = rmf_traffic::Trajectory::Profile::make_guided(
+        rmf_traffic::geometry::make_final_convex<
+          rmf_traffic::geometry::Box>(1.0, 1.0));
+
+  const auto make_line = [&](
+      const double x, const std::string& map = "test_map",
+      const rmf_traffic::Duration delay = 0s)
+  {
+    rmf_traffic::Trajectory trajectory{map};
+    trajectory.insert(
+          start_time + delay, profile,
+          Eigen::Vector3d{x, -5.0, 0.0}, Eigen::Vector3d::Zero());
+    trajectory.insert(
+          start_time + delay + 10s, profile,
+          Eigen::Vector3d{x, 5.0, 0.0}, Eigen::Vector3d::Zero());
+    return trajectory;
+  };
+
+  rmf_traffic::schedule::Database db;
+  std::vector<Version> ids;
+  for(std::size_t i=0; i < 30; ++i)
+    ids.push_back(db.insert(make_line(3.0*i)));
+
+  for(std::size_t i=0; i < 5; ++i)
+    db.insert(make_line(3.0*i, "other_map"));
+
+  Eigen::Isometry2d tf = Eigen::Isometry2d::Identity();
+  tf.translate(Eigen::Vector2d{10.0, 0.0});
+  const rmf_traffic::Region region{
+    "test_map", start_time, start_time + 1min,
+    {{rmf_traffic::geometry::make_final_convex<
+        rmf_traffic::geometry::Box>(20.0, 20.0), tf}}};
+
+  const rmf_traffic::Time timespan_finish = start_time + 1min;
+  const std::vector<rmf_traffic::schedule::Query> queries = {
+    rmf_traffic::schedule::query_everything(),
+    rmf_traffic::schedule::make_query({region}),
+    rmf_traffic::schedule::make_query(
+        {"test_map"}, &start_time, &timespan_finish)
+  };
+
+  // Each mirror begins with a complete copy of what is relevant to its query
+  std::vector<rmf_traffic::schedule::Mirror> mirrors(queries.size());
+  for(std::size_t i=0; i < queries.size(); ++i)
+    mirrors[i].update(db.changes(queries[i]));
+
+  const auto ids_of = [](const rmf_traffic::schedule::Viewer::View& view)
+  {
+    std::set<Version> result;
+    for(const auto& element : view)
+      result.insert(element.id);
+    return result;
+  };
+
+  const auto update_and_compare = [&]()
+  {
+    for(std::size_t i=0; i < queries.size(); ++i)
+    {
+      rmf_traffic::schedule::Query query = queries[i];
+      query.versions().query_after(mirrors[i].latest_version());
+      mirrors[i].update(db.changes(query));
+      CHECK(mirrors[i].latest_version() == db.latest_version());
+
+      CHECK(ids_of(mirrors[i].query(queries[i]))
+            == ids_of(db.query(queries[i])));
+
+      // A mirror that is up to date does not need any changes
+      rmf_traffic::schedule::Query latest = queries[i];
+      latest.versions().query_after(db.latest_version());
+      CHECK(db.changes(latest).size() == 0);
+    }
+  };
+
+  update_and_compare();
+
+  WHEN("Trajectories are changed in ways that move them in and out of view")
+  {
+    // Move out of the region
+    ids[1] = db.replace(ids[1], make_line(60.0));
+    update_and_compare();
+
+    // Move onto another map
+    ids[2] = db.replace(ids[2], make_line(6.0, "other_map"));
+    update_and_compare();
+
+    db.erase(ids[3]);
+    update_and_compare();
+
+    // Move out of the time range of the region and the timespan
+    ids[4] = db.delay(ids[4], start_time, 2min);
+    update_and_compare();
+
+    db.insert(make_line(15.0));
+    update_and_compare();
+
+    // Move back into the region after the mirror forgot about it
+    ids[1] = db.replace(ids[1], make_line(3.0));
+    update_and_compare();
+
+    THEN("Every mirror agrees with the database")
+    {
+      for(std::size_t i=0; i < queries.size(); ++i)
+      {
+        CHECK(ids_of(mirrors[i].query(queries[i]))
+              == ids_of(db.query(queries[i])));
+      }
+    }
+  }
+
+  WHEN("Many changes happen before the mirrors catch up")
+  {
+    for(std::size_t i=5; i < 30; i += 2)
+      ids[i] = db.delay(ids[i], start_time, 1s);
+
+    for(std::size_t i=6; i < 30; i += 4)
+      db.erase(ids[i]);
+
+    update_and_compare();
+
+    THEN("Patches for old versions still bring the mirrors up to date")
+    {
+      rmf_traffic::schedule::Mirror late;
+      late.update(db.changes(queries[0]));
+      CHECK(ids_of(late.query(queries[0])) == ids_of(db.query(queries[0])));
+    }
+  }
+}
+
+//==============================================================================
+SCENARIO("Lagging mirrors receive compressed lineages")
+{
+  using Mode = rmf_traffic::schedule::Database::Change::Mode;
+  const bool test_performance = false;
+  const std::size_t NumDelays = 300;
+  const std::size_t NumRobots = test_performance? 200 : 5;
+
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+  const auto profile = rmf_traffic::Trajectory::Profile::make_guided(
+        rmf_traffic::geometry::make_final_convex<
+          rmf_traffic::geometry::Box>(1.0, 1.0));
+
+  const auto make_path = [&](const double y)
+  {
+    rmf_traffic::Trajectory trajectory{"test_map"};
+    for(std::size_t i=0; i < 10; ++i)
+    {
+      trajectory.insert(
+            start_time + i*10s, profile,
+            Eigen::Vector3d{5.0*i, y, 0.0}, Eigen::Vector3d::Zero());
+    }
+    return trajectory;
+  };
+
+  rmf_traffic::schedule::Database db;
+  std::vector<rmf_traffic::schedule::Version> ids;
+  for(std::size_t r=0; r < NumRobots; ++r)
+    ids.push_back(db.insert(make_path(3.0*r)));
+
+  // One mirror keeps up with every change while the other one falls behind
+  rmf_traffic::schedule::Mirror follower;
+  rmf_traffic::schedule::Mirror lagging;
+  follower.update(db.changes(rmf_traffic::schedule::query_everything()));
+  lagging.update(db.changes(rmf_traffic::schedule::query_everything()));
+  const auto lagging_version = lagging.latest_version();
+
+  double follower_apply_sec = 0.0;
+  std::size_t follower_changes = 0;
+  for(std::size_t k=0; k < NumDelays; ++k)
+  {
+    for(std::size_t r=0; r < NumRobots; ++r)
+      ids[r] = db.delay(ids[r], start_time + 15s, 100ms);
+
+    const auto patch = db.changes(
+          rmf_traffic::schedule::make_query(follower.latest_version()));
+    follower_changes += patch.size();
+
+    const auto start = std::chrono::steady_clock::now();
+    follower.update(patch);
+    follower_apply_sec += rmf_traffic::time::to_seconds(
+          std::chrono::steady_clock::now() - start);
+  }
+
+  WHEN("The lagging mirror catches up")
+  {
+    const auto patch = db.changes(
+          rmf_traffic::schedule::make_query(lagging_version));
+
+    const auto start = std::chrono::steady_clock::now();
+    lagging.update(patch);
+    const double lagging_apply_sec = rmf_traffic::time::to_seconds(
+          std::chrono::steady_clock::now() - start);
+
+    if(test_performance)
+    {
+      std::cout << "Catching up on " << NumDelays << " delays for "
+                << NumRobots << " robots: " << follower_changes
+                << " changes in " << follower_apply_sec << "s | "
+                << patch.size() << " changes in " << lagging_apply_sec
+                << "s" << std::endl;
+    }
+
+    THEN("It gets one replacement for each lineage")
+    {
+      CHECK(follower_changes == NumDelays*NumRobots);
+      REQUIRE(patch.size() == NumRobots);
+      for(const auto& change : patch)
+        CHECK(change.get_mode() == Mode::Replace);
+    }
+
+    THEN("It agrees with the mirror that kept up")
+    {
+      const auto expected = follower.query(
+            rmf_traffic::schedule::query_everything());
+      const auto actual = lagging.query(
+            rmf_traffic::schedule::query_everything());
+      REQUIRE(expected.size() == actual.size());
+
+      auto e_it = expected.begin();
+      auto a_it = actual.begin();
+      for(; e_it != expected.end(); ++e_it, ++a_it)
+      {
+        CHECK(e_it->id == a_it->id);
+        REQUIRE(e_it->trajectory.size() == a_it->trajectory.size());
+
+        auto e_seg = e_it->trajectory.begin();
+        auto a_seg = a_it->trajectory.begin();
+        for(; e_seg != e_it->trajectory.end(); ++e_seg, ++a_seg)
+        {
+          CHECK(e_seg->get_finish_time() == a_seg->get_finish_time());
+          CHECK((e_seg->get_finish_position()
+                 - a_seg->get_finish_position()).norm() == Approx(0.0));
+        }
+      }
+    }
+  }
+
+  WHEN("A mirror is only one change behind")
+  {
+    rmf_traffic::schedule::Mirror close;
+    close.update(db.changes(rmf_traffic::schedule::query_everything()));
+    const auto version = close.latest_version();
+    db.delay(ids[0], start_time + 15s, 100ms);
+
+    const auto patch = db.changes(
+          rmf_traffic::schedule::make_query(version));
+
+    THEN("The delay is cheaper to send than a replacement")
+    {
+      REQUIRE(patch.size() == 1);
+      CHECK(patch.begin()->get_mode() == Mode::Delay);
+    }
+  }
+}
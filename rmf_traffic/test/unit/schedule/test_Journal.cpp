@@ -0,0 +1,365 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <rmf_traffic/schedule/Journal.hpp>
+#include <rmf_traffic/schedule/Mirror.hpp>
+#include <rmf_traffic/geometry/Box.hpp>
+#include <rmf_traffic/geometry/Circle.hpp>
+
+#include <rmf_utils/catch.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+namespace {
+//==============================================================================
+// Change this to true to measure how long it takes to recover a large schedule
+const bool test_performance = false;
+// const bool test_performance = true;
+
+//==============================================================================
+class TemporaryDirectory
+{
+public:
+
+  TemporaryDirectory()
+  {
+    char path[] = "/tmp/rmf_traffic_journal_XXXXXX";
+    REQUIRE(mkdtemp(path));
+    name = path;
+  }
+
+  ~TemporaryDirectory()
+  {
+    for(const std::string file : {"snapshot", "snapshot.tmp", "journal"})
+    {
+      std::remove((name + "/" + file).c_str());
+      std::remove((name + "/" + file + ".failed").c_str());
+    }
+
+    rmdir(name.c_str());
+  }
+
+  std::string name;
+};
+
+//==============================================================================
+struct ElementInfo
+{
+  std::size_t size;
+  rmf_traffic::Time start;
+  rmf_traffic::Time finish;
+  std::string map;
+
+  bool operator==(const ElementInfo& other) const
+  {
+    return size == other.size && start == other.start
+        && finish == other.finish && map == other.map;
+  }
+};
+
+//==============================================================================
+std::map<rmf_traffic::schedule::Version, ElementInfo> contents(
+    const rmf_traffic::schedule::Viewer& viewer)
+{
+  std::map<rmf_traffic::schedule::Version, ElementInfo> result;
+  for(const auto& element : viewer.query(
+        rmf_traffic::schedule::query_everything()))
+  {
+    result.insert(std::make_pair(
+      element.id,
+      ElementInfo{
+        element.trajectory.size(),
+        *element.trajectory.start_time(),
+        *element.trajectory.finish_time(),
+        element.trajectory.get_map_name()
+      }));
+  }
+
+  return result;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+SCENARIO("Recovering a database from its journal")
+{
+  using Version = rmf_traffic::schedule::Version;
+  using Database = rmf_traffic::schedule::Database;
+
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+  const auto box = rmf_traffic::Trajectory::Profile::make_guided(
+        rmf_traffic::geometry::make_final_convex<
+          rmf_traffic::geometry::Box>(1.0, 2.0));
+  const auto circle = rmf_traffic::Trajectory::Profile::make_queued(
+        rmf_traffic::geometry::make_final_convex<
+          rmf_traffic::geometry::Circle>(0.5), "queue");
+
+  const auto make_line = [&](
+      const double x, const rmf_traffic::Duration start = 0s,
+      const std::string& map = "test_map")
+  {
+    rmf_traffic::Trajectory trajectory{map};
+    trajectory.insert(
+          start_time + start, box,
+          Eigen::Vector3d{x, -5.0, 0.0}, Eigen::Vector3d::Zero());
+    trajectory.insert(
+          start_time + start + 10s, circle,
+          Eigen::Vector3d{x, 0.0, 0.0}, Eigen::Vector3d{0.0, 1.0, 0.0});
+    trajectory.insert(
+          start_time + start + 20s, box,
+          Eigen::Vector3d{x, 5.0, 0.0}, Eigen::Vector3d::Zero());
+    return trajectory;
+  };
+
+  TemporaryDirectory directory;
+  rmf_traffic::schedule::Journal journal(directory.name);
+
+  Database db = journal.recover();
+  CHECK(db.latest_version() == 0);
+
+  // This mirror stays up to date with the database until the restart
+  const rmf_traffic::schedule::Query everything =
+      rmf_traffic::schedule::query_everything();
+  rmf_traffic::schedule::Mirror mirror;
+
+  std::vector<Version> ids;
+  for(std::size_t i=0; i < 20; ++i)
+  {
+    const auto start = std::chrono::seconds(2*i);
+    ids.push_back(db.insert(make_line(3.0*i, start, i%4? "test" : "other")));
+    journal.record(db);
+  }
+
+  const auto change_some = [&](const std::size_t offset)
+  {
+    ids[offset] = db.delay(ids[offset], start_time + 5s, 3s);
+    journal.record(db);
+
+    ids[offset+1] = db.replace(ids[offset+1], make_line(-2.0, 1min));
+    journal.record(db);
+
+    ids[offset+2] = db.interrupt(
+          ids[offset+2], make_line(1.0, 2s, "test"), 1s);
+    journal.record(db);
+
+    db.erase(ids[offset+3]);
+    journal.record(db);
+  };
+
+  change_some(0);
+  mirror.update(db.changes(everything));
+
+  // The first few trajectories get culled, except the ones that were moved to
+  // a later time.
+  db.cull(start_time + 25s);
+  journal.record(db);
+
+  const auto check_recovery = [&]()
+  {
+    rmf_traffic::schedule::Journal restarted(directory.name);
+    Database recovered = restarted.recover();
+
+    CHECK(recovered.latest_version() == db.latest_version());
+    CHECK(recovered.oldest_version() == db.oldest_version());
+    CHECK(contents(recovered) == contents(db));
+
+    // A mirror that was following the original database can catch up with the
+    // recovered one
+    rmf_traffic::schedule::Query query = everything;
+    query.versions().query_after(mirror.latest_version());
+    const auto original_patch = db.changes(query);
+    const auto recovered_patch = recovered.changes(query);
+    REQUIRE(recovered_patch.size() == original_patch.size());
+    auto o = original_patch.begin();
+    for(const auto& change : recovered_patch)
+    {
+      CHECK(change.get_mode() == o->get_mode());
+      CHECK(change.id() == o->id());
+      ++o;
+    }
+
+    mirror.update(recovered_patch);
+    CHECK(contents(mirror) == contents(db));
+
+    return recovered;
+  };
+
+  WHEN("The database is recovered from only the journal")
+  {
+    CHECK(journal.changes_since_snapshot() == db.latest_version());
+    check_recovery();
+  }
+
+  WHEN("A snapshot was taken before the last changes")
+  {
+    journal.snapshot(db);
+    CHECK(journal.changes_since_snapshot() == 0);
+
+    change_some(8);
+    CHECK(journal.changes_since_snapshot() == 4);
+
+    Database recovered = check_recovery();
+
+    THEN("The recovered database continues with the same versions")
+    {
+      rmf_traffic::schedule::Journal restarted(directory.name);
+      recovered = restarted.recover();
+
+      const Version next = db.insert(make_line(100.0));
+      CHECK(recovered.insert(make_line(100.0)) == next);
+      restarted.record(recovered);
+
+      CHECK(contents(check_recovery()) == contents(recovered));
+    }
+  }
+
+  WHEN("A snapshot was taken without changes after it")
+  {
+    journal.snapshot(db);
+    check_recovery();
+  }
+
+  WHEN("The last change was only partially written")
+  {
+    change_some(12);
+
+    {
+      std::ofstream file(
+            directory.name + "/journal", std::ios::binary | std::ios::app);
+      const uint32_t size = 100;
+      file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+      file.write("partial", 7);
+    }
+
+    check_recovery();
+
+    THEN("The fragment is removed before anything else is recorded")
+    {
+      rmf_traffic::schedule::Journal restarted(directory.name);
+      Database recovered = restarted.recover();
+      recovered.insert(make_line(100.0));
+      restarted.record(recovered);
+
+      db.insert(make_line(100.0));
+      check_recovery();
+    }
+  }
+
+  WHEN("The journal has a change that cannot be read")
+  {
+    {
+      std::ofstream file(
+            directory.name + "/journal", std::ios::binary | std::ios::app);
+      const uint32_t size = 4;
+      file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+      file.write("\xff\xff\xff\xff", 4);
+    }
+
+    rmf_traffic::schedule::Journal restarted(directory.name);
+    CHECK_THROWS_AS(restarted.recover(), std::runtime_error);
+
+    THEN("The files can be moved aside to start over without losing them")
+    {
+      restarted.move_aside(".failed");
+      CHECK(restarted.recover().latest_version() == 0);
+      CHECK(std::ifstream(directory.name + "/journal.failed"));
+
+      restarted.snapshot(Database());
+      CHECK(std::ifstream(directory.name + "/journal.failed"));
+    }
+  }
+}
+
+//==============================================================================
+SCENARIO("Restarting a large schedule")
+{
+  using Database = rmf_traffic::schedule::Database;
+
+  const std::size_t N = test_performance? 100000 : 1000;
+
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+  const auto profile = rmf_traffic::Trajectory::Profile::make_guided(
+        rmf_traffic::geometry::make_final_convex<
+          rmf_traffic::geometry::Circle>(0.5));
+
+  TemporaryDirectory directory;
+  rmf_traffic::schedule::Journal journal(directory.name);
+
+  // Spread the trajectories out across a large floor over half an hour
+  Database db;
+  for(std::size_t i=0; i < N; ++i)
+  {
+    const double x = static_cast<double>(i % 100) * 4.0;
+    const double y = static_cast<double>((i / 100) % 100) * 4.0;
+    const rmf_traffic::Time t =
+        start_time + std::chrono::seconds(static_cast<int64_t>(i % 1800));
+
+    rmf_traffic::Trajectory trajectory{"test_map"};
+    for(std::size_t s=0; s < 5; ++s)
+    {
+      trajectory.insert(
+            t + std::chrono::seconds(10*s), profile,
+            Eigen::Vector3d{x + s, y, 0.0}, Eigen::Vector3d{0.1, 0.0, 0.0});
+    }
+
+    db.insert(std::move(trajectory));
+  }
+
+  const auto snapshot_start = std::chrono::steady_clock::now();
+  journal.snapshot(db);
+  const auto snapshot_finish = std::chrono::steady_clock::now();
+
+  // A burst of changes after the snapshot gets replayed from the journal
+  const std::size_t M = N/10;
+  for(std::size_t i=0; i < M; ++i)
+  {
+    db.delay(static_cast<rmf_traffic::schedule::Version>(i+1), start_time, 1s);
+    journal.record(db);
+  }
+
+  const auto recover_start = std::chrono::steady_clock::now();
+  rmf_traffic::schedule::Journal restarted(directory.name);
+  const Database recovered = restarted.recover();
+  const auto recover_finish = std::chrono::steady_clock::now();
+
+  CHECK(recovered.latest_version() == db.latest_version());
+  CHECK(contents(recovered).size() == N);
+
+  if(test_performance)
+  {
+    const auto seconds = [](const rmf_traffic::Duration d)
+    {
+      return std::chrono::duration_cast<std::chrono::duration<double>>(d)
+          .count();
+    };
+
+    std::cout << "Snapshot of " << N << " entries: "
+              << seconds(snapshot_finish - snapshot_start) << "s\n"
+              << "Recovery of " << N << " entries and " << M
+              << " journaled changes: "
+              << seconds(recover_finish - recover_start) << "s" << std::endl;
+  }
+}
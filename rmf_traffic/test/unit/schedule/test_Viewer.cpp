@@ -0,0 +1,652 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "src/rmf_traffic/schedule/ViewerInternal.hpp"
+
+#include <rmf_traffic/geometry/Box.hpp>
+#include <rmf_traffic/geometry/Circle.hpp>
+#include <rmf_traffic/schedule/Database.hpp>
+#include <rmf_traffic/schedule/Mirror.hpp>
+
+#include <rmf_utils/catch.hpp>
+
+#include <iostream>
+#include <limits>
+#include <unordered_set>
+
+namespace {
+
+//==============================================================================
+// Set this to true to print the timing results of the delay benchmark
+const bool test_performance = false;
+// const bool test_performance = true;
+
+//==============================================================================
+rmf_traffic::Trajectory make_column_trajectory(
+    const rmf_traffic::Time start_time,
+    const rmf_traffic::Trajectory::ProfilePtr& profile,
+    const double x,
+    const std::string& map = "test_map")
+{
+  using namespace std::chrono_literals;
+  rmf_traffic::Trajectory trajectory{map};
+  trajectory.insert(
+        start_time, profile,
+        Eigen::Vector3d{x, -5.0, 0.0}, Eigen::Vector3d::Zero());
+  trajectory.insert(
+        start_time + 10s, profile,
+        Eigen::Vector3d{x, 5.0, 0.0}, Eigen::Vector3d::Zero());
+  return trajectory;
+}
+
+//==============================================================================
+std::unordered_set<rmf_traffic::schedule::Version> query_column(
+    const rmf_traffic::schedule::Viewer& viewer,
+    const rmf_traffic::Time start_time,
+    const double x)
+{
+  using namespace std::chrono_literals;
+  const auto box = rmf_traffic::geometry::make_final_convex<
+      rmf_traffic::geometry::Box>(1.0, 1.0);
+
+  Eigen::Isometry2d tf = Eigen::Isometry2d::Identity();
+  tf.translate(Eigen::Vector2d{x, 0.0});
+
+  const rmf_traffic::Region region{
+    "test_map", start_time, start_time + 10s, {{box, tf}}};
+
+  std::unordered_set<rmf_traffic::schedule::Version> ids;
+  for(const auto& element
+      : viewer.query(rmf_traffic::schedule::make_query({region})))
+    ids.insert(element.id);
+
+  return ids;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+SCENARIO("Region queries only report nearby trajectories")
+{
+  using namespace std::chrono_literals;
+  using Version = rmf_traffic::schedule::Version;
+
+  const auto start_time = std::chrono::steady_clock::now();
+  const auto profile = rmf_traffic::Trajectory::Profile::make_guided(
+        rmf_traffic::geometry::make_final_convex<
+          rmf_traffic::geometry::Circle>(0.5));
+
+  rmf_traffic::schedule::Database db;
+
+  // Each trajectory moves along its own column, and the columns are spread
+  // farther apart than the cells of the spatial index.
+  const std::size_t N = 20;
+  const double spacing = 3.0*rmf_traffic::schedule::internal::Bucket::CellSize;
+  std::vector<Version> ids;
+  for(std::size_t i=0; i < N; ++i)
+  {
+    ids.push_back(db.insert(make_column_trajectory(
+                              start_time, profile, spacing*i)));
+  }
+
+  WHEN("Each column is queried")
+  {
+    for(std::size_t i=0; i < N; ++i)
+    {
+      const auto result = query_column(db, start_time, spacing*i);
+      REQUIRE(result.size() == 1);
+      CHECK(result.count(ids[i]) == 1);
+    }
+
+    CHECK(query_column(db, start_time, spacing*(N+1)).empty());
+    CHECK(query_column(db, start_time, -spacing).empty());
+  }
+
+  WHEN("A trajectory is replaced by one in a different column")
+  {
+    const Version new_id = db.replace(
+          ids[3], make_column_trajectory(start_time, profile, spacing*7));
+
+    CHECK(query_column(db, start_time, spacing*3).empty());
+
+    const auto result = query_column(db, start_time, spacing*7);
+    CHECK(result.size() == 2);
+    CHECK(result.count(ids[7]) == 1);
+    CHECK(result.count(new_id) == 1);
+  }
+
+  WHEN("A trajectory is delayed past the query window")
+  {
+    const Version new_id = db.delay(ids[5], start_time - 1s, 1min);
+
+    CHECK(query_column(db, start_time, spacing*5).empty());
+    const auto result = query_column(db, start_time + 1min, spacing*5);
+    REQUIRE(result.size() == 1);
+    CHECK(result.count(new_id) == 1);
+  }
+
+  WHEN("A trajectory is erased")
+  {
+    db.erase(ids[2]);
+    CHECK(query_column(db, start_time, spacing*2).empty());
+    CHECK(query_column(db, start_time, spacing*3).size() == 1);
+  }
+
+  WHEN("The changes are mirrored")
+  {
+    db.replace(ids[3], make_column_trajectory(start_time, profile, spacing*7));
+    db.erase(ids[4]);
+
+    rmf_traffic::schedule::Mirror mirror;
+    mirror.update(db.changes(rmf_traffic::schedule::query_everything()));
+
+    for(std::size_t i=0; i < N; ++i)
+    {
+      const std::size_t expected = (i == 3 || i == 4)? 0 : (i == 7)? 2 : 1;
+      CHECK(query_column(mirror, start_time, spacing*i).size() == expected);
+    }
+  }
+
+  WHEN("The region tests are spread across a thread pool")
+  {
+    db.replace(ids[3], make_column_trajectory(start_time, profile, spacing*7));
+
+    // One query whose regions cover every other column
+    const auto box = rmf_traffic::geometry::make_final_convex<
+        rmf_traffic::geometry::Box>(1.0, 1.0);
+    std::vector<rmf_traffic::Region> regions;
+    for(std::size_t i=0; i < N; i += 2)
+    {
+      Eigen::Isometry2d tf = Eigen::Isometry2d::Identity();
+      tf.translate(Eigen::Vector2d{spacing*i, 0.0});
+      regions.push_back(rmf_traffic::Region{
+                          "test_map", start_time, start_time + 10s,
+                          {{box, tf}}});
+    }
+    const auto query = rmf_traffic::schedule::make_query(regions);
+
+    std::vector<Version> serial_view;
+    for(const auto& element : db.query(query))
+      serial_view.push_back(element.id);
+    const std::size_t serial_changes = db.changes(query).size();
+
+    CHECK(!db.get_thread_pool());
+    db.set_thread_pool(std::make_shared<rmf_traffic::ThreadPool>(3));
+    REQUIRE(db.get_thread_pool());
+    CHECK(db.get_thread_pool()->size() == 3);
+
+    THEN("The results are the same as without the pool")
+    {
+      std::vector<Version> parallel_view;
+      for(const auto& element : db.query(query))
+        parallel_view.push_back(element.id);
+
+      CHECK(parallel_view == serial_view);
+      CHECK(db.changes(query).size() == serial_changes);
+
+      for(std::size_t i=0; i < N; ++i)
+      {
+        const std::size_t expected = (i == 3)? 0 : (i == 7)? 2 : 1;
+        CHECK(query_column(db, start_time, spacing*i).size() == expected);
+      }
+    }
+
+    THEN("Copies of the database share the pool")
+    {
+      const rmf_traffic::schedule::Database copy = db;
+      CHECK(copy.get_thread_pool() == db.get_thread_pool());
+    }
+  }
+}
+
+//==============================================================================
+SCENARIO("Spatial grid of a timeline bucket")
+{
+  using Bucket = rmf_traffic::schedule::internal::Bucket;
+  using Entry = rmf_traffic::schedule::internal::Entry;
+  using BoundingBox = rmf_traffic::internal::BoundingBox;
+
+  const auto make_entry = [](rmf_traffic::schedule::Version v)
+  {
+    return std::make_shared<Entry>(rmf_traffic::Trajectory("test_map"), v);
+  };
+
+  const auto collect = [](const Bucket& bucket, const BoundingBox& box)
+  {
+    std::unordered_set<rmf_traffic::schedule::Version> visited;
+    bucket.for_each_nearby(
+          box, [&](const rmf_traffic::schedule::internal::ConstEntryPtr& e)
+    {
+      visited.insert(e->version);
+    });
+    return visited;
+  };
+
+  const auto entry_0 = make_entry(0);
+  const auto entry_2 = make_entry(2);
+
+  Bucket bucket;
+  bucket.insert(entry_0, {Bucket::make_cell(0, 0)});
+  bucket.insert(make_entry(1), {Bucket::make_cell(0, 0), Bucket::make_cell(1, 0)});
+  bucket.insert(entry_2, {Bucket::make_cell(-3, 4)});
+  bucket.insert(make_entry(3), {});
+  REQUIRE(bucket.size() == 4);
+
+  const double s = Bucket::CellSize;
+  const BoundingBox near_origin{{0.1*s, 0.1*s}, {0.2*s, 0.2*s}};
+  const BoundingBox near_two{{-2.5*s, 4.5*s}, {-2.2*s, 4.7*s}};
+
+  CHECK(collect(bucket, near_origin)
+        == std::unordered_set<rmf_traffic::schedule::Version>({0, 1, 3}));
+  CHECK(collect(bucket, near_two)
+        == std::unordered_set<rmf_traffic::schedule::Version>({2, 3}));
+
+  std::unordered_set<rmf_traffic::schedule::Version> removed;
+  bucket.erase_if(
+        [](const rmf_traffic::schedule::internal::ConstEntryPtr& e)
+  {
+    return e->version % 2 == 1;
+  }, removed);
+
+  CHECK(removed == std::unordered_set<rmf_traffic::schedule::Version>({1, 3}));
+  CHECK(bucket.size() == 2);
+  CHECK(collect(bucket, near_origin)
+        == std::unordered_set<rmf_traffic::schedule::Version>({0}));
+  CHECK(collect(bucket, BoundingBox{{-1e3, -1e3}, {1e3, 1e3}})
+        == std::unordered_set<rmf_traffic::schedule::Version>({0, 2}));
+
+  // Successors take over the cells of the entries that they replace, while
+  // the replaced entries are only kept around for culling.
+  const auto entry_4 = make_entry(4);
+  CHECK(bucket.replace(entry_0, entry_4));
+  CHECK(bucket.size() == 2);
+  CHECK(collect(bucket, near_origin)
+        == std::unordered_set<rmf_traffic::schedule::Version>({4}));
+
+  const auto entry_5 = make_entry(5);
+  CHECK(bucket.replace(entry_4, entry_5, {Bucket::make_cell(-3, 4)}));
+  CHECK(collect(bucket, near_origin).empty());
+  CHECK(collect(bucket, near_two)
+        == std::unordered_set<rmf_traffic::schedule::Version>({2, 5}));
+
+  CHECK(bucket.retire(entry_2));
+  CHECK(!bucket.retire(entry_2));
+  CHECK(!bucket.replace(entry_2, make_entry(6)));
+  CHECK(bucket.size() == 1);
+  CHECK(collect(bucket, near_two)
+        == std::unordered_set<rmf_traffic::schedule::Version>({5}));
+
+  removed.clear();
+  bucket.erase_if(
+        [](const rmf_traffic::schedule::internal::ConstEntryPtr& e)
+  {
+    return e->version < 5;
+  }, removed);
+
+  CHECK(removed
+        == std::unordered_set<rmf_traffic::schedule::Version>({0, 2, 4}));
+  CHECK(bucket.size() == 1);
+
+  removed.clear();
+  bucket.erase_if(
+        [](const rmf_traffic::schedule::internal::ConstEntryPtr&)
+  {
+    return true;
+  }, removed);
+
+  CHECK(removed == std::unordered_set<rmf_traffic::schedule::Version>({5}));
+  CHECK(bucket.empty());
+}
+
+//==============================================================================
+SCENARIO("Delays move entries through the timeline")
+{
+  using namespace std::chrono_literals;
+  using Version = rmf_traffic::schedule::Version;
+
+  const auto start_time = std::chrono::steady_clock::now();
+  const auto profile = rmf_traffic::Trajectory::Profile::make_guided(
+        rmf_traffic::geometry::make_final_convex<
+          rmf_traffic::geometry::Circle>(0.5));
+
+  const double spacing = 3.0*rmf_traffic::schedule::internal::Bucket::CellSize;
+
+  // A trajectory that travels up one column, waits at the top of it for a few
+  // minutes, and then moves over to the next column.
+  rmf_traffic::Trajectory trajectory{"test_map"};
+  trajectory.insert(
+        start_time, profile, Eigen::Vector3d{0.0, -5.0, 0.0},
+        Eigen::Vector3d::Zero());
+  trajectory.insert(
+        start_time + 10s, profile, Eigen::Vector3d{0.0, 5.0, 0.0},
+        Eigen::Vector3d::Zero());
+  trajectory.insert(
+        start_time + 3min, profile, Eigen::Vector3d{0.0, 5.0, 0.0},
+        Eigen::Vector3d::Zero());
+  trajectory.insert(
+        start_time + 3min + 30s, profile,
+        Eigen::Vector3d{spacing, 5.0, 0.0}, Eigen::Vector3d::Zero());
+
+  rmf_traffic::schedule::Database db;
+  Version id = db.insert(trajectory);
+  db.insert(make_column_trajectory(start_time, profile, 3.0*spacing));
+
+  rmf_traffic::schedule::Mirror mirror;
+  mirror.update(db.changes(rmf_traffic::schedule::query_everything()));
+
+  // Check every viewer against a fresh database that has the same trajectories
+  // inserted into it from scratch.
+  const auto check_against_fresh_database = [&](
+      const std::vector<const rmf_traffic::schedule::Viewer*>& viewers)
+  {
+    rmf_traffic::schedule::Database fresh;
+    for(const auto& element
+        : db.query(rmf_traffic::schedule::query_everything()))
+      fresh.insert(element.trajectory);
+
+    const auto box = rmf_traffic::geometry::make_final_convex<
+        rmf_traffic::geometry::Box>(1.0, 1.0);
+
+    for(const double x : {0.0, spacing, 2.0*spacing, 3.0*spacing})
+    {
+      for(const double y : {-5.0, 0.0, 5.0})
+      {
+        Eigen::Isometry2d tf = Eigen::Isometry2d::Identity();
+        tf.translate(Eigen::Vector2d{x, y});
+
+        for(auto t = start_time; t < start_time + 12min; t += 20s)
+        {
+          const auto query = rmf_traffic::schedule::make_query(
+            {rmf_traffic::Region{"test_map", t, t + 20s, {{box, tf}}}});
+
+          const std::size_t expected = fresh.query(query).size();
+          for(const auto* viewer : viewers)
+            CHECK(viewer->query(query).size() == expected);
+        }
+      }
+    }
+  };
+
+  WHEN("The trajectory is delayed many times")
+  {
+    for(std::size_t i=0; i < 100; ++i)
+    {
+      const Version last_known = db.latest_version();
+      id = db.delay(id, start_time + 3min, 3s);
+      mirror.update(db.changes(rmf_traffic::schedule::make_query(last_known)));
+    }
+
+    THEN("Queries only find the latest version at its delayed times")
+    {
+      check_against_fresh_database({&db, &mirror});
+
+      Eigen::Isometry2d tf = Eigen::Isometry2d::Identity();
+      tf.translate(Eigen::Vector2d{spacing, 5.0});
+      const auto arrival = start_time + 3min + 30s + 300s;
+      const auto view = db.query(rmf_traffic::schedule::make_query(
+        {rmf_traffic::Region{"test_map", arrival, arrival + 1s,
+          {{rmf_traffic::geometry::make_final_convex<
+              rmf_traffic::geometry::Box>(1.0, 1.0), tf}}}}));
+      REQUIRE(view.size() == 1);
+      CHECK(view.begin()->id == id);
+    }
+
+    THEN("Culling still removes every old version")
+    {
+      db.cull(start_time + 20min);
+      CHECK(db.statistics().entries == 0);
+    }
+  }
+
+  WHEN("The trajectory is delayed and interrupted")
+  {
+    const Version last_known = db.latest_version();
+    id = db.delay(id, start_time + 5s, 2min);
+
+    rmf_traffic::Trajectory interruption{"test_map"};
+    interruption.insert(
+          start_time + 4min, profile, Eigen::Vector3d{0.0, 5.0, 0.0},
+          Eigen::Vector3d::Zero());
+    interruption.insert(
+          start_time + 4min + 20s, profile,
+          Eigen::Vector3d{2.0*spacing, 5.0, 0.0}, Eigen::Vector3d::Zero());
+    id = db.interrupt(id, interruption, 10s);
+    mirror.update(db.changes(rmf_traffic::schedule::make_query(last_known)));
+
+    THEN("Queries agree with a freshly built schedule")
+    {
+      check_against_fresh_database({&db, &mirror});
+    }
+  }
+
+  WHEN("The trajectory is delayed backwards and replaced")
+  {
+    const Version last_known = db.latest_version();
+    id = db.delay(id, start_time, -40s);
+    id = db.replace(id, make_column_trajectory(start_time, profile, spacing));
+    mirror.update(db.changes(rmf_traffic::schedule::make_query(last_known)));
+
+    THEN("Queries agree with a freshly built schedule")
+    {
+      check_against_fresh_database({&db, &mirror});
+    }
+  }
+}
+
+//==============================================================================
+SCENARIO("Delaying entries of a crowded schedule")
+{
+  using namespace std::chrono_literals;
+  using Version = rmf_traffic::schedule::Version;
+
+  const auto start_time = std::chrono::steady_clock::now();
+  const auto profile = rmf_traffic::Trajectory::Profile::make_guided(
+        rmf_traffic::geometry::make_final_convex<
+          rmf_traffic::geometry::Circle>(0.5));
+
+  const double spacing = 3.0*rmf_traffic::schedule::internal::Bucket::CellSize;
+
+  for(const std::size_t size : {10u, 100u, 1000u})
+  {
+    // Every trajectory shares the same buckets of the timeline, and each delay
+    // is small enough that the entries stay in those buckets.
+    rmf_traffic::schedule::Database db;
+    std::vector<Version> ids;
+    for(std::size_t i=0; i < size; ++i)
+    {
+      ids.push_back(db.insert(make_column_trajectory(
+          start_time, profile, spacing*static_cast<double>(i))));
+    }
+
+    const std::size_t rounds = test_performance? 100 : 1;
+    const auto start = std::chrono::steady_clock::now();
+    for(std::size_t r=0; r < rounds; ++r)
+    {
+      for(Version& id : ids)
+        id = db.delay(id, start_time, 1ms);
+    }
+    const auto finish = std::chrono::steady_clock::now();
+
+    if(test_performance)
+    {
+      const double sec = rmf_traffic::time::to_seconds(finish - start);
+      std::cout << "Delay [" << size << " entries]: "
+                << 1e6*sec/static_cast<double>(rounds*size)
+                << "us per delay" << std::endl;
+    }
+
+    CHECK(db.latest_version() == ids.back());
+    CHECK(query_column(db, start_time, 0.0)
+          == std::unordered_set<Version>({ids.front()}));
+    CHECK(query_column(db, start_time, spacing*static_cast<double>(size-1))
+          == std::unordered_set<Version>({ids.back()}));
+  }
+}
+
+//==============================================================================
+SCENARIO("Version-indexed entry store")
+{
+  using EntryStore = rmf_traffic::schedule::internal::EntryStore;
+  using Entry = rmf_traffic::schedule::internal::Entry;
+  using EntryPtr = rmf_traffic::schedule::internal::EntryPtr;
+  using Version = rmf_traffic::schedule::Version;
+
+  const auto make_entry = [](const Version v)
+  {
+    return std::make_shared<Entry>(rmf_traffic::Trajectory("test_map"), v);
+  };
+
+  const auto versions_of = [](const EntryStore& store)
+  {
+    std::vector<Version> versions;
+    store.for_each([&](const EntryPtr& entry)
+    {
+      versions.push_back(entry->version);
+    });
+    return versions;
+  };
+
+  const auto check_store = [&](const Version start)
+  {
+    EntryStore store;
+    CHECK(store.empty());
+    CHECK(store.find(start) == nullptr);
+
+    for(Version k=0; k < 8; ++k)
+      CHECK(store.insert(make_entry(start + k)));
+
+    REQUIRE(store.size() == 8);
+    CHECK(store.oldest() == start);
+
+    // Every version finds its own entry
+    for(Version k=0; k < 8; ++k)
+    {
+      const EntryPtr* entry = store.find(start + k);
+      REQUIRE(entry);
+      CHECK((*entry)->version == start + k);
+    }
+
+    CHECK(store.find(start + 8) == nullptr);
+    CHECK(store.find(start - 1) == nullptr);
+
+    // A version that is taken cannot be inserted again
+    const EntryPtr original = *store.find(start + 3);
+    CHECK_FALSE(store.insert(make_entry(start + 3)));
+    CHECK(store.size() == 8);
+    CHECK(*store.find(start + 3) == original);
+
+    // Erasing entries trims the store from the front
+    CHECK(store.erase(start + 3));
+    CHECK_FALSE(store.erase(start + 3));
+    CHECK(store.erase(start));
+    CHECK(store.erase(start + 1));
+    CHECK(store.size() == 5);
+    CHECK(store.find(start) == nullptr);
+    CHECK(store.find(start + 3) == nullptr);
+    CHECK(store.find(start + 2) != nullptr);
+    CHECK(store.oldest() == start + 2);
+    CHECK(versions_of(store) == std::vector<Version>(
+            {start + 2, start + 4, start + 5, start + 6, start + 7}));
+
+    // Older and newer versions can be added around the remaining ones
+    CHECK(store.insert(make_entry(start)));
+    CHECK(store.insert(make_entry(start + 12)));
+    CHECK(store.oldest() == start);
+    CHECK(versions_of(store) == std::vector<Version>(
+            {start, start + 2, start + 4, start + 5, start + 6, start + 7,
+             start + 12}));
+
+    // Entries can be erased by a predicate
+    store.erase_if([&](const EntryPtr& entry)
+    {
+      return (entry->version - start) % 2 == 0;
+    });
+    CHECK(store.size() == 2);
+    CHECK(store.oldest() == start + 5);
+    CHECK(versions_of(store) == std::vector<Version>({start + 5, start + 7}));
+
+    // Erasing everything leaves the store empty
+    for(const Version v : versions_of(store))
+      CHECK(store.erase(v));
+
+    CHECK(store.empty());
+    CHECK(versions_of(store).empty());
+
+    CHECK(store.insert(make_entry(start + 100)));
+    CHECK(store.oldest() == start + 100);
+    CHECK(store.size() == 1);
+  };
+
+  GIVEN("Versions that are far from the limit of Version")
+  {
+    check_store(10);
+  }
+
+  GIVEN("Versions that overflow the limit of Version")
+  {
+    check_store(std::numeric_limits<Version>::max() - 3);
+  }
+
+  GIVEN("Versions that are spread far apart")
+  {
+    // This is what the store of a mirror looks like when its query only
+    // matches a small fraction of the changes to the schedule.
+    const std::size_t N = 100;
+    const Version gap = 10000;
+    const auto check_sparse_store = [&](const Version start)
+    {
+      EntryStore store;
+      std::vector<Version> versions;
+      for(std::size_t i=0; i < N; ++i)
+      {
+        versions.push_back(start + i*gap);
+        CHECK(store.insert(make_entry(versions.back())));
+      }
+
+      CHECK(versions_of(store) == versions);
+      CHECK(store.oldest() == start);
+
+      // The footprint grows with the number of entries, not their span
+      const std::size_t bounded_capacity = 64 * store.size();
+      CHECK(store.capacity() <= bounded_capacity);
+
+      std::size_t visited = 0;
+      store.for_each_after(start + (N/2)*gap - 1, [&](const EntryPtr&)
+      {
+        ++visited;
+      });
+      CHECK(visited == N/2);
+
+      // Erasing most of the entries releases their memory
+      for(std::size_t i=0; i < N-2; ++i)
+        CHECK(store.erase(versions[i]));
+
+      CHECK(store.oldest() == versions[N-2]);
+      CHECK(store.capacity() <= 64 * store.size());
+      CHECK(versions_of(store) == std::vector<Version>(
+              {versions[N-2], versions[N-1]}));
+
+      CHECK(store.erase(versions[N-1]));
+      CHECK(store.erase(versions[N-2]));
+      CHECK(store.empty());
+      CHECK(store.capacity() == 0);
+    };
+
+    check_sparse_store(10);
+    check_sparse_store(std::numeric_limits<Version>::max() - (N/2)*gap);
+  }
+}
@@ -20,8 +20,11 @@
 #include <rmf_traffic/Conflict.hpp>
 
 #include "utils_Trajectory.hpp"
+#include "src/rmf_traffic/DetectConflictInternal.hpp"
+#include "src/rmf_traffic/Spline.hpp"
 
 #include <iostream>
+#include <random>
 
 using namespace std::chrono_literals;
 
@@ -300,4 +303,115 @@ SCENARIO("Test Broad-Phase Collision Detection")
       std::cout << "Per run: " << sec/N << std::endl;
     }
   }
-}
\ No newline at end of file
+}
+
+namespace {
+
+//==============================================================================
+// A plain scalar version of the extrema calculation, used as a reference for
+// the batched bounding box kernel.
+double evaluate_cubic(const Eigen::Vector4d& coeffs, const double t)
+{
+  return (coeffs[3] * t * t * t
+      + coeffs[2] * t * t
+      + coeffs[1] * t
+      + coeffs[0]);
+}
+
+//==============================================================================
+std::array<double, 2> reference_extrema(const Eigen::Vector4d& coeffs)
+{
+  std::vector<double> candidates;
+  candidates.push_back(evaluate_cubic(coeffs, 0));
+  candidates.push_back(evaluate_cubic(coeffs, 1));
+
+  if (std::abs(coeffs[3]) < 1e-12)
+  {
+    if (std::abs(coeffs[2]) > 1e-12)
+      candidates.push_back(
+            evaluate_cubic(coeffs, -coeffs[1] / (2 * coeffs[2])));
+  }
+  else
+  {
+    const double D = 4 * pow(coeffs[2], 2) - 12 * coeffs[3] * coeffs[1];
+    if (std::abs(D) < 1e-12)
+    {
+      candidates.push_back(
+            evaluate_cubic(coeffs, (-2 * coeffs[2]) / (6 * coeffs[3])));
+    }
+    else if (D > 0)
+    {
+      candidates.push_back(evaluate_cubic(
+          coeffs, ((-2 * coeffs[2]) + std::sqrt(D)) / (6 * coeffs[3])));
+      candidates.push_back(evaluate_cubic(
+          coeffs, ((-2 * coeffs[2]) - std::sqrt(D)) / (6 * coeffs[3])));
+    }
+  }
+
+  return {*std::min_element(candidates.begin(), candidates.end()),
+        *std::max_element(candidates.begin(), candidates.end())};
+}
+
+} // anonymous namespace
+
+//==============================================================================
+SCENARIO("Batched spline bounding boxes")
+{
+  const auto begin_time = std::chrono::steady_clock::now();
+  const auto profile = make_test_profile(UnitCircle);
+  const double r = profile->get_shape()->get_characteristic_length();
+
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<double> position(-20.0, 20.0);
+  std::uniform_real_distribution<double> velocity(-3.0, 3.0);
+
+  // Mix stationary, straight, and curved segments so that every branch of the
+  // extrema calculation gets used
+  rmf_traffic::Trajectory trajectory("test_map");
+  rmf_traffic::Time t = begin_time;
+  Eigen::Vector3d p = Eigen::Vector3d::Zero();
+  for (std::size_t i = 0; i < 40; ++i)
+  {
+    Eigen::Vector3d v = Eigen::Vector3d::Zero();
+    if (i % 4 == 1)
+      p += Eigen::Vector3d{5.0, -2.0, 0.0};
+    else if (i % 4 > 1)
+    {
+      p = Eigen::Vector3d{position(rng), position(rng), 0.0};
+      v = Eigen::Vector3d{velocity(rng), velocity(rng), 0.0};
+    }
+
+    trajectory.insert(t, profile, p, v);
+    t += std::chrono::seconds(1 + i % 5);
+  }
+  REQUIRE(trajectory.size() == 40);
+
+  std::vector<rmf_traffic::Spline> splines;
+  for (auto it = ++trajectory.begin(); it != trajectory.end(); ++it)
+    splines.emplace_back(it);
+
+  // Use every count up to a few blocks, so that partially filled blocks are
+  // tested too
+  for (std::size_t count = 1; count <= splines.size(); ++count)
+  {
+    std::vector<rmf_traffic::internal::BoundingBox> boxes(count);
+    rmf_traffic::internal::get_bounding_boxes(
+          splines.data(), count, boxes.data());
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      const auto& coeffs = splines[i].get_params().coeffs;
+      const auto x = reference_extrema(coeffs[0]);
+      const auto y = reference_extrema(coeffs[1]);
+
+      CHECK(boxes[i].min[0] == x[0] - r);
+      CHECK(boxes[i].max[0] == x[1] + r);
+      CHECK(boxes[i].min[1] == y[0] - r);
+      CHECK(boxes[i].max[1] == y[1] + r);
+
+      const auto single = rmf_traffic::internal::get_bounding_box(splines[i]);
+      CHECK(single.min == boxes[i].min);
+      CHECK(single.max == boxes[i].max);
+    }
+  }
+}
@@ -18,9 +18,15 @@
 #include "utils_Conflict.hpp"
 #include "utils_Trajectory.hpp"
 #include "src/rmf_traffic/DetectConflictInternal.hpp"
+#include "src/rmf_traffic/Spline.hpp"
+#include "src/rmf_traffic/StaticMotion.hpp"
+#include "src/rmf_traffic/geometry/ShapeInternal.hpp"
+
+#include <fcl/continuous_collision.h>
 
 #include <rmf_utils/catch.hpp>
 #include <iostream>
+#include <random>
 
 using namespace std::chrono_literals;
 
@@ -477,6 +483,9 @@ SCENARIO("DetectConflict unit tests")
       REQUIRE(t2.size() == 2);
 
       CHECK(rmf_traffic::DetectConflict::broad_phase(t1, t2));
+      CHECK(rmf_traffic::internal::broad_phase(
+              *rmf_traffic::internal::get_bounds(t1),
+              *rmf_traffic::internal::get_bounds(t2)));
       auto conflicts = rmf_traffic::DetectConflict::between(t1, t2);
       CHECK(conflicts.size() == 1);
       CHECK(conflicts.front().get_segments().first == ++t1.begin()); //segment with the conflict
@@ -494,6 +503,9 @@ SCENARIO("DetectConflict unit tests")
       REQUIRE(t2.size() == 2);
 
       CHECK(rmf_traffic::DetectConflict::broad_phase(t1, t2));
+      CHECK(rmf_traffic::internal::broad_phase(
+              *rmf_traffic::internal::get_bounds(t1),
+              *rmf_traffic::internal::get_bounds(t2)));
       auto conflicts=rmf_traffic::DetectConflict::between(t1, t2);
       CHECK(conflicts.size() == 1);
       CHECK(conflicts.front().get_segments().first == --t1.end()); //segment with the conflict
@@ -515,6 +527,9 @@ SCENARIO("DetectConflict unit tests")
       REQUIRE(t2.size()==5);
 
       CHECK(rmf_traffic::DetectConflict::broad_phase(t1, t2));
+      CHECK(rmf_traffic::internal::broad_phase(
+              *rmf_traffic::internal::get_bounds(t1),
+              *rmf_traffic::internal::get_bounds(t2)));
       auto conflicts=rmf_traffic::DetectConflict::between(t1, t2);
       CHECK(conflicts.size() == 2);
       CHECK(conflicts.front().get_segments().first == ++t1.begin()); // segment with the conflict
@@ -529,8 +544,85 @@ SCENARIO("DetectConflict unit tests")
       REQUIRE(t2.size() == 2);
 
       CHECK_FALSE(rmf_traffic::DetectConflict::broad_phase(t1, t2));
+      CHECK_FALSE(rmf_traffic::internal::broad_phase(
+                    *rmf_traffic::internal::get_bounds(t1),
+                    *rmf_traffic::internal::get_bounds(t2)));
       CHECK(rmf_traffic::DetectConflict::between(t1, t2).size()==0);
     }
+
+    WHEN("The bounds of t1 are requested more than once")
+    {
+      const auto bounds = rmf_traffic::internal::get_bounds(t1);
+      REQUIRE(bounds->segments.size() == 3);
+      CHECK(rmf_traffic::internal::get_bounds(t1) == bounds);
+
+      THEN("Copies of t1 share the same bounds")
+      {
+        const rmf_traffic::Trajectory copy = t1;
+        CHECK(rmf_traffic::internal::get_bounds(copy) == bounds);
+      }
+
+      THEN("Modifying t1 replaces its bounds")
+      {
+        t1.find(time + 30s)->set_finish_position(
+              Eigen::Vector3d{20, -5, M_PI_2});
+
+        const auto new_bounds = rmf_traffic::internal::get_bounds(t1);
+        CHECK(new_bounds != bounds);
+        CHECK(new_bounds->box.max.x() > bounds->box.max.x());
+        CHECK(new_bounds->segments[0].box.max.x()
+              == Approx(bounds->segments[0].box.max.x()));
+
+        // The old bounds are still intact for anyone who is holding them
+        CHECK(bounds->box.max.x() < 11.0);
+      }
+
+      THEN("Delaying t1 replaces its bounds")
+      {
+        t1.begin()->adjust_finish_times(5s);
+
+        const auto new_bounds = rmf_traffic::internal::get_bounds(t1);
+        CHECK(new_bounds != bounds);
+        CHECK(new_bounds->start_time == time + 5s);
+        CHECK(new_bounds->segments.front().spline.start_time() == time + 5s);
+      }
+
+      THEN("Modifying a copy of t1 does not affect the bounds of t1")
+      {
+        rmf_traffic::Trajectory copy = t1;
+        copy.insert(time + 40s, profile,
+                    Eigen::Vector3d{10, 5, M_PI_2}, Eigen::Vector3d::Zero());
+
+        CHECK(rmf_traffic::internal::get_bounds(copy)->segments.size() == 4);
+        CHECK(rmf_traffic::internal::get_bounds(t1) == bounds);
+      }
+
+      THEN("Giving the profile of t1 a new shape replaces its bounds")
+      {
+        rmf_traffic::Trajectory t2("test_map");
+        const auto small_profile = rmf_traffic::Trajectory::Profile::make_guided(
+              rmf_traffic::geometry::make_final_convex<
+                rmf_traffic::geometry::Circle>(0.1));
+        t2.insert(time + 20s, small_profile,
+                  Eigen::Vector3d{5, -7, 0}, Eigen::Vector3d::Zero());
+        t2.insert(time + 30s, small_profile,
+                  Eigen::Vector3d{5, -7, 0}, Eigen::Vector3d::Zero());
+
+        CHECK_FALSE(rmf_traffic::internal::broad_phase(
+                      *rmf_traffic::internal::get_bounds(t1),
+                      *rmf_traffic::internal::get_bounds(t2)));
+
+        profile->set_shape(rmf_traffic::geometry::make_final_convex<
+                             rmf_traffic::geometry::Box>(5.0, 5.0));
+
+        const auto new_bounds = rmf_traffic::internal::get_bounds(t1);
+        CHECK(new_bounds != bounds);
+        CHECK(new_bounds->box.min.y() < bounds->box.min.y() - 1.0);
+        CHECK(rmf_traffic::internal::get_bounds(t1) == new_bounds);
+        CHECK(rmf_traffic::internal::broad_phase(
+                *new_bounds, *rmf_traffic::internal::get_bounds(t2)));
+      }
+    }
   }
 
   GIVEN("A trajectory with a curve")
@@ -631,4 +723,642 @@ SCENARIO("DetectConflict unit tests")
   }
 }
 
+// Set this to true to print the timing results of the benchmarks below
+const bool test_performance = false;
+// const bool test_performance = true;
+
+//==============================================================================
+namespace {
+
+struct FclResult
+{
+  bool is_collide;
+  double time_of_contact;
+};
+
+//==============================================================================
+FclResult fcl_collide(
+    const rmf_traffic::Spline& spline_a,
+    const rmf_traffic::geometry::FinalConvexShape& shape_a,
+    const rmf_traffic::Spline& spline_b,
+    const rmf_traffic::geometry::FinalConvexShape& shape_b,
+    const rmf_traffic::Time start_time,
+    const rmf_traffic::Time finish_time)
+{
+  using Implementation =
+      rmf_traffic::geometry::FinalConvexShape::Implementation;
+
+  const auto obj_a = fcl::ContinuousCollisionObject(
+        Implementation::get_collision(shape_a),
+        std::make_shared<fcl::SplineMotion>(
+          spline_a.to_fcl(start_time, finish_time)));
+  const auto obj_b = fcl::ContinuousCollisionObject(
+        Implementation::get_collision(shape_b),
+        std::make_shared<fcl::SplineMotion>(
+          spline_b.to_fcl(start_time, finish_time)));
+
+  fcl::ContinuousCollisionRequest request;
+  request.ccd_solver_type = fcl::CCDC_CONSERVATIVE_ADVANCEMENT;
+  request.gjk_solver_type = fcl::GST_LIBCCD;
+  fcl::ContinuousCollisionResult result;
+  fcl::collide(&obj_a, &obj_b, request, result);
+
+  return {result.is_collide, result.time_of_contact};
+}
+
+//==============================================================================
+FclResult fcl_collide(
+    const rmf_traffic::Spline& spline,
+    const rmf_traffic::geometry::FinalConvexShape& shape,
+    const Eigen::Isometry2d& pose,
+    const rmf_traffic::geometry::FinalConvexShape& region_shape,
+    const rmf_traffic::Time start_time,
+    const rmf_traffic::Time finish_time)
+{
+  using Implementation =
+      rmf_traffic::geometry::FinalConvexShape::Implementation;
+
+  const auto obj = fcl::ContinuousCollisionObject(
+        Implementation::get_collision(shape),
+        std::make_shared<fcl::SplineMotion>(
+          spline.to_fcl(start_time, finish_time)));
+  const auto obj_region = fcl::ContinuousCollisionObject(
+        Implementation::get_collision(region_shape),
+        std::make_shared<rmf_traffic::internal::StaticMotion>(pose));
+
+  fcl::ContinuousCollisionRequest request;
+  request.ccd_solver_type = fcl::CCDC_CONSERVATIVE_ADVANCEMENT;
+  request.gjk_solver_type = fcl::GST_LIBCCD;
+  fcl::ContinuousCollisionResult result;
+  fcl::collide(&obj, &obj_region, request, result);
+
+  return {result.is_collide, result.time_of_contact};
+}
+
+//==============================================================================
+/// Find the closest that two circles come to touching, by sampling. Pairs
+/// that barely touch or barely miss are left out of the comparison, because
+/// the solvers are allowed to disagree about them within their tolerances.
+double sample_clearance(
+    const rmf_traffic::Spline& spline_a,
+    const rmf_traffic::Spline& spline_b,
+    const double radius)
+{
+  const rmf_traffic::Time start_time = spline_a.start_time();
+  const rmf_traffic::Duration range = spline_a.finish_time() - start_time;
+
+  double clearance = std::numeric_limits<double>::infinity();
+  const std::size_t samples = 1000;
+  for(std::size_t i=0; i <= samples; ++i)
+  {
+    const rmf_traffic::Time t = start_time
+        + rmf_traffic::Duration(range.count()*i/samples);
+    const Eigen::Vector3d d =
+        spline_a.compute_position(t) - spline_b.compute_position(t);
+    clearance = std::min(clearance, d.block<2,1>(0,0).norm() - radius);
+  }
+
+  return clearance;
+}
+
+//==============================================================================
+rmf_traffic::Trajectory make_random_trajectory(
+    std::mt19937& rng,
+    const rmf_traffic::Time start_time,
+    const rmf_traffic::Trajectory::ConstProfilePtr& profile)
+{
+  std::uniform_real_distribution<double> position(-5.0, 5.0);
+  std::uniform_real_distribution<double> velocity(-1.0, 1.0);
+
+  rmf_traffic::Trajectory trajectory("test_map");
+  for(const auto t : {start_time, start_time + 10s})
+  {
+    trajectory.insert(
+          t, profile,
+          Eigen::Vector3d{position(rng), position(rng), position(rng)},
+          Eigen::Vector3d{velocity(rng), velocity(rng), velocity(rng)});
+  }
+
+  return trajectory;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+SCENARIO("Analytic circle collisions agree with FCL")
+{
+  const rmf_traffic::Time time = std::chrono::steady_clock::now();
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<double> radius_dist(0.2, 1.5);
+
+  const auto make_circle = [&]()
+  {
+    return rmf_traffic::geometry::make_final_convex<
+        rmf_traffic::geometry::Circle>(radius_dist(rng));
+  };
+
+  const double toc_margin = 0.05;
+  const double grazing_margin = 0.05;
+
+  GIVEN("Two circles moving along random splines")
+  {
+    std::size_t collisions = 0;
+    std::size_t misses = 0;
+    for(std::size_t i=0; i < 500; ++i)
+    {
+      const auto shape_a = make_circle();
+      const auto shape_b = make_circle();
+      const auto t_a = make_random_trajectory(
+            rng, time, rmf_traffic::Trajectory::Profile::make_guided(shape_a));
+      const auto t_b = make_random_trajectory(
+            rng, time, rmf_traffic::Trajectory::Profile::make_guided(shape_b));
+
+      const rmf_traffic::Spline spline_a(++t_a.begin());
+      const rmf_traffic::Spline spline_b(++t_b.begin());
+
+      double radius_a;
+      double radius_b;
+      REQUIRE(rmf_traffic::internal::get_circle_radius(*shape_a, radius_a));
+      REQUIRE(rmf_traffic::internal::get_circle_radius(*shape_b, radius_b));
+
+      const double clearance =
+          sample_clearance(spline_a, spline_b, radius_a + radius_b);
+      if(std::abs(clearance) < grazing_margin)
+        continue;
+
+      double toc = -1.0;
+      const bool analytic = rmf_traffic::internal::detect_circle_collision(
+            spline_a, radius_a, spline_b, radius_b, time, time + 10s, &toc);
+      const FclResult fcl = fcl_collide(
+            spline_a, *shape_a, spline_b, *shape_b, time, time + 10s);
+
+      CHECK(analytic == (clearance < 0.0));
+      CHECK(analytic == fcl.is_collide);
+      if(analytic && fcl.is_collide)
+      {
+        CHECK(toc == Approx(fcl.time_of_contact).margin(toc_margin));
+        ++collisions;
+      }
+      else
+      {
+        ++misses;
+      }
+
+      // The narrow phase should dispatch to the analytic solver and agree
+      // with it
+      const auto conflicts =
+          rmf_traffic::DetectConflict::narrow_phase(t_a, t_b, true);
+      CHECK(conflicts.empty() == !analytic);
+    }
+
+    // Make sure the random pairs cover both outcomes
+    CHECK(collisions > 50);
+    CHECK(misses > 50);
+  }
+
+  GIVEN("A circle moving along random splines past static regions")
+  {
+    std::uniform_real_distribution<double> position(-4.0, 4.0);
+    std::uniform_real_distribution<double> length(0.2, 3.0);
+    std::uniform_real_distribution<double> angle(-M_PI, M_PI);
+
+    std::size_t collisions = 0;
+    for(std::size_t i=0; i < 500; ++i)
+    {
+      const auto shape = make_circle();
+      const auto trajectory = make_random_trajectory(
+            rng, time, rmf_traffic::Trajectory::Profile::make_guided(shape));
+      const rmf_traffic::Spline spline(++trajectory.begin());
+
+      Eigen::Isometry2d pose = Eigen::Isometry2d::Identity();
+      pose.translate(Eigen::Vector2d{position(rng), position(rng)});
+      pose.rotate(Eigen::Rotation2Dd(angle(rng)));
+
+      const auto region_shape = i%2 == 0?
+            rmf_traffic::geometry::make_final_convex<
+              rmf_traffic::geometry::Box>(length(rng), length(rng))
+          : make_circle();
+
+      double radius;
+      REQUIRE(rmf_traffic::internal::get_circle_radius(*shape, radius));
+      rmf_traffic::internal::RoundedBox box;
+      REQUIRE(rmf_traffic::internal::make_rounded_box(
+                *region_shape, pose, box));
+
+      double toc = -1.0;
+      const bool analytic = rmf_traffic::internal::detect_circle_collision(
+            spline, radius, box, time, time + 10s, &toc);
+      const FclResult fcl = fcl_collide(
+            spline, *shape, pose, *region_shape, time, time + 10s);
+
+      // Grazing contacts are checked again with a slightly smaller and a
+      // slightly larger circle, which must bracket the FCL answer.
+      if(analytic != fcl.is_collide)
+      {
+        rmf_traffic::internal::RoundedBox inflated = box;
+        inflated.radius += grazing_margin;
+        CHECK(rmf_traffic::internal::detect_circle_collision(
+                spline, radius, inflated, time, time + 10s, nullptr));
+
+        rmf_traffic::internal::RoundedBox deflated = box;
+        deflated.radius -= grazing_margin;
+        CHECK_FALSE(rmf_traffic::internal::detect_circle_collision(
+                spline, radius, deflated, time, time + 10s, nullptr));
+        continue;
+      }
+
+      if(analytic)
+      {
+        ++collisions;
+        CHECK(toc == Approx(fcl.time_of_contact).margin(toc_margin));
+      }
+
+      rmf_traffic::internal::Spacetime region;
+      region.lower_time_bound = nullptr;
+      region.upper_time_bound = nullptr;
+      region.pose = pose;
+      region.shape = region_shape;
+      CHECK(rmf_traffic::internal::detect_conflicts(
+              trajectory, region, nullptr) == analytic);
+    }
+
+    CHECK(collisions > 50);
+  }
+
+  GIVEN("A benchmark of the analytic solver against FCL")
+  {
+    const std::size_t N = test_performance? 20000 : 100;
+    std::vector<rmf_traffic::Trajectory> trajectories;
+    std::vector<rmf_traffic::geometry::ConstFinalConvexShapePtr> shapes;
+    for(std::size_t i=0; i < 2*N; ++i)
+    {
+      shapes.push_back(make_circle());
+      trajectories.push_back(make_random_trajectory(
+          rng, time, rmf_traffic::Trajectory::Profile::make_guided(
+            shapes.back())));
+    }
+
+    std::size_t analytic_collisions = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(std::size_t i=0; i < N; ++i)
+    {
+      const rmf_traffic::Spline spline_a(++trajectories[2*i].begin());
+      const rmf_traffic::Spline spline_b(++trajectories[2*i+1].begin());
+      double radius_a;
+      double radius_b;
+      rmf_traffic::internal::get_circle_radius(*shapes[2*i], radius_a);
+      rmf_traffic::internal::get_circle_radius(*shapes[2*i+1], radius_b);
+      double toc;
+      if(rmf_traffic::internal::detect_circle_collision(
+           spline_a, radius_a, spline_b, radius_b, time, time + 10s, &toc))
+        ++analytic_collisions;
+    }
+    const double analytic_sec = rmf_traffic::time::to_seconds(
+          std::chrono::steady_clock::now() - start);
+
+    std::size_t fcl_collisions = 0;
+    start = std::chrono::steady_clock::now();
+    for(std::size_t i=0; i < N; ++i)
+    {
+      const rmf_traffic::Spline spline_a(++trajectories[2*i].begin());
+      const rmf_traffic::Spline spline_b(++trajectories[2*i+1].begin());
+      if(fcl_collide(spline_a, *shapes[2*i], spline_b, *shapes[2*i+1],
+                     time, time + 10s).is_collide)
+        ++fcl_collisions;
+    }
+    const double fcl_sec = rmf_traffic::time::to_seconds(
+          std::chrono::steady_clock::now() - start);
+
+    if(test_performance)
+    {
+      std::cout << "Circle solver [" << N << " pairs]: analytic "
+                << analytic_sec << "s (" << analytic_collisions
+                << " collisions) | FCL " << fcl_sec << "s ("
+                << fcl_collisions << " collisions)" << std::endl;
+    }
+
+    // Only grazing pairs are allowed to disagree
+    const double disagreement = std::abs(
+          static_cast<double>(analytic_collisions)
+          - static_cast<double>(fcl_collisions));
+    CHECK(disagreement <= 0.02*N + 1);
+  }
+}
+
+//==============================================================================
+SCENARIO("Batch conflict detection")
+{
+  const rmf_traffic::Time time = std::chrono::steady_clock::now();
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<double> position(-50.0, 50.0);
+  std::uniform_real_distribution<double> step(-3.0, 3.0);
+  std::uniform_int_distribution<int> start_offset(0, 60);
+
+  const auto profile = rmf_traffic::Trajectory::Profile::make_guided(
+        rmf_traffic::geometry::make_final_convex<
+          rmf_traffic::geometry::Circle>(0.5));
+
+  // Make a random walk that spans a minute, with a few of them on a second map
+  const auto make_walk = [&](const std::size_t i)
+  {
+    rmf_traffic::Trajectory trajectory(i%10 == 0? "other_map" : "test_map");
+    rmf_traffic::Time t = time + std::chrono::seconds(start_offset(rng));
+    Eigen::Vector3d p{position(rng), position(rng), 0.0};
+    for(std::size_t k=0; k < 7; ++k)
+    {
+      trajectory.insert(t, profile, p, Eigen::Vector3d::Zero());
+      p += Eigen::Vector3d{step(rng), step(rng), 0.0};
+      t += 10s;
+    }
+
+    return trajectory;
+  };
+
+  const std::size_t N = test_performance? 500 : 120;
+  std::vector<rmf_traffic::Trajectory> trajectories;
+  for(std::size_t i=0; i < N; ++i)
+    trajectories.push_back(make_walk(i));
+
+  std::vector<const rmf_traffic::Trajectory*> set;
+  for(const auto& trajectory : trajectories)
+    set.push_back(&trajectory);
+
+  using Report = rmf_traffic::DetectConflict::Report;
+
+  WHEN("Every pair in the set is checked")
+  {
+    auto start = std::chrono::steady_clock::now();
+    const auto pairs = rmf_traffic::DetectConflict::among(set);
+    const double batch_sec = rmf_traffic::time::to_seconds(
+          std::chrono::steady_clock::now() - start);
+
+    std::vector<std::pair<std::size_t, std::size_t>> expected;
+    start = std::chrono::steady_clock::now();
+    for(std::size_t i=0; i < N; ++i)
+    {
+      for(std::size_t j=i+1; j < N; ++j)
+      {
+        if(!rmf_traffic::DetectConflict::between(
+             trajectories[i], trajectories[j], true).empty())
+          expected.emplace_back(i, j);
+      }
+    }
+    const double pairwise_sec = rmf_traffic::time::to_seconds(
+          std::chrono::steady_clock::now() - start);
+
+    if(test_performance)
+    {
+      std::cout << "Batch conflicts [" << N << " trajectories, "
+                << expected.size() << " conflicts]: among() " << batch_sec
+                << "s | pairwise between() " << pairwise_sec << "s"
+                << std::endl;
+    }
+
+    THEN("The same pairs are found as with between()")
+    {
+      REQUIRE(expected.size() > 0);
+      REQUIRE(pairs.size() == expected.size());
+      for(std::size_t k=0; k < pairs.size(); ++k)
+      {
+        CHECK(pairs[k].first == expected[k].first);
+        CHECK(pairs[k].second == expected[k].second);
+        REQUIRE(pairs[k].conflicts.size() == 1);
+
+        const auto& segments = pairs[k].conflicts.front().get_segments();
+        CHECK(segments.first->get_finish_time()
+              <= *trajectories[pairs[k].first].finish_time());
+        CHECK(segments.second->get_finish_time()
+              <= *trajectories[pairs[k].second].finish_time());
+      }
+    }
+
+    THEN("Only one conflict is reported when asked for the first")
+    {
+      const auto first = rmf_traffic::DetectConflict::among(
+            set, Report::FirstConflict);
+      REQUIRE(first.size() == 1);
+      CHECK(first.front().first == expected.front().first);
+      CHECK(first.front().second == expected.front().second);
+    }
+
+    THEN("Every conflict is reported when asked for all of them")
+    {
+      const auto all = rmf_traffic::DetectConflict::among(
+            set, Report::AllConflicts);
+      REQUIRE(all.size() == expected.size());
+      for(const auto& pair : all)
+      {
+        CHECK(pair.conflicts.size() ==
+              rmf_traffic::DetectConflict::between(
+                trajectories[pair.first], trajectories[pair.second]).size());
+      }
+    }
+  }
+
+  WHEN("One trajectory is checked against the set")
+  {
+    const rmf_traffic::Trajectory trajectory = make_walk(1);
+    const auto matches =
+        rmf_traffic::DetectConflict::against(trajectory, set);
+
+    std::vector<std::size_t> expected;
+    for(std::size_t i=0; i < N; ++i)
+    {
+      if(!rmf_traffic::DetectConflict::between(
+           trajectory, trajectories[i], true).empty())
+        expected.push_back(i);
+    }
+
+    REQUIRE(matches.size() == expected.size());
+    for(std::size_t k=0; k < matches.size(); ++k)
+    {
+      CHECK(matches[k].index == expected[k]);
+      REQUIRE(matches[k].conflicts.size() == 1);
+      CHECK(matches[k].conflicts.front().get_segments().first->get_finish_time()
+            <= *trajectory.finish_time());
+    }
+
+    const auto first = rmf_traffic::DetectConflict::against(
+          trajectory, set, Report::FirstConflict);
+    CHECK(first.size() == std::min<std::size_t>(1, expected.size()));
+  }
+
+  WHEN("A trajectory is checked against a set on another map")
+  {
+    rmf_traffic::Trajectory trajectory = make_walk(1);
+    std::vector<const rmf_traffic::Trajectory*> other_map_set;
+    for(const auto& t : trajectories)
+    {
+      if(t.get_map_name() != trajectory.get_map_name())
+        other_map_set.push_back(&t);
+    }
+
+    REQUIRE(!other_map_set.empty());
+    CHECK(rmf_traffic::DetectConflict::against(
+            trajectory, other_map_set).empty());
+  }
+
+  WHEN("The checks are spread across a thread pool")
+  {
+    rmf_traffic::ThreadPool pool(4);
+    CHECK(pool.size() == 4);
+
+    const auto same_pairs = [](
+        const std::vector<rmf_traffic::DetectConflict::Pair>& a,
+        const std::vector<rmf_traffic::DetectConflict::Pair>& b)
+    {
+      REQUIRE(a.size() == b.size());
+      for(std::size_t k=0; k < a.size(); ++k)
+      {
+        CHECK(a[k].first == b[k].first);
+        CHECK(a[k].second == b[k].second);
+        REQUIRE(a[k].conflicts.size() == b[k].conflicts.size());
+        for(std::size_t c=0; c < a[k].conflicts.size(); ++c)
+        {
+          CHECK(a[k].conflicts[c].get_time() == b[k].conflicts[c].get_time());
+          CHECK(a[k].conflicts[c].get_segments()
+                == b[k].conflicts[c].get_segments());
+        }
+      }
+    };
+
+    for(const auto report :
+        {Report::FirstConflict, Report::FirstOfEachPair, Report::AllConflicts})
+    {
+      auto start = std::chrono::steady_clock::now();
+      const auto serial = rmf_traffic::DetectConflict::among(set, report);
+      const double serial_sec = rmf_traffic::time::to_seconds(
+            std::chrono::steady_clock::now() - start);
+
+      start = std::chrono::steady_clock::now();
+      const auto parallel =
+          rmf_traffic::DetectConflict::among(set, report, &pool);
+      const double parallel_sec = rmf_traffic::time::to_seconds(
+            std::chrono::steady_clock::now() - start);
+
+      if(test_performance)
+      {
+        std::cout << "Batch conflicts [" << N << " trajectories, report "
+                  << static_cast<int>(report) << "]: serial " << serial_sec
+                  << "s | " << pool.size() << " workers " << parallel_sec
+                  << "s" << std::endl;
+      }
+
+      same_pairs(serial, parallel);
+
+      for(std::size_t i=0; i < N; i += 7)
+      {
+        const auto serial_matches = rmf_traffic::DetectConflict::against(
+              trajectories[i], set, report);
+        const auto parallel_matches = rmf_traffic::DetectConflict::against(
+              trajectories[i], set, report, &pool);
+
+        REQUIRE(serial_matches.size() == parallel_matches.size());
+        for(std::size_t k=0; k < serial_matches.size(); ++k)
+        {
+          CHECK(serial_matches[k].index == parallel_matches[k].index);
+          CHECK(serial_matches[k].conflicts.size()
+                == parallel_matches[k].conflicts.size());
+        }
+      }
+    }
+  }
+}
+
+//==============================================================================
+SCENARIO("Reusing a conflict context")
+{
+  const rmf_traffic::Time time = std::chrono::steady_clock::now();
+  std::mt19937 rng(11);
+  std::uniform_real_distribution<double> length(0.2, 1.5);
+  std::uniform_real_distribution<double> position(-4.0, 4.0);
+
+  // Boxes are not handled by the analytic circle solver, so every check of
+  // these shapes goes through FCL. There are more shapes than a context keeps
+  // objects for, so its cache will get flushed along the way.
+  std::vector<rmf_traffic::Trajectory> trajectories;
+  for(std::size_t i=0; i < 150; ++i)
+  {
+    const auto shape = rmf_traffic::geometry::make_final_convex<
+        rmf_traffic::geometry::Box>(length(rng), length(rng));
+    trajectories.push_back(make_random_trajectory(
+        rng, time, rmf_traffic::Trajectory::Profile::make_guided(shape)));
+  }
+
+  const auto same_conflicts = [](
+      const std::vector<rmf_traffic::ConflictData>& a,
+      const std::vector<rmf_traffic::ConflictData>& b)
+  {
+    REQUIRE(a.size() == b.size());
+    for(std::size_t k=0; k < a.size(); ++k)
+      CHECK(a[k].get_time() == b[k].get_time());
+  };
+
+  rmf_traffic::DetectConflict::Context context;
+
+  WHEN("Pairs of trajectories are checked with the same context")
+  {
+    std::size_t conflicts = 0;
+    for(std::size_t repeat=0; repeat < 2; ++repeat)
+    {
+      for(std::size_t i=0; i+1 < trajectories.size(); ++i)
+      {
+        const auto& a = trajectories[i];
+        const auto& b = trajectories[i+1];
+        for(const bool quit : {true, false})
+        {
+          const auto expected =
+              rmf_traffic::DetectConflict::narrow_phase(a, b, quit);
+          same_conflicts(expected, rmf_traffic::DetectConflict::narrow_phase(
+                           a, b, quit, &context));
+          same_conflicts(expected, rmf_traffic::DetectConflict::narrow_phase(
+                           b, a, quit, &context));
+          same_conflicts(
+                rmf_traffic::DetectConflict::between(a, b, quit),
+                rmf_traffic::DetectConflict::between(a, b, quit, &context));
+
+          if(!expected.empty())
+            ++conflicts;
+        }
+      }
+    }
+
+    THEN("Some of the pairs were in conflict")
+    {
+      CHECK(conflicts > 0);
+    }
+  }
+
+  WHEN("Trajectories are checked against regions with the same context")
+  {
+    for(std::size_t i=0; i < trajectories.size(); ++i)
+    {
+      Eigen::Isometry2d pose = Eigen::Isometry2d::Identity();
+      pose.translate(Eigen::Vector2d{position(rng), position(rng)});
+
+      rmf_traffic::internal::Spacetime region;
+      region.lower_time_bound = nullptr;
+      region.upper_time_bound = nullptr;
+      region.pose = pose;
+      region.shape = rmf_traffic::geometry::make_final_convex<
+          rmf_traffic::geometry::Box>(length(rng), length(rng));
+
+      const bool expected = rmf_traffic::internal::detect_conflicts(
+            trajectories[i], region, nullptr);
+      CHECK(rmf_traffic::internal::detect_conflicts(
+              trajectories[i], region, nullptr, &context) == expected);
+
+      // Mixing region checks with pairwise checks must not disturb either
+      if(i+1 < trajectories.size())
+      {
+        same_conflicts(
+              rmf_traffic::DetectConflict::narrow_phase(
+                trajectories[i], trajectories[i+1]),
+              rmf_traffic::DetectConflict::narrow_phase(
+                trajectories[i], trajectories[i+1], false, &context));
+      }
+    }
+  }
+}
+
 // A useful website for playing with 2D cubic splines: https://www.desmos.com/calculator/
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "src/rmf_traffic/ThreadPoolInternal.hpp"
+
+#include <rmf_utils/catch.hpp>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+//==============================================================================
+SCENARIO("Thread pool")
+{
+  using Implementation = rmf_traffic::ThreadPool::Implementation;
+
+  GIVEN("No pool")
+  {
+    std::vector<std::size_t> order;
+    Implementation::for_each(nullptr, 10, [&](const std::size_t i)
+    {
+      order.push_back(i);
+    });
+
+    THEN("The jobs are run in order on this thread")
+    {
+      REQUIRE(order.size() == 10);
+      for(std::size_t i=0; i < order.size(); ++i)
+        CHECK(order[i] == i);
+    }
+  }
+
+  GIVEN("A pool with the default number of workers")
+  {
+    rmf_traffic::ThreadPool pool;
+    CHECK(pool.size() == std::max(1u, std::thread::hardware_concurrency()));
+  }
+
+  GIVEN("A pool with a few workers")
+  {
+    rmf_traffic::ThreadPool pool(3);
+    CHECK(pool.size() == 3);
+
+    WHEN("A large range is given to it")
+    {
+      const std::size_t N = 10000;
+      std::vector<std::atomic<int>> calls(N);
+      for(auto& c : calls)
+        c = 0;
+
+      Implementation::for_each(&pool, N, [&](const std::size_t i)
+      {
+        ++calls[i];
+      });
+
+      THEN("Every index is visited exactly once")
+      {
+        std::size_t wrong = 0;
+        for(const auto& c : calls)
+          wrong += (c != 1)? 1 : 0;
+
+        CHECK(wrong == 0);
+      }
+    }
+
+    WHEN("Jobs use the pool themselves")
+    {
+      std::atomic<std::size_t> total(0);
+      Implementation::for_each(&pool, 20, [&](const std::size_t)
+      {
+        Implementation::for_each(&pool, 50, [&](const std::size_t)
+        {
+          ++total;
+        });
+      });
+
+      THEN("Every nested job is run without deadlocking")
+      {
+        CHECK(total == 20*50);
+      }
+    }
+
+    WHEN("A job throws an exception")
+    {
+      std::atomic<std::size_t> finished(0);
+      const auto run = [&]()
+      {
+        Implementation::for_each(&pool, 100, [&](const std::size_t i)
+        {
+          if(i == 42)
+            throw std::runtime_error("test");
+
+          ++finished;
+        });
+      };
+
+      THEN("It gets rethrown to the caller")
+      {
+        CHECK_THROWS_AS(run(), std::runtime_error);
+      }
+    }
+
+    WHEN("Several threads share the pool")
+    {
+      std::atomic<std::size_t> total(0);
+      std::vector<std::thread> threads;
+      for(std::size_t t=0; t < 4; ++t)
+      {
+        threads.emplace_back([&]()
+        {
+          for(std::size_t k=0; k < 10; ++k)
+          {
+            Implementation::for_each(&pool, 100, [&](const std::size_t)
+            {
+              ++total;
+            });
+          }
+        });
+      }
+
+      for(auto& thread : threads)
+        thread.join();
+
+      THEN("Every job of every thread gets run")
+      {
+        CHECK(total == 4*10*100);
+      }
+    }
+  }
+}
@@ -22,6 +22,26 @@
 
 using namespace std::chrono_literals;
 
+// Set this to true to print the timing results of the storage benchmarks
+const bool test_performance = false;
+// const bool test_performance = true;
+const std::size_t N = test_performance? 1000 : 1;
+
+//==============================================================================
+void print_timing(
+    const std::string& label,
+    const std::size_t segments,
+    const std::chrono::steady_clock::time_point& start_time)
+{
+  if(test_performance)
+  {
+    const auto finish_time = std::chrono::steady_clock::now();
+    const double sec = rmf_traffic::time::to_seconds(finish_time - start_time);
+    std::cout << label << " [" << segments << " segments]: "
+              << 1e6*sec/N << "us per run" << std::endl;
+  }
+}
+
 SCENARIO("Profile unit tests")
 {
   // Profile Construction and Getters
@@ -1039,3 +1059,210 @@ SCENARIO("Trajectory and base_iterator unit tests")
     }
   }
 }
+
+SCENARIO("Modifying copies of a Trajectory")
+{
+  const rmf_traffic::Time time = std::chrono::steady_clock::now();
+  const auto profile = create_test_profile(UnitBox);
+
+  rmf_traffic::Trajectory original("test_map");
+  for(std::size_t i=0; i < 20; ++i)
+  {
+    const double x = static_cast<double>(i);
+    original.insert(
+          time + std::chrono::seconds(i), profile,
+          Eigen::Vector3d(x, 0, 0), Eigen::Vector3d(1, 0, 0));
+  }
+
+  const auto check_original = [&](const rmf_traffic::Trajectory& t)
+  {
+    REQUIRE(t.size() == 20);
+    std::size_t i = 0;
+    for(const auto& segment : t)
+    {
+      CHECK(segment.get_finish_time() == time + std::chrono::seconds(i));
+      CHECK(segment.get_finish_position()
+            == Eigen::Vector3d(static_cast<double>(i), 0, 0));
+      ++i;
+    }
+    CHECK(*t.start_time() == time);
+    CHECK(*t.finish_time() == time + 19s);
+    CHECK(rmf_traffic::Trajectory::Debug::check_iterator_time_consistency(
+            t, true));
+  };
+
+  rmf_traffic::Trajectory copy = original;
+
+  WHEN("Delaying the copy")
+  {
+    copy.find(time + 10s)->adjust_finish_times(5s);
+
+    THEN("Only the copy is delayed")
+    {
+      check_original(original);
+      CHECK(copy.find(time + 9s)->get_finish_time() == time + 9s);
+      CHECK(copy.find(time + 12s)->get_finish_time() == time + 15s);
+      CHECK(*copy.finish_time() == time + 24s);
+      CHECK(copy.duration() == 24s);
+      CHECK(rmf_traffic::Trajectory::Debug::check_iterator_time_consistency(
+              copy, true));
+    }
+  }
+
+  WHEN("Delaying the copy repeatedly")
+  {
+    for(std::size_t i=0; i < 20; ++i)
+      copy.find(time + std::chrono::seconds(i) + 50*i*1ms)
+          ->adjust_finish_times(50ms);
+
+    THEN("Every delay accumulates in the copy")
+    {
+      check_original(original);
+      std::size_t i = 0;
+      for(const auto& segment : copy)
+      {
+        CHECK(segment.get_finish_time()
+              == time + std::chrono::seconds(i) + 50*(i+1)*1ms);
+        ++i;
+      }
+      CHECK(rmf_traffic::Trajectory::Debug::check_iterator_time_consistency(
+              copy, true));
+    }
+  }
+
+  WHEN("Changing the segments of the copy")
+  {
+    copy.find(time + 3s)->set_finish_position(Eigen::Vector3d(-1, -1, -1));
+    copy.find(time + 4s)->set_finish_time(time + 4500ms);
+    copy.erase(copy.find(time + 15s));
+    copy.insert(
+          time + 7500ms, profile, Eigen::Vector3d::Zero(),
+          Eigen::Vector3d::Zero());
+
+    THEN("The original is unchanged")
+    {
+      check_original(original);
+      REQUIRE(copy.size() == 20);
+      CHECK(copy.find(time + 3s)->get_finish_position()
+            == Eigen::Vector3d(-1, -1, -1));
+      CHECK(copy.find(time + 4200ms)->get_finish_time() == time + 4500ms);
+      CHECK(copy.find(time + 14500ms)->get_finish_time() == time + 16s);
+      CHECK(copy.find(time + 7200ms)->get_finish_time() == time + 7500ms);
+      CHECK(rmf_traffic::Trajectory::Debug::check_iterator_time_consistency(
+              copy, true));
+    }
+  }
+
+  WHEN("Changing the original")
+  {
+    original.find(time + 5s)->set_finish_velocity(Eigen::Vector3d::Zero());
+    original.begin()->adjust_finish_times(-2s);
+
+    THEN("The copy is unchanged")
+    {
+      check_original(copy);
+      CHECK(original.find(time + 3s)->get_finish_velocity()
+            == Eigen::Vector3d::Zero());
+      CHECK(*original.start_time() == time - 2s);
+    }
+  }
+}
+
+SCENARIO("Trajectory storage benchmarks")
+{
+  const rmf_traffic::Time time = std::chrono::steady_clock::now();
+  const auto profile = create_test_profile(UnitBox);
+
+  for(const std::size_t size : {10u, 100u, 1000u})
+  {
+    // Build the expected finish times, then shuffle them deterministically so
+    // that insertion exercises the front, middle, and back of the storage.
+    std::vector<rmf_traffic::Time> times;
+    for(std::size_t i=0; i < size; ++i)
+      times.push_back(time + std::chrono::seconds(i));
+
+    std::vector<rmf_traffic::Time> insertion_order;
+    for(std::size_t i=0; i < size; i += 2)
+      insertion_order.push_back(times[i]);
+    for(std::size_t i=size-1; i < size; i -= 2)
+      insertion_order.push_back(times[i]);
+    REQUIRE(insertion_order.size() == size);
+
+    rmf_traffic::Trajectory trajectory("test_map");
+    auto start = std::chrono::steady_clock::now();
+    for(std::size_t n=0; n < N; ++n)
+    {
+      trajectory = rmf_traffic::Trajectory("test_map");
+      for(const auto& t : times)
+      {
+        trajectory.insert(
+              t, profile, Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero());
+      }
+    }
+    print_timing("Append", size, start);
+    CHECK(trajectory.size() == size);
+
+    start = std::chrono::steady_clock::now();
+    for(std::size_t n=0; n < N; ++n)
+    {
+      trajectory = rmf_traffic::Trajectory("test_map");
+      for(const auto& t : insertion_order)
+      {
+        trajectory.insert(
+              t, profile, Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero());
+      }
+    }
+    print_timing("Insert", size, start);
+
+    REQUIRE(trajectory.size() == size);
+    CHECK(rmf_traffic::Trajectory::Debug::check_iterator_time_consistency(
+            trajectory, true));
+
+    std::size_t found = 0;
+    start = std::chrono::steady_clock::now();
+    for(std::size_t n=0; n < N; ++n)
+    {
+      for(const auto& t : times)
+        found += trajectory.find(t + 500ms) != trajectory.end()? 1 : 0;
+    }
+    print_timing("Find", size, start);
+    // Every time except the last one should land inside the trajectory
+    CHECK(found == N*(size-1));
+
+    std::size_t copied = 0;
+    start = std::chrono::steady_clock::now();
+    for(std::size_t n=0; n < N; ++n)
+    {
+      const rmf_traffic::Trajectory copy = trajectory;
+      copied += copy.size();
+    }
+    print_timing("Copy", size, start);
+    CHECK(copied == N*size);
+
+    start = std::chrono::steady_clock::now();
+    for(std::size_t n=0; n < N; ++n)
+    {
+      rmf_traffic::Trajectory delayed = trajectory;
+      delayed.find(times[size/2])->adjust_finish_times(1s);
+      copied += delayed.size();
+    }
+    print_timing("Copy and delay", size, start);
+    CHECK(*trajectory.finish_time() == times.back());
+
+    std::size_t index = 0;
+    start = std::chrono::steady_clock::now();
+    for(std::size_t n=0; n < N; ++n)
+    {
+      index = 0;
+      for(const auto& segment : trajectory)
+      {
+        if(segment.get_finish_time() != times[index])
+          break;
+
+        ++index;
+      }
+    }
+    print_timing("Iterate", size, start);
+    CHECK(index == size);
+  }
+}
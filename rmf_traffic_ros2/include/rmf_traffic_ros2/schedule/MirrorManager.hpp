@@ -58,6 +58,10 @@ public:
     /// True if the mirror should be updated each time a MirrorWakeup message
     /// is received. The MirrorWakeup messages are sent out each time a change
     /// is introduced to the schedule database.
+    ///
+    /// If the schedule streams patches for the query of this mirror, then the
+    /// patches will be applied as they arrive instead, and the schedule will
+    /// only be asked for an update when the mirror has missed a patch.
     bool update_on_wakeup() const;
 
     /// Toggle the choice to wakeup on an update.
@@ -20,6 +20,7 @@
 #include <rmf_traffic_ros2/schedule/Patch.hpp>
 #include <rmf_traffic_ros2/schedule/Query.hpp>
 
+#include <rmf_traffic_msgs/msg/mirror_patch.hpp>
 #include <rmf_traffic_msgs/msg/mirror_wakeup.hpp>
 
 #include <rmf_traffic_msgs/srv/mirror_update.hpp>
@@ -28,6 +29,8 @@
 
 #include <rclcpp/logging.hpp>
 
+#include <limits>
+
 namespace rmf_traffic_ros2 {
 namespace schedule {
 
@@ -41,6 +44,9 @@ using UnregisterQueryClient = rclcpp::Client<UnregisterQuery>::SharedPtr;
 using MirrorWakeup = rmf_traffic_msgs::msg::MirrorWakeup;
 using MirrorWakeupSub = rclcpp::Subscription<MirrorWakeup>::SharedPtr;
 
+using MirrorPatch = rmf_traffic_msgs::msg::MirrorPatch;
+using MirrorPatchSub = rclcpp::Subscription<MirrorPatch>::SharedPtr;
+
 //==============================================================================
 class MirrorManager::Implementation
 {
@@ -51,6 +57,7 @@ public:
   MirrorUpdateClient mirror_update_client;
   UnregisterQueryClient unregister_query_client;
   MirrorWakeupSub mirror_wakeup_sub;
+  MirrorPatchSub mirror_patch_sub;
 
   MirrorUpdate::Request::SharedPtr request_msg;
 
@@ -64,6 +71,7 @@ public:
       rclcpp::Node& _node,
       Options _options,
       uint64_t _query_id,
+      const std::string& _patch_topic,
       MirrorUpdateClient _mirror_update_client,
       UnregisterQueryClient _unregister_query_client)
     : node(_node),
@@ -72,12 +80,26 @@ public:
       unregister_query_client(std::move(_unregister_query_client)),
       request_msg(std::make_shared<MirrorUpdate::Request>())
   {
-    mirror_wakeup_sub = node.create_subscription<MirrorWakeup>(
-          MirrorWakeupTopicName, rclcpp::SystemDefaultsQoS(),
-          [&](const MirrorWakeup::SharedPtr msg)
+    if(_patch_topic.empty())
     {
-      trigger_wakeup(msg->latest_version);
-    });
+      mirror_wakeup_sub = node.create_subscription<MirrorWakeup>(
+            MirrorWakeupTopicName, rclcpp::SystemDefaultsQoS(),
+            [&](const MirrorWakeup::SharedPtr msg)
+      {
+        trigger_wakeup(msg->latest_version);
+      });
+    }
+    else
+    {
+      // The schedule streams the patches of our query to us, so there is no
+      // need to listen for wakeups.
+      mirror_patch_sub = node.create_subscription<MirrorPatch>(
+            _patch_topic, rclcpp::SystemDefaultsQoS().reliable(),
+            [&](const MirrorPatch::SharedPtr msg)
+      {
+        receive_patch(*msg);
+      });
+    }
 
     request_msg->query_id = _query_id;
   }
@@ -88,6 +110,63 @@ public:
       update(minimum_version);
   }
 
+  void receive_patch(const MirrorPatch& msg)
+  {
+    if(!options.update_on_wakeup())
+      return;
+
+    using Version = rmf_traffic::schedule::Version;
+    const Version current = mirror.latest_version();
+    if(waiting_for_reply || msg.previous_version != current)
+    {
+      // Versions are compared with modular arithmetic in case they have
+      // wrapped around.
+      const Version behind = msg.patch.latest_version - current;
+      if(behind == 0 || behind > std::numeric_limits<Version>::max()/2)
+      {
+        // We already have every change in this patch
+        return;
+      }
+
+      // We have missed a patch, or an update that is in flight will leave us
+      // behind this patch, so we need to ask the schedule for the changes.
+      update(msg.patch.latest_version);
+      return;
+    }
+
+    try
+    {
+      apply(convert(msg.patch));
+    }
+    catch(const std::exception& e)
+    {
+      RCLCPP_ERROR(
+            node.get_logger(),
+            "[rmf_traffic_ros2::MirrorManager] Failed to deserialize "
+            "MirrorPatch message: " + std::string(e.what()));
+    }
+  }
+
+  void apply(const rmf_traffic::schedule::Database::Patch& patch)
+  {
+    RCLCPP_DEBUG(
+          node.get_logger(),
+          "Updating mirror ["
+          + std::to_string(patch.latest_version())
+          + "]: " + std::to_string(patch.size()) + " changes");
+
+    std::mutex* update_mutex = options.update_mutex();
+    if (update_mutex)
+    {
+      std::lock_guard<std::mutex> lock(*update_mutex);
+      mirror.update(patch);
+    }
+    else
+    {
+      mirror.update(patch);
+    }
+  }
+
   void update(
       uint64_t minimum_version,
       const rmf_traffic::Duration wait = rmf_traffic::Duration(0))
@@ -119,22 +198,7 @@ public:
         const rmf_traffic::schedule::Database::Patch patch =
             convert(response->patch);
 
-        RCLCPP_DEBUG(
-              node.get_logger(),
-              "Updating mirror ["
-              + std::to_string(response->patch.latest_version)
-              + "]: " + std::to_string(patch.size()) + " changes");
-
-        std::mutex* update_mutex = options.update_mutex();
-        if (update_mutex)
-        {
-          std::lock_guard<std::mutex> lock(*update_mutex);
-          mirror.update(patch);
-        }
-        else
-        {
-          mirror.update(patch);
-        }
+        apply(patch);
 
         waiting_for_reply = false;
         if (patch.latest_version() < next_minimum_version)
@@ -364,6 +428,7 @@ public:
           node,
           std::move(options),
           registration.query_id,
+          registration.patch_topic,
           std::move(mirror_update_client),
           std::move(unregister_query_client));
   }
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "ConflictGraph.hpp"
+
+#include <rmf_traffic/Conflict.hpp>
+
+namespace rmf_traffic_schedule {
+
+//==============================================================================
+void ConflictGraph::apply(const Patch& patch)
+{
+  using Mode = rmf_traffic::schedule::Database::Change::Mode;
+
+  // Drop every entry that this patch makes obsolete. The entries that replace
+  // them will be checked from scratch during process().
+  for(const auto& change : patch)
+  {
+    switch(change.get_mode())
+    {
+      case Mode::Interrupt:
+        _remove(change.interrupt()->original_id());
+        break;
+      case Mode::Delay:
+        _remove(change.delay()->original_id());
+        break;
+      case Mode::Replace:
+        _remove(change.replace()->original_id());
+        break;
+      case Mode::Erase:
+        _remove(change.erase()->original_id());
+        break;
+      case Mode::Cull:
+        _cull(change.cull()->time());
+        break;
+      case Mode::Insert:
+      case Mode::Invalid:
+      case Mode::NUM:
+        break;
+    }
+  }
+
+  _mirror.update(patch);
+  _latest_version = patch.latest_version();
+}
+
+//==============================================================================
+void ConflictGraph::process()
+{
+  if(_last_processed_version == _latest_version)
+    return;
+
+  const auto changed = _mirror.query(
+        rmf_traffic::schedule::make_query(_last_processed_version));
+
+  std::unordered_set<Version> changed_ids;
+  for(const auto& element : changed)
+    changed_ids.insert(element.id);
+
+  using Element = rmf_traffic::schedule::Viewer::View::Element;
+  for(const auto& element : changed)
+  {
+    const rmf_traffic::Trajectory& trajectory = element.trajectory;
+    const auto neighbors = _mirror.query(
+          rmf_traffic::schedule::make_query(
+            {trajectory.get_map_name()},
+            trajectory.start_time(),
+            trajectory.finish_time()));
+
+    std::vector<const rmf_traffic::Trajectory*> candidates;
+    std::vector<const Element*> candidate_elements;
+    for(const auto& neighbor : neighbors)
+    {
+      if(neighbor.id == element.id)
+        continue;
+
+      // If both entries are new, then only check the pair once
+      if(changed_ids.count(neighbor.id) != 0 && neighbor.id < element.id)
+        continue;
+
+      candidates.push_back(&neighbor.trajectory);
+      candidate_elements.push_back(&neighbor);
+    }
+
+    const auto matches = rmf_traffic::DetectConflict::against(
+          trajectory, candidates,
+          rmf_traffic::DetectConflict::Report::FirstOfEachPair,
+          _mirror.get_thread_pool().get());
+
+    for(const auto& match : matches)
+    {
+      const Element& neighbor = *candidate_elements[match.index];
+      _add_edge(element.id, neighbor.id,
+                *trajectory.finish_time(),
+                *neighbor.trajectory.finish_time());
+    }
+  }
+
+  _last_processed_version = _latest_version;
+}
+
+//==============================================================================
+std::unordered_set<ConflictGraph::Version> ConflictGraph::conflicts() const
+{
+  std::unordered_set<Version> result;
+  result.reserve(_graph.size());
+  for(const auto& vertex : _graph)
+    result.insert(vertex.first);
+
+  return result;
+}
+
+//==============================================================================
+const std::unordered_set<ConflictGraph::Version>*
+ConflictGraph::conflicts_with(const Version id) const
+{
+  const auto it = _graph.find(id);
+  if(it == _graph.end())
+    return nullptr;
+
+  return &it->second.edges;
+}
+
+//==============================================================================
+ConflictGraph::Version ConflictGraph::latest_version() const
+{
+  return _latest_version;
+}
+
+//==============================================================================
+void ConflictGraph::set_thread_pool(
+    std::shared_ptr<rmf_traffic::ThreadPool> pool)
+{
+  _mirror.set_thread_pool(std::move(pool));
+}
+
+//==============================================================================
+void ConflictGraph::_add_edge(
+    const Version a,
+    const Version b,
+    const rmf_traffic::Time finish_a,
+    const rmf_traffic::Time finish_b)
+{
+  _graph.insert(std::make_pair(a, Vertex{finish_a, {}}))
+      .first->second.edges.insert(b);
+
+  _graph.insert(std::make_pair(b, Vertex{finish_b, {}}))
+      .first->second.edges.insert(a);
+}
+
+//==============================================================================
+void ConflictGraph::_remove(const Version id)
+{
+  const auto it = _graph.find(id);
+  if(it == _graph.end())
+    return;
+
+  for(const Version other : it->second.edges)
+  {
+    const auto other_it = _graph.find(other);
+    if(other_it == _graph.end())
+      continue;
+
+    other_it->second.edges.erase(id);
+    if(other_it->second.edges.empty())
+      _graph.erase(other_it);
+  }
+
+  _graph.erase(it);
+}
+
+//==============================================================================
+void ConflictGraph::_cull(const rmf_traffic::Time time)
+{
+  std::vector<Version> culled;
+  for(const auto& vertex : _graph)
+  {
+    if(vertex.second.finish_time < time)
+      culled.push_back(vertex.first);
+  }
+
+  for(const Version id : culled)
+    _remove(id);
+}
+
+} // namespace rmf_traffic_schedule
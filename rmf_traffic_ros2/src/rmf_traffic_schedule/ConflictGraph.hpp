@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SRC__RMF_TRAFFIC_SCHEDULE__CONFLICTGRAPH_HPP
+#define SRC__RMF_TRAFFIC_SCHEDULE__CONFLICTGRAPH_HPP
+
+#include <rmf_traffic/schedule/Database.hpp>
+#include <rmf_traffic/schedule/Mirror.hpp>
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace rmf_traffic_schedule {
+
+//==============================================================================
+/// Keeps track of which schedule entries are in conflict with each other.
+///
+/// The graph is maintained incrementally. Each time a patch arrives, the
+/// entries that it obsoletes are dropped from the graph, and only the entries
+/// that it introduces get checked for conflicts, and only against the entries
+/// that share their map and time span.
+class ConflictGraph
+{
+public:
+
+  using Version = rmf_traffic::schedule::Version;
+  using Patch = rmf_traffic::schedule::Database::Patch;
+
+  /// Apply a patch to the graph's mirror of the schedule.
+  ///
+  /// This is cheap compared to process(), and it must be called while the
+  /// Database that produced the patch is still locked, because the patch may
+  /// refer to data that belongs to that Database.
+  void apply(const Patch& patch);
+
+  /// Check every entry that has arrived since the last call to process() for
+  /// conflicts against its neighbors. This does not need the upstream Database
+  /// to be locked.
+  void process();
+
+  /// Get the set of entries that are currently in conflict with at least one
+  /// other entry.
+  std::unordered_set<Version> conflicts() const;
+
+  /// Get the entries that are in conflict with the given entry. Returns a
+  /// nullptr if the entry is not in conflict with anything.
+  const std::unordered_set<Version>* conflicts_with(Version id) const;
+
+  /// Get the latest schedule version that has been applied to this graph.
+  Version latest_version() const;
+
+  /// Spread the queries and conflict checks of process() across a thread pool.
+  void set_thread_pool(std::shared_ptr<rmf_traffic::ThreadPool> pool);
+
+private:
+
+  void _add_edge(Version a, Version b, rmf_traffic::Time finish_a,
+                 rmf_traffic::Time finish_b);
+
+  void _remove(Version id);
+
+  void _cull(rmf_traffic::Time time);
+
+  rmf_traffic::schedule::Mirror _mirror;
+  Version _latest_version = 0;
+  Version _last_processed_version = 0;
+
+  struct Vertex
+  {
+    rmf_traffic::Time finish_time;
+    std::unordered_set<Version> edges;
+  };
+
+  // Only entries that are in conflict with something have a vertex
+  std::unordered_map<Version, Vertex> _graph;
+};
+
+} // namespace rmf_traffic_schedule
+
+#endif // SRC__RMF_TRAFFIC_SCHEDULE__CONFLICTGRAPH_HPP
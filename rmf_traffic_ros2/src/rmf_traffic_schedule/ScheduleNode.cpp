@@ -16,6 +16,7 @@
 */
 
 #include "ScheduleNode.hpp"
+#include "ConflictGraph.hpp"
 
 #include <rmf_traffic_ros2/StandardNames.hpp>
 #include <rmf_traffic_ros2/Trajectory.hpp>
@@ -23,44 +24,70 @@
 #include <rmf_traffic_ros2/schedule/Patch.hpp>
 
 #include <rmf_traffic/Conflict.hpp>
-#include <rmf_traffic/schedule/Mirror.hpp>
 
 #include <rmf_utils/optional.hpp>
 
+#include <algorithm>
+#include <chrono>
+
 namespace rmf_traffic_schedule {
 
 //==============================================================================
-std::unordered_set<rmf_traffic::schedule::Version> get_conflicts(
-    const rmf_traffic::schedule::Viewer::View& view)
+ScheduleNode::ScheduleNode()
+  : Node("rmf_traffic_schedule_node")
 {
-  // TODO(MXG): Make this function more efficient by only checking the latest
-  // unchecked changes against the ones that came before them, and then
-  // appending that list onto the conflicts of the previous version.
-
-  std::unordered_set<rmf_traffic::schedule::Version> conflicts;
-  for (auto v0 = view.begin(); v0 != view.end(); ++v0)
+  // The schedule gets recovered before any of the services are offered, so
+  // that nobody ever sees an empty schedule after a restart.
+  const std::string persistence_directory =
+      declare_parameter("persistence_directory", std::string());
+  snapshot_period = static_cast<std::size_t>(
+        std::max(1, declare_parameter("snapshot_period", 10000)));
+
+  if(!persistence_directory.empty())
   {
-    auto v1 = ++rmf_traffic::schedule::Viewer::View::const_iterator{v0};
-    for (; v1 != view.end(); ++v1)
+    journal = std::make_unique<rmf_traffic::schedule::Journal>(
+          persistence_directory);
+    try
     {
-      if (!rmf_traffic::DetectConflict::between(
-            v0->trajectory, v1->trajectory, true).empty())
+      database = journal->recover();
+      RCLCPP_INFO(
+            get_logger(),
+            "Recovered schedule from [" + persistence_directory
+            + "] at version " + std::to_string(database.latest_version()));
+    }
+    catch(const std::exception& e)
+    {
+      // The files that could not be recovered are kept so that they can be
+      // inspected or recovered by hand. If they cannot even be moved, then we
+      // refuse to start rather than risk writing over them.
+      const std::string suffix = ".failed-" + std::to_string(
+            std::chrono::system_clock::now().time_since_epoch().count());
+
+      RCLCPP_ERROR(
+            get_logger(),
+            "Failed to recover the schedule from [" + persistence_directory
+            + "]: " + e.what() + " | The files will be renamed with the suffix ["
+            + suffix + "] and the schedule will start out empty.");
+
+      journal->move_aside(suffix);
+      database = rmf_traffic::schedule::Database();
+
+      try
       {
-        conflicts.insert(v0->id);
-        conflicts.insert(v1->id);
+        journal->snapshot(database);
+      }
+      catch(const std::exception& e)
+      {
+        RCLCPP_ERROR(
+              get_logger(),
+              "Failed to start a new snapshot in [" + persistence_directory
+              + "]: " + e.what());
       }
     }
   }
 
-  return conflicts;
-}
-
-//==============================================================================
-ScheduleNode::ScheduleNode()
-  : Node("rmf_traffic_schedule_node")
-{
-  // TODO(MXG): As soon as possible, all of these services should be made
-  // multi-threaded so they can be parallel processed.
+  services_group = create_callback_group(
+        rclcpp::callback_group::CallbackGroupType::Reentrant);
 
   submit_trajectories_service =
       create_service<rmf_traffic_msgs::srv::SubmitTrajectories>(
@@ -68,7 +95,9 @@ ScheduleNode::ScheduleNode()
         [=](const std::shared_ptr<rmw_request_id_t> request_header,
             const SubmitTrajectories::Request::SharedPtr request,
             const SubmitTrajectories::Response::SharedPtr response)
-        { this->submit_trajectories(request_header, request, response); });
+        { this->submit_trajectories(request_header, request, response); },
+        rmw_qos_profile_services_default,
+        services_group);
 
   replace_trajectories_service =
       create_service<ReplaceTrajectories>(
@@ -76,7 +105,9 @@ ScheduleNode::ScheduleNode()
         [=](const request_id_ptr request_header,
             const ReplaceTrajectories::Request::SharedPtr request,
             const ReplaceTrajectories::Response::SharedPtr response)
-        { this->replace_trajectories(request_header, request, response); });
+        { this->replace_trajectories(request_header, request, response); },
+        rmw_qos_profile_services_default,
+        services_group);
 
   delay_trajectories_service =
       create_service<DelayTrajectories>(
@@ -84,7 +115,9 @@ ScheduleNode::ScheduleNode()
         [=](const request_id_ptr request_header,
             const DelayTrajectories::Request::SharedPtr request,
             const DelayTrajectories::Response::SharedPtr response)
-        { this->delay_trajectories(request_header, request, response); });
+        { this->delay_trajectories(request_header, request, response); },
+        rmw_qos_profile_services_default,
+        services_group);
 
   erase_trajectories_service =
       create_service<EraseTrajectories>(
@@ -92,7 +125,9 @@ ScheduleNode::ScheduleNode()
         [=](const std::shared_ptr<rmw_request_id_t> request_header,
             const EraseTrajectories::Request::SharedPtr request,
             const EraseTrajectories::Response::SharedPtr response)
-        { this->erase_trajectories(request_header, request, response); });
+        { this->erase_trajectories(request_header, request, response); },
+        rmw_qos_profile_services_default,
+        services_group);
 
   resolve_conflicts_service =
       create_service<ResolveConflicts>(
@@ -100,7 +135,9 @@ ScheduleNode::ScheduleNode()
         [=](const std::shared_ptr<rmw_request_id_t> request_header,
             const ResolveConflicts::Request::SharedPtr request,
             const ResolveConflicts::Response::SharedPtr response)
-        { this->resolve_conflicts(request_header, request, response); });
+        { this->resolve_conflicts(request_header, request, response); },
+        rmw_qos_profile_services_default,
+        services_group);
 
   register_query_service =
       create_service<RegisterQuery>(
@@ -108,7 +145,9 @@ ScheduleNode::ScheduleNode()
         [=](const std::shared_ptr<rmw_request_id_t> request_header,
             const RegisterQuery::Request::SharedPtr request,
             const RegisterQuery::Response::SharedPtr response)
-        { this->register_query(request_header, request, response); });
+        { this->register_query(request_header, request, response); },
+        rmw_qos_profile_services_default,
+        services_group);
 
   unregister_query_service =
       create_service<UnregisterQuery>(
@@ -116,7 +155,9 @@ ScheduleNode::ScheduleNode()
         [=](const std::shared_ptr<rmw_request_id_t> request_header,
             const UnregisterQuery::Request::SharedPtr request,
             const UnregisterQuery::Response::SharedPtr response)
-        { this->unregister_query(request_header, request, response); });
+        { this->unregister_query(request_header, request, response); },
+        rmw_qos_profile_services_default,
+        services_group);
 
   mirror_update_service =
       create_service<MirrorUpdate>(
@@ -124,23 +165,58 @@ ScheduleNode::ScheduleNode()
         [=](const std::shared_ptr<rmw_request_id_t> request_header,
             const MirrorUpdate::Request::SharedPtr request,
             const MirrorUpdate::Response::SharedPtr response)
-        { this->mirror_update(request_header, request, response); });
+        { this->mirror_update(request_header, request, response); },
+        rmw_qos_profile_services_default,
+        services_group);
 
   mirror_wakeup_publisher =
       create_publisher<MirrorWakeup>(
         rmf_traffic_ros2::MirrorWakeupTopicName,
         rclcpp::SystemDefaultsQoS());
 
+  // Mirrors that were built before patches could be streamed will keep using
+  // the wakeups, so those are still published either way.
+  stream_patches = declare_parameter("stream_patches", true);
+
   conflict_publisher =
       create_publisher<ScheduleConflict>(
         rmf_traffic_ros2::ScheduleConflictTopicName,
         rclcpp::SystemDefaultsQoS());
 
+  // Trajectories that finished longer ago than the retention horizon are no
+  // longer relevant to anyone, so we periodically cull them to keep the memory
+  // usage of the schedule bounded.
+  const double retention_horizon_sec =
+      declare_parameter("retention_horizon", 600.0);
+  const double cull_period_sec = declare_parameter("cull_period", 60.0);
+
+  retention_horizon = std::chrono::duration_cast<rmf_traffic::Duration>(
+        std::chrono::duration<double>(retention_horizon_sec));
+
+  cull_timer = create_wall_timer(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::duration<double>(cull_period_sec)),
+        [=]() { this->cull(); });
+
+  // The conflict checks are spread across this many worker threads. A value of
+  // 0 uses one worker for each hardware thread, and a value of 1 runs the
+  // checks on the threads that need them instead of using a pool.
+  const int conflict_check_threads =
+      declare_parameter("conflict_check_threads", 0);
+
+  if(conflict_check_threads != 1)
+  {
+    thread_pool = std::make_shared<rmf_traffic::ThreadPool>(
+          static_cast<std::size_t>(std::max(0, conflict_check_threads)));
+    database.set_thread_pool(thread_pool);
+  }
+
   conflict_check_quit = false;
   conflict_check_thread = std::thread(
         [&]()
   {
-    rmf_traffic::schedule::Mirror mirror;
+    ConflictGraph conflict_graph;
+    conflict_graph.set_thread_pool(thread_pool);
 
     Version last_checked_version = 0;
 
@@ -152,7 +228,7 @@ ScheduleNode::ScheduleNode()
 
       // Use this scope to minimize how long we lock the database for
       {
-        std::unique_lock<std::mutex> lock(database_mutex);
+        ReadLock lock(database_mutex);
         conflict_check_cv.wait_for(lock, std::chrono::milliseconds(100), [&]()
         {
           return (database.latest_version() > last_checked_version)
@@ -168,11 +244,13 @@ ScheduleNode::ScheduleNode()
 
         next_patch = database.changes(next_query);
 
-        // TODO(MXG): Check whether the database really needs to remain locked
-        // during this update.
+        // The patch may refer to trajectory data that belongs to the database,
+        // so the database needs to remain locked while the patch is applied.
+        // Applying the patch only reads from the database, so a read lock is
+        // enough, and the service handlers can keep reading in the meantime.
         try
         {
-          mirror.update(*next_patch);
+          conflict_graph.apply(*next_patch);
           last_checked_version = next_patch->latest_version();
         }
         catch(const std::exception& e)
@@ -182,10 +260,12 @@ ScheduleNode::ScheduleNode()
         }
       }
 
-      const auto view = mirror.query(
-            rmf_traffic::schedule::query_everything());
-
-      const auto conflicts = get_conflicts(view);
+      // Only the entries that arrived with this patch get checked, and only
+      // against their neighbors in spacetime. Conflicts that were found for
+      // older entries are remembered by the graph until those entries get
+      // replaced, delayed, erased, or culled.
+      conflict_graph.process();
+      const auto conflicts = conflict_graph.conflicts();
       if (!conflicts.empty())
       {
         {
@@ -276,12 +356,19 @@ std::unordered_set<uint64_t> ScheduleNode::process_trajectories(
       throw std::runtime_error(error);
     }
 
+    // The view may refer to trajectory data that belongs to the database, so
+    // we hold a read lock until we are done inspecting it.
+    ReadLock lock(database_mutex);
     const auto view = database.query(
           rmf_traffic::schedule::make_query(
               {requested_trajectory.get_map_name()},
               requested_trajectory.start_time(),
               requested_trajectory.finish_time()));
 
+    // Sort the schedule entries by whether they were already in conflict
+    std::vector<const rmf_traffic::Trajectory*> initial;
+    std::vector<rmf_traffic::schedule::Version> initial_ids;
+    std::vector<const rmf_traffic::Trajectory*> others;
     for(const auto& v : view)
     {
       if (initial_conflicts.count(v.id) != 0)
@@ -291,26 +378,25 @@ std::unordered_set<uint64_t> ScheduleNode::process_trajectories(
         if (replace_ids.count(v.id) != 0)
           continue;
 
-        if (!rmf_traffic::DetectConflict::between(
-              requested_trajectory, v.trajectory, true).empty())
-          unresolved_conflicts.insert(v.id);
-
+        initial.push_back(&v.trajectory);
+        initial_ids.push_back(v.id);
         continue;
       }
 
-      // TODO(MXG) Since we already put these time limits in the query, do we
-      // really need to check them again here?
-      if(*requested_trajectory.finish_time() < *v.trajectory.start_time())
-        continue;
+      others.push_back(&v.trajectory);
+    }
 
-      if(*v.trajectory.finish_time() < *requested_trajectory.start_time())
-        continue;
+    using Report = rmf_traffic::DetectConflict::Report;
+    for(const auto& match : rmf_traffic::DetectConflict::against(
+          requested_trajectory, initial, Report::FirstOfEachPair,
+          thread_pool.get()))
+      unresolved_conflicts.insert(initial_ids[match.index]);
 
-      const auto conflicts = rmf_traffic::DetectConflict::narrow_phase(
-            requested_trajectory, v.trajectory, true);
-      if (!conflicts.empty())
-        output_conflicts.push_back(i);
-    }
+    // The index gets listed once for each entry that it conflicts with
+    const auto new_conflicts = rmf_traffic::DetectConflict::against(
+          requested_trajectory, others, Report::FirstOfEachPair,
+          thread_pool.get());
+    output_conflicts.insert(output_conflicts.end(), new_conflicts.size(), i);
 
     output_trajectories.emplace_back(std::move(requested_trajectory));
   }
@@ -320,25 +406,26 @@ std::unordered_set<uint64_t> ScheduleNode::process_trajectories(
 
 //==============================================================================
 std::vector<uint64_t> check_self_conflicts(
-    const std::vector<rmf_traffic::Trajectory>& requested_trajectories)
+    const std::vector<rmf_traffic::Trajectory>& requested_trajectories,
+    rmf_traffic::ThreadPool* const pool)
 {
   // TODO(MXG): Should there be constraints on trajectory submissions to avoid
   // this kind of check? Like each submission can only refer to one vehicle at
   // a time, and therefore we should never need to test these trajectories for
   // conflicts with each other?
+  std::vector<const rmf_traffic::Trajectory*> trajectories;
+  trajectories.reserve(requested_trajectories.size());
+  for(const auto& trajectory : requested_trajectories)
+    trajectories.push_back(&trajectory);
+
   std::vector<uint64_t> conflicting_indices;
   conflicting_indices.reserve(requested_trajectories.size());
-  for(std::size_t i=0; i < requested_trajectories.size()-1; ++i)
-  {
-    for(std::size_t j=i+1; j < requested_trajectories.size(); ++j)
-    {
-      const auto conflicts = rmf_traffic::DetectConflict::between(
-            requested_trajectories[i],
-            requested_trajectories[j], true);
-      if (!conflicts.empty())
-        conflicting_indices.push_back(i);
-    }
-  }
+  const auto pairs = rmf_traffic::DetectConflict::among(
+        trajectories, rmf_traffic::DetectConflict::Report::FirstOfEachPair,
+        pool);
+
+  for(const auto& pair : pairs)
+    conflicting_indices.push_back(pair.first);
 
   return conflicting_indices;
 }
@@ -350,7 +437,7 @@ void ScheduleNode::submit_trajectories(
     const SubmitTrajectories::Response::SharedPtr& response)
 {
   response->accepted = true;
-  response->current_version = database.latest_version();
+  response->current_version = latest_version();
   response->original_version = response->current_version;
   response->error.clear();
 
@@ -371,18 +458,21 @@ void ScheduleNode::submit_trajectories(
 //  if (has_conflicts(conflicting_indices, *response))
 //    return;
 
-  conflicting_indices = check_self_conflicts(requested_trajectories);
+  conflicting_indices = check_self_conflicts(
+      requested_trajectories, thread_pool.get());
 
 //  if(has_conflicts(conflicting_indices, *response))
 //    return;
 
   {
-    std::unique_lock<std::mutex> lock(database_mutex);
+    WriteLock lock(database_mutex);
     for(auto&& request : requested_trajectories)
       database.insert(std::move(request));
+
+    response->current_version = database.latest_version();
+    record_changes(lock);
   }
 
-  response->current_version = database.latest_version();
   wakeup_mirrors();
 
   RCLCPP_INFO(
@@ -399,23 +489,34 @@ void ScheduleNode::perform_replacement(
     uint64_t& current_version)
 {
   std::size_t index=0;
-  std::unique_lock<std::mutex> lock(database_mutex);
-  while (index < replace_ids.size() &&
-         index < trajectories.size())
+  WriteLock lock(database_mutex);
+  try
   {
-    database.replace(replace_ids[index], std::move(trajectories[index]));
-    ++index;
-  }
+    while (index < replace_ids.size() &&
+           index < trajectories.size())
+    {
+      database.replace(replace_ids[index], std::move(trajectories[index]));
+      ++index;
+    }
 
-  for (; index < trajectories.size(); ++index)
-    database.insert(std::move(trajectories[index]));
+    for (; index < trajectories.size(); ++index)
+      database.insert(std::move(trajectories[index]));
 
-  latest_trajectory_version = database.latest_version();
+    latest_trajectory_version = database.latest_version();
 
-  for (; index < replace_ids.size(); ++index)
-    database.erase(replace_ids[index]);
+    for (; index < replace_ids.size(); ++index)
+      database.erase(replace_ids[index]);
+  }
+  catch(const std::exception&)
+  {
+    // The changes that were made before the failure stay in the database, so
+    // they still need to be recorded.
+    record_changes(lock);
+    throw;
+  }
 
   current_version = database.latest_version();
+  record_changes(lock);
 }
 
 //==============================================================================
@@ -424,7 +525,7 @@ void ScheduleNode::replace_trajectories(
     const ReplaceTrajectories::Request::SharedPtr& request,
     const ReplaceTrajectories::Response::SharedPtr& response)
 {
-  response->original_version = database.latest_version();
+  response->original_version = latest_version();
   response->current_version = response->original_version;
   if (request->replace_ids.size() == 0)
   {
@@ -472,7 +573,7 @@ void ScheduleNode::delay_trajectories(
     const DelayTrajectories::Request::SharedPtr& request,
     const DelayTrajectories::Response::SharedPtr& response)
 {
-  response->original_version = database.latest_version();
+  response->original_version = latest_version();
   response->current_version = response->original_version;
 
   const auto from_time = std::chrono::steady_clock::time_point(
@@ -488,12 +589,21 @@ void ScheduleNode::delay_trajectories(
   const auto delay = std::chrono::nanoseconds(request->delay);
 
   {
-    std::unique_lock<std::mutex> lock(database_mutex);
-    for (const rmf_traffic::schedule::Version id : request->delay_ids)
-      database.delay(id, from_time, delay);
-  }
+    WriteLock lock(database_mutex);
+    try
+    {
+      for (const rmf_traffic::schedule::Version id : request->delay_ids)
+        database.delay(id, from_time, delay);
+    }
+    catch(const std::exception&)
+    {
+      record_changes(lock);
+      throw;
+    }
 
-  response->current_version = database.latest_version();
+    response->current_version = database.latest_version();
+    record_changes(lock);
+  }
 
   wakeup_mirrors();
 }
@@ -505,12 +615,22 @@ void ScheduleNode::erase_trajectories(
     const EraseTrajectories::Response::SharedPtr& response)
 {
   {
-    std::unique_lock<std::mutex> lock(database_mutex);
-    for(const uint64_t id : request->erase_ids)
-      database.erase(id);
+    WriteLock lock(database_mutex);
+    try
+    {
+      for(const uint64_t id : request->erase_ids)
+        database.erase(id);
+    }
+    catch(const std::exception&)
+    {
+      record_changes(lock);
+      throw;
+    }
+
+    response->version = database.latest_version();
+    record_changes(lock);
   }
 
-  response->version = database.latest_version();
   wakeup_mirrors();
 }
 
@@ -520,7 +640,7 @@ void ScheduleNode::resolve_conflicts(
     const ResolveConflicts::Request::SharedPtr& request,
     const ResolveConflicts::Response::SharedPtr& response)
 {
-  response->current_version = database.latest_version();
+  response->current_version = latest_version();
   response->original_version = response->current_version;
   response->accepted = false;
 
@@ -619,7 +739,8 @@ void ScheduleNode::resolve_conflicts(
 //    return;
 //  }
 
-  conflict_indices = check_self_conflicts(resolution_trajectories);
+  conflict_indices = check_self_conflicts(
+      resolution_trajectories, thread_pool.get());
 
   if (has_conflicts(conflict_indices, *response))
   {
@@ -656,6 +777,7 @@ void ScheduleNode::register_query(
     const RegisterQuery::Request::SharedPtr& request,
     const RegisterQuery::Response::SharedPtr& response)
 {
+  std::unique_lock<std::mutex> lock(registered_queries_mutex);
   uint64_t query_id = last_query_id;
   uint64_t attempts = 0;
   do
@@ -674,9 +796,39 @@ void ScheduleNode::register_query(
     }
   } while(registered_queries.find(query_id) != registered_queries.end());
 
+  // If an identical query has already been registered, then this ID will share
+  // its record so that their patches only need to be computed once.
+  RegisteredQueryPtr registered;
+  for(const auto& entry : registered_queries)
+  {
+    if(entry.second->msg == request->query)
+    {
+      registered = entry.second;
+      break;
+    }
+  }
+
+  if(!registered)
+  {
+    registered = std::make_shared<RegisteredQuery>(
+          request->query, rmf_traffic_ros2::convert(request->query));
+
+    if(stream_patches)
+    {
+      // The first mirror of this query will get caught up by a MirrorUpdate,
+      // so the stream only needs to begin from the current version.
+      registered->streamed_version = latest_version();
+      registered->patch_topic =
+          rmf_traffic_ros2::MirrorPatchTopicPrefix + std::to_string(query_id);
+      registered->patch_publisher = create_publisher<MirrorPatch>(
+            registered->patch_topic, rclcpp::SystemDefaultsQoS().reliable());
+    }
+  }
+
+  response->patch_topic = registered->patch_topic;
+
   last_query_id = query_id;
-  registered_queries.insert(
-        std::make_pair(query_id, rmf_traffic_ros2::convert(request->query)));
+  registered_queries.insert(std::make_pair(query_id, std::move(registered)));
 
   response->query_id = query_id;
   RCLCPP_INFO(
@@ -690,6 +842,7 @@ void ScheduleNode::unregister_query(
     const UnregisterQuery::Request::SharedPtr& request,
     const UnregisterQuery::Response::SharedPtr& response)
 {
+  std::unique_lock<std::mutex> lock(registered_queries_mutex);
   const auto it = registered_queries.find(request->query_id);
   if(it == registered_queries.end())
   {
@@ -717,32 +870,224 @@ void ScheduleNode::mirror_update(
     const MirrorUpdate::Request::SharedPtr& request,
     const MirrorUpdate::Response::SharedPtr& response)
 {
-  const auto query_it = registered_queries.find(request->query_id);
-  if(query_it == registered_queries.end())
+  RegisteredQueryPtr registered;
   {
-    response->error = "Unrecognized query_id: "
-        + std::to_string(request->query_id);
-    RCLCPP_WARN(
-          get_logger(),
-          "[ScheduleNode::mirror_update] " + response->error);
+    std::unique_lock<std::mutex> lock(registered_queries_mutex);
+    const auto query_it = registered_queries.find(request->query_id);
+    if(query_it == registered_queries.end())
+    {
+      response->error = "Unrecognized query_id: "
+          + std::to_string(request->query_id);
+      RCLCPP_WARN(
+            get_logger(),
+            "[ScheduleNode::mirror_update] " + response->error);
+      return;
+    }
+
+    registered = query_it->second;
+  }
+
+  ReadLock lock(database_mutex);
+  response->patch = get_patch(*registered, request->latest_mirror_version);
+}
+
+//==============================================================================
+auto ScheduleNode::get_patch(
+    RegisteredQuery& registered,
+    const Version mirror_version) -> SchedulePatch
+{
+  // The read lock of the caller keeps the latest version from changing until
+  // this patch has been computed.
+  const Version patch_version = database.latest_version();
+
+  std::promise<SchedulePatch> promise;
+  std::shared_future<SchedulePatch> patch;
+  {
+    std::unique_lock<std::mutex> lock(registered.patches_mutex);
+    if(registered.patch_version != patch_version)
+    {
+      // The schedule has moved on, so none of the cached patches are up to
+      // date anymore.
+      registered.patches.clear();
+      registered.patch_version = patch_version;
+    }
+
+    const auto inserted = registered.patches.insert(
+          std::make_pair(mirror_version, std::shared_future<SchedulePatch>()));
+
+    if(!inserted.second)
+    {
+      patch = inserted.first->second;
+      lock.unlock();
+
+      // Another request has already computed this patch or is in the middle of
+      // computing it.
+      return patch.get();
+    }
+
+    inserted.first->second = promise.get_future().share();
+  }
+
+  try
+  {
+    auto query = rmf_traffic::schedule::make_query(mirror_version);
+    query.spacetime() = registered.spacetime;
+
+    // The patch may refer to trajectory data that belongs to the database, so
+    // it needs to be converted before the caller releases its read lock.
+    SchedulePatch msg = rmf_traffic_ros2::convert(database.changes(query));
+    promise.set_value(msg);
+    return msg;
+  }
+  catch(...)
+  {
+    // Forget about this patch so that a later request can try again, and let
+    // any requests that are waiting for it know what went wrong.
+    {
+      std::unique_lock<std::mutex> lock(registered.patches_mutex);
+      if(registered.patch_version == patch_version)
+        registered.patches.erase(mirror_version);
+    }
+
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+}
+
+//==============================================================================
+void ScheduleNode::publish_patches()
+{
+  std::vector<RegisteredQueryPtr> streams;
+  {
+    std::unique_lock<std::mutex> lock(registered_queries_mutex);
+    for(const auto& entry : registered_queries)
+    {
+      const RegisteredQueryPtr& registered = entry.second;
+      if(!registered->patch_publisher)
+        continue;
+
+      // Identical queries share one record, so make sure each one is only
+      // published once.
+      if(std::find(streams.begin(), streams.end(), registered) == streams.end())
+        streams.push_back(registered);
+    }
+  }
+
+  ReadLock lock(database_mutex);
+  const Version latest = database.latest_version();
+  for(const auto& registered : streams)
+  {
+    std::unique_lock<std::mutex> stream_lock(registered->stream_mutex);
+    if(registered->streamed_version == latest)
+    {
+      // Another thread has already published this version
+      continue;
+    }
+
+    MirrorPatch msg;
+    msg.previous_version = registered->streamed_version;
+    msg.patch = get_patch(*registered, registered->streamed_version);
+    registered->patch_publisher->publish(msg);
+    registered->streamed_version = latest;
+  }
+}
+
+//==============================================================================
+void ScheduleNode::record_changes(const WriteLock&)
+{
+  if(!journal)
     return;
+
+  std::lock_guard<std::mutex> journal_lock(journal_mutex);
+  try
+  {
+    journal->record(database);
   }
+  catch(const std::exception& e)
+  {
+    RCLCPP_ERROR(
+          get_logger(),
+          "Failed to save changes to the schedule in ["
+          + journal->directory() + "]: " + e.what());
+  }
+}
+
+//==============================================================================
+void ScheduleNode::snapshot_if_needed()
+{
+  if(!journal)
+    return;
 
-  auto query = rmf_traffic::schedule::make_query(
-        request->latest_mirror_version);
-  query.spacetime() = query_it->second;
+  // Every change was already recorded while its writer held the write lock, so
+  // a read lock is enough to keep the snapshot consistent with the journal.
+  ReadLock lock(database_mutex);
+  std::lock_guard<std::mutex> journal_lock(journal_mutex);
+  if(journal->changes_since_snapshot() < snapshot_period)
+    return;
 
-  response->patch = rmf_traffic_ros2::convert(database.changes(query));
+  try
+  {
+    journal->snapshot(database);
+  }
+  catch(const std::exception& e)
+  {
+    RCLCPP_ERROR(
+          get_logger(),
+          "Failed to write a snapshot of the schedule in ["
+          + journal->directory() + "]: " + e.what());
+  }
 }
 
 //==============================================================================
 void ScheduleNode::wakeup_mirrors()
 {
+  snapshot_if_needed();
+
+  if(stream_patches)
+    publish_patches();
+
   rmf_traffic_msgs::msg::MirrorWakeup msg;
-  msg.latest_version = database.latest_version();
+  msg.latest_version = latest_version();
   mirror_wakeup_publisher->publish(msg);
 
   conflict_check_cv.notify_all();
 }
 
+//==============================================================================
+rmf_traffic::schedule::Version ScheduleNode::latest_version()
+{
+  ReadLock lock(database_mutex);
+  return database.latest_version();
+}
+
+//==============================================================================
+void ScheduleNode::cull()
+{
+  {
+    WriteLock lock(database_mutex);
+    const Version initial_version = database.latest_version();
+    database.cull(std::chrono::steady_clock::now() - retention_horizon);
+    if(database.latest_version() == initial_version)
+      return;
+
+    record_changes(lock);
+  }
+
+  rmf_traffic::schedule::Viewer::Statistics stats;
+  {
+    ReadLock lock(database_mutex);
+    stats = database.statistics();
+  }
+
+  wakeup_mirrors();
+
+  RCLCPP_INFO(
+        get_logger(),
+        "Culled schedule | entries: " + std::to_string(stats.entries)
+        + " | superseded: " + std::to_string(stats.superseded_entries)
+        + " | history: " + std::to_string(stats.history_entries)
+        + " | buckets: " + std::to_string(stats.buckets)
+        + " | segments: " + std::to_string(stats.segments));
+}
+
 } // namespace rmf_traffic_schedule
@@ -19,11 +19,15 @@
 #define SRC__RMF_TRAFFIC_SCHEDULE__SCHEDULENODE_HPP
 
 #include <rmf_traffic/schedule/Database.hpp>
+#include <rmf_traffic/schedule/Journal.hpp>
 
 #include <rclcpp/node.hpp>
 
+#include <rmf_traffic_msgs/msg/mirror_patch.hpp>
 #include <rmf_traffic_msgs/msg/mirror_wakeup.hpp>
 #include <rmf_traffic_msgs/msg/schedule_conflict.hpp>
+#include <rmf_traffic_msgs/msg/schedule_patch.hpp>
+#include <rmf_traffic_msgs/msg/schedule_query_spacetime.hpp>
 
 #include <rmf_traffic_msgs/srv/submit_trajectories.hpp>
 #include <rmf_traffic_msgs/srv/replace_trajectories.hpp>
@@ -36,6 +40,8 @@
 #include <rmf_traffic_msgs/srv/mirror_update.h>
 #include <rmf_traffic_msgs/srv/unregister_query.hpp>
 
+#include <future>
+#include <shared_mutex>
 #include <unordered_map>
 
 namespace rmf_traffic_schedule {
@@ -53,6 +59,10 @@ private:
 
   using request_id_ptr = std::shared_ptr<rmw_request_id_t>;
 
+  // The services of this node are placed in a reentrant callback group so
+  // that a multi-threaded executor can process them in parallel.
+  rclcpp::callback_group::CallbackGroup::SharedPtr services_group;
+
   using SubmitTrajectories = rmf_traffic_msgs::srv::SubmitTrajectories;
   using SubmitTrajectoriesService = rclcpp::Service<SubmitTrajectories>;
 
@@ -166,23 +176,115 @@ private:
 
   void wakeup_mirrors();
 
+  /// Get the latest version of the database while holding a read lock
+  rmf_traffic::schedule::Version latest_version();
+
+  /// Cull every trajectory that finished before the retention horizon
+  void cull();
+
+  rmf_traffic::Duration retention_horizon;
+  rclcpp::TimerBase::SharedPtr cull_timer;
+
+  // Writers take a unique lock on the database while they commit their changes,
+  // so changes are always committed one at a time and in order. Readers (mirror
+  // updates, conflict checks, and trajectory evaluation) take a shared lock, so
+  // they can run in parallel with each other and only need to wait for the
+  // commits themselves, never for the work that goes into preparing them.
+  //
   // TODO(MXG): Consider using libguarded instead of a database_mutex
-  std::mutex database_mutex;
+  using DatabaseMutex = std::shared_timed_mutex;
+  using ReadLock = std::shared_lock<DatabaseMutex>;
+  using WriteLock = std::unique_lock<DatabaseMutex>;
+  DatabaseMutex database_mutex;
   rmf_traffic::schedule::Database database;
 
-  using QueryMap =
-      std::unordered_map<uint64_t, rmf_traffic::schedule::Query::Spacetime>;
+  // Keeps a copy of the database on disk so that it can be recovered after a
+  // restart, or a nullptr if no persistence_directory was given. The journal
+  // mutex is always locked after the database mutex.
+  std::unique_ptr<rmf_traffic::schedule::Journal> journal;
+  std::mutex journal_mutex;
+  std::size_t snapshot_period;
+
+  /// Save the changes of the database to the journal. This must be called by
+  /// every writer before it releases its write lock, so that no mirror can be
+  /// given a version that has not been saved yet.
+  void record_changes(const WriteLock& lock);
+
+  /// Write a new snapshot if enough changes have been saved since the last one
+  void snapshot_if_needed();
+
+  // Spreads out the conflict checks of the services and the conflict checking
+  // thread, or a nullptr if they should be run on the threads that need them.
+  std::shared_ptr<rmf_traffic::ThreadPool> thread_pool;
+
+  using SchedulePatch = rmf_traffic_msgs::msg::SchedulePatch;
+  using Version = rmf_traffic::schedule::Version;
+
+  using MirrorPatch = rmf_traffic_msgs::msg::MirrorPatch;
+  using MirrorPatchPublisher = rclcpp::Publisher<MirrorPatch>;
+
+  // True if patches should be published to the mirrors of each registered
+  // query as soon as the schedule changes, instead of waiting for the mirrors
+  // to request them after a MirrorWakeup.
+  bool stream_patches = true;
+
+  // Most mirrors register the same query and ask for the same range of
+  // versions right after each wakeup, so every distinct query is registered
+  // once, and the patches that get generated for it are remembered until the
+  // schedule moves past the version that they lead to.
+  struct RegisteredQuery
+  {
+    RegisteredQuery(
+        rmf_traffic_msgs::msg::ScheduleQuerySpacetime msg_,
+        rmf_traffic::schedule::Query::Spacetime spacetime_)
+    : msg(std::move(msg_)),
+      spacetime(std::move(spacetime_))
+    {
+      // Do nothing
+    }
+
+    const rmf_traffic_msgs::msg::ScheduleQuerySpacetime msg;
+    const rmf_traffic::schedule::Query::Spacetime spacetime;
+
+    // Patches that lead up to patch_version, keyed by the version that they
+    // start from. Each patch is computed by the first request that needs it,
+    // and any concurrent requests for the same patch wait for that result.
+    std::mutex patches_mutex;
+    Version patch_version = 0;
+    std::unordered_map<Version, std::shared_future<SchedulePatch>> patches;
+
+    // Streams a patch to the mirrors of this query each time the schedule
+    // changes, or a nullptr if patches are not being streamed. Each streamed
+    // patch begins from the version that the previous one led up to.
+    std::string patch_topic;
+    MirrorPatchPublisher::SharedPtr patch_publisher;
+    std::mutex stream_mutex;
+    Version streamed_version = 0;
+  };
+
+  using RegisteredQueryPtr = std::shared_ptr<RegisteredQuery>;
+
+  /// Get the patch for a mirror of this query, computing it if no other
+  /// request has already done so. The caller must hold a read lock on the
+  /// database.
+  SchedulePatch get_patch(RegisteredQuery& registered, Version mirror_version);
+
+  /// Publish the changes since the last streamed patch of each registered
+  /// query
+  void publish_patches();
+
+  using QueryMap = std::unordered_map<uint64_t, RegisteredQueryPtr>;
   // TODO(MXG): Have a way to make query registrations expire after they have
   // not been used for some set amount of time (e.g. 24 hours? 48 hours?).
   std::size_t last_query_id = 0;
   QueryMap registered_queries;
+  std::mutex registered_queries_mutex;
 
   // TODO(MXG): Make this a separate node
   std::thread conflict_check_thread;
-  std::condition_variable conflict_check_cv;
+  std::condition_variable_any conflict_check_cv;
   std::atomic_bool conflict_check_quit;
 
-  using Version = rmf_traffic::schedule::Version;
   struct ConflictInfo
   {
     ConflictInfo(std::unordered_set<Version> ids)
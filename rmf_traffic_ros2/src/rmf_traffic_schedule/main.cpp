@@ -18,6 +18,7 @@
 #include "ScheduleNode.hpp"
 
 #include <rclcpp/rclcpp.hpp>
+#include <rclcpp/executors.hpp>
 
 int main(int argc, char* argv[])
 {
@@ -29,7 +30,11 @@ int main(int argc, char* argv[])
         node->get_logger(),
         "Beginning traffic schedule node");
 
-  rclcpp::spin(node);
+  // The service handlers of the node only lock the database for as long as
+  // they need to, so we let them run in parallel.
+  rclcpp::executors::MultiThreadedExecutor executor;
+  executor.add_node(node);
+  executor.spin();
 
   RCLCPP_INFO(
         node->get_logger(),
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2019 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "ScheduleNode.hpp"
+
+#include <rmf_traffic_ros2/StandardNames.hpp>
+#include <rmf_traffic_ros2/Trajectory.hpp>
+#include <rmf_traffic_ros2/schedule/MirrorManager.hpp>
+
+#include <rmf_traffic/geometry/Circle.hpp>
+#include <rmf_traffic/schedule/Database.hpp>
+
+#include <rmf_traffic_msgs/srv/submit_trajectories.hpp>
+
+#include <rclcpp/executors.hpp>
+#include <rclcpp/rclcpp.hpp>
+
+#include <gtest/gtest.h>
+
+#include <functional>
+#include <map>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+using SubmitTrajectories = rmf_traffic_msgs::srv::SubmitTrajectories;
+using Version = rmf_traffic::schedule::Version;
+
+//==============================================================================
+/// Spin the executor until the condition is met or the timeout runs out.
+/// Everything in this test is spun from the test thread, so the condition can
+/// look at the mirrors without racing against their updates.
+bool spin_until(
+    rclcpp::executors::SingleThreadedExecutor& executor,
+    const std::function<bool()>& condition,
+    const rmf_traffic::Duration timeout = 10s)
+{
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  while(!condition())
+  {
+    if(std::chrono::steady_clock::now() > deadline)
+      return false;
+
+    executor.spin_some();
+    std::this_thread::sleep_for(1ms);
+  }
+
+  return true;
+}
+
+//==============================================================================
+struct ElementInfo
+{
+  std::size_t size;
+  rmf_traffic::Time start;
+  rmf_traffic::Time finish;
+
+  bool operator==(const ElementInfo& other) const
+  {
+    return size == other.size && start == other.start && finish == other.finish;
+  }
+};
+
+//==============================================================================
+std::map<Version, ElementInfo> contents(
+    const rmf_traffic::schedule::Viewer& viewer)
+{
+  std::map<Version, ElementInfo> result;
+  for(const auto& element : viewer.query(
+        rmf_traffic::schedule::query_everything()))
+  {
+    result.insert(std::make_pair(
+      element.id,
+      ElementInfo{
+        element.trajectory.size(),
+        *element.trajectory.start_time(),
+        *element.trajectory.finish_time()
+      }));
+  }
+
+  return result;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+TEST(ScheduleMirrors, MirrorsConvergeAfterMissingAPatch)
+{
+  rclcpp::init(0, nullptr);
+
+  const std::size_t N = 3;
+
+  rclcpp::executors::SingleThreadedExecutor executor;
+
+  const auto schedule = std::make_shared<rmf_traffic_schedule::ScheduleNode>();
+  executor.add_node(schedule);
+
+  const auto client_node = std::make_shared<rclcpp::Node>("test_client");
+  executor.add_node(client_node);
+  const auto submit_client = client_node->create_client<SubmitTrajectories>(
+        rmf_traffic_ros2::SubmitTrajectoriesSrvName);
+
+  rmf_traffic::schedule::Query::Spacetime everywhere;
+  everywhere.query_all();
+
+  std::vector<std::shared_ptr<rclcpp::Node>> mirror_nodes;
+  std::vector<rmf_traffic_ros2::schedule::MirrorManager> mirrors;
+  for(std::size_t i=0; i < N; ++i)
+  {
+    mirror_nodes.push_back(
+          std::make_shared<rclcpp::Node>("test_mirror_" + std::to_string(i)));
+    executor.add_node(mirror_nodes.back());
+
+    auto future = rmf_traffic_ros2::schedule::make_mirror(
+          *mirror_nodes.back(), everywhere);
+
+    ASSERT_TRUE(spin_until(executor, [&]()
+    {
+      return future.wait_for(0s) == std::future_status::ready;
+    }));
+
+    mirrors.emplace_back(future.get());
+  }
+
+  // The schedule is mimicked by a local database, which assigns the same
+  // versions as long as it receives the same changes in the same order.
+  rmf_traffic::schedule::Database expected;
+
+  const auto profile = rmf_traffic::Trajectory::Profile::make_guided(
+        rmf_traffic::geometry::make_final_convex<
+          rmf_traffic::geometry::Circle>(0.5));
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+
+  std::size_t lines = 0;
+  const auto submit = [&]() -> Version
+  {
+    rmf_traffic::Trajectory trajectory{"test_map"};
+    const double y = 5.0 * static_cast<double>(lines++);
+    trajectory.insert(
+          start_time, profile,
+          Eigen::Vector3d{0.0, y, 0.0}, Eigen::Vector3d::Zero());
+    trajectory.insert(
+          start_time + 10s, profile,
+          Eigen::Vector3d{10.0, y, 0.0}, Eigen::Vector3d::Zero());
+
+    auto request = std::make_shared<SubmitTrajectories::Request>();
+    request->trajectories.push_back(rmf_traffic_ros2::convert(trajectory));
+    expected.insert(std::move(trajectory));
+
+    auto response = submit_client->async_send_request(request);
+    EXPECT_TRUE(spin_until(executor, [&]()
+    {
+      return response.wait_for(0s) == std::future_status::ready;
+    }));
+
+    const auto result = response.get();
+    EXPECT_TRUE(result->accepted);
+    EXPECT_EQ(result->current_version, expected.latest_version());
+    return result->current_version;
+  };
+
+  const auto converged = [&](const Version version)
+  {
+    for(const auto& mirror : mirrors)
+    {
+      if(mirror.viewer().latest_version() != version)
+        return false;
+    }
+
+    return true;
+  };
+
+  const auto check_contents = [&]()
+  {
+    const auto expected_contents = contents(expected);
+    for(const auto& mirror : mirrors)
+      EXPECT_TRUE(contents(mirror.viewer()) == expected_contents);
+  };
+
+  const Version first = submit();
+  ASSERT_TRUE(spin_until(executor, [&](){ return converged(first); }));
+  check_contents();
+
+  // The first mirror ignores the patches that arrive while its updates are
+  // switched off, which is what it would see if a patch got dropped.
+  mirrors.front().set_options(
+        rmf_traffic_ros2::schedule::MirrorManager::Options(nullptr, false));
+
+  const Version missed = submit();
+  ASSERT_TRUE(spin_until(executor, [&]()
+  {
+    for(std::size_t i=1; i < N; ++i)
+    {
+      if(mirrors[i].viewer().latest_version() != missed)
+        return false;
+    }
+
+    return true;
+  }));
+
+  // Give the dropped patch time to reach the first mirror as well
+  spin_until(executor, [](){ return false; }, 100ms);
+  ASSERT_NE(mirrors.front().viewer().latest_version(), missed);
+
+  mirrors.front().set_options(
+        rmf_traffic_ros2::schedule::MirrorManager::Options(nullptr, true));
+
+  // The next patch does not begin at the version of the first mirror, so it
+  // has to ask the schedule for the changes that it missed.
+  const Version latest = submit();
+  EXPECT_TRUE(spin_until(executor, [&](){ return converged(latest); }));
+  check_contents();
+
+  // Every mirror keeps following the patches after that
+  for(std::size_t i=0; i < 5; ++i)
+    submit();
+
+  EXPECT_TRUE(spin_until(executor, [&]()
+  {
+    return converged(expected.latest_version());
+  }));
+  check_contents();
+
+  mirrors.clear();
+  rclcpp::shutdown();
+}